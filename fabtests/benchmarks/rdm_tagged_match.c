@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2021 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under the BSD license
+ * below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+#include <rdma/fi_errno.h>
+
+#include <shared.h>
+#include "benchmark_shared.h"
+
+static bool unexpected;
+
+/*
+ * Each iteration queues a window of tagged receives and sends the matching
+ * messages with their tags in reverse order.  Every incoming message then
+ * matches the most recently posted receive, and every posted receive the
+ * oldest unexpected message, which is the worst case for a provider that
+ * searches its queues linearly.  The tags stay in lock step with rx_seq and
+ * tx_seq, the same as the bandwidth test, so that the single receive
+ * posted ahead by the common code is the last one matched.
+ */
+static int send_window(void)
+{
+	uint64_t tag = tx_seq + opts.window_size - 1;
+	int ret, i;
+
+	for (i = 0; i < opts.window_size; i++, tag--) {
+		ret = ft_post_tx_buf(ep, remote_fi_addr, opts.transfer_size,
+				     NO_CQ_DATA, &tx_ctx_arr[i].context,
+				     tx_buf, mr_desc, tag);
+		if (ret)
+			return ret;
+	}
+
+	return ft_get_tx_comp(tx_seq);
+}
+
+static int recv_window(void)
+{
+	int ret, i;
+
+	for (i = 0; i < opts.window_size; i++) {
+		ret = ft_post_rx(ep, opts.transfer_size, &rx_ctx_arr[i].context);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+static int match_expected(void)
+{
+	int ret;
+
+	if (opts.dst_addr) {
+		ret = ft_rx(ep, 4);
+		if (ret)
+			return ret;
+
+		return send_window();
+	}
+
+	ret = recv_window();
+	if (ret)
+		return ret;
+
+	ret = ft_tx(ep, remote_fi_addr, 4, &tx_ctx);
+	if (ret)
+		return ret;
+
+	/* rx_seq is always one ahead */
+	return ft_get_rx_comp(rx_seq - 1);
+}
+
+static int match_unexpected(void)
+{
+	int ret;
+
+	if (opts.dst_addr) {
+		ret = send_window();
+		if (ret)
+			return ret;
+
+		return ft_rx(ep, 4);
+	}
+
+	/* The receive posted ahead takes the last message sent */
+	ret = ft_get_rx_comp(rx_seq);
+	if (ret)
+		return ret;
+
+	ret = recv_window();
+	if (ret)
+		return ret;
+
+	ret = ft_get_rx_comp(rx_seq - 1);
+	if (ret)
+		return ret;
+
+	return ft_tx(ep, remote_fi_addr, 4, &tx_ctx);
+}
+
+static int run(void)
+{
+	int i, ret;
+
+	ret = ft_init_fabric();
+	if (ret)
+		return ret;
+
+	ret = ft_sync();
+	if (ret)
+		return ret;
+
+	for (i = 0; i < opts.iterations + opts.warmup_iterations; i++) {
+		if (i == opts.warmup_iterations)
+			ft_start();
+
+		ret = unexpected ? match_unexpected() : match_expected();
+		if (ret)
+			return ret;
+	}
+	ft_stop();
+
+	show_perf(NULL, opts.transfer_size, opts.iterations, &start, &end,
+		  opts.window_size);
+
+	return ft_finalize();
+}
+
+int main(int argc, char **argv)
+{
+	int op, ret;
+
+	opts = INIT_OPTS;
+	opts.options |= FT_OPT_BW | FT_OPT_SIZE;
+	opts.iterations = 100;
+	opts.transfer_size = 64;
+	opts.window_size = 512;
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return EXIT_FAILURE;
+
+	while ((op = getopt(argc, argv, "uh" CS_OPTS INFO_OPTS BENCHMARK_OPTS)) != -1) {
+		switch (op) {
+		default:
+			ft_parse_benchmark_opts(op, optarg);
+			ft_parseinfo(op, optarg, hints, &opts);
+			ft_parsecsopts(op, optarg, &opts);
+			break;
+		case 'u':
+			unexpected = true;
+			break;
+		case '?':
+		case 'h':
+			ft_csusage(argv[0], "Tag matching test for RDM endpoints with deep receive queues.");
+			FT_PRINT_OPTS_USAGE("-u", "match against unexpected messages "
+					    "instead of posted receives");
+			ft_benchmark_usage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind < argc)
+		opts.dst_addr = argv[optind];
+
+	hints->ep_attr->type = FI_EP_RDM;
+	hints->domain_attr->resource_mgmt = FI_RM_ENABLED;
+	hints->caps = FI_TAGGED;
+	hints->mode = FI_CONTEXT;
+	hints->domain_attr->mr_mode = opts.mr_mode;
+	hints->domain_attr->threading = FI_THREAD_DOMAIN;
+
+	ret = run();
+
+	ft_free_res();
+	return ft_exit_code(ret);
+}
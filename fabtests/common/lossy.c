@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2021 Intel Corporation.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Lossy link shim.  Preloaded into a test (LD_PRELOAD=libfabtests_lossy.so)
+ * it silently discards outgoing datagrams to emulate packet loss below a
+ * socket based DGRAM provider, such as udp under ofi_rxd.  Dropped sends
+ * report success to the caller.
+ *
+ *   FT_LOSSY_DROP  percentage of datagrams to drop, e.g. 1 or 0.5 (default 0)
+ *   FT_LOSSY_SEED  seed for the drop pattern (default: process id)
+ *
+ * A summary of dropped datagrams is written to stderr at exit.
+ */
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+typedef ssize_t (*sendto_fn)(int, const void *, size_t, int,
+			     const struct sockaddr *, socklen_t);
+typedef ssize_t (*sendmsg_fn)(int, const struct msghdr *, int);
+typedef int (*sendmmsg_fn)(int, struct mmsghdr *, unsigned int, int);
+
+static sendto_fn real_sendto;
+static sendmsg_fn real_sendmsg;
+static sendmmsg_fn real_sendmmsg;
+
+/* Drop threshold scaled to 2^32, 0 disables the shim */
+static uint64_t drop_thresh;
+static uint64_t rand_state;
+static unsigned long sent_cnt, drop_cnt;
+
+static void __attribute__((constructor)) lossy_init(void)
+{
+	char *val;
+	double rate;
+
+	real_sendto = (sendto_fn) dlsym(RTLD_NEXT, "sendto");
+	real_sendmsg = (sendmsg_fn) dlsym(RTLD_NEXT, "sendmsg");
+	real_sendmmsg = (sendmmsg_fn) dlsym(RTLD_NEXT, "sendmmsg");
+
+	val = getenv("FT_LOSSY_DROP");
+	rate = val ? atof(val) : 0.0;
+	if (rate <= 0.0)
+		return;
+	if (rate > 100.0)
+		rate = 100.0;
+	drop_thresh = (uint64_t) (rate / 100.0 * (double) (1ULL << 32));
+
+	val = getenv("FT_LOSSY_SEED");
+	rand_state = val ? strtoull(val, NULL, 0) : (uint64_t) getpid();
+	rand_state = rand_state * 2 + 1;
+}
+
+static void __attribute__((destructor)) lossy_fini(void)
+{
+	if (drop_thresh && sent_cnt + drop_cnt)
+		fprintf(stderr, "lossy: dropped %lu of %lu sends\n",
+			drop_cnt, sent_cnt + drop_cnt);
+}
+
+/* xorshift64*, racy updates between threads are harmless here */
+static uint32_t lossy_rand(void)
+{
+	rand_state ^= rand_state >> 12;
+	rand_state ^= rand_state << 25;
+	rand_state ^= rand_state >> 27;
+	return (uint32_t) ((rand_state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static int lossy_is_dgram(int fd)
+{
+	socklen_t len = sizeof(int);
+	int type;
+
+	return !getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len) &&
+	       type == SOCK_DGRAM;
+}
+
+static int lossy_drop(int fd)
+{
+	if (!drop_thresh || lossy_rand() >= drop_thresh ||
+	    !lossy_is_dgram(fd)) {
+		sent_cnt++;
+		return 0;
+	}
+	drop_cnt++;
+	return 1;
+}
+
+ssize_t sendto(int fd, const void *buf, size_t len, int flags,
+	       const struct sockaddr *dest_addr, socklen_t addrlen)
+{
+	if (lossy_drop(fd))
+		return len;
+	return real_sendto(fd, buf, len, flags, dest_addr, addrlen);
+}
+
+ssize_t sendmsg(int fd, const struct msghdr *msg, int flags)
+{
+	ssize_t len = 0;
+	size_t i;
+
+	if (lossy_drop(fd)) {
+		for (i = 0; i < msg->msg_iovlen; i++)
+			len += msg->msg_iov[i].iov_len;
+		return len;
+	}
+	return real_sendmsg(fd, msg, flags);
+}
+
+/*
+ * Pass runs of kept messages to the real sendmmsg, skipping dropped ones.
+ * A short send from the kernel ends the call as it would without the shim.
+ */
+int sendmmsg(int fd, struct mmsghdr *msgvec, unsigned int vlen, int flags)
+{
+	unsigned int i, start;
+	size_t j;
+	int ret;
+
+	for (i = 0, start = 0; i < vlen; i++) {
+		if (!lossy_drop(fd))
+			continue;
+
+		if (i > start) {
+			ret = real_sendmmsg(fd, &msgvec[start], i - start,
+					    flags);
+			if (ret < 0)
+				return start ? (int) start : ret;
+			if ((unsigned int) ret < i - start)
+				return start + ret;
+		}
+
+		msgvec[i].msg_len = 0;
+		for (j = 0; j < msgvec[i].msg_hdr.msg_iovlen; j++)
+			msgvec[i].msg_len += msgvec[i].msg_hdr.msg_iov[j].iov_len;
+		start = i + 1;
+	}
+
+	if (vlen > start) {
+		ret = real_sendmmsg(fd, &msgvec[start], vlen - start, flags);
+		if (ret < 0)
+			return start ? (int) start : ret;
+		return start + ret;
+	}
+	return vlen;
+}
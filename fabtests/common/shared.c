@@ -115,7 +115,7 @@ struct fi_rma_iov remote;
 
 struct ft_opts opts;
 
-struct test_size_param test_size[] = {
+static struct test_size_param def_test_sizes[] = {
 	{ 1 <<  0, 0 },
 	{ 1 <<  1, 0 }, { (1 <<  1) + (1 <<  0), 0 },
 	{ 1 <<  2, 0 }, { (1 <<  2) + (1 <<  1), 0 },
@@ -142,7 +142,38 @@ struct test_size_param test_size[] = {
 	{ 1 << 23, 0 },
 };
 
-const unsigned int test_cnt = (sizeof test_size / sizeof test_size[0]);
+struct test_size_param *test_size = def_test_sizes;
+unsigned int test_cnt = ARRAY_SIZE(def_test_sizes);
+
+/*
+ * Replaces the test sizes with every step bytes from start to end, for
+ * sweeping a size range at a finer grain than the default sizes, e.g. to
+ * find where a provider switches protocols.
+ */
+static int ft_parse_size_range(char *range)
+{
+	struct test_size_param *sizes;
+	size_t start, end, step;
+	unsigned int i, cnt;
+
+	if (sscanf(range, "%zu:%zu:%zu", &start, &end, &step) != 3 ||
+	    !step || end < start) {
+		FT_ERR("invalid size range %s, expected start:end:step", range);
+		return -FI_EINVAL;
+	}
+
+	cnt = (end - start) / step + 1;
+	sizes = calloc(cnt, sizeof(*sizes));
+	if (!sizes)
+		return -FI_ENOMEM;
+
+	for (i = 0; i < cnt; i++)
+		sizes[i].size = start + i * step;
+
+	test_size = sizes;
+	test_cnt = cnt;
+	return 0;
+}
 
 #define INTEG_SEED 7
 static const char integ_alphabet[] = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
@@ -2865,7 +2896,8 @@ void ft_csusage(char *name, char *desc)
 	FT_PRINT_OPTS_USAGE("-I <number>", "number of iterations");
 	FT_PRINT_OPTS_USAGE("-Q", "bind EQ to domain (vs. endpoint)");
 	FT_PRINT_OPTS_USAGE("-w <number>", "number of warmup iterations");
-	FT_PRINT_OPTS_USAGE("-S <size>", "specific transfer size or 'all'");
+	FT_PRINT_OPTS_USAGE("-S <size>", "specific transfer size, 'all', "
+			    "or a range start:end:step");
 	FT_PRINT_OPTS_USAGE("-l", "align transmit and receive buffers to page size");
 	FT_PRINT_OPTS_USAGE("-m", "machine readable output");
 	FT_PRINT_OPTS_USAGE("-D <device_iface>", "Specify device interface: eg cuda, ze(default: None). "
@@ -3001,6 +3033,10 @@ void ft_parsecsopts(int op, char *optarg, struct ft_opts *opts)
 	case 'S':
 		if (!strncasecmp("all", optarg, 3)) {
 			opts->sizes_enabled = FT_ENABLE_ALL;
+		} else if (strchr(optarg, ':')) {
+			if (ft_parse_size_range(optarg))
+				exit(EXIT_FAILURE);
+			opts->sizes_enabled = FT_ENABLE_ALL;
 		} else {
 			opts->options |= FT_OPT_SIZE;
 			opts->transfer_size = atol(optarg);
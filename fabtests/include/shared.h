@@ -76,8 +76,8 @@ struct test_size_param {
 	int enable_flags;
 };
 
-extern struct test_size_param test_size[];
-extern const unsigned int test_cnt;
+extern struct test_size_param *test_size;
+extern unsigned int test_cnt;
 #define TEST_CNT test_cnt
 
 #define FT_ENABLE_ALL		(~0)
@@ -173,6 +173,8 @@ short_tests=(
 	"fi_rdm_tagged_bw -I 5 -U"
 	"fi_rdm_tagged_bw -I 5 -v"
 	"fi_rdm_tagged_bw -I 5 -v -U"
+	"fi_rdm_tagged_match -I 5"
+	"fi_rdm_tagged_match -I 5 -u"
 	"fi_dgram_pingpong -I 5"
 )
 
@@ -213,10 +215,21 @@ standard_tests=(
 	"fi_rdm_tagged_bw -U"
 	"fi_rdm_tagged_bw -v"
 	"fi_rdm_tagged_bw -v -U"
+	"fi_rdm_tagged_match"
+	"fi_rdm_tagged_match -u"
 	"fi_dgram_pingpong"
 	"fi_dgram_pingpong -k"
 )
 
+# Run with FI_SHM_DISABLE_CMA=1 when testing shm, which forces large
+# transfers through the segmented (SAR) protocol.
+shm_sar_tests=(
+	"fi_rdm_tagged_bw"
+	"fi_rdm_tagged_bw -v"
+	"fi_rma_bw -e rdm -o write"
+	"fi_rma_bw -e rdm -o read"
+)
+
 unit_tests=(
 	"fi_getinfo_test -s SERVER_ADDR GOOD_ADDR"
 	"fi_av_test -g GOOD_ADDR -n 1 -s SERVER_ADDR"
@@ -445,6 +458,7 @@ function unit_test {
 
 function cs_test {
 	local test=$1
+	local test_env=${2:+"$2 "}
 	local s_ret=0
 	local c_ret=0
 	local test_exe="${test} -p \"${PROV}\""
@@ -461,7 +475,7 @@ function cs_test {
 	else
 		s_arg="-s $S_INTERFACE"
 	fi
-	s_cmd="${BIN_PATH}${test_exe} ${S_ARGS} $s_arg"
+	s_cmd="${test_env}${BIN_PATH}${test_exe} ${S_ARGS} $s_arg"
 	${SERVER_CMD} "${EXPORT_ENV} $s_cmd" &> $s_outp &
 	s_pid=$!
 	sleep 1
@@ -471,7 +485,7 @@ function cs_test {
 	else
 		c_arg="-s $C_INTERFACE $S_INTERFACE"
 	fi
-	c_cmd="${BIN_PATH}${test_exe} ${C_ARGS} $c_arg"
+	c_cmd="${test_env}${BIN_PATH}${test_exe} ${C_ARGS} $c_arg"
 	${CLIENT_CMD} "${EXPORT_ENV} $c_cmd" &> $c_outp &
 	c_pid=$!
 
@@ -485,6 +499,7 @@ function cs_test {
 
 	end_time=$(date '+%s')
 	test_time=$(compute_duration "$start_time" "$end_time")
+	test_exe="${test_env}${test_exe}"
 
 	if [[ $STRICT_MODE -eq 0 && $s_ret -eq $FI_ENODATA && $c_ret -eq $FI_ENODATA ]] ||
 	   [[ $STRICT_MODE -eq 0 && $s_ret -eq $FI_ENOSYS && $c_ret -eq $FI_ENOSYS ]]; then
@@ -745,6 +760,11 @@ function main {
 			for test in "${standard_tests[@]}"; do
 				cs_test "$test"
 			done
+			if [[ $PROV == "shm" ]]; then
+				for test in "${shm_sar_tests[@]}"; do
+					cs_test "$test" "env FI_SHM_DISABLE_CMA=1"
+				done
+			fi
 		;;
 		complex)
 			for test in "${complex_tests[@]}"; do
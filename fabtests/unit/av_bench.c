@@ -0,0 +1,326 @@
+/*
+ * Copyright (c) 2021 Intel Corporation.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <rdma/fi_errno.h>
+
+#include "shared.h"
+#include "unit_common.h"
+
+/* Ports handed out per IP address when generating peer addresses */
+#define PORTS_PER_IP 60000
+
+static size_t num_addr = 65536;
+static size_t batch_size;
+static size_t addrlen;
+static char *addr_buf;
+static fi_addr_t *fi_addrs;
+
+static char err_buf[512];
+
+/*
+ * Builds num_addr distinct, valid destination addresses derived from the
+ * local source address.  The addresses need not be reachable, since AV
+ * insertion does not communicate with the peer.
+ */
+static int gen_addrs(void)
+{
+	struct sockaddr_in sin = { 0 };
+	struct sockaddr_in6 sin6 = { 0 };
+	uint32_t ip, base;
+	size_t i;
+
+	switch (fi->addr_format) {
+	case FI_SOCKADDR_IN:
+		addrlen = sizeof(sin);
+		if (fi->src_addr)
+			memcpy(&sin, fi->src_addr, addrlen);
+		sin.sin_family = AF_INET;
+		if (sin.sin_addr.s_addr == htonl(INADDR_ANY))
+			sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		base = sin.sin_addr.s_addr;
+		break;
+	case FI_SOCKADDR_IN6:
+		addrlen = sizeof(sin6);
+		if (fi->src_addr)
+			memcpy(&sin6, fi->src_addr, addrlen);
+		sin6.sin6_family = AF_INET6;
+		if (!memcmp(&sin6.sin6_addr, &in6addr_any,
+			    sizeof(sin6.sin6_addr)))
+			sin6.sin6_addr = in6addr_loopback;
+		memcpy(&base, &sin6.sin6_addr.s6_addr[12], sizeof(base));
+		break;
+	default:
+		printf("Address format %" PRIu32 " not supported\n",
+		       fi->addr_format);
+		return -FI_ENOSYS;
+	}
+
+	addr_buf = calloc(num_addr, addrlen);
+	fi_addrs = calloc(num_addr, sizeof(*fi_addrs));
+	if (!addr_buf || !fi_addrs)
+		return -FI_ENOMEM;
+
+	for (i = 0; i < num_addr; i++) {
+		if (addrlen == sizeof(sin)) {
+			sin.sin_port = htons(1024 + i % PORTS_PER_IP);
+			ip = htonl(ntohl(base) + i / PORTS_PER_IP);
+			memcpy(&sin.sin_addr, &ip, sizeof(ip));
+			memcpy(addr_buf + i * addrlen, &sin, addrlen);
+		} else {
+			sin6.sin6_port = htons(1024 + i % PORTS_PER_IP);
+			ip = htonl(ntohl(base) + i / PORTS_PER_IP);
+			memcpy(&sin6.sin6_addr.s6_addr[12], &ip, sizeof(ip));
+			memcpy(addr_buf + i * addrlen, &sin6, addrlen);
+		}
+	}
+	return 0;
+}
+
+static void show_result(const char *name, struct timespec *a,
+			struct timespec *b)
+{
+	int64_t ns = get_elapsed(a, b, NANO);
+
+	printf("%-10s %10zu %12.2f %10.1f\n", name, num_addr,
+	       ns / 1000.0, (double) ns / num_addr);
+}
+
+static int insert_all(fi_addr_t *out)
+{
+	size_t i, cnt;
+	int ret;
+
+	for (i = 0; i < num_addr; i += cnt) {
+		cnt = MIN(batch_size, num_addr - i);
+		ret = fi_av_insert(av, addr_buf + i * addrlen, cnt,
+				   out ? &out[i] : NULL, 0, NULL);
+		if (ret != cnt) {
+			FT_UNIT_STRERR(err_buf, "fi_av_insert", ret);
+			printf("%s, %d of %zu inserted\n", err_buf, ret, cnt);
+			return ret < 0 ? ret : -FI_EOTHER;
+		}
+	}
+	return 0;
+}
+
+static int run_bench(enum fi_av_type type)
+{
+	struct fi_av_attr attr = { 0 };
+	struct timespec a, b;
+	fi_addr_t *again;
+	size_t i, len;
+	char buf[sizeof(struct sockaddr_in6)];
+	int ret;
+
+	attr.type = type;
+	attr.count = num_addr;
+	ret = fi_av_open(domain, &attr, &av, NULL);
+	if (ret) {
+		FT_PRINTERR("fi_av_open", ret);
+		return ret;
+	}
+
+	again = calloc(num_addr, sizeof(*again));
+	if (!again) {
+		ret = -FI_ENOMEM;
+		goto out;
+	}
+
+	printf("%-10s %10s %12s %10s\n", "phase", "addrs", "usec", "ns/addr");
+
+	clock_gettime(CLOCK_MONOTONIC, &a);
+	ret = insert_all(fi_addrs);
+	clock_gettime(CLOCK_MONOTONIC, &b);
+	if (ret)
+		goto out;
+	show_result("insert", &a, &b);
+
+	/* Inserting known addresses exercises the address hash lookup */
+	clock_gettime(CLOCK_MONOTONIC, &a);
+	ret = insert_all(again);
+	clock_gettime(CLOCK_MONOTONIC, &b);
+	if (ret)
+		goto out;
+	show_result("reinsert", &a, &b);
+
+	clock_gettime(CLOCK_MONOTONIC, &a);
+	for (i = 0; i < num_addr; i++) {
+		len = sizeof(buf);
+		ret = fi_av_lookup(av, fi_addrs[i], buf, &len);
+		if (ret)
+			break;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &b);
+	/* Not every provider can map back every fi_addr, skip the phase */
+	if (ret)
+		FT_PRINTERR("fi_av_lookup", ret);
+	else
+		show_result("lookup", &a, &b);
+
+	for (i = 0; i < num_addr; i++) {
+		if (again[i] != fi_addrs[i]) {
+			printf("address %zu reinserted as %" PRIu64
+			       ", expected %" PRIu64 "\n", i, again[i],
+			       fi_addrs[i]);
+			ret = -FI_EOTHER;
+			goto out;
+		}
+	}
+
+	/* Drop the reference taken by the second insert, then the entries */
+	ret = fi_av_remove(av, again, num_addr, 0);
+	if (ret) {
+		FT_PRINTERR("fi_av_remove", ret);
+		goto out;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &a);
+	ret = fi_av_remove(av, fi_addrs, num_addr, 0);
+	clock_gettime(CLOCK_MONOTONIC, &b);
+	if (ret) {
+		FT_PRINTERR("fi_av_remove", ret);
+		goto out;
+	}
+	show_result("remove", &a, &b);
+
+out:
+	free(again);
+	FT_CLOSE_FID(av);
+	return ret;
+}
+
+static void usage(void)
+{
+	ft_unit_usage("fi_av_bench",
+		      "Measure address vector insert, lookup and remove cost.");
+	FT_PRINT_OPTS_USAGE("-n <count>", "number of addresses (default 65536)");
+	FT_PRINT_OPTS_USAGE("-b <count>", "addresses per fi_av_insert call "
+			    "(default: all)");
+	FT_PRINT_OPTS_USAGE("-s <address>", "local address used as base");
+}
+
+int main(int argc, char **argv)
+{
+	int op, ret;
+
+	opts = INIT_OPTS;
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return EXIT_FAILURE;
+
+	while ((op = getopt(argc, argv, FAB_OPTS "n:b:s:h")) != -1) {
+		switch (op) {
+		case 'n':
+			num_addr = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			batch_size = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			opts.src_addr = optarg;
+			break;
+		default:
+			ft_parseinfo(op, optarg, hints, &opts);
+			break;
+		case '?':
+		case 'h':
+			usage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!num_addr) {
+		printf("Test requires -n > 0\n");
+		return EXIT_FAILURE;
+	}
+	if (!batch_size || batch_size > num_addr)
+		batch_size = num_addr;
+
+	hints->mode = ~0;
+	hints->domain_attr->mode = ~0;
+	hints->domain_attr->mr_mode = ~(FI_MR_BASIC | FI_MR_SCALABLE);
+	hints->addr_format = FI_SOCKADDR;
+	hints->ep_attr->type = FI_EP_RDM;
+
+	ret = fi_getinfo(FT_FIVERSION, opts.src_addr, 0, FI_SOURCE, hints, &fi);
+	if (ret == -FI_ENODATA) {
+		hints->ep_attr->type = FI_EP_DGRAM;
+		ret = fi_getinfo(FT_FIVERSION, opts.src_addr, 0, FI_SOURCE,
+				 hints, &fi);
+	}
+	if (ret) {
+		FT_PRINTERR("fi_getinfo", ret);
+		goto out;
+	}
+
+	ret = ft_open_fabric_res();
+	if (ret)
+		goto out;
+
+	ret = gen_addrs();
+	if (ret)
+		goto out;
+
+	printf("AV benchmark on fabric %s, %zu addresses, batch %zu\n",
+	       fi->fabric_attr->name, num_addr, batch_size);
+
+	if (fi->domain_attr->av_type == FI_AV_UNSPEC ||
+	    fi->domain_attr->av_type == FI_AV_MAP) {
+		printf("\nFI_AV_MAP\n");
+		ret = run_bench(FI_AV_MAP);
+		if (ret)
+			goto out;
+	}
+
+	if (fi->domain_attr->av_type == FI_AV_UNSPEC ||
+	    fi->domain_attr->av_type == FI_AV_TABLE) {
+		printf("\nFI_AV_TABLE\n");
+		ret = run_bench(FI_AV_TABLE);
+	}
+
+out:
+	free(addr_buf);
+	free(fi_addrs);
+	ft_free_res();
+	return ft_exit_code(ret);
+}
@@ -75,6 +75,8 @@ static inline int ofi_free_hugepage_buf(void *memptr, size_t size)
 	return munmap(memptr, size);
 }
 
+int ofi_mbind_node(void *addr, size_t len, int node);
+
 static inline int ofi_hugepage_enabled(void)
 {
 	size_t len;
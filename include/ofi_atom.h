@@ -355,6 +355,19 @@ typedef atomic_long	ofi_atomic_int64_t;
 OFI_ATOMIC_DEFINE(32)
 OFI_ATOMIC_DEFINE(64)
 
+/*
+ * Order plain loads and stores, e.g. the indices of a queue with a single
+ * producer and a single consumer.  A release fence before publishing an
+ * index pairs with an acquire fence after reading it.
+ */
+#ifdef HAVE_ATOMICS
+#define ofi_atomic_release_fence() atomic_thread_fence(memory_order_release)
+#define ofi_atomic_acquire_fence() atomic_thread_fence(memory_order_acquire)
+#else
+#define ofi_atomic_release_fence() ofi_osd_mem_fence()
+#define ofi_atomic_acquire_fence() ofi_osd_mem_fence()
+#endif
+
 #ifdef __cplusplus
 }
 #endif
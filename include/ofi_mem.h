@@ -40,6 +40,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ofi_list.h>
+#include <ofi_lock.h>
 #include <ofi_osd.h>
 
 
@@ -285,13 +286,28 @@ void dummy ## name (void) /* work-around global ; scope */
  * Buffer Pool
  */
 
+/*
+ * OFI_BUFPOOL_THREAD_CACHE: each thread allocates from and frees to its
+ * own magazine of up to 2 * cache_cnt buffers, moving cache_cnt buffers
+ * at a time to or from the shared free list under the pool lock.  Only
+ * the refill and flush take the lock, so callers need not serialize
+ * ofi_buf_alloc/ofi_buf_free.  Not supported with OFI_BUFPOOL_INDEXED.
+ *
+ * OFI_BUFPOOL_NUMA_NODE: bind new regions to attr.numa_node, where the
+ * OS supports it.
+ */
 enum {
 	OFI_BUFPOOL_INDEXED		= 1 << 1,
 	OFI_BUFPOOL_NO_TRACK		= 1 << 2,
 	OFI_BUFPOOL_HUGEPAGES		= 1 << 3,
+	OFI_BUFPOOL_THREAD_CACHE	= 1 << 4,
+	OFI_BUFPOOL_NUMA_NODE		= 1 << 5,
 };
 
+#define OFI_BUFPOOL_DEF_CACHE_CNT	32
+
 struct ofi_bufpool_region;
+struct ofi_bufpool_cache;
 
 struct ofi_bufpool_attr {
 	size_t 		size;
@@ -303,6 +319,16 @@ struct ofi_bufpool_attr {
 	void		(*init_fn)(struct ofi_bufpool_region *region, void *buf);
 	void 		*context;
 	int		flags;
+	size_t		cache_cnt;
+	int		numa_node;
+};
+
+struct ofi_bufpool_stats {
+	uint64_t	alloc_cnt;
+	uint64_t	free_cnt;
+	uint64_t	refill_cnt;
+	uint64_t	flush_cnt;
+	size_t		entry_cnt;
 };
 
 struct ofi_bufpool {
@@ -319,6 +345,18 @@ struct ofi_bufpool {
 	size_t				alloc_size;
 	size_t				region_size;
 	struct ofi_bufpool_attr		attr;
+
+	/* Counts ops on the shared free list, plus those of the caches of
+	 * exited threads */
+	uint64_t			alloc_cnt;
+	uint64_t			free_cnt;
+
+	/* OFI_BUFPOOL_THREAD_CACHE only */
+	fastlock_t			lock;
+	pthread_key_t			cache_key;
+	struct dlist_entry		cache_list;
+	uint64_t			refill_cnt;
+	uint64_t			flush_cnt;
 };
 
 struct ofi_bufpool_region {
@@ -366,6 +404,14 @@ void ofi_bufpool_destroy(struct ofi_bufpool *pool);
 
 int ofi_bufpool_grow(struct ofi_bufpool *pool);
 
+void *ofi_bufpool_cache_alloc(struct ofi_bufpool *pool);
+void ofi_bufpool_cache_free(struct ofi_bufpool *pool, void *buf);
+
+/* Counters of thread caches are read without synchronization, so the
+ * result is approximate while other threads use the pool. */
+void ofi_bufpool_get_stats(struct ofi_bufpool *pool,
+			   struct ofi_bufpool_stats *stats);
+
 static inline struct ofi_bufpool_hdr *ofi_buf_hdr(void *buf)
 {
 	return (struct ofi_bufpool_hdr *)
@@ -391,10 +437,18 @@ static inline struct ofi_bufpool *ofi_buf_pool(void *buf)
 
 static inline void ofi_buf_free(void *buf)
 {
+	struct ofi_bufpool *pool = ofi_buf_pool(buf);
+
+	assert(!(pool->attr.flags & OFI_BUFPOOL_INDEXED));
+	if (pool->attr.flags & OFI_BUFPOOL_THREAD_CACHE) {
+		ofi_bufpool_cache_free(pool, buf);
+		return;
+	}
+
 	assert(ofi_buf_region(buf)->use_cnt--);
-	assert(!(ofi_buf_pool(buf)->attr.flags & OFI_BUFPOOL_INDEXED));
+	pool->free_cnt++;
 	slist_insert_head(&ofi_buf_hdr(buf)->entry.slist,
-			  &ofi_buf_pool(buf)->free_list.entries);
+			  &pool->free_list.entries);
 }
 
 int ofi_ibuf_is_lower(struct dlist_entry *item, const void *arg);
@@ -407,6 +461,7 @@ static inline void ofi_ibuf_free(void *buf)
 	assert(ofi_buf_pool(buf)->attr.flags & OFI_BUFPOOL_INDEXED);
 	assert(ofi_buf_region(buf)->use_cnt--);
 	buf_hdr = ofi_buf_hdr(buf);
+	buf_hdr->region->pool->free_cnt++;
 
 	dlist_insert_order(&buf_hdr->region->free_list,
 			   ofi_ibuf_is_lower, &buf_hdr->entry.dlist);
@@ -449,6 +504,9 @@ static inline void *ofi_buf_alloc(struct ofi_bufpool *pool)
 	struct ofi_bufpool_hdr *buf_hdr;
 
 	assert(!(pool->attr.flags & OFI_BUFPOOL_INDEXED));
+	if (pool->attr.flags & OFI_BUFPOOL_THREAD_CACHE)
+		return ofi_bufpool_cache_alloc(pool);
+
 	if (OFI_UNLIKELY(ofi_bufpool_empty(pool))) {
 		if (ofi_bufpool_grow(pool))
 			return NULL;
@@ -457,6 +515,7 @@ static inline void *ofi_buf_alloc(struct ofi_bufpool *pool)
 	slist_remove_head_container(&pool->free_list.entries,
 				struct ofi_bufpool_hdr, buf_hdr, entry.slist);
 	assert(++buf_hdr->region->use_cnt);
+	pool->alloc_cnt++;
 	return ofi_buf_data(buf_hdr);
 }
 
@@ -489,6 +548,7 @@ static inline void *ofi_ibuf_alloc(struct ofi_bufpool *pool)
 	dlist_pop_front(&buf_region->free_list, struct ofi_bufpool_hdr,
 			buf_hdr, entry.dlist);
 	assert(++buf_hdr->region->use_cnt);
+	pool->alloc_cnt++;
 
 	if (dlist_empty(&buf_region->free_list))
 		dlist_remove_init(&buf_region->entry);
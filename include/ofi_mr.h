@@ -262,6 +262,11 @@ struct ofi_mr_cache_params {
 	char *				monitor;
 	int				cuda_monitor_enabled;
 	int				rocr_monitor_enabled;
+	/* Eviction starts at high_watermark and stops below low_watermark,
+	 * both in percent of max_cnt/max_size. */
+	size_t				high_watermark;
+	size_t				low_watermark;
+	int				async_evict;
 };
 
 extern struct ofi_mr_cache_params	cache_params;
@@ -269,7 +274,11 @@ extern struct ofi_mr_cache_params	cache_params;
 struct ofi_mr_entry {
 	struct ofi_mr_info		info;
 	struct ofi_rbnode		*node;
-	int				use_cnt;
+	/* -1 until published to the cache, and once the entry has been
+	 * handed off to be freed */
+	ofi_atomic32_t			use_cnt;
+	/* bumped each time the entry storage is freed */
+	ofi_atomic32_t			seq;
 	struct dlist_entry		list_entry;
 	union ofi_mr_hmem_info		hmem_info;
 	uint8_t				data[];
@@ -277,6 +286,18 @@ struct ofi_mr_entry {
 
 #define OFI_HMEM_MAX 4
 
+/* Per-thread last-hit entries checked before taking mm_lock */
+#define OFI_MR_CACHE_TLS_CNT 4
+
+struct ofi_mr_cache_stats {
+	size_t				search_cnt;
+	size_t				hit_cnt;
+	size_t				delete_cnt;
+	size_t				notify_cnt;
+	size_t				cached_cnt;
+	size_t				cached_size;
+};
+
 struct ofi_mr_cache {
 	struct util_domain		*domain;
 	struct ofi_mem_monitor		*monitors[OFI_HMEM_MAX];
@@ -298,6 +319,18 @@ struct ofi_mr_cache {
 	size_t				notify_cnt;
 	struct ofi_bufpool		*entry_pool;
 
+	/* Bumped whenever an entry leaves the tree, invalidating the
+	 * per-thread last-hit entries recorded before it. */
+	ofi_atomic64_t			gen;
+	pthread_key_t			tls_key;
+	struct dlist_entry		tls_list;
+
+	/* With async_evict, deregistration runs here instead of inline */
+	pthread_t			reaper;
+	pthread_cond_t			reaper_cond;
+	bool				reaper_running;
+	bool				reaper_stop;
+
 	int				(*add_region)(struct ofi_mr_cache *cache,
 						      struct ofi_mr_entry *entry);
 	void				(*delete_region)(struct ofi_mr_cache *cache,
@@ -334,6 +367,8 @@ struct ofi_mr_entry *ofi_mr_cache_find(struct ofi_mr_cache *cache,
 int ofi_mr_cache_reg(struct ofi_mr_cache *cache, const struct fi_mr_attr *attr,
 		     struct ofi_mr_entry **entry);
 void ofi_mr_cache_delete(struct ofi_mr_cache *cache, struct ofi_mr_entry *entry);
+void ofi_mr_cache_get_stats(struct ofi_mr_cache *cache,
+			    struct ofi_mr_cache_stats *stats);
 
 
 #endif /* _OFI_MR_H_ */
@@ -102,6 +102,111 @@ void dummy ## name (void) /* work-around global ; scope */
 #define ofi_cirque_commit(cq)		((cq)->wcnt++)
 
 
+/*
+ * Lock-free multi-producer, single consumer circular queue template
+ *
+ * Producers reserve entries with an atomic fetch-add of the write
+ * position, so callers must limit the number of outstanding entries to
+ * the queue size, e.g. by using credits.  Every entry carries a sequence
+ * number, which is pos while the entry is free to be written at
+ * position pos, and pos + 1 once the write has been committed.  The
+ * consumer releases an entry by advancing its sequence by the queue
+ * size.  The queue holds no pointers, and may be placed in shared memory.
+ * The entries start 128 bytes into the queue, so that an entry type
+ * whose size plus the sequence is a multiple of 64 bytes is cache line
+ * aligned if the queue is.
+ */
+#define OFI_DECLARE_ATOMIC_Q(entrytype, name)			\
+struct name ## _entry {						\
+	ofi_atomic64_t	seq;					\
+	entrytype	buf;					\
+};								\
+struct name {							\
+	ofi_atomic64_t	write_pos;				\
+	uint8_t		pad[64 - sizeof(ofi_atomic64_t)];	\
+	int64_t		read_pos;				\
+	int64_t		size;					\
+	int64_t		size_mask;				\
+	uint8_t		pad2[64 - 3 * sizeof(int64_t)];		\
+	struct name ## _entry	entry[];			\
+};								\
+								\
+static inline void name ## _init(struct name *q, size_t size)	\
+{								\
+	size_t i;						\
+	assert(size == roundup_power_of_two(size));		\
+	q->size = size;						\
+	q->size_mask = size - 1;				\
+	q->read_pos = 0;					\
+	ofi_atomic_initialize64(&q->write_pos, 0);		\
+	for (i = 0; i < size; i++)				\
+		ofi_atomic_initialize64(&q->entry[i].seq, i);	\
+}								\
+								\
+static inline struct name * name ## _create(size_t size)	\
+{								\
+	struct name *q;						\
+	q = (struct name*) calloc(1, sizeof(*q) +		\
+		sizeof(struct name ## _entry) *			\
+		(roundup_power_of_two(size)));			\
+	if (q)							\
+		name ##_init(q, roundup_power_of_two(size));	\
+	return q;						\
+}								\
+								\
+static inline void name ## _free(struct name *q)		\
+{								\
+	free(q);						\
+}								\
+								\
+/* Returns the position of the first of cnt consecutive entries */ \
+static inline int64_t name ## _reserve(struct name *q, int cnt)	\
+{								\
+	return ofi_atomic_add64(&q->write_pos, cnt) - cnt;	\
+}								\
+								\
+/* Waits for the consumer to release the entry at pos */	\
+static inline entrytype *name ## _claim(struct name *q, int64_t pos) \
+{								\
+	struct name ## _entry *entry;				\
+	entry = &q->entry[pos & q->size_mask];			\
+	while (ofi_atomic_get64(&entry->seq) != pos)		\
+		;						\
+	return &entry->buf;					\
+}								\
+								\
+static inline void name ## _commit(struct name *q, int64_t pos)	\
+{								\
+	ofi_atomic_set64(&q->entry[pos & q->size_mask].seq, pos + 1); \
+}								\
+								\
+static inline entrytype *name ## _head(struct name *q)		\
+{								\
+	struct name ## _entry *entry;				\
+	entry = &q->entry[q->read_pos & q->size_mask];		\
+	if (ofi_atomic_get64(&entry->seq) != q->read_pos + 1)	\
+		return NULL;					\
+	return &entry->buf;					\
+}								\
+								\
+/* Returns the entry i positions after the head.  The caller must	\
+ * know that it has been committed, e.g. because it was committed	\
+ * before the head by the same producer.				\
+ */								\
+static inline entrytype *name ## _peek(struct name *q, int64_t i) \
+{								\
+	return &q->entry[(q->read_pos + i) & q->size_mask].buf;	\
+}								\
+								\
+static inline void name ## _discard(struct name *q)		\
+{								\
+	ofi_atomic_set64(&q->entry[q->read_pos & q->size_mask].seq, \
+			 q->read_pos + q->size);		\
+	q->read_pos++;						\
+}								\
+void dummy ## name (void) /* work-around global ; scope */
+
+
 /*
  * Simple ring buffer
  */
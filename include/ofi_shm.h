@@ -52,7 +52,7 @@ extern "C" {
 #endif
 
 
-#define SMR_VERSION	1
+#define SMR_VERSION	6
 
 #ifdef HAVE_ATOMICS
 #define SMR_FLAG_ATOMIC	(1 << 0)
@@ -67,8 +67,10 @@ extern "C" {
 #endif
 
 #define SMR_FLAG_IPC_SOCK (1 << 2)
+#define SMR_FLAG_XPMEM	(1 << 3)
 
-#define SMR_CMD_SIZE		128	/* align with 64-byte cache line */
+/* A cmd and its queue sequence number fill two 64-byte cache lines */
+#define SMR_CMD_SIZE		120
 
 /* SMR op_src: Specifies data source location */
 enum {
@@ -78,6 +80,7 @@ enum {
 	smr_src_mmap,	/* mmap-based fallback protocol */
 	smr_src_sar,	/* segmentation fallback protocol */
 	smr_src_ipc,	/* device IPC handle protocol */
+	smr_src_xpmem,	/* reference iovec via XPMEM attach */
 };
 
 //reserves 0-255 for defined ops and room for new ops
@@ -99,7 +102,7 @@ enum {
 
 /*
  * Unique smr_op_hdr for smr message protocol:
- * 	addr - local shm_id of peer sending msg (for shm lookup)
+ * 	id - local shm_id of peer sending msg (for shm lookup)
  * 	op - type of op (ex. ofi_op_msg, defined in ofi_proto.h)
  * 	op_src - msg src (ex. smr_src_inline, defined above)
  * 	op_flags - operation flags (ex. SMR_REMOTE_CQ_DATA, defined above)
@@ -108,10 +111,10 @@ enum {
  */
 struct smr_msg_hdr {
 	uint64_t		msg_id;
-	int64_t			id;
-	uint32_t		op;
-	uint16_t		op_src;
-	uint16_t		op_flags;
+	int32_t			id;
+	uint16_t		op;
+	uint8_t			op_src;
+	uint8_t			op_flags;
 
 	uint64_t		size;
 	uint64_t		src_data;
@@ -128,6 +131,23 @@ struct smr_msg_hdr {
 #define SMR_MSG_DATA_LEN	(SMR_CMD_SIZE - sizeof(struct smr_msg_hdr))
 #define SMR_COMP_DATA_LEN	(SMR_MSG_DATA_LEN / 2)
 
+/*
+ * Inline msgs that do not fit in a single cmd continue in up to
+ * SMR_INLINE_MAX_CMDS - 1 following cmd queue entries, which are used
+ * as raw data.  This avoids an inject buffer for small messages.
+ */
+#define SMR_INLINE_MAX_CMDS	8
+#define SMR_INLINE_SIZE		(SMR_MSG_DATA_LEN + \
+				 (SMR_INLINE_MAX_CMDS - 1) * SMR_CMD_SIZE)
+
+static inline int smr_inline_cmds(size_t size)
+{
+	if (size <= SMR_MSG_DATA_LEN)
+		return 1;
+	return 1 + (int) ((size - SMR_MSG_DATA_LEN + SMR_CMD_SIZE - 1) /
+			  SMR_CMD_SIZE);
+}
+
 #define IPC_HANDLE_SIZE		64
 struct smr_ipc_info {
 	uint64_t	iface;
@@ -163,7 +183,7 @@ struct smr_cmd_msg {
 	union smr_cmd_data	data;
 };
 
-#define SMR_RMA_DATA_LEN	(128 - sizeof(uint64_t))
+#define SMR_RMA_DATA_LEN	(SMR_CMD_SIZE - sizeof(uint64_t))
 struct smr_cmd_rma {
 	uint64_t		rma_count;
 	union {
@@ -184,6 +204,9 @@ struct smr_cmd {
 #define SMR_INJECT_SIZE		4096
 #define SMR_COMP_INJECT_SIZE	(SMR_INJECT_SIZE / 2)
 #define SMR_SAR_SIZE		16384
+#define SMR_SAR_DEPTH		2
+#define SMR_SAR_MAX_DEPTH	64
+#define SMR_SAR_MAX_SIZE	(1 << 20)
 
 #define SMR_NAME_MAX		256
 #define SMR_SOCK_NAME_MAX sizeof(((struct sockaddr_un *)0)->sun_path)
@@ -214,17 +237,35 @@ struct smr_peer {
 	struct smr_addr		peer;
 	fi_addr_t		fiaddr;
 	struct smr_region	*region;
+	int64_t			next_free;
 };
 
-#define SMR_MAX_PEERS	256
+#define SMR_MAX_PEERS		4096
+#define SMR_PEER_CHUNK_SHIFT	6
+#define SMR_PEER_CHUNK_SIZE	(1 << SMR_PEER_CHUNK_SHIFT)
+#define SMR_MAX_SAR_MSGS	256
 
+/*
+ * Peers are allocated in chunks of SMR_PEER_CHUNK_SIZE as the map grows.
+ * Chunks are never moved or freed until the map is closed, so a peer can
+ * be looked up by id without taking the map lock.  Released ids are
+ * queued in FIFO order to delay their reuse.
+ */
 struct smr_map {
 	fastlock_t		lock;
-	int64_t			cur_id;
+	int64_t			peer_cnt;
+	int64_t			free_head;
+	int64_t			free_tail;
 	struct ofi_rbmap	rbmap;
-	struct smr_peer		peers[SMR_MAX_PEERS];
+	struct smr_peer		*peers[SMR_MAX_PEERS / SMR_PEER_CHUNK_SIZE];
 };
 
+static inline struct smr_peer *smr_map_peer(struct smr_map *map, int64_t id)
+{
+	return &map->peers[id >> SMR_PEER_CHUNK_SHIFT]
+			  [id & (SMR_PEER_CHUNK_SIZE - 1)];
+}
+
 struct smr_region {
 	uint8_t		version;
 	uint8_t		resv;
@@ -232,20 +273,29 @@ struct smr_region {
 	int		pid;
 	uint8_t		cma_cap_peer;
 	uint8_t		cma_cap_self;
+	int64_t		xpmem_segid; /* valid if SMR_FLAG_XPMEM is set */
 	void		*base_addr;
-	fastlock_t	lock; /* lock for shm access
-				 Must hold smr->lock before tx/rx cq locks
-				 in order to progress or post recv */
+	fastlock_t	lock; /* protects the inject and sar pools, and
+				 sar_cnt.  The cmd queue is lock-free. */
 	struct smr_map	*map;
 
 	size_t		total_size;
-	size_t		cmd_cnt; /* Doubles as a tracker for number of cmds AND
+	ofi_atomic64_t	cmd_cnt; /* Doubles as a tracker for number of cmds AND
 				    number of inject buffers available for use,
 				    to ensure 1:1 ratio of cmds to inject bufs.
 				    Might not always be paired consistently with
 				    cmd alloc/free depending on protocol
-				    (Ex. unexpected messages, RMA requests) */
+				    (Ex. unexpected messages, RMA requests).
+				    Senders take these credits before
+				    reserving cmd queue entries. */
 	size_t		sar_cnt;
+	size_t		sar_depth; /* segments per SAR message */
+	size_t		sar_size; /* payload bytes per segment */
+	size_t		sar_buf_size; /* segment stride */
+	ofi_atomic64_t	peer_data_cnt; /* number of initialized peer_data
+					  entries, grown by the owner as
+					  peer ids are assigned.  Space is
+					  reserved for SMR_MAX_PEERS. */
 
 	/* offsets from start of smr_region */
 	size_t		cmd_queue_offset;
@@ -255,6 +305,7 @@ struct smr_region {
 	size_t		peer_data_offset;
 	size_t		name_offset;
 	size_t		sock_name_offset;
+	size_t		sar_buf_offset;
 };
 
 struct smr_resp {
@@ -279,21 +330,27 @@ enum {
 
 struct smr_sar_buf {
 	uint64_t	status;
-	uint8_t		buf[SMR_SAR_SIZE];
+	uint8_t		buf[];
 };
 
+/*
+ * A SAR message is a ring of sar_depth segments, which the sender fills
+ * and the receiver drains in order.  The segments live in the SAR buffer
+ * area of the region owning the pool, so that the pool entries stay small
+ * and buffers are only backed by memory once used.
+ */
 struct smr_sar_msg {
-	struct smr_sar_buf	sar[2];
+	uint64_t	buf_offset;
 };
 
-OFI_DECLARE_CIRQUE(struct smr_cmd, smr_cmd_queue);
+OFI_DECLARE_ATOMIC_Q(struct smr_cmd, smr_cmd_queue);
 OFI_DECLARE_CIRQUE(struct smr_resp, smr_resp_queue);
 SMR_DECLARE_FREESTACK(struct smr_inject_buf, smr_inject_pool);
 SMR_DECLARE_FREESTACK(struct smr_sar_msg, smr_sar_pool);
 
 static inline struct smr_region *smr_peer_region(struct smr_region *smr, int i)
 {
-	return smr->map->peers[i].region;
+	return smr_map_peer(smr->map, i)->region;
 }
 static inline struct smr_cmd_queue *smr_cmd_queue(struct smr_region *smr)
 {
@@ -311,10 +368,23 @@ static inline struct smr_peer_data *smr_peer_data(struct smr_region *smr)
 {
 	return (struct smr_peer_data *) ((char *) smr + smr->peer_data_offset);
 }
+void	smr_peer_data_grow(struct smr_region *smr, int64_t id);
+static inline void smr_reserve_peer_data(struct smr_region *smr, int64_t id)
+{
+	if (id >= ofi_atomic_get64(&smr->peer_data_cnt))
+		smr_peer_data_grow(smr, id);
+}
 static inline struct smr_sar_pool *smr_sar_pool(struct smr_region *smr)
 {
 	return (struct smr_sar_pool *) ((char *) smr + smr->sar_pool_offset);
 }
+static inline struct smr_sar_buf *smr_sar_buf(struct smr_region *smr,
+					      struct smr_sar_msg *sar_msg,
+					      size_t seg)
+{
+	return (struct smr_sar_buf *) ((char *) smr + sar_msg->buf_offset +
+				       seg * smr->sar_buf_size);
+}
 static inline const char *smr_name(struct smr_region *smr)
 {
 	return (const char *) smr + smr->name_offset;
@@ -334,19 +404,24 @@ struct smr_attr {
 	const char	*name;
 	size_t		rx_count;
 	size_t		tx_count;
+	size_t		sar_depth;
+	size_t		sar_size;
 };
 
 size_t smr_calculate_size_offsets(size_t tx_count, size_t rx_count,
+				  size_t sar_depth, size_t sar_size,
 				  size_t *cmd_offset, size_t *resp_offset,
 				  size_t *inject_offset, size_t *sar_offset,
 				  size_t *peer_offset, size_t *name_offset,
-				  size_t *sock_offset);
+				  size_t *sock_offset, size_t *sar_buf_offset);
 void	smr_cma_check(struct smr_region *region, struct smr_region *peer_region);
 void	smr_cleanup(void);
 int	smr_map_create(const struct fi_provider *prov, int peer_count,
 		       struct smr_map **map);
 int	smr_map_to_region(const struct fi_provider *prov,
 			  struct smr_peer *peer_buf);
+int	smr_map_region(const struct fi_provider *prov, struct smr_map *map,
+		       int64_t id);
 void	smr_map_to_endpoint(struct smr_region *region, int64_t id);
 void	smr_unmap_from_endpoint(struct smr_region *region, int64_t id);
 void	smr_exchange_all_peers(struct smr_region *region);
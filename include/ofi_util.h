@@ -477,9 +477,16 @@ int ofi_wait_yield_open(struct fid_fabric *fabric, struct fi_wait_attr *attr,
  * In such cases, fi_cq_read will return 0 if there are available
  * entries on the CQ.  This allows poll sets to drive progress
  * without introducing private interfaces to the CQ.
+ *
+ * With FI_THREAD_DOMAIN or FI_THREAD_COMPLETION, cq_lock is a no-op, and
+ * the completion ring is used as a single producer, single consumer
+ * queue: writers publish entries through ofi_cq_commit, and readers
+ * copy runs of them without locking.  The overflow (aux) queue is
+ * always protected by aux_lock, as both sides modify it.
  */
 
-typedef void (*fi_cq_read_func)(void **dst, void *src);
+/* Copies cnt entries from src, advancing dst */
+typedef void (*fi_cq_read_func)(void **dst, void *src, size_t cnt);
 
 struct util_cq_aux_entry {
 	struct fi_cq_tagged_entry	*cq_slot;
@@ -507,6 +514,7 @@ struct util_cq {
 	fi_addr_t		*src;
 
 	struct slist		aux_queue;
+	fastlock_t		aux_lock;
 	fi_cq_read_func		read_entry;
 	int			internal_wait;
 	ofi_atomic32_t		signaled;
@@ -531,6 +539,8 @@ ssize_t ofi_cq_sread(struct fid_cq *cq_fid, void *buf, size_t count,
 ssize_t ofi_cq_sreadfrom(struct fid_cq *cq_fid, void *buf, size_t count,
 		fi_addr_t *src_addr, const void *cond, int timeout);
 int ofi_cq_signal(struct fid_cq *cq_fid);
+const char *ofi_cq_strerror(struct fid_cq *cq_fid, int prov_errno,
+		const void *err_data, char *buf, size_t len);
 
 int ofi_cq_write_overflow(struct util_cq *cq, void *context, uint64_t flags,
 			  size_t len, void *buf, uint64_t data, uint64_t tag,
@@ -542,6 +552,13 @@ static inline void util_cq_signal(struct util_cq *cq)
 	cq->wait->signal(cq->wait);
 }
 
+/* Publishes the entry at the write position to lock-free readers */
+static inline void ofi_cq_commit(struct util_cq *cq)
+{
+	ofi_atomic_release_fence();
+	ofi_cirque_commit(cq->cirq);
+}
+
 static inline void
 ofi_cq_write_entry(struct util_cq *cq, void *context, uint64_t flags,
 		   size_t len, void *buf, uint64_t data, uint64_t tag)
@@ -553,7 +570,7 @@ ofi_cq_write_entry(struct util_cq *cq, void *context, uint64_t flags,
 	comp->buf = buf;
 	comp->data = data;
 	comp->tag = tag;
-	ofi_cirque_commit(cq->cirq);
+	ofi_cq_commit(cq);
 }
 
 static inline void
@@ -602,6 +619,9 @@ ofi_cq_write_src(struct util_cq *cq, void *context, uint64_t flags, size_t len,
 	return ret;
 }
 
+int ofi_cq_write_batch(struct util_cq *cq,
+		       const struct fi_cq_tagged_entry *comp,
+		       const fi_addr_t *src, size_t count);
 int ofi_cq_insert_error(struct util_cq *cq,
 			const struct fi_cq_err_entry *err_entry);
 int ofi_cq_write_error(struct util_cq *cq,
@@ -682,7 +702,6 @@ static inline void ofi_cntr_inc(struct util_cntr *cntr)
 
 struct util_av_entry {
 	ofi_atomic32_t	use_cnt;
-	UT_hash_handle	hh;
 	/*
 	 * data includes 'addr' and any other additional fields
 	 * associated with av_entry. 'addr' must be the first
@@ -692,6 +711,22 @@ struct util_av_entry {
 	char		data[];
 };
 
+/*
+ * Open-addressed (linear probing) index from address to fi_addr.  Slots
+ * keep a hash of the address, so that probing only touches the entry of
+ * a slot whose hash matches.  A hash of 0 marks an empty slot.
+ */
+struct util_av_hash_slot {
+	uint64_t		hash;
+	fi_addr_t		fi_addr;
+};
+
+struct util_av_hash {
+	struct util_av_hash_slot *slot;
+	size_t			size;
+	size_t			cnt;
+};
+
 struct util_av {
 	struct fid_av		av_fid;
 	struct util_domain	*domain;
@@ -700,7 +735,7 @@ struct util_av {
 	fastlock_t		lock;
 	const struct fi_provider *prov;
 
-	struct util_av_entry	*hash;
+	struct util_av_hash	hash;
 	struct ofi_bufpool	*av_entry_pool;
 
 	struct util_coll_mc	*coll_mc;
@@ -250,6 +250,8 @@ OFI_DEF_COMPLEX_OPS(long_double)
 	__sync_bool_compare_and_swap((ptr), (expected), (desired))
 #endif /* HAVE_BUILTIN_ATOMICS */
 
+#define ofi_osd_mem_fence() __sync_synchronize()
+
 int ofi_set_thread_affinity(const char *s);
 
 
@@ -905,6 +905,11 @@ static inline int ofi_free_hugepage_buf(void *memptr, size_t size)
 	return -FI_ENOSYS;
 }
 
+static inline int ofi_mbind_node(void *addr, size_t len, int node)
+{
+	return -FI_ENOSYS;
+}
+
 static inline int ofi_hugepage_enabled(void)
 {
 	return 0;
@@ -1022,6 +1027,8 @@ typedef LONGLONG ofi_atomic_int_64_t;
 
 #endif /* HAVE_BUILTIN_ATOMICS */
 
+#define ofi_osd_mem_fence() MemoryBarrier()
+
 static inline int ofi_set_thread_affinity(const char *s)
 {
 	OFI_UNUSED(s);
@@ -147,6 +147,35 @@ static inline int pthread_yield(void)
 	return 0;
 }
 
+/*
+ * Thread-specific data.  TLS slots have no destructor, so values left
+ * behind by exiting threads are not cleaned up.
+ */
+typedef DWORD pthread_key_t;
+
+static inline int pthread_key_create(pthread_key_t *key,
+				     void (*destructor)(void *))
+{
+	(void) destructor;
+	*key = TlsAlloc();
+	return *key == TLS_OUT_OF_INDEXES ? EAGAIN : 0;
+}
+
+static inline int pthread_key_delete(pthread_key_t key)
+{
+	return TlsFree(key) ? 0 : EINVAL;
+}
+
+static inline void *pthread_getspecific(pthread_key_t key)
+{
+	return TlsGetValue(key);
+}
+
+static inline int pthread_setspecific(pthread_key_t key, const void *value)
+{
+	return TlsSetValue(key, (LPVOID) value) ? 0 : EINVAL;
+}
+
 /*
  * TODO: temporary solution
  * Need to re-implement
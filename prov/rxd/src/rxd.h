@@ -60,7 +60,7 @@
 #ifndef _RXD_H_
 #define _RXD_H_
 
-#define RXD_PROTOCOL_VERSION 	(2)
+#define RXD_PROTOCOL_VERSION 	(3)
 
 #define RXD_MAX_MTU_SIZE	4096
 
@@ -72,10 +72,28 @@
 #define RXD_RX_POOL_CHUNK_CNT	1024
 #define RXD_MAX_PENDING		128
 #define RXD_MAX_PKT_RETRY	50
+#define RXD_CQ_BATCH		16
 #define RXD_ADDR_INVALID	0
 
+/* Retransmit timeout bounds (usec), congestion window defaults (pkts) and
+ * loss rate (percent of a round) treated as congestion */
+#define RXD_MIN_RTO		1000
+#define RXD_MAX_RTO		4000000
+#define RXD_INIT_CWND		16
+#define RXD_MIN_CWND		2
+#define RXD_LOSS_THRESH		2
+
+/* Retransmit timer wheel: 1 msec ticks, 64 slots per level, each level
+ * covering 64 times the span of the one below */
+#define RXD_TIMER_BITS		6
+#define RXD_TIMER_SLOTS		(1 << RXD_TIMER_BITS)
+#define RXD_TIMER_MASK		(RXD_TIMER_SLOTS - 1)
+#define RXD_TIMER_LEVELS	3
+
 #define RXD_PKT_IN_USE		(1 << 0)
 #define RXD_PKT_ACKED		(1 << 1)
+#define RXD_PKT_SACKED		(1 << 2)
+#define RXD_PKT_RTX		(1 << 3)
 
 #define RXD_REMOTE_CQ_DATA	(1 << 0)
 #define RXD_NO_TX_COMP		(1 << 1)
@@ -84,6 +102,7 @@
 #define RXD_TAG_HDR		(1 << 4)
 #define RXD_INLINE		(1 << 5)
 #define RXD_MULTI_RECV		(1 << 6)
+#define RXD_ACK_REQ		(1 << 7)
 
 #define RXD_IDX_OFFSET(x)	(x + 1)	
 
@@ -123,6 +142,8 @@ struct rxd_domain {
 
 struct rxd_peer {
 	struct dlist_entry entry;
+	struct dlist_entry ack_entry;
+	fi_addr_t rxd_addr;
 	fi_addr_t peer_addr;
 	uint64_t tx_seq_no;
 	uint64_t rx_seq_no;
@@ -132,6 +153,24 @@ struct rxd_peer {
 	uint16_t tx_window;
 	int retry_cnt;
 
+	/* congestion control: AIMD window, loss accounted per round which
+	 * ends once round_seq is acked */
+	uint16_t cwnd;
+	uint16_t ssthresh;
+	uint16_t cwnd_cnt;
+	uint64_t round_seq;
+	size_t round_acked;
+	size_t round_lost;
+
+	/* RTT estimate and retransmit timeout, in usec */
+	uint64_t srtt;
+	uint64_t rttvar;
+	uint64_t rto;
+
+	/* timer wheel slot and expiration tick, in msec */
+	struct dlist_entry timer_entry;
+	uint64_t timer_expire;
+
 	uint16_t unacked_cnt;
 	uint8_t active;
 
@@ -182,6 +221,12 @@ struct rxd_buf_pool {
 	struct rxd_ep *rxd_ep;
 };
 
+struct rxd_timer_wheel {
+	uint64_t now;		/* last tick expired */
+	size_t cnt;
+	struct dlist_entry slots[RXD_TIMER_LEVELS][RXD_TIMER_SLOTS];
+};
+
 struct rxd_ep {
 	struct util_ep util_ep;
 	struct fid_ep *dg_ep;
@@ -193,7 +238,7 @@ struct rxd_ep {
 	size_t rx_prefix_size;
 	size_t min_multi_recv_size;
 	int do_local_mr;
-	int next_retry;
+	int next_retry;		/* msec until next retransmit, -1 if none */
 	int dg_cq_fd;
 	uint32_t tx_flags;
 	uint32_t rx_flags;
@@ -217,6 +262,8 @@ struct rxd_ep {
 	struct dlist_entry active_peers;
 	struct dlist_entry rts_sent_list;
 	struct dlist_entry ctrl_pkts;
+	struct dlist_entry ack_list;
+	struct rxd_timer_wheel timer_wheel;
 
 	struct index_map peers_idm;
 };
@@ -226,6 +273,20 @@ static inline struct rxd_peer *rxd_peer(struct rxd_ep *ep, fi_addr_t rxd_addr)
 	return ofi_idm_lookup(&ep->peers_idm, rxd_addr);
 
 }
+
+static inline void rxd_peer_new_round(struct rxd_peer *peer)
+{
+	peer->round_seq = peer->tx_seq_no;
+	peer->round_acked = 0;
+	peer->round_lost = 0;
+}
+
+/* Packets a peer may have in flight: receiver window capped by cwnd */
+static inline uint16_t rxd_peer_window(struct rxd_peer *peer)
+{
+	return MIN(peer->tx_window, peer->cwnd);
+}
+
 static inline struct rxd_domain *rxd_ep_domain(struct rxd_ep *ep)
 {
 	return container_of(ep->util_ep.domain, struct rxd_domain, util_domain);
@@ -429,12 +490,15 @@ int rxd_av_insert_dg_addr(struct rxd_av *av, const void *addr,
 			  void *context);
 
 /* Pkt resource functions */
-int rxd_ep_post_buf(struct rxd_ep *ep);
-void rxd_ep_send_ack(struct rxd_ep *rxd_ep, fi_addr_t peer);
+int rxd_ep_post_buf(struct rxd_ep *ep, uint64_t flags);
+void rxd_ep_queue_ack(struct rxd_ep *ep, fi_addr_t peer);
+void rxd_ep_flush_acks(struct rxd_ep *ep);
 struct rxd_pkt_entry *rxd_get_tx_pkt(struct rxd_ep *ep);
 struct rxd_x_entry *rxd_get_tx_entry(struct rxd_ep *ep, uint32_t op);
 struct rxd_x_entry *rxd_get_rx_entry(struct rxd_ep *ep, uint32_t op);
 int rxd_ep_send_pkt(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry);
+int rxd_ep_send_pkt_flags(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry,
+			  uint64_t flags);
 ssize_t rxd_ep_post_data_pkts(struct rxd_ep *ep, struct rxd_x_entry *tx_entry);
 void rxd_insert_unacked(struct rxd_ep *ep, fi_addr_t peer,
 			struct rxd_pkt_entry *pkt_entry);
@@ -474,8 +538,12 @@ struct rxd_x_entry *rxd_rx_entry_init(struct rxd_ep *ep,
 			uint32_t op, uint32_t flags);
 void rxd_tx_entry_free(struct rxd_ep *ep, struct rxd_x_entry *tx_entry);
 void rxd_rx_entry_free(struct rxd_ep *ep, struct rxd_x_entry *rx_entry);
-int rxd_get_timeout(uint8_t retry_cnt);
-uint64_t rxd_get_retry_time(uint64_t start, uint8_t retry_cnt);
+uint64_t rxd_get_timeout(struct rxd_peer *peer);
+uint64_t rxd_get_retry_time(struct rxd_peer *peer, uint64_t start);
+void rxd_peer_rtt_sample(struct rxd_peer *peer, uint64_t rtt);
+void rxd_peer_open_cwnd(struct rxd_peer *peer, size_t acked);
+void rxd_peer_close_cwnd(struct rxd_peer *peer);
+void rxd_peer_set_timer(struct rxd_ep *ep, struct rxd_peer *peer);
 
 /* Generic message functions */
 ssize_t rxd_ep_generic_recvmsg(struct rxd_ep *rxd_ep, const struct iovec *iov,
@@ -494,6 +562,7 @@ ssize_t rxd_ep_generic_inject(struct rxd_ep *rxd_ep, const struct iovec *iov,
 void rxd_tx_entry_progress(struct rxd_ep *ep, struct rxd_x_entry *tx_entry,
 			   int try_send);
 void rxd_handle_recv_comp(struct rxd_ep *ep, struct fi_cq_msg_entry *comp);
+void rxd_progress_buf_pkts(struct rxd_ep *ep, fi_addr_t peer);
 void rxd_handle_send_comp(struct rxd_ep *ep, struct fi_cq_msg_entry *comp);
 void rxd_handle_error(struct rxd_ep *ep);
 void rxd_progress_op(struct rxd_ep *ep, struct rxd_x_entry *rx_entry,
@@ -190,12 +190,13 @@ void rxd_ep_recv_data(struct rxd_ep *ep, struct rxd_x_entry *x_entry,
 	x_entry->next_seg_no++;
 
 	if (x_entry->next_seg_no < x_entry->num_segs) {
-		if (!(rxd_peer(ep, pkt->base_hdr.peer)->rx_seq_no %
+		if (pkt->base_hdr.flags & RXD_ACK_REQ ||
+		    !(rxd_peer(ep, pkt->base_hdr.peer)->rx_seq_no %
 		    rxd_peer(ep, pkt->base_hdr.peer)->rx_window))
-			rxd_ep_send_ack(ep, pkt->base_hdr.peer);
+			rxd_ep_queue_ack(ep, pkt->base_hdr.peer);
 		return;
 	}
-	rxd_ep_send_ack(ep, pkt->base_hdr.peer);
+	rxd_ep_queue_ack(ep, pkt->base_hdr.peer);
 
 	if (x_entry->cq_entry.flags & FI_READ)
 		rxd_complete_tx(ep, x_entry);
@@ -242,7 +243,7 @@ int rxd_start_xfer(struct rxd_ep *ep, struct rxd_x_entry *tx_entry)
 	struct rxd_base_hdr *hdr = rxd_get_base_hdr(tx_entry->pkt);
 
 	if (rxd_peer(ep, tx_entry->peer)->unacked_cnt >=
-	    rxd_peer(ep, tx_entry->peer)->tx_window)
+	    rxd_peer_window(rxd_peer(ep, tx_entry->peer)))
 		return 0;
 
 	tx_entry->start_seq = rxd_set_pkt_seq(rxd_peer(ep, tx_entry->peer),
@@ -264,7 +265,7 @@ int rxd_start_xfer(struct rxd_ep *ep, struct rxd_x_entry *tx_entry)
 	}
 
 	return rxd_peer(ep, tx_entry->peer)->unacked_cnt <
-	       rxd_peer(ep,tx_entry->peer)->tx_window;
+	       rxd_peer_window(rxd_peer(ep, tx_entry->peer));
 }
 
 void rxd_progress_tx_list(struct rxd_ep *ep, struct rxd_peer *peer)
@@ -286,9 +287,11 @@ void rxd_progress_tx_list(struct rxd_ep *ep, struct rxd_peer *peer)
 	dlist_foreach_container_safe(&peer->tx_list, struct rxd_x_entry,
 				tx_entry, entry, tmp_entry) {
 		if (tx_entry->pkt) {
-			if (!rxd_start_xfer(ep, tx_entry) ||
-			    tx_entry->op == RXD_READ_REQ)
+			if (!rxd_start_xfer(ep, tx_entry))
 				break;
+			/* started reads wait for data on the rma_rx_list */
+			if (tx_entry->op == RXD_READ_REQ)
+				continue;
 		}
 
 		if (tx_entry->bytes_done == tx_entry->cq_entry.len) {
@@ -306,7 +309,7 @@ void rxd_progress_tx_list(struct rxd_ep *ep, struct rxd_peer *peer)
 
 		if (tx_entry->op == RXD_DATA_READ && !tx_entry->bytes_done) {
 			if (rxd_peer(ep, tx_entry->peer)->unacked_cnt >=
-		    	    rxd_peer(ep, tx_entry->peer)->tx_window) {
+		    	    rxd_peer_window(rxd_peer(ep, tx_entry->peer))) {
 				break;
 			}
 			tx_entry->start_seq = rxd_peer(ep,tx_entry->peer)->tx_seq_no;
@@ -326,6 +329,8 @@ void rxd_progress_tx_list(struct rxd_ep *ep, struct rxd_peer *peer)
 
 	if (dlist_empty(&peer->tx_list))
 		peer->retry_cnt = 0;
+
+	rxd_peer_set_timer(ep, peer);
 }
 
 static void rxd_update_peer(struct rxd_ep *ep, fi_addr_t peer, fi_addr_t peer_addr)
@@ -676,7 +681,7 @@ static struct rxd_x_entry *rxd_rx_atomic_fetch(struct rxd_ep *ep,
 
 	dlist_insert_tail(&rx_entry->entry, &(rxd_peer(ep, rx_entry->peer)->tx_list));
 
-	rxd_ep_send_ack(ep, base_hdr->peer);
+	rxd_ep_queue_ack(ep, base_hdr->peer);
 
 	rxd_progress_tx_list(ep, rxd_peer(ep, rx_entry->peer));
 
@@ -895,68 +900,33 @@ static struct rxd_x_entry *rxd_get_data_x_entry(struct rxd_ep *ep,
 	return ofi_bufpool_get_ibuf(ep->tx_entry_pool.pool, data_pkt->ext_hdr.tx_id);
 }
 
-static void rxd_progress_buf_pkts(struct rxd_ep *ep, fi_addr_t peer)
+/*
+ * Hold a packet that arrived ahead of a lost one so that only the missing
+ * packets need to be retransmitted.  Packets are kept ordered by sequence
+ * number; duplicates and packets beyond the receive window are dropped.
+ */
+static int rxd_buf_pkt(struct rxd_ep *ep, struct rxd_peer *peer,
+		       struct rxd_pkt_entry *pkt_entry)
 {
-	struct fi_cq_err_entry err_entry;
-	struct rxd_pkt_entry *pkt_entry;
-	struct rxd_base_hdr *base_hdr;
-	struct rxd_sar_hdr *sar_hdr;
-	struct rxd_tag_hdr *tag_hdr;
-	struct rxd_data_hdr *data_hdr;
-	struct rxd_rma_hdr *rma_hdr;
-	struct rxd_atom_hdr *atom_hdr;
-	void *msg;
-	int ret;
-	size_t msg_size;
-	struct rxd_x_entry *rx_entry = NULL;
-	struct rxd_data_pkt *data_pkt;
-	struct dlist_entry *bufpkts;
+	struct rxd_pkt_entry *buf_entry;
+	uint64_t seq_no = rxd_get_base_hdr(pkt_entry)->seq_no;
 
-	bufpkts = &(rxd_peer(ep, peer)->buf_pkts);
-	while (!dlist_empty(bufpkts)) {
-		pkt_entry = container_of(bufpkts->next, struct rxd_pkt_entry,
-					 d_entry);
-		base_hdr = rxd_get_base_hdr(pkt_entry);
-		if (base_hdr->seq_no != rxd_peer(ep, peer)->rx_seq_no)
-			return;
-		if (base_hdr->type == RXD_DATA || base_hdr->type == RXD_DATA_READ) {
-			data_pkt = (struct rxd_data_pkt *) pkt_entry->pkt;
-			rx_entry = rxd_get_data_x_entry(ep, data_pkt);
-			rxd_ep_recv_data(ep, rx_entry, data_pkt, pkt_entry->pkt_size);
-		} else {
-			ret = rxd_unpack_init_rx(ep, &rx_entry, pkt_entry, base_hdr, &sar_hdr,
-					      &tag_hdr, &data_hdr, &rma_hdr, &atom_hdr,
-					      &msg, &msg_size);
-			if (ret) {
-				memset(&err_entry, 0, sizeof(err_entry));
-				err_entry.err = FI_ETRUNC;
-				err_entry.prov_errno = 0;
-				ret = ofi_cq_write_error(&rxd_ep_rx_cq(ep)->util_cq,
-							 &err_entry);
-				if (ret)
-					FI_WARN(&rxd_prov, FI_LOG_EP_CTRL,
-						"could not write error entry\n");
-				rxd_peer(ep, base_hdr->peer)->rx_seq_no++;
-				rxd_remove_free_pkt_entry(pkt_entry);
-				continue;
-			}
-			if (!rx_entry) {
-				if (base_hdr->type == RXD_MSG ||
-				    base_hdr->type == RXD_TAGGED) {
-					rxd_peer(ep, base_hdr->peer)->rx_seq_no++;
-					continue;
-				}
-				break;
-			}
+	if (ofi_after_eq(peer->rx_seq_no, seq_no) ||
+	    seq_no - peer->rx_seq_no >= (uint64_t) rxd_env.max_unacked)
+		return 0;
 
-			rxd_progress_op(ep, rx_entry, pkt_entry, base_hdr,
-					sar_hdr, tag_hdr, data_hdr, rma_hdr,
-					atom_hdr, &msg, msg_size);
+	dlist_foreach_container(&peer->buf_pkts, struct rxd_pkt_entry,
+				buf_entry, d_entry) {
+		if (rxd_get_base_hdr(buf_entry)->seq_no == seq_no)
+			return 0;
+		if (ofi_before(seq_no, rxd_get_base_hdr(buf_entry)->seq_no)) {
+			dlist_insert_before(&pkt_entry->d_entry,
+					    &buf_entry->d_entry);
+			return 1;
 		}
-
-		rxd_peer(ep,base_hdr->peer)->rx_seq_no++;
-		rxd_remove_free_pkt_entry(pkt_entry);
 	}
+	dlist_insert_tail(&pkt_entry->d_entry, &peer->buf_pkts);
+	return 1;
 }
 
 static void rxd_handle_data(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
@@ -964,6 +934,7 @@ static void rxd_handle_data(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 	struct rxd_data_pkt *pkt = (struct rxd_data_pkt *) (pkt_entry->pkt);
 	struct rxd_x_entry *x_entry;
 	struct rxd_unexp_msg *unexp_msg;
+	int buffered;
 
 	if (pkt_entry->pkt_size < sizeof(*pkt) + ep->rx_prefix_size) {
 		FI_WARN(&rxd_prov, FI_LOG_CQ,
@@ -980,15 +951,14 @@ static void rxd_handle_data(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 			dlist_insert_tail(&pkt_entry->d_entry, &unexp_msg->pkt_list);
 			if (pkt->ext_hdr.seg_no + 1 == unexp_msg->sar_hdr->num_segs - 1) {
 				rxd_peer(ep, pkt->base_hdr.peer)->curr_unexp = NULL;
-				rxd_ep_send_ack(ep, pkt->base_hdr.peer);
+				rxd_ep_queue_ack(ep, pkt->base_hdr.peer);
+			} else if (pkt->base_hdr.flags & RXD_ACK_REQ) {
+				rxd_ep_queue_ack(ep, pkt->base_hdr.peer);
 			}
 			return;
 		}
 		x_entry = rxd_get_data_x_entry(ep, pkt);
 		rxd_ep_recv_data(ep, x_entry, pkt, pkt_entry->pkt_size);
-		if (!dlist_empty(&(rxd_peer(ep, 
-				   pkt->base_hdr.peer)->buf_pkts)))
-			rxd_progress_buf_pkts(ep, pkt->base_hdr.peer);
 	} else if (!rxd_env.retry) {
 		dlist_insert_order(&(rxd_peer(ep, 
 				     pkt->base_hdr.peer)->buf_pkts),
@@ -996,7 +966,11 @@ static void rxd_handle_data(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 		return;
 	} else if (rxd_peer(ep, pkt->base_hdr.peer)->peer_addr != 
 		   RXD_ADDR_INVALID) {
-		rxd_ep_send_ack(ep, pkt->base_hdr.peer);
+		buffered = rxd_buf_pkt(ep, rxd_peer(ep, pkt->base_hdr.peer),
+				       pkt_entry);
+		rxd_ep_queue_ack(ep, pkt->base_hdr.peer);
+		if (buffered)
+			return;
 	}
 free:
 	ofi_buf_free(pkt_entry);
@@ -1022,9 +996,13 @@ static void rxd_handle_op(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 			return;
 		}
 
-		if (rxd_peer(ep, base_hdr->peer)->peer_addr != RXD_ADDR_INVALID)
-			goto ack;
-		goto release;
+		if (rxd_peer(ep, base_hdr->peer)->peer_addr == RXD_ADDR_INVALID)
+			goto release;
+		if (rxd_buf_pkt(ep, rxd_peer(ep, base_hdr->peer), pkt_entry)) {
+			rxd_ep_queue_ack(ep, base_hdr->peer);
+			return;
+		}
+		goto ack;
 	}
 
 	if (rxd_peer(ep, base_hdr->peer)->peer_addr == RXD_ADDR_INVALID)
@@ -1046,7 +1024,7 @@ static void rxd_handle_op(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 			if (!sar_hdr)
 				rxd_peer(ep, base_hdr->peer)->curr_unexp = NULL;
 
-			rxd_ep_send_ack(ep, base_hdr->peer);
+			rxd_ep_queue_ack(ep, base_hdr->peer);
 			return;
 		}
 		rxd_peer(ep, base_hdr->peer)->rx_window = 0;
@@ -1058,15 +1036,44 @@ static void rxd_handle_op(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 	rxd_progress_op(ep, rx_entry, pkt_entry, base_hdr, sar_hdr, tag_hdr,
 			data_hdr, rma_hdr, atom_hdr, &msg, msg_size);
 
-	if (!dlist_empty(&(rxd_peer(ep, base_hdr->peer)->buf_pkts)))
-		rxd_progress_buf_pkts(ep, base_hdr->peer);
-
 ack:
-	rxd_ep_send_ack(ep, base_hdr->peer);
+	rxd_ep_queue_ack(ep, base_hdr->peer);
 release:
 	ofi_buf_free(pkt_entry);
 }
 
+/*
+ * Feed buffered packets that are now in order back through the regular
+ * receive path.  Packets overtaken by rx_seq_no (e.g. skipped by a discarded
+ * message) are released.
+ */
+void rxd_progress_buf_pkts(struct rxd_ep *ep, fi_addr_t peer)
+{
+	struct rxd_pkt_entry *pkt_entry;
+	struct rxd_base_hdr *base_hdr;
+	struct dlist_entry *bufpkts;
+
+	bufpkts = &(rxd_peer(ep, peer)->buf_pkts);
+	while (!dlist_empty(bufpkts)) {
+		pkt_entry = container_of(bufpkts->next, struct rxd_pkt_entry,
+					 d_entry);
+		base_hdr = rxd_get_base_hdr(pkt_entry);
+		if (ofi_before(base_hdr->seq_no, rxd_peer(ep, peer)->rx_seq_no)) {
+			dlist_remove(&pkt_entry->d_entry);
+			ofi_buf_free(pkt_entry);
+			continue;
+		}
+		if (base_hdr->seq_no != rxd_peer(ep, peer)->rx_seq_no)
+			return;
+
+		dlist_remove(&pkt_entry->d_entry);
+		if (base_hdr->type == RXD_DATA || base_hdr->type == RXD_DATA_READ)
+			rxd_handle_data(ep, pkt_entry);
+		else
+			rxd_handle_op(ep, pkt_entry);
+	}
+}
+
 static void rxd_handle_cts(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 {
 	struct rxd_cts_pkt *cts = (struct rxd_cts_pkt *) (pkt_entry->pkt);
@@ -1080,23 +1087,83 @@ static void rxd_handle_cts(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 	rxd_update_peer(ep, cts->rts_addr, cts->cts_addr);
 }
 
+/*
+ * Mark packets covered by the selective ack blocks and resend, once, any
+ * packet the peer has skipped over.  Packets still owned by the datagram
+ * provider are left for the retransmit timer.  Newly sacked packets also
+ * provide an RTT sample, as their cumulative ack may be held back.
+ */
+static void rxd_handle_sack(struct rxd_ep *ep, struct rxd_peer *peer,
+			    struct rxd_ack_pkt *ack)
+{
+	struct rxd_pkt_entry *pkt_entry;
+	uint64_t seq_no, high = ack->base_hdr.seq_no;
+	uint64_t sent = 0;
+	uint32_t i;
+	int sacked;
+
+	for (i = 0; i < ack->sack_cnt; i++) {
+		if (ofi_after_eq(ack->sack[i].end, high))
+			high = ack->sack[i].end;
+	}
+
+	dlist_foreach_container(&peer->unacked, struct rxd_pkt_entry,
+				pkt_entry, d_entry) {
+		seq_no = rxd_get_base_hdr(pkt_entry)->seq_no;
+		if (ofi_after_eq(seq_no, high))
+			break;
+
+		for (i = 0, sacked = 0; i < ack->sack_cnt && !sacked; i++) {
+			sacked = ofi_after_eq(seq_no, ack->sack[i].start) &&
+				 ofi_before(seq_no, ack->sack[i].end);
+		}
+		if (sacked) {
+			if (!(pkt_entry->flags & (RXD_PKT_SACKED | RXD_PKT_RTX)))
+				sent = pkt_entry->timestamp;
+			pkt_entry->flags |= RXD_PKT_SACKED;
+			continue;
+		}
+
+		if (pkt_entry->flags & (RXD_PKT_IN_USE | RXD_PKT_ACKED |
+					RXD_PKT_SACKED | RXD_PKT_RTX))
+			continue;
+
+		if (rxd_ep_send_pkt(ep, pkt_entry))
+			break;
+		pkt_entry->flags |= RXD_PKT_RTX;
+		peer->round_lost++;
+	}
+
+	if (sent)
+		rxd_peer_rtt_sample(peer, ofi_gettime_us() - sent);
+}
+
 static void rxd_handle_ack(struct rxd_ep *ep, struct rxd_pkt_entry *ack_entry)
 {
 	struct rxd_ack_pkt *ack = (struct rxd_ack_pkt *) (ack_entry->pkt);
 	struct rxd_pkt_entry *pkt_entry;
 	fi_addr_t peer = ack->base_hdr.peer;
 	struct rxd_base_hdr *hdr;
+	uint64_t sent = 0;
+	size_t acked = 0;
+
+	if (ack_entry->pkt_size < sizeof(*ack) - sizeof(ack->sack) +
+				  ep->rx_prefix_size ||
+	    ack->sack_cnt > RXD_MAX_SACK_BLKS ||
+	    ack_entry->pkt_size < sizeof(*ack) - sizeof(ack->sack) +
+				  ack->sack_cnt * sizeof(ack->sack[0]) +
+				  ep->rx_prefix_size) {
+		FI_WARN(&rxd_prov, FI_LOG_CQ, "Cannot process malformed ack\n");
+		return;
+	}
 
 	rxd_peer(ep, peer)->tx_window = ack->ext_hdr.rx_id;
 
-	if (rxd_peer(ep, peer)->last_rx_ack == ack->base_hdr.seq_no)
+	if (ofi_before(ack->base_hdr.seq_no, rxd_peer(ep, peer)->last_rx_ack))
 		return;
 
 	rxd_peer(ep, peer)->last_rx_ack = ack->base_hdr.seq_no;
 
-	if (dlist_empty(&(rxd_peer(ep, peer)->unacked)))
-		return;
-
 	pkt_entry = container_of((&(rxd_peer(ep, 
 				    peer)->unacked))->next,
 				 struct rxd_pkt_entry, d_entry);
@@ -1107,6 +1174,12 @@ static void rxd_handle_ack(struct rxd_ep *ep, struct rxd_pkt_entry *ack_entry)
 		if (ofi_after_eq(hdr->seq_no, ack->base_hdr.seq_no))
 			break;
 
+		if (!(pkt_entry->flags & RXD_PKT_ACKED)) {
+			acked++;
+			if (!(pkt_entry->flags & (RXD_PKT_RTX | RXD_PKT_SACKED)))
+				sent = pkt_entry->timestamp;
+		}
+
 		if (pkt_entry->flags & RXD_PKT_IN_USE) {
 			pkt_entry->flags |= RXD_PKT_ACKED;
 			pkt_entry = container_of((&pkt_entry->d_entry)->next,
@@ -1121,6 +1194,13 @@ static void rxd_handle_ack(struct rxd_ep *ep, struct rxd_pkt_entry *ack_entry)
 					struct rxd_pkt_entry, d_entry);
 	}
 
+	if (sent)
+		rxd_peer_rtt_sample(rxd_peer(ep, peer), ofi_gettime_us() - sent);
+	if (acked)
+		rxd_peer_open_cwnd(rxd_peer(ep, peer), acked);
+	if (ack->sack_cnt)
+		rxd_handle_sack(ep, rxd_peer(ep, peer), ack);
+
 	rxd_progress_tx_list(ep, rxd_peer(ep, ack->base_hdr.peer));
 }
 
@@ -1155,15 +1235,16 @@ void rxd_handle_recv_comp(struct rxd_ep *ep, struct fi_cq_msg_entry *comp)
 {
 	struct rxd_pkt_entry *pkt_entry =
 		container_of(comp->op_context, struct rxd_pkt_entry, context);
+	fi_addr_t peer;
 
 	FI_DBG(&rxd_prov, FI_LOG_EP_DATA,
 	       "got recv completion (type: %s)\n",
 	       rxd_pkt_type_str[(rxd_pkt_type(pkt_entry))]);
 
-	rxd_ep_post_buf(ep);
 	rxd_remove_rx_pkt(ep, pkt_entry);
 
 	pkt_entry->pkt_size = comp->len;
+	peer = rxd_get_base_hdr(pkt_entry)->peer;
 	switch (rxd_pkt_type(pkt_entry)) {
 	case RXD_RTS:
 		rxd_handle_rts(ep, pkt_entry);
@@ -1179,15 +1260,20 @@ void rxd_handle_recv_comp(struct rxd_ep *ep, struct fi_cq_msg_entry *comp)
 		rxd_handle_data(ep, pkt_entry);
 		/* don't need to perform action below:
 		 * - release/repost RX packet */
-		return;
+		goto buf_pkts;
 	default:
 		rxd_handle_op(ep, pkt_entry);
 		/* don't need to perform action below:
 		 * - release/repost RX packet */
-		return;
+		goto buf_pkts;
 	}
 
 	ofi_buf_free(pkt_entry);
+	return;
+
+buf_pkts:
+	if (rxd_peer(ep, peer) && !dlist_empty(&(rxd_peer(ep, peer)->buf_pkts)))
+		rxd_progress_buf_pkts(ep, peer);
 }
 
 void rxd_handle_error(struct rxd_ep *ep)
@@ -1267,7 +1353,7 @@ ssize_t rxd_cq_sreadfrom(struct fid_cq *cq_fid, void *buf, size_t count,
 		cq->cq_fastlock_release(&cq->ep_list_lock);
 
 		ret = fi_wait(&cq->wait->wait_fid, ep_retry == -1 ?
-			      timeout : rxd_get_timeout(ep_retry));
+			      timeout : ep_retry);
 
 		if (ep_retry != -1 && ret == -FI_ETIMEDOUT)
 			ret = 0;
@@ -223,19 +223,28 @@ struct rxd_x_entry *rxd_rx_entry_init(struct rxd_ep *ep,
 	return rx_entry;
 }
 
-int rxd_ep_post_buf(struct rxd_ep *ep)
+/* FI_MORE chains the post with the ones that follow it */
+int rxd_ep_post_buf(struct rxd_ep *ep, uint64_t flags)
 {
 	struct rxd_pkt_entry *pkt_entry;
+	struct iovec iov;
+	struct fi_msg msg;
 	ssize_t ret;
 
 	pkt_entry = ofi_buf_alloc(ep->rx_pkt_pool.pool);
 	if (!pkt_entry)
 		return -FI_ENOMEM;
 
-	ret = fi_recv(ep->dg_ep, rxd_pkt_start(pkt_entry),
-		      rxd_ep_domain(ep)->max_mtu_sz,
-		      pkt_entry->desc, FI_ADDR_UNSPEC,
-		      &pkt_entry->context);
+	iov.iov_base = rxd_pkt_start(pkt_entry);
+	iov.iov_len = rxd_ep_domain(ep)->max_mtu_sz;
+	msg.msg_iov = &iov;
+	msg.desc = &pkt_entry->desc;
+	msg.iov_count = 1;
+	msg.addr = FI_ADDR_UNSPEC;
+	msg.context = &pkt_entry->context;
+	msg.data = 0;
+
+	ret = fi_recvmsg(ep->dg_ep, &msg, flags);
 	if (ret) {
 		ofi_buf_free(pkt_entry);
 		FI_WARN(&rxd_prov, FI_LOG_EP_CTRL, "failed to repost\n");
@@ -265,7 +274,7 @@ static int rxd_ep_enable(struct rxd_ep *ep)
 
 	fastlock_acquire(&ep->util_ep.lock);
 	for (i = 0; i < ep->rx_size; i++) {
-		ret = rxd_ep_post_buf(ep);
+		ret = rxd_ep_post_buf(ep, i + 1 < ep->rx_size ? FI_MORE : 0);
 		if (ret)
 			break;
 	}
@@ -275,16 +284,244 @@ static int rxd_ep_enable(struct rxd_ep *ep)
 }
 
 /*
- * Exponential back-off starting at 1ms, max 4s.
+ * Retransmit timeout in usec: RTT based RTO, doubled on every expiry and
+ * kept until a new RTT sample is taken, max 4s.
+ */
+uint64_t rxd_get_timeout(struct rxd_peer *peer)
+{
+	return peer->rto;
+}
+
+uint64_t rxd_get_retry_time(struct rxd_peer *peer, uint64_t start)
+{
+	return start + rxd_get_timeout(peer);
+}
+
+/*
+ * RTT smoothing and RTO computation follow RFC 6298, with RXD_MIN_RTO as
+ * the clock granularity.  Samples are only taken from packets that were
+ * never retransmitted or selectively acked, whose acks may have been held
+ * back by a hole.  While the oldest packet is being retried the backed off
+ * RTO is kept, so that selective acks of later packets cannot shrink it.
+ */
+void rxd_peer_rtt_sample(struct rxd_peer *peer, uint64_t rtt)
+{
+	uint64_t delta;
+
+	if (peer->retry_cnt)
+		return;
+
+	if (!peer->srtt) {
+		peer->srtt = MAX(rtt, 1);
+		peer->rttvar = rtt / 2;
+	} else {
+		delta = peer->srtt > rtt ? peer->srtt - rtt : rtt - peer->srtt;
+		peer->rttvar = (3 * peer->rttvar + delta) / 4;
+		peer->srtt = MAX((7 * peer->srtt + rtt) / 8, 1);
+	}
+	peer->rto = MIN(peer->srtt + MAX(4 * peer->rttvar, RXD_MIN_RTO),
+			RXD_MAX_RTO);
+}
+
+/*
+ * Slow start below ssthresh, then one packet per window of acks.  Once per
+ * round (a flight of packets) the window is cut by 30% if more than one
+ * packet and more than RXD_LOSS_THRESH percent of the round was lost, so
+ * that sparse random loss on an uncongested link does not throttle the
+ * sender.
+ */
+void rxd_peer_open_cwnd(struct rxd_peer *peer, size_t acked)
+{
+	size_t cwnd = peer->cwnd;
+
+	peer->round_acked += acked;
+	if (ofi_after_eq(peer->last_rx_ack, peer->round_seq)) {
+		if (peer->round_lost > 1 &&
+		    peer->round_lost * 100 > (peer->round_acked +
+		    peer->round_lost) * RXD_LOSS_THRESH) {
+			peer->ssthresh = MAX(cwnd * 7 / 10, RXD_MIN_CWND);
+			peer->cwnd = peer->ssthresh;
+			peer->cwnd_cnt = 0;
+			rxd_peer_new_round(peer);
+			return;
+		}
+		rxd_peer_new_round(peer);
+	}
+
+	if (cwnd < peer->ssthresh) {
+		cwnd += acked;
+	} else {
+		peer->cwnd_cnt += acked;
+		while (peer->cwnd_cnt >= cwnd) {
+			peer->cwnd_cnt -= cwnd;
+			cwnd++;
+		}
+	}
+	peer->cwnd = MIN(cwnd, rxd_env.max_unacked);
+}
+
+/* A retransmit timeout halves ssthresh and restarts from slow start */
+void rxd_peer_close_cwnd(struct rxd_peer *peer)
+{
+	peer->ssthresh = MAX(MIN(peer->cwnd, peer->unacked_cnt) / 2,
+			     RXD_MIN_CWND);
+	peer->cwnd = RXD_MIN_CWND;
+	peer->cwnd_cnt = 0;
+	rxd_peer_new_round(peer);
+}
+
+static void rxd_timer_init(struct rxd_timer_wheel *wheel, uint64_t now)
+{
+	int i, j;
+
+	wheel->now = now;
+	wheel->cnt = 0;
+	for (i = 0; i < RXD_TIMER_LEVELS; i++) {
+		for (j = 0; j < RXD_TIMER_SLOTS; j++)
+			dlist_init(&wheel->slots[i][j]);
+	}
+}
+
+/*
+ * A timer goes to the lowest level whose span covers its distance from the
+ * current tick, in the slot selected by its expiration at that level.  Higher
+ * level slots are cascaded down as the wheel turns past them.  Timers beyond
+ * the top level are clamped to its span.
+ */
+static void rxd_timer_place(struct rxd_timer_wheel *wheel,
+			    struct rxd_peer *peer)
+{
+	uint64_t delta;
+	int level;
+
+	if (peer->timer_expire < wheel->now)
+		peer->timer_expire = wheel->now;
+
+	delta = peer->timer_expire - wheel->now;
+	for (level = 0; level < RXD_TIMER_LEVELS - 1; level++) {
+		if (delta < (1ULL << (RXD_TIMER_BITS * (level + 1))))
+			break;
+	}
+	if (delta >= (1ULL << (RXD_TIMER_BITS * RXD_TIMER_LEVELS)))
+		peer->timer_expire = wheel->now +
+			(1ULL << (RXD_TIMER_BITS * RXD_TIMER_LEVELS)) - 1;
+
+	dlist_insert_tail(&peer->timer_entry, &wheel->slots[level]
+			  [(peer->timer_expire >> (RXD_TIMER_BITS * level)) &
+			   RXD_TIMER_MASK]);
+}
+
+static void rxd_timer_del(struct rxd_timer_wheel *wheel, struct rxd_peer *peer)
+{
+	if (dlist_empty(&peer->timer_entry))
+		return;
+
+	dlist_remove_init(&peer->timer_entry);
+	wheel->cnt--;
+}
+
+/* Expiration ticks already passed fire on the next tick */
+static void rxd_timer_add(struct rxd_timer_wheel *wheel, struct rxd_peer *peer,
+			  uint64_t expire)
+{
+	rxd_timer_del(wheel, peer);
+	peer->timer_expire = MAX(expire, wheel->now + 1);
+	rxd_timer_place(wheel, peer);
+	wheel->cnt++;
+}
+
+static void rxd_timer_cascade(struct rxd_timer_wheel *wheel, int level)
+{
+	struct dlist_entry list;
+	struct rxd_peer *peer;
+
+	dlist_init(&list);
+	dlist_splice_tail(&list, &wheel->slots[level][(wheel->now >>
+			  (RXD_TIMER_BITS * level)) & RXD_TIMER_MASK]);
+	while (!dlist_empty(&list)) {
+		dlist_pop_front(&list, struct rxd_peer, peer, timer_entry);
+		rxd_timer_place(wheel, peer);
+	}
+}
+
+/* Move peers whose timers expired by tick now to the expired list */
+static void rxd_timer_expire(struct rxd_timer_wheel *wheel, uint64_t now,
+			     struct dlist_entry *expired)
+{
+	struct dlist_entry *slot;
+	struct rxd_peer *peer;
+	int level;
+
+	while (wheel->cnt && wheel->now < now) {
+		wheel->now++;
+		for (level = RXD_TIMER_LEVELS - 1; level > 0; level--) {
+			if (!(wheel->now & ((1ULL << (RXD_TIMER_BITS *
+						      level)) - 1)))
+				rxd_timer_cascade(wheel, level);
+		}
+
+		slot = &wheel->slots[0][wheel->now & RXD_TIMER_MASK];
+		while (!dlist_empty(slot)) {
+			dlist_pop_front(slot, struct rxd_peer, peer,
+					timer_entry);
+			dlist_insert_tail(&peer->timer_entry, expired);
+			wheel->cnt--;
+		}
+	}
+	wheel->now = MAX(wheel->now, now);
+}
+
+/*
+ * Msec until the next timer may expire, -1 if none is set.  Timers past the
+ * first level are reported at the tick they are cascaded on, which is no
+ * later than their expiration.
  */
-int rxd_get_timeout(uint8_t retry_cnt)
+static int rxd_timer_next(struct rxd_timer_wheel *wheel)
 {
-	return MIN(1 << retry_cnt, 4000);
+	uint64_t tick, next = UINT64_MAX;
+	int level, i;
+
+	if (!wheel->cnt)
+		return -1;
+
+	for (level = 0; level < RXD_TIMER_LEVELS; level++) {
+		tick = wheel->now >> (RXD_TIMER_BITS * level);
+		for (i = 1; i <= RXD_TIMER_SLOTS; i++) {
+			if (!dlist_empty(&wheel->slots[level]
+					 [(tick + i) & RXD_TIMER_MASK])) {
+				next = MIN(next, (tick + i) <<
+					   (RXD_TIMER_BITS * level));
+				break;
+			}
+		}
+	}
+	return (int) (next - wheel->now);
 }
 
-uint64_t rxd_get_retry_time(uint64_t start, uint8_t retry_cnt)
+/*
+ * Arm the peer's retransmit timer for its oldest unacked packet.  A peer with
+ * queued transfers but nothing in flight was held back by a lack of
+ * resources and is retried on the next tick.
+ */
+void rxd_peer_set_timer(struct rxd_ep *ep, struct rxd_peer *peer)
 {
-	return start + rxd_get_timeout(retry_cnt);
+	struct rxd_pkt_entry *head;
+
+	if (!rxd_env.retry)
+		return;
+
+	if (!dlist_empty(&peer->unacked)) {
+		head = container_of(peer->unacked.next, struct rxd_pkt_entry,
+				    d_entry);
+		rxd_timer_add(&ep->timer_wheel, peer,
+			      (rxd_get_retry_time(peer, head->timestamp) +
+			       999) / 1000);
+	} else if (!dlist_empty(&peer->tx_list) &&
+		   peer->peer_addr != RXD_ADDR_INVALID) {
+		rxd_timer_add(&ep->timer_wheel, peer, 0);
+	} else {
+		rxd_timer_del(&ep->timer_wheel, peer);
+	}
 }
 
 void rxd_init_data_pkt(struct rxd_ep *ep, struct rxd_x_entry *tx_entry,
@@ -378,17 +615,19 @@ void rxd_insert_unacked(struct rxd_ep *ep, fi_addr_t peer,
 {
 	dlist_insert_tail(&pkt_entry->d_entry,
 			  &(rxd_peer(ep, peer)->unacked));
-	rxd_peer(ep, peer)->unacked_cnt++;
+	if (!rxd_peer(ep, peer)->unacked_cnt++)
+		rxd_peer_set_timer(ep, rxd_peer(ep, peer));
 }
 
 ssize_t rxd_ep_post_data_pkts(struct rxd_ep *ep, struct rxd_x_entry *tx_entry)
 {
 	struct rxd_pkt_entry *pkt_entry;
 	struct rxd_data_pkt *data;
+	uint64_t flags;
 
 	while (tx_entry->bytes_done != tx_entry->cq_entry.len) {
 		if (rxd_peer(ep, tx_entry->peer)->unacked_cnt >=
-		    rxd_peer(ep, tx_entry->peer)->tx_window)
+		    rxd_peer_window(rxd_peer(ep, tx_entry->peer)))
 			return 0;
 
 		pkt_entry = rxd_get_tx_pkt(ep);
@@ -403,25 +642,51 @@ ssize_t rxd_ep_post_data_pkts(struct rxd_ep *ep, struct rxd_x_entry *tx_entry)
 		if (data->base_hdr.type != RXD_DATA_READ)
 			data->base_hdr.seq_no++;
 
-		rxd_ep_send_pkt(ep, pkt_entry);
+		/* Let the datagram provider send the train in one go, and ask
+		 * for an ack once it fills the window so the sender is clocked
+		 * by acks rather than by the retransmit timer */
+		if (rxd_peer(ep, tx_entry->peer)->unacked_cnt + 1 <
+		    rxd_peer_window(rxd_peer(ep, tx_entry->peer))) {
+			flags = tx_entry->bytes_done != tx_entry->cq_entry.len ?
+				FI_MORE : 0;
+		} else {
+			data->base_hdr.flags |= RXD_ACK_REQ;
+			flags = 0;
+		}
+		rxd_ep_send_pkt_flags(ep, pkt_entry, flags);
 		rxd_insert_unacked(ep, tx_entry->peer, pkt_entry);
 	}
 
 	return rxd_peer(ep, tx_entry->peer)->unacked_cnt >=
-	       rxd_peer(ep, tx_entry->peer)->tx_window;
+	       rxd_peer_window(rxd_peer(ep, tx_entry->peer));
 }
 
-int rxd_ep_send_pkt(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
+int rxd_ep_send_pkt_flags(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry,
+			  uint64_t flags)
 {
+	struct iovec iov;
+	struct fi_msg msg;
 	int ret;
 	fi_addr_t dg_addr;
-	pkt_entry->timestamp = ofi_gettime_ms();
+	pkt_entry->timestamp = ofi_gettime_us();
 
 	dg_addr = (intptr_t) ofi_idx_lookup(&(rxd_ep_av(ep)->rxdaddr_dg_idx),
 					    pkt_entry->peer);
-	ret = fi_send(ep->dg_ep, (const void *) rxd_pkt_start(pkt_entry),
-		      pkt_entry->pkt_size, pkt_entry->desc, dg_addr,
-		      &pkt_entry->context);
+	if (flags) {
+		iov.iov_base = rxd_pkt_start(pkt_entry);
+		iov.iov_len = pkt_entry->pkt_size;
+		msg.msg_iov = &iov;
+		msg.desc = &pkt_entry->desc;
+		msg.iov_count = 1;
+		msg.addr = dg_addr;
+		msg.context = &pkt_entry->context;
+		msg.data = 0;
+		ret = fi_sendmsg(ep->dg_ep, &msg, flags);
+	} else {
+		ret = fi_send(ep->dg_ep, (const void *) rxd_pkt_start(pkt_entry),
+			      pkt_entry->pkt_size, pkt_entry->desc, dg_addr,
+			      &pkt_entry->context);
+	}
 	if (ret) {
 		FI_WARN(&rxd_prov, FI_LOG_EP_CTRL, "error sending packet: %d (%s)\n",
 			ret, fi_strerror(-ret));
@@ -432,6 +697,11 @@ int rxd_ep_send_pkt(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 	return 0;
 }
 
+int rxd_ep_send_pkt(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
+{
+	return rxd_ep_send_pkt_flags(ep, pkt_entry, 0);
+}
+
 static ssize_t rxd_ep_send_rts(struct rxd_ep *rxd_ep, fi_addr_t rxd_addr)
 {
 	struct rxd_pkt_entry *pkt_entry;
@@ -559,7 +829,38 @@ size_t rxd_init_msg(void **ptr, const struct iovec *iov, size_t iov_count,
 	return done;
 }
 
-void rxd_ep_send_ack(struct rxd_ep *rxd_ep, fi_addr_t peer)
+/*
+ * Describe packets buffered out of order as up to RXD_MAX_SACK_BLKS ranges,
+ * lowest first.  buf_pkts is kept sorted by sequence number.
+ */
+static uint32_t rxd_ep_fill_sack(struct rxd_peer *peer, struct rxd_ack_pkt *ack)
+{
+	struct rxd_pkt_entry *pkt_entry;
+	struct rxd_sack_blk *blk = NULL;
+	uint64_t seq_no;
+	uint32_t cnt = 0;
+
+	dlist_foreach_container(&peer->buf_pkts, struct rxd_pkt_entry,
+				pkt_entry, d_entry) {
+		seq_no = rxd_get_base_hdr(pkt_entry)->seq_no;
+		if (ofi_after_eq(peer->rx_seq_no, seq_no))
+			continue;
+		if (blk && blk->end == seq_no) {
+			blk->end++;
+			continue;
+		}
+		if (cnt == RXD_MAX_SACK_BLKS)
+			break;
+		blk = &ack->sack[cnt++];
+		blk->start = seq_no;
+		blk->end = seq_no + 1;
+	}
+
+	return cnt;
+}
+
+static void rxd_ep_send_ack(struct rxd_ep *rxd_ep, fi_addr_t peer,
+			    uint64_t flags)
 {
 	struct rxd_pkt_entry *pkt_entry;
 	struct rxd_ack_pkt *ack;
@@ -571,7 +872,11 @@ void rxd_ep_send_ack(struct rxd_ep *rxd_ep, fi_addr_t peer)
 	}
 
 	ack = (struct rxd_ack_pkt *) (pkt_entry->pkt);
-	pkt_entry->pkt_size = sizeof(*ack) + rxd_ep->tx_prefix_size;
+	ack->sack_cnt = rxd_ep_fill_sack(rxd_peer(rxd_ep, peer), ack);
+	ack->resv = 0;
+	pkt_entry->pkt_size = sizeof(*ack) - sizeof(ack->sack) +
+			      ack->sack_cnt * sizeof(ack->sack[0]) +
+			      rxd_ep->tx_prefix_size;
 	pkt_entry->peer = peer;
 
 	ack->base_hdr.version = RXD_PROTOCOL_VERSION;
@@ -582,10 +887,36 @@ void rxd_ep_send_ack(struct rxd_ep *rxd_ep, fi_addr_t peer)
 	rxd_peer(rxd_ep, peer)->last_tx_ack = ack->base_hdr.seq_no;
 
 	dlist_insert_tail(&pkt_entry->d_entry, &rxd_ep->ctrl_pkts);
-	if (rxd_ep_send_pkt(rxd_ep, pkt_entry))
+	if (rxd_ep_send_pkt_flags(rxd_ep, pkt_entry, flags))
 		rxd_remove_free_pkt_entry(pkt_entry);
 }
 
+/*
+ * Acks are deferred until the current burst of received packets has been
+ * handled, so that a peer gets at most one ack per burst, reflecting its
+ * latest receive state.
+ */
+void rxd_ep_queue_ack(struct rxd_ep *ep, fi_addr_t peer)
+{
+	struct rxd_peer *peer_entry = rxd_peer(ep, peer);
+
+	if (dlist_empty(&peer_entry->ack_entry))
+		dlist_insert_tail(&peer_entry->ack_entry, &ep->ack_list);
+}
+
+void rxd_ep_flush_acks(struct rxd_ep *ep)
+{
+	struct rxd_peer *peer;
+
+	while (!dlist_empty(&ep->ack_list)) {
+		dlist_pop_front(&ep->ack_list, struct rxd_peer, peer,
+				ack_entry);
+		dlist_init(&peer->ack_entry);
+		rxd_ep_send_ack(ep, peer->rxd_addr,
+				dlist_empty(&ep->ack_list) ? 0 : FI_MORE);
+	}
+}
+
 static void rxd_ep_free_res(struct rxd_ep *ep)
 {
 	if (ep->tx_pkt_pool.pool)
@@ -631,6 +962,8 @@ static void rxd_close_peer(struct rxd_ep *ep, struct rxd_peer *peer)
 		rxd_tx_entry_free(ep, x_entry);
 	}
 
+	rxd_timer_del(&ep->timer_wheel, peer);
+	dlist_remove_init(&peer->ack_entry);
 	dlist_remove(&peer->entry);
 	peer->active = 0;
 }
@@ -914,44 +1247,81 @@ static void rxd_peer_timeout(struct rxd_ep *rxd_ep, struct rxd_peer *peer)
 	dlist_remove(&peer->entry);
 }
 
+/*
+ * Retransmit once the oldest unacked packet times out.  The head is always
+ * resent since it is the packet the peer is waiting on; later packets are
+ * resent only if they have timed out as well and were not selectively acked.
+ * A single timeout is usually a lost tail packet or ack and only counts as a
+ * loss; the window collapses if the retransmission times out again.
+ */
 static void rxd_progress_pkt_list(struct rxd_ep *ep, struct rxd_peer *peer)
 {
-	struct rxd_pkt_entry *pkt_entry;
+	struct rxd_pkt_entry *pkt_entry, *head;
 	uint64_t current;
-	int ret, retry = 0;
 
-	current = ofi_gettime_ms();
 	if (peer->retry_cnt > RXD_MAX_PKT_RETRY) {
 		rxd_peer_timeout(ep, peer);
 		return;
 	}
 
-	dlist_foreach_container(&peer->unacked, struct rxd_pkt_entry,
-				pkt_entry, d_entry) {
-		if (pkt_entry->flags & (RXD_PKT_IN_USE | RXD_PKT_ACKED) ||
-		    current < rxd_get_retry_time(pkt_entry->timestamp, peer->retry_cnt))
-			break;
-		retry = 1;
-		ret = rxd_ep_send_pkt(ep, pkt_entry);
-		if (ret)
-			break;
-	}
-	if (retry)
+	if (dlist_empty(&peer->unacked))
+		return;
+
+	current = ofi_gettime_us();
+	head = container_of(peer->unacked.next, struct rxd_pkt_entry, d_entry);
+	if (!(head->flags & (RXD_PKT_IN_USE | RXD_PKT_ACKED)) &&
+	    current >= rxd_get_retry_time(peer, head->timestamp)) {
+		if (peer->retry_cnt)
+			rxd_peer_close_cwnd(peer);
+		else
+			peer->round_lost++;
+		dlist_foreach_container(&peer->unacked, struct rxd_pkt_entry,
+					pkt_entry, d_entry) {
+			if (pkt_entry->flags & (RXD_PKT_IN_USE | RXD_PKT_ACKED))
+				continue;
+			if (pkt_entry != head &&
+			    (pkt_entry->flags & RXD_PKT_SACKED ||
+			     current < rxd_get_retry_time(peer,
+							  pkt_entry->timestamp)))
+				continue;
+			if (rxd_ep_send_pkt(ep, pkt_entry))
+				break;
+			pkt_entry->flags |= RXD_PKT_RTX;
+		}
 		peer->retry_cnt++;
+		peer->rto = MIN(peer->rto * 2, RXD_MAX_RTO);
+	}
 
-	if (!dlist_empty(&peer->unacked))
-		ep->next_retry = ep->next_retry == -1 ? peer->retry_cnt :
-				 MIN(ep->next_retry, peer->retry_cnt);
+	rxd_peer_set_timer(ep, peer);
 }
 
-void rxd_ep_progress(struct util_ep *util_ep)
+/*
+ * Only peers whose retransmit timer expired are visited, so the cost of
+ * progress does not grow with the number of peers with data in flight.
+ */
+static void rxd_progress_timers(struct rxd_ep *ep)
 {
+	struct dlist_entry expired;
 	struct rxd_peer *peer;
-	struct fi_cq_msg_entry cq_entry;
-	struct dlist_entry *tmp;
+
+	dlist_init(&expired);
+	rxd_timer_expire(&ep->timer_wheel, ofi_gettime_ms(), &expired);
+	while (!dlist_empty(&expired)) {
+		dlist_pop_front(&expired, struct rxd_peer, peer, timer_entry);
+		dlist_init(&peer->timer_entry);
+		rxd_progress_pkt_list(ep, peer);
+		if (peer->active && dlist_empty(&peer->unacked))
+			rxd_progress_tx_list(ep, peer);
+	}
+	ep->next_retry = rxd_timer_next(&ep->timer_wheel);
+}
+
+void rxd_ep_progress(struct util_ep *util_ep)
+{
+	struct fi_cq_msg_entry cq_entry[RXD_CQ_BATCH];
 	struct rxd_ep *ep;
 	ssize_t ret;
-	int i;
+	int i, j, reposts;
 
 	ep = container_of(util_ep, struct rxd_ep, util_ep);
 
@@ -959,7 +1329,7 @@ void rxd_ep_progress(struct util_ep *util_ep)
 	for(ret = 1, i = 0;
 	    ret > 0 && (!rxd_env.spin_count || i < rxd_env.spin_count);
 	    i++) {
-		ret = fi_cq_read(ep->dg_cq, &cq_entry, 1);
+		ret = fi_cq_read(ep->dg_cq, cq_entry, RXD_CQ_BATCH);
 		if (ret == -FI_EAGAIN)
 			break;
 
@@ -968,28 +1338,24 @@ void rxd_ep_progress(struct util_ep *util_ep)
 			continue;
 		}
 
-		if (cq_entry.flags & FI_RECV)
-			rxd_handle_recv_comp(ep, &cq_entry);
-		else
-			rxd_handle_send_comp(ep, &cq_entry);
-	}
-
-	if (!rxd_env.retry)
-		goto out;
-
-	ep->next_retry = -1;
-	dlist_foreach_container_safe(&ep->rts_sent_list, struct rxd_peer,
-				     peer, entry, tmp)
-		rxd_progress_pkt_list(ep, peer);
+		for (j = 0, reposts = 0; j < ret; j++) {
+			if (cq_entry[j].flags & FI_RECV) {
+				rxd_handle_recv_comp(ep, &cq_entry[j]);
+				reposts++;
+			} else {
+				rxd_handle_send_comp(ep, &cq_entry[j]);
+			}
+		}
 
-	dlist_foreach_container_safe(&ep->active_peers, struct rxd_peer,
-				     peer, entry, tmp) {
-		rxd_progress_pkt_list(ep, peer);
-		if (dlist_empty(&peer->unacked))
-			rxd_progress_tx_list(ep, peer);
+		/* replace the burst's receive buffers with one chained post */
+		for (j = 0; j < reposts; j++)
+			rxd_ep_post_buf(ep, j + 1 < reposts ? FI_MORE : 0);
+		rxd_ep_flush_acks(ep);
 	}
 
-out:
+	if (rxd_env.retry)
+		rxd_progress_timers(ep);
+
 	fastlock_release(&ep->util_ep.lock);
 }
 
@@ -1135,6 +1501,8 @@ int rxd_ep_init_res(struct rxd_ep *ep, struct fi_info *fi_info)
 	dlist_init(&ep->unexp_list);
 	dlist_init(&ep->unexp_tag_list);
 	dlist_init(&ep->ctrl_pkts);
+	dlist_init(&ep->ack_list);
+	rxd_timer_init(&ep->timer_wheel, ofi_gettime_ms());
 	slist_init(&ep->rx_pkt_list);
 
 	return 0;
@@ -1152,6 +1520,7 @@ int rxd_create_peer(struct rxd_ep *ep, uint64_t rxd_addr)
 	if (!peer)
 		return -FI_ENOMEM;	
 
+	peer->rxd_addr = rxd_addr;
 	peer->peer_addr = RXD_ADDR_INVALID;
 	peer->tx_seq_no = 0;
 	peer->rx_seq_no = 0;
@@ -1161,12 +1530,23 @@ int rxd_create_peer(struct rxd_ep *ep, uint64_t rxd_addr)
 	peer->tx_window = rxd_env.max_unacked;
 	peer->unacked_cnt = 0;
 	peer->retry_cnt = 0;
+	peer->cwnd = MIN(RXD_INIT_CWND, rxd_env.max_unacked);
+	peer->ssthresh = rxd_env.max_unacked;
+	peer->cwnd_cnt = 0;
+	peer->round_seq = 0;
+	peer->round_acked = 0;
+	peer->round_lost = 0;
+	peer->srtt = 0;
+	peer->rttvar = 0;
+	peer->rto = RXD_MIN_RTO;
 	peer->active = 0;
 	dlist_init(&(peer->unacked));
 	dlist_init(&(peer->tx_list));
 	dlist_init(&(peer->rx_list));
 	dlist_init(&(peer->rma_rx_list));
 	dlist_init(&(peer->buf_pkts));
+	dlist_init(&(peer->timer_entry));
+	dlist_init(&(peer->ack_entry));
 		
 	if (ofi_idm_set(&(ep->peers_idm), rxd_addr, peer) < 0)
 		goto err;
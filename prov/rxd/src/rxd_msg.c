@@ -146,7 +146,8 @@ static int rxd_ep_discard_recv(struct rxd_ep *rxd_ep, void *context,
 	rxd_peer(rxd_ep, unexp_msg->base_hdr->peer)->rx_seq_no =
 			MAX(seq, rxd_peer(rxd_ep, 
 				 unexp_msg->base_hdr->peer)->rx_seq_no);
-	rxd_ep_send_ack(rxd_ep, unexp_msg->base_hdr->peer);
+	rxd_progress_buf_pkts(rxd_ep, unexp_msg->base_hdr->peer);
+	rxd_ep_queue_ack(rxd_ep, unexp_msg->base_hdr->peer);
 
 	ret = ofi_cq_write(rxd_ep->util_ep.rx_cq, context, FI_TAGGED | FI_RECV,
 			   0, NULL, unexp_msg->data_hdr ?
@@ -261,6 +262,7 @@ ssize_t rxd_ep_generic_recvmsg(struct rxd_ep *rxd_ep, const struct iovec *iov,
 	ret = rxd_ep_discard_recv(rxd_ep, context, unexp_msg);
 
 out:
+	rxd_ep_flush_acks(rxd_ep);
 	fastlock_release(&rxd_ep->util_ep.lock);
 	return ret;
 }
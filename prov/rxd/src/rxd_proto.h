@@ -120,11 +120,24 @@ struct rxd_cts_pkt {
 
 /*
  * ACK: to signal received packets and send tx/rx id info
+ * 	- base_hdr.seq_no: next sequence number expected in order
+ * 	- ext_hdr.rx_id: receive window, in packets
+ * 	- sack_cnt/sack: selective ack blocks [start, end) of packets received
+ * 	  out of order past seq_no; only sack_cnt blocks are sent
  */
+#define RXD_MAX_SACK_BLKS	4
+
+struct rxd_sack_blk {
+	uint64_t		start;
+	uint64_t		end;
+};
+
 struct rxd_ack_pkt {
 	struct rxd_base_hdr	base_hdr;
 	struct rxd_ext_hdr	ext_hdr;
-	//TODO fill in more fields? Selective ack?
+	uint32_t		sack_cnt;
+	uint32_t		resv;
+	struct rxd_sack_blk	sack[RXD_MAX_SACK_BLKS];
 };
 
 /*
@@ -56,6 +56,8 @@
 #include <ofi_iov.h>
 #include <ofi_hmem.h>
 
+#include "fi_ext_rxm.h"
+
 #ifndef _RXM_H_
 #define _RXM_H_
 
@@ -132,6 +134,8 @@ extern size_t rxm_cm_progress_interval;
 extern size_t rxm_cq_eq_fairness;
 extern int force_auto_progress;
 extern int rxm_use_write_rndv;
+extern int rxm_adaptive_proto;
+extern int rxm_rndv_rails;
 extern enum fi_wait_obj def_wait_obj, def_tcp_wait_obj;
 
 struct rxm_ep;
@@ -143,6 +147,9 @@ struct rxm_ep;
 
 #define RXM_CMAP_IDX_BITS OFI_IDX_INDEX_BITS
 
+#define RXM_CMAP_SHARD_BITS	10
+#define RXM_CMAP_SHARD_SIZE	(1 << RXM_CMAP_SHARD_BITS)
+
 enum rxm_cmap_signal {
 	RXM_CMAP_UNSPEC,
 	RXM_CMAP_FREE,
@@ -194,13 +201,28 @@ struct rxm_cmap_attr {
 	void 				*name;
 };
 
+/* Top level of the AV handle table.  When an fi_addr falls beyond it, a
+ * larger copy is published in its place.  Replaced directories are kept
+ * on the prev list until the cmap is freed, as lookups may still be
+ * reading them. */
+struct rxm_cmap_dir {
+	struct rxm_cmap_dir	*prev;
+	size_t			shard_cnt;
+	ofi_atomic64_t		shards[];
+};
+
 struct rxm_cmap {
 	struct rxm_ep		*ep;
 	struct util_av		*av;
 
-	/* cmap handles that correspond to addresses in AV */
-	struct rxm_cmap_handle **handles_av;
-	size_t			num_allocated;
+	/* cmap handles that correspond to addresses in AV, indexed by
+	 * fi_addr, in a struct rxm_cmap_dir of shards of
+	 * RXM_CMAP_SHARD_SIZE entries.  Shards are allocated on demand and
+	 * never moved or freed before the cmap, and directories, shards and
+	 * entries are published atomically.  Lookups are lock-free; only
+	 * connection state changes, made with the ep lock held, update the
+	 * table. */
+	ofi_atomic64_t		handles_av;
 
 	/* Store all cmap handles (inclusive of handles_av) in an indexer.
 	 * This allows reverse lookup of the handle using the index. */
@@ -211,9 +233,6 @@ struct rxm_cmap {
 	struct dlist_entry	peer_list;
 	struct rxm_cmap_attr	attr;
 	pthread_t		cm_thread;
-	ofi_fastlock_acquire_t	acquire;
-	ofi_fastlock_release_t	release;
-	fastlock_t		lock;
 };
 
 enum rxm_cmap_reject_reason {
@@ -229,9 +248,12 @@ union rxm_cm_data {
 		uint8_t ctrl_version;
 		uint8_t op_version;
 		uint16_t port;
-		uint8_t padding[2];
+		uint8_t rail;		/* 0 for the main connection */
+		uint8_t padding;
 		uint32_t eager_size;
 		uint32_t rx_size;
+		/* Rail requests carry the server's conn id of the main
+		 * connection instead */
 		uint64_t client_conn_id;
 	} connect;
 
@@ -267,8 +289,21 @@ int rxm_msg_eq_progress(struct rxm_ep *rxm_ep);
 static inline struct rxm_cmap_handle *
 rxm_cmap_acquire_handle(struct rxm_cmap *cmap, fi_addr_t fi_addr)
 {
-	assert(fi_addr < cmap->num_allocated);
-	return cmap->handles_av[fi_addr];
+	struct rxm_cmap_dir *dir;
+	ofi_atomic64_t *shard;
+
+	dir = (struct rxm_cmap_dir *) (uintptr_t)
+	      ofi_atomic_get64(&cmap->handles_av);
+	if (OFI_UNLIKELY((fi_addr >> RXM_CMAP_SHARD_BITS) >= dir->shard_cnt))
+		return NULL;
+
+	shard = (ofi_atomic64_t *) (uintptr_t)
+		ofi_atomic_get64(&dir->shards[fi_addr >> RXM_CMAP_SHARD_BITS]);
+	if (!shard)
+		return NULL;
+
+	return (struct rxm_cmap_handle *) (uintptr_t)
+		ofi_atomic_get64(&shard[fi_addr & (RXM_CMAP_SHARD_SIZE - 1)]);
 }
 
 struct rxm_fabric {
@@ -428,9 +463,13 @@ struct rxm_recv_match_attr {
 };
 
 struct rxm_unexp_msg {
+	/* All unexpected messages, in arrival order */
 	struct dlist_entry entry;
+	/* Unexpected messages with the same (addr, tag) hash */
+	struct dlist_entry hash_entry;
 	fi_addr_t addr;
 	uint64_t tag;
+	uint64_t seq;
 };
 
 struct rxm_iov {
@@ -486,6 +525,7 @@ struct rxm_rx_buf {
 	struct dlist_entry rndv_wait_entry;
 	struct rxm_rndv_hdr *remote_rndv_hdr;
 	size_t rndv_rma_index;
+	size_t rndv_rma_count;
 	struct fid_mr *mr[RXM_IOV_LIMIT];
 
 	/* Must stay at bottom */
@@ -500,12 +540,21 @@ struct rxm_tx_base_buf {
 	struct rxm_pkt pkt;
 };
 
+/* Send start time for adaptive protocol selection; start == 0 if unsampled.
+ * The connection is referenced by key, as it may be freed before the send
+ * completes.  Time spent on the deferred tx queue is added to start. */
+struct rxm_tx_sample {
+	uint64_t conn_key;
+	uint64_t start;
+};
+
 struct rxm_tx_eager_buf {
 	/* Must stay at top */
 	struct rxm_buf hdr;
 
 	void *app_context;
 	uint64_t flags;
+	struct rxm_tx_sample sample;
 
 	/* Must stay at bottom */
 	struct rxm_pkt pkt;
@@ -517,6 +566,7 @@ struct rxm_tx_sar_buf {
 
 	void *app_context;
 	uint64_t flags;
+	struct rxm_tx_sample sample;
 
 	/* Must stay at bottom */
 	struct rxm_pkt pkt;
@@ -528,6 +578,7 @@ struct rxm_tx_rndv_buf {
 
 	void *app_context;
 	uint64_t flags;
+	struct rxm_tx_sample sample;
 	struct fid_mr *mr[RXM_IOV_LIMIT];
 	uint8_t count;
 
@@ -587,6 +638,8 @@ struct rxm_deferred_tx_entry {
 	struct rxm_conn *rxm_conn;
 	struct dlist_entry entry;
 	enum rxm_deferred_tx_entry_type type;
+	/* Set only for adaptive connections */
+	uint64_t queue_time;
 
 	union {
 		struct {
@@ -598,11 +651,13 @@ struct rxm_deferred_tx_entry {
 		} rndv_done;
 		struct {
 			struct rxm_rx_buf *rx_buf;
+			struct fid_ep *msg_ep;
 			struct fi_rma_iov rma_iov;
 			struct rxm_iov rxm_iov;
 		} rndv_read;
 		struct {
 			struct rxm_tx_rndv_buf *tx_buf;
+			struct fid_ep *msg_ep;
 			struct fi_rma_iov rma_iov;
 			struct rxm_iov rxm_iov;
 		} rndv_write;
@@ -638,6 +693,7 @@ struct rxm_deferred_tx_entry {
 
 struct rxm_recv_entry {
 	struct dlist_entry entry;
+	uint64_t seq;
 	struct rxm_iov rxm_iov;
 	fi_addr_t addr;
 	void *context;
@@ -669,12 +725,30 @@ enum rxm_recv_queue_type {
 	RXM_RECV_QUEUE_TAGGED,
 };
 
+/*
+ * Posted receives and unexpected messages are hashed by (addr, tag).  The
+ * address is only part of the key with FI_DIRECTED_RECV, and the tag is
+ * always 0 for the untagged queue.  Receives that can't be hashed, because
+ * they use ignore bits or FI_ADDR_UNSPEC, are kept on recv_wild_list.
+ * Receives are stamped with a sequence number when posted, so that an
+ * incoming message matches the oldest of the first hashed and first
+ * wildcard candidates, preserving posting order.  Unexpected messages are
+ * also kept on unexp_msg_list in arrival order for wildcard receives.
+ */
+#define RXM_MATCH_HASH_MAX	4096
+
 struct rxm_recv_queue {
 	struct rxm_ep		*rxm_ep;
 	enum rxm_recv_queue_type type;
 	struct rxm_recv_fs	*fs;
-	struct dlist_entry	recv_list;
+	struct dlist_entry	*recv_hash;
+	struct dlist_entry	recv_wild_list;
+	struct dlist_entry	*unexp_hash;
 	struct dlist_entry	unexp_msg_list;
+	size_t			hash_mask;
+	uint64_t		recv_seq;
+	uint64_t		unexp_seq;
+	bool			directed;
 	size_t			dyn_rbuf_unexp_cnt;
 	dlist_func_t		*match_recv;
 	dlist_func_t		*match_unexp;
@@ -718,9 +792,30 @@ struct rxm_rndv_ops {
 			size_t count, fi_addr_t remote_addr, uint64_t addr,
 			uint64_t key, void *context);
 	ssize_t (*defer_xfer)(struct rxm_deferred_tx_entry **def_tx_entry,
-			      size_t index, struct iovec *iov,
-			      void *desc[RXM_IOV_LIMIT], size_t count,
-			      void *buf);
+			      struct fid_ep *msg_ep,
+			      const struct fi_rma_iov *rma_iov,
+			      struct iovec *iov, void *desc[RXM_IOV_LIMIT],
+			      size_t count, void *buf);
+};
+
+/*
+ * Progress reads up to RXM_MSG_CQ_BATCH msg CQ entries at a time.  User
+ * completions generated while handling them are staged here and written
+ * to the util CQs with one lock round trip per CQ.
+ */
+#define RXM_MSG_CQ_BATCH	16
+#define RXM_CQ_BATCH_SIZE	(RXM_MSG_CQ_BATCH * 2)
+
+struct rxm_cq_batch_entry {
+	struct util_cq *cq;
+	struct fi_cq_tagged_entry comp;
+	fi_addr_t src;
+};
+
+struct rxm_cq_batch {
+	bool active;
+	size_t count;
+	struct rxm_cq_batch_entry entry[RXM_CQ_BATCH_SIZE];
 };
 
 struct rxm_ep {
@@ -760,6 +855,53 @@ struct rxm_ep {
 
 	struct rxm_eager_ops	*eager_ops;
 	struct rxm_rndv_ops	*rndv_ops;
+
+	struct rxm_cq_batch	cq_batch;
+};
+
+/*
+ * Adaptive protocol selection (FI_OFI_RXM_ADAPTIVE_PROTO).  Sends larger
+ * than 2^RXM_ADAPT_MIN_SHIFT are grouped into power-of-two size classes,
+ * class i covering (2^(MIN_SHIFT + i), 2^(MIN_SHIFT + i + 1)].  Each class
+ * tracks a moving average of the send completion time, in ns per KiB, for
+ * the copy protocols (eager/SAR) and for rendezvous.  Every RXM_ADAPT_PROBE
+ * sends in a class use the protocol not currently preferred, so both
+ * averages stay fresh.  The connection's crossover point is the lower
+ * bound of the first class that prefers rendezvous.
+ */
+#define RXM_ADAPT_MIN_SHIFT	10
+#define RXM_ADAPT_MAX_SHIFT	24
+#define RXM_ADAPT_CLASSES	(RXM_ADAPT_MAX_SHIFT - RXM_ADAPT_MIN_SHIFT)
+#define RXM_ADAPT_PROBE		32
+/* Every RXM_ADAPT_SAMPLE-th send in a class is timed.  Timed copy sends
+ * ask the msg provider for delivery completion, so that both protocols
+ * are measured until the peer acknowledges the data. */
+#define RXM_ADAPT_SAMPLE	8
+
+enum rxm_adapt_proto {
+	RXM_ADAPT_COPY,
+	RXM_ADAPT_RNDV,
+	RXM_ADAPT_PROTO_CNT,
+};
+
+struct rxm_adapt_class {
+	uint64_t cost[RXM_ADAPT_PROTO_CNT];
+	uint32_t sends;
+	bool rndv;
+};
+
+/*
+ * Rendezvous rails (FI_OFI_RXM_RNDV_RAILS).  The connecting side opens
+ * up to RXM_MAX_RAILS - 1 extra msg endpoints to the peer once the main
+ * connection is up.  Rendezvous reads are split into chunks of at least
+ * RXM_RAIL_STRIPE_MIN bytes and spread over all connected rails.
+ */
+#define RXM_MAX_RAILS		8
+#define RXM_RAIL_STRIPE_MIN	(64 * 1024)
+
+struct rxm_rail {
+	struct fid_ep *msg_ep;
+	bool connected;
 };
 
 struct rxm_conn {
@@ -780,8 +922,53 @@ struct rxm_conn {
 	struct dlist_entry sar_deferred_rx_msg_list;
 
 	uint32_t rndv_tx_credits;
+
+	/* Extra connections to the same peer used to stripe rendezvous
+	 * reads.  rail[i] carries rail index i + 1; msg_ep is rail 0. */
+	struct rxm_rail rail[RXM_MAX_RAILS - 1];
+	uint8_t next_rail;
+
+	/* Protocol crossover points; only differ from the endpoint limits
+	 * when adapt is set */
+	size_t eager_limit;
+	size_t sar_limit;
+	struct rxm_adapt_class *adapt;
 };
 
+enum rxm_adapt_proto
+rxm_conn_adapt_select(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
+		      size_t len, uint64_t flags, bool *sample);
+void rxm_conn_adapt_sample(struct rxm_ep *rxm_ep, struct rxm_tx_sample *sample,
+			   size_t len, enum rxm_adapt_proto proto);
+
+static inline void
+rxm_tx_sample_start(struct rxm_conn *rxm_conn, struct rxm_tx_sample *sample,
+		    bool sampled)
+{
+	if (OFI_LIKELY(!sampled)) {
+		sample->start = 0;
+		return;
+	}
+	sample->conn_key = rxm_conn->handle.key;
+	sample->start = ofi_gettime_ns();
+}
+
+/* Leaves the time a send sat on the deferred tx queue out of its sample */
+static inline void
+rxm_tx_sample_resume(struct rxm_tx_sample *sample, uint64_t queue_time)
+{
+	if (OFI_UNLIKELY(sample->start && queue_time))
+		sample->start += ofi_gettime_ns() - queue_time;
+}
+
+static inline void
+rxm_tx_sample_end(struct rxm_ep *rxm_ep, struct rxm_tx_sample *sample,
+		  size_t len, enum rxm_adapt_proto proto)
+{
+	if (OFI_UNLIKELY(sample->start))
+		rxm_conn_adapt_sample(rxm_ep, sample, len, proto);
+}
+
 extern struct fi_provider rxm_prov;
 extern struct fi_fabric_attr rxm_fabric_attr;
 extern struct fi_domain_attr rxm_domain_attr;
@@ -918,15 +1105,44 @@ static inline void rxm_cntr_incerr(struct util_cntr *cntr)
 		cntr->cntr_fid.ops->adderr(&cntr->cntr_fid, 1);
 }
 
+void rxm_cq_batch_flush(struct rxm_ep *rxm_ep);
+
+static inline void
+rxm_cq_batch_add(struct rxm_ep *rxm_ep, struct util_cq *cq, void *context,
+		 uint64_t flags, size_t len, void *buf, uint64_t data,
+		 uint64_t tag, fi_addr_t addr)
+{
+	struct rxm_cq_batch_entry *entry;
+
+	if (rxm_ep->cq_batch.count == RXM_CQ_BATCH_SIZE)
+		rxm_cq_batch_flush(rxm_ep);
+
+	entry = &rxm_ep->cq_batch.entry[rxm_ep->cq_batch.count++];
+	entry->cq = cq;
+	entry->comp.op_context = context;
+	entry->comp.flags = flags;
+	entry->comp.len = len;
+	entry->comp.buf = buf;
+	entry->comp.data = data;
+	entry->comp.tag = tag;
+	entry->src = addr;
+}
+
 static inline void
-rxm_cq_write(struct util_cq *cq, void *context, uint64_t flags, size_t len,
-	     void *buf, uint64_t data, uint64_t tag)
+rxm_cq_write(struct rxm_ep *rxm_ep, struct util_cq *cq, void *context,
+	     uint64_t flags, size_t len, void *buf, uint64_t data, uint64_t tag)
 {
 	int ret;
 
 	FI_DBG(&rxm_prov, FI_LOG_CQ, "Reporting %s completion\n",
 	       fi_tostr((void *) &flags, FI_TYPE_CQ_EVENT_FLAGS));
 
+	if (rxm_ep->cq_batch.active) {
+		rxm_cq_batch_add(rxm_ep, cq, context, flags, len, buf, data,
+				 tag, FI_ADDR_NOTAVAIL);
+		return;
+	}
+
 	ret = ofi_cq_write(cq, context, flags, len, buf, data, tag);
 	if (ret) {
 		FI_WARN(&rxm_prov, FI_LOG_CQ,
@@ -936,14 +1152,21 @@ rxm_cq_write(struct util_cq *cq, void *context, uint64_t flags, size_t len,
 }
 
 static inline void
-rxm_cq_write_src(struct util_cq *cq, void *context, uint64_t flags, size_t len,
-		 void *buf, uint64_t data, uint64_t tag, fi_addr_t addr)
+rxm_cq_write_src(struct rxm_ep *rxm_ep, struct util_cq *cq, void *context,
+		 uint64_t flags, size_t len, void *buf, uint64_t data,
+		 uint64_t tag, fi_addr_t addr)
 {
 	int ret;
 
 	FI_DBG(&rxm_prov, FI_LOG_CQ, "Reporting %s completion\n",
 	       fi_tostr((void *) &flags, FI_TYPE_CQ_EVENT_FLAGS));
 
+	if (rxm_ep->cq_batch.active) {
+		rxm_cq_batch_add(rxm_ep, cq, context, flags, len, buf, data,
+				 tag, addr);
+		return;
+	}
+
 	ret = ofi_cq_write_src(cq, context, flags, len, buf, data, tag, addr);
 	if (ret) {
 		FI_WARN(&rxm_prov, FI_LOG_CQ,
@@ -1001,17 +1224,53 @@ rxm_recv_entry_release(struct rxm_recv_queue *queue, struct rxm_recv_entry *entr
 	ofi_freestack_push(queue->fs, entry);
 }
 
+static inline size_t
+rxm_match_hash(struct rxm_recv_queue *queue, fi_addr_t addr, uint64_t tag)
+{
+	uint64_t key;
+
+	key = (queue->directed ? addr : 0) * 0x9e3779b97f4a7c15ULL ^ tag;
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+	return (size_t) key & queue->hash_mask;
+}
+
+static inline bool
+rxm_recv_is_wild(struct rxm_recv_queue *queue, fi_addr_t addr, uint64_t ignore)
+{
+	return ignore || (queue->directed && addr == FI_ADDR_UNSPEC);
+}
+
+static inline void rxm_unexp_msg_remove(struct rxm_rx_buf *rx_buf)
+{
+	dlist_remove(&rx_buf->unexp_msg.entry);
+	dlist_remove(&rx_buf->unexp_msg.hash_entry);
+}
+
+void rxm_recv_queue_insert(struct rxm_recv_queue *queue,
+			   struct rxm_recv_entry *recv_entry);
+void rxm_recv_queue_requeue(struct rxm_recv_queue *queue,
+			    struct rxm_recv_entry *recv_entry);
+struct rxm_recv_entry *
+rxm_recv_queue_match(struct rxm_recv_queue *queue,
+		     struct rxm_recv_match_attr *match_attr);
+void rxm_unexp_msg_insert(struct rxm_recv_queue *queue,
+			  struct rxm_rx_buf *rx_buf);
+void rxm_unexp_msg_rehash(struct rxm_recv_queue *queue,
+			  struct rxm_rx_buf *rx_buf);
+
 static inline void
 rxm_cq_write_recv_comp(struct rxm_rx_buf *rx_buf, void *context, uint64_t flags,
 		       size_t len, char *buf)
 {
 	if (rx_buf->ep->rxm_info->caps & FI_SOURCE)
-		rxm_cq_write_src(rx_buf->ep->util_ep.rx_cq, context,
+		rxm_cq_write_src(rx_buf->ep, rx_buf->ep->util_ep.rx_cq, context,
 				 flags, len, buf, rx_buf->pkt.hdr.data,
 				 rx_buf->pkt.hdr.tag,
 				 rx_buf->conn->handle.fi_addr);
 	else
-		rxm_cq_write(rx_buf->ep->util_ep.rx_cq, context,
+		rxm_cq_write(rx_buf->ep, rx_buf->ep->util_ep.rx_cq, context,
 			     flags, len, buf, rx_buf->pkt.hdr.data,
 			     rx_buf->pkt.hdr.tag);
 }
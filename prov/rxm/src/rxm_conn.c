@@ -42,6 +42,7 @@
 static struct rxm_cmap_handle *rxm_conn_alloc(struct rxm_cmap *cmap);
 static int rxm_conn_connect(struct rxm_ep *ep,
 			    struct rxm_cmap_handle *handle, const void *addr);
+static void rxm_conn_open_rails(struct rxm_ep *ep, struct rxm_conn *rxm_conn);
 static int rxm_conn_signal(struct rxm_ep *ep, void *context,
 			   enum rxm_cmap_signal signal);
 static void rxm_conn_av_updated_handler(struct rxm_cmap_handle *handle);
@@ -206,28 +207,86 @@ ssize_t rxm_get_conn(struct rxm_ep *rxm_ep, fi_addr_t addr,
 	return 0;
 }
 
-static inline int
-rxm_cmap_check_and_realloc_handles_table(struct rxm_cmap *cmap,
-					 fi_addr_t fi_addr)
+/* Copy the shard pointers of prev, if any, into a new directory */
+static struct rxm_cmap_dir *
+rxm_cmap_alloc_dir(struct rxm_cmap_dir *prev, size_t shard_cnt)
 {
-	void *new_handles;
-	size_t grow_size;
+	struct rxm_cmap_dir *dir;
+	int64_t shard;
+	size_t i;
 
-	if (OFI_LIKELY(fi_addr < cmap->num_allocated))
-		return 0;
+	dir = malloc(sizeof(*dir) + shard_cnt * sizeof(dir->shards[0]));
+	if (!dir)
+		return NULL;
 
-	grow_size = MAX(ofi_av_size(cmap->av), fi_addr - cmap->num_allocated + 1);
+	dir->prev = prev;
+	dir->shard_cnt = shard_cnt;
+	for (i = 0; i < shard_cnt; i++) {
+		shard = (prev && i < prev->shard_cnt) ?
+			ofi_atomic_get64(&prev->shards[i]) : 0;
+		ofi_atomic_initialize64(&dir->shards[i], shard);
+	}
+	return dir;
+}
 
-	new_handles = realloc(cmap->handles_av,
-			      (grow_size + cmap->num_allocated) *
-			      sizeof(*cmap->handles_av));
-	if (OFI_LIKELY(!new_handles))
-		return -FI_ENOMEM;
+/* Free the shards and every directory of the AV handle table */
+static void rxm_cmap_free_dir(struct rxm_cmap *cmap)
+{
+	struct rxm_cmap_dir *dir, *prev;
+	size_t i;
+
+	dir = (struct rxm_cmap_dir *) (uintptr_t)
+	      ofi_atomic_get64(&cmap->handles_av);
+
+	for (i = 0; i < dir->shard_cnt; i++)
+		free((void *) (uintptr_t) ofi_atomic_get64(&dir->shards[i]));
+
+	for (; dir; dir = prev) {
+		prev = dir->prev;
+		free(dir);
+	}
+}
+
+static int rxm_cmap_set_handle(struct rxm_cmap *cmap, fi_addr_t fi_addr,
+			       struct rxm_cmap_handle *handle)
+{
+	struct rxm_cmap_dir *dir;
+	ofi_atomic64_t *shard;
+	size_t shard_idx = fi_addr >> RXM_CMAP_SHARD_BITS;
+	int i;
+
+	dir = (struct rxm_cmap_dir *) (uintptr_t)
+	      ofi_atomic_get64(&cmap->handles_av);
+	if (shard_idx >= dir->shard_cnt) {
+		if (!handle)
+			return 0;
+
+		dir = rxm_cmap_alloc_dir(dir, MAX(dir->shard_cnt << 1,
+						  shard_idx + 1));
+		if (!dir)
+			return -FI_ENOMEM;
+
+		ofi_atomic_set64(&cmap->handles_av, (uintptr_t) dir);
+	}
+
+	shard = (ofi_atomic64_t *) (uintptr_t)
+		ofi_atomic_get64(&dir->shards[shard_idx]);
+	if (!shard) {
+		if (!handle)
+			return 0;
+
+		shard = calloc(RXM_CMAP_SHARD_SIZE, sizeof(*shard));
+		if (!shard)
+			return -FI_ENOMEM;
+
+		for (i = 0; i < RXM_CMAP_SHARD_SIZE; i++)
+			ofi_atomic_initialize64(&shard[i], 0);
+		ofi_atomic_set64(&dir->shards[shard_idx], (uintptr_t) shard);
+	}
 
-	cmap->handles_av = new_handles;
-	memset(&cmap->handles_av[cmap->num_allocated], 0,
-	       sizeof(*cmap->handles_av) * grow_size);
-	cmap->num_allocated += grow_size;
+	/* The handle must be fully initialized before it is published */
+	ofi_atomic_set64(&shard[fi_addr & (RXM_CMAP_SHARD_SIZE - 1)],
+			 (uintptr_t) handle);
 	return 0;
 }
 
@@ -252,8 +311,151 @@ rxm_conn_inject_pkt_alloc(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 	return inject_pkt;
 }
 
+static bool rxm_conn_sar_enabled(struct rxm_ep *rxm_ep)
+{
+	/* SAR uses eager_limit as segment size */
+	return rxm_ep->sar_limit > rxm_eager_limit &&
+	       rxm_eager_limit <
+	       (1ULL << (8 * sizeof_field(struct ofi_ctrl_hdr, seg_size)));
+}
+
+static size_t rxm_adapt_class_size(int i)
+{
+	return (size_t) 1 << (RXM_ADAPT_MIN_SHIFT + i);
+}
+
+static int rxm_adapt_class_idx(size_t len)
+{
+	assert(len > rxm_adapt_class_size(0));
+	return MIN(ofi_msb(len - 1) - 1 - RXM_ADAPT_MIN_SHIFT,
+		   RXM_ADAPT_CLASSES - 1);
+}
+
+static size_t rxm_conn_def_xover(struct rxm_ep *rxm_ep)
+{
+	return rxm_conn_sar_enabled(rxm_ep) ? rxm_ep->sar_limit :
+					      rxm_eager_limit;
+}
+
+static void rxm_conn_set_limits(struct rxm_ep *rxm_ep,
+				struct rxm_conn *rxm_conn, size_t xover)
+{
+	rxm_conn->eager_limit = MIN(xover, rxm_eager_limit);
+	rxm_conn->sar_limit = rxm_conn_sar_enabled(rxm_ep) ?
+			      MAX(xover, rxm_conn->eager_limit) :
+			      rxm_conn->eager_limit;
+}
+
+static void rxm_conn_adapt_update(struct rxm_ep *rxm_ep,
+				  struct rxm_conn *rxm_conn)
+{
+	size_t xover;
+	int i;
+
+	for (i = 0; i < RXM_ADAPT_CLASSES; i++) {
+		if (rxm_conn->adapt[i].rndv)
+			break;
+	}
+
+	xover = (i < RXM_ADAPT_CLASSES) ? rxm_adapt_class_size(i) :
+		MAX(rxm_conn_def_xover(rxm_ep),
+		    (size_t) 1 << RXM_ADAPT_MAX_SHIFT);
+	rxm_conn_set_limits(rxm_ep, rxm_conn, xover);
+
+	FI_DBG(&rxm_prov, FI_LOG_EP_DATA, "conn %p: eager limit %zu, "
+	       "SAR limit %zu\n", rxm_conn, rxm_conn->eager_limit,
+	       rxm_conn->sar_limit);
+}
+
+enum rxm_adapt_proto
+rxm_conn_adapt_select(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
+		      size_t len, uint64_t flags, bool *sample)
+{
+	struct rxm_adapt_class *class;
+	enum rxm_adapt_proto proto;
+	bool copy_ok;
+
+	*sample = false;
+	proto = (len <= rxm_conn->sar_limit) ? RXM_ADAPT_COPY : RXM_ADAPT_RNDV;
+	if ((flags & FI_INJECT) || len <= rxm_adapt_class_size(0))
+		return proto;
+
+	class = &rxm_conn->adapt[rxm_adapt_class_idx(len)];
+	++class->sends;
+	*sample = !(class->sends % RXM_ADAPT_SAMPLE);
+	if (class->sends % RXM_ADAPT_PROBE)
+		return proto;
+
+	copy_ok = len <= rxm_eager_limit || (rxm_conn_sar_enabled(rxm_ep) &&
+		  len <= MAX(rxm_ep->sar_limit,
+			     (size_t) 1 << RXM_ADAPT_MAX_SHIFT));
+	if (proto == RXM_ADAPT_COPY)
+		return RXM_ADAPT_RNDV;
+	return copy_ok ? RXM_ADAPT_COPY : RXM_ADAPT_RNDV;
+}
+
+void rxm_conn_adapt_sample(struct rxm_ep *rxm_ep, struct rxm_tx_sample *sample,
+			   size_t len, enum rxm_adapt_proto proto)
+{
+	struct rxm_adapt_class *class;
+	struct rxm_conn *rxm_conn;
+	uint64_t cost, copy, rndv;
+	bool prefer_rndv;
+
+	rxm_conn = rxm_key2conn(rxm_ep, sample->conn_key);
+	if (!rxm_conn || !rxm_conn->adapt || len <= rxm_adapt_class_size(0))
+		return;
+
+	class = &rxm_conn->adapt[rxm_adapt_class_idx(len)];
+	cost = MAX((ofi_gettime_ns() - sample->start) * 1024 / len, 1);
+	if (class->cost[proto]) {
+		class->cost[proto] = (int64_t) class->cost[proto] +
+			((int64_t) cost - (int64_t) class->cost[proto]) / 8;
+	} else {
+		class->cost[proto] = cost;
+	}
+
+	copy = class->cost[RXM_ADAPT_COPY];
+	rndv = class->cost[RXM_ADAPT_RNDV];
+	if (!copy || !rndv)
+		return;
+
+	/* Require a 1/8 advantage before switching to avoid flapping */
+	prefer_rndv = class->rndv ? (copy + copy / 8 >= rndv) :
+				    (rndv + rndv / 8 < copy);
+	if (prefer_rndv != class->rndv) {
+		class->rndv = prefer_rndv;
+		rxm_conn_adapt_update(rxm_ep, rxm_conn);
+	}
+}
+
+static void rxm_conn_adapt_free(struct rxm_conn *rxm_conn)
+{
+	free(rxm_conn->adapt);
+	rxm_conn->adapt = NULL;
+}
+
+static int rxm_conn_adapt_init(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn)
+{
+	size_t xover = rxm_conn_def_xover(rxm_ep);
+	int i;
+
+	rxm_conn_set_limits(rxm_ep, rxm_conn, xover);
+	if (!rxm_adaptive_proto)
+		return 0;
+
+	rxm_conn->adapt = calloc(RXM_ADAPT_CLASSES, sizeof(*rxm_conn->adapt));
+	if (!rxm_conn->adapt)
+		return -FI_ENOMEM;
+
+	for (i = 0; i < RXM_ADAPT_CLASSES; i++)
+		rxm_conn->adapt[i].rndv = rxm_adapt_class_size(i) >= xover;
+	return 0;
+}
+
 static void rxm_conn_res_free(struct rxm_conn *rxm_conn)
 {
+	rxm_conn_adapt_free(rxm_conn);
 	ofi_freealign(rxm_conn->inject_pkt);
 	rxm_conn->inject_pkt = NULL;
 	ofi_freealign(rxm_conn->inject_data_pkt);
@@ -271,6 +473,12 @@ static int rxm_conn_res_alloc(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn)
 	dlist_init(&rxm_conn->sar_rx_msg_list);
 	dlist_init(&rxm_conn->sar_deferred_rx_msg_list);
 
+	if (rxm_conn_adapt_init(rxm_ep, rxm_conn)) {
+		FI_WARN(&rxm_prov, FI_LOG_EP_CTRL, "unable to allocate "
+			"protocol statistics for connection\n");
+		return -FI_ENOMEM;
+	}
+
 	if (rxm_ep->util_ep.domain->threading != FI_THREAD_SAFE) {
 		rxm_conn->inject_pkt =
 			rxm_conn_inject_pkt_alloc(rxm_ep, rxm_conn,
@@ -296,12 +504,25 @@ static int rxm_conn_res_alloc(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn)
 	return 0;
 }
 
+static void rxm_conn_close_rail(struct rxm_rail *rail)
+{
+	if (!rail->msg_ep)
+		return;
+
+	if (fi_close(&rail->msg_ep->fid))
+		FI_WARN(&rxm_prov, FI_LOG_EP_CTRL, "unable to close rail msg_ep\n");
+
+	rail->msg_ep = NULL;
+	rail->connected = false;
+}
+
 static void rxm_conn_close(struct rxm_cmap_handle *handle)
 {
 	struct rxm_conn *rxm_conn = container_of(handle, struct rxm_conn, handle);
 	struct rxm_conn *rxm_conn_tmp;
 	struct rxm_deferred_tx_entry *def_tx_entry;
 	struct dlist_entry *conn_entry_tmp;
+	int i;
 
 	dlist_foreach_container_safe(&handle->cmap->ep->deferred_tx_conn_queue,
 				     struct rxm_conn, rxm_conn_tmp,
@@ -321,6 +542,9 @@ static void rxm_conn_close(struct rxm_cmap_handle *handle)
 		}
 	}
 
+	for (i = 0; i < RXM_MAX_RAILS - 1; i++)
+		rxm_conn_close_rail(&rxm_conn->rail[i]);
+
 	FI_DBG(&rxm_prov, FI_LOG_EP_CTRL, "closing msg ep\n");
 	if (!rxm_conn->msg_ep)
 		return;
@@ -354,14 +578,13 @@ int rxm_cmap_alloc_handle(struct rxm_cmap *cmap, fi_addr_t fi_addr,
 	       "Allocated handle: %p for fi_addr: %" PRIu64 "\n",
 	       *handle, fi_addr);
 
-	ret = rxm_cmap_check_and_realloc_handles_table(cmap, fi_addr);
+	rxm_cmap_init_handle(*handle, cmap, state, fi_addr, NULL);
+	ret = rxm_cmap_set_handle(cmap, fi_addr, *handle);
 	if (ret) {
+		rxm_cmap_clear_key(*handle);
 		rxm_conn_free(*handle);
 		return ret;
 	}
-
-	rxm_cmap_init_handle(*handle, cmap, state, fi_addr, NULL);
-	cmap->handles_av[fi_addr] = *handle;
 	return 0;
 }
 
@@ -415,7 +638,7 @@ int rxm_cmap_remove(struct rxm_cmap *cmap, int index)
 	struct rxm_cmap_handle *handle;
 	int ret = -FI_ENOENT;
 
-	handle = cmap->handles_av[index];
+	handle = rxm_cmap_acquire_handle(cmap, index);
 	if (!handle) {
 		FI_WARN(&rxm_prov, FI_LOG_EP_CTRL, "cmap entry not found\n");
 		return ret;
@@ -430,7 +653,7 @@ int rxm_cmap_remove(struct rxm_cmap *cmap, int index)
 		return ret;
 	}
 	handle->fi_addr = FI_ADDR_NOTAVAIL;
-	cmap->handles_av[index] = NULL;
+	rxm_cmap_set_handle(cmap, index, NULL);
 	handle->peer->handle = handle;
 	memcpy(handle->peer->addr, ofi_av_get_addr(cmap->av, index),
 	       cmap->av->addrlen);
@@ -441,17 +664,11 @@ int rxm_cmap_remove(struct rxm_cmap *cmap, int index)
 static int rxm_cmap_move_handle(struct rxm_cmap_handle *handle,
 				fi_addr_t fi_addr)
 {
-	int ret;
-
 	dlist_remove(&handle->peer->entry);
 	free(handle->peer);
 	handle->peer = NULL;
 	handle->fi_addr = fi_addr;
-	ret = rxm_cmap_check_and_realloc_handles_table(handle->cmap, fi_addr);
-	if (OFI_UNLIKELY(ret))
-		return ret;
-	handle->cmap->handles_av[fi_addr] = handle;
-	return 0;
+	return rxm_cmap_set_handle(handle->cmap, fi_addr, handle);
 }
 
 int rxm_cmap_update(struct rxm_cmap *cmap, const void *addr, fi_addr_t fi_addr)
@@ -462,11 +679,8 @@ int rxm_cmap_update(struct rxm_cmap *cmap, const void *addr, fi_addr_t fi_addr)
 	/* Check whether we have already allocated a handle for this `fi_addr`. */
 	/* We rely on the fact that `ofi_ip_av_insert`/`ofi_av_insert_addr` returns
 	 * the same `fi_addr` for the equal addresses */
-	if (fi_addr < cmap->num_allocated) {
-		handle = rxm_cmap_acquire_handle(cmap, fi_addr);
-		if (handle)
-			return 0;
-	}
+	if (rxm_cmap_acquire_handle(cmap, fi_addr))
+		return 0;
 
 	handle = rxm_cmap_get_handle_peer(cmap, addr);
 	if (!handle) {
@@ -741,19 +955,34 @@ static int rxm_cmap_cm_thread_close(struct rxm_cmap *cmap)
 
 void rxm_cmap_free(struct rxm_cmap *cmap)
 {
+	struct rxm_cmap_handle *handle;
 	struct rxm_cmap_peer *peer;
 	struct dlist_entry *entry;
-	size_t i;
+	struct rxm_cmap_dir *dir;
+	ofi_atomic64_t *shard;
+	size_t i, j;
 
 	FI_INFO(cmap->av->prov, FI_LOG_EP_CTRL, "Closing cmap\n");
 	rxm_cmap_cm_thread_close(cmap);
 
-	for (i = 0; i < cmap->num_allocated; i++) {
-		if (cmap->handles_av[i]) {
-			rxm_cmap_clear_key(cmap->handles_av[i]);
-			rxm_conn_free(cmap->handles_av[i]);
+	dir = (struct rxm_cmap_dir *) (uintptr_t)
+	      ofi_atomic_get64(&cmap->handles_av);
+	for (i = 0; i < dir->shard_cnt; i++) {
+		shard = (ofi_atomic64_t *) (uintptr_t)
+			ofi_atomic_get64(&dir->shards[i]);
+		if (!shard)
+			continue;
+
+		for (j = 0; j < RXM_CMAP_SHARD_SIZE; j++) {
+			handle = (struct rxm_cmap_handle *) (uintptr_t)
+				 ofi_atomic_get64(&shard[j]);
+			if (handle) {
+				rxm_cmap_clear_key(handle);
+				rxm_conn_free(handle);
+			}
 		}
 	}
+	rxm_cmap_free_dir(cmap);
 
 	while (!dlist_empty(&cmap->peer_list)) {
 		entry = cmap->peer_list.next;
@@ -764,7 +993,6 @@ void rxm_cmap_free(struct rxm_cmap *cmap)
 		free(peer);
 	}
 
-	free(cmap->handles_av);
 	free(cmap->attr.name);
 	ofi_idx_reset(&cmap->handles_idx);
 	free(cmap);
@@ -787,6 +1015,7 @@ int rxm_cmap_alloc(struct rxm_ep *rxm_ep, struct rxm_cmap_attr *attr)
 {
 	struct rxm_cmap *cmap;
 	struct util_ep *ep = &rxm_ep->util_ep;
+	struct rxm_cmap_dir *dir;
 	int ret;
 
 	cmap = calloc(1, sizeof *cmap);
@@ -796,12 +1025,13 @@ int rxm_cmap_alloc(struct rxm_ep *rxm_ep, struct rxm_cmap_attr *attr)
 	cmap->ep = rxm_ep;
 	cmap->av = ep->av;
 
-	cmap->handles_av = calloc(ofi_av_size(ep->av), sizeof(*cmap->handles_av));
-	if (!cmap->handles_av) {
+	dir = rxm_cmap_alloc_dir(NULL, MAX(ofi_div_ceil(ofi_av_size(ep->av),
+						       RXM_CMAP_SHARD_SIZE), 1));
+	if (!dir) {
 		ret = -FI_ENOMEM;
 		goto err1;
 	}
-	cmap->num_allocated = ofi_av_size(ep->av);
+	ofi_atomic_initialize64(&cmap->handles_av, (uintptr_t) dir);
 
 	cmap->attr = *attr;
 	cmap->attr.name = mem_dup(attr->name, ep->av->addrlen);
@@ -844,14 +1074,16 @@ err3:
 	rxm_ep->cmap = NULL;
 	free(cmap->attr.name);
 err2:
-	free(cmap->handles_av);
+	rxm_cmap_free_dir(cmap);
 err1:
 	free(cmap);
 	return ret;
 }
 
+/* Rails only carry RMA, so they are not flow controlled and get no
+ * receive buffers of their own. */
 static int rxm_msg_ep_open(struct rxm_ep *rxm_ep, struct fi_info *msg_info,
-			   struct rxm_conn *rxm_conn, void *context)
+			   void *context, bool rail, struct fid_ep **ep)
 {
 	struct rxm_domain *rxm_domain;
 	struct fid_ep *msg_ep;
@@ -898,6 +1130,9 @@ static int rxm_msg_ep_open(struct rxm_ep *rxm_ep, struct fi_info *msg_info,
 		goto err;
 	}
 
+	if (rail)
+		goto out;
+
 	ret = rxm_domain->flow_ctrl_ops->enable(msg_ep);
 	if (!ret) {
 		rxm_domain->flow_ctrl_ops->set_threshold(
@@ -909,8 +1144,8 @@ static int rxm_msg_ep_open(struct rxm_ep *rxm_ep, struct fi_info *msg_info,
 		if (ret)
 			goto err;
 	}
-
-	rxm_conn->msg_ep = msg_ep;
+out:
+	*ep = msg_ep;
 	return 0;
 err:
 	fi_close(&msg_ep->fid);
@@ -920,7 +1155,7 @@ err:
 static int rxm_conn_reprocess_directed_recvs(struct rxm_recv_queue *recv_queue)
 {
 	struct rxm_rx_buf *rx_buf;
-	struct dlist_entry *entry, *tmp_entry;
+	struct dlist_entry *tmp_entry;
 	struct rxm_recv_match_attr match_attr;
 	struct fi_cq_err_entry err_entry = {0};
 	int ret, count = 0;
@@ -937,15 +1172,14 @@ static int rxm_conn_reprocess_directed_recvs(struct rxm_recv_queue *recv_queue)
 		match_attr.addr = rx_buf->unexp_msg.addr;
 		match_attr.tag = rx_buf->unexp_msg.tag;
 
-		entry = dlist_remove_first_match(&recv_queue->recv_list,
-						 recv_queue->match_recv,
-						 &match_attr);
-		if (!entry)
+		rx_buf->recv_entry = rxm_recv_queue_match(recv_queue,
+							  &match_attr);
+		if (!rx_buf->recv_entry) {
+			rxm_unexp_msg_rehash(recv_queue, rx_buf);
 			continue;
+		}
 
-		dlist_remove(&rx_buf->unexp_msg.entry);
-		rx_buf->recv_entry = container_of(entry, struct rxm_recv_entry,
-						  entry);
+		rxm_unexp_msg_remove(rx_buf);
 
 		ret = rxm_handle_rx_buf(rx_buf);
 		if (ret) {
@@ -1060,6 +1294,67 @@ static size_t rxm_conn_get_rx_size(struct rxm_ep *rxm_ep,
 		return msg_info->rx_attr->size;
 }
 
+/*
+ * A rail joins an existing connection, so it bypasses the cmap state
+ * machine.  The request names the main connection by our own key.
+ */
+static int
+rxm_msg_process_rail_connreq(struct rxm_ep *rxm_ep, struct fi_info *msg_info,
+			     union rxm_cm_data *remote_cm_data)
+{
+	union rxm_cm_data cm_data = { 0 };
+	union rxm_cm_data reject_cm_data = {
+		.reject = {
+			.version = RXM_CM_DATA_VERSION,
+			.reason = RXM_CMAP_REJECT_GENUINE,
+		}
+	};
+	struct rxm_cmap_handle *handle;
+	struct rxm_conn *rxm_conn;
+	struct rxm_rail *rail;
+	uint8_t index = remote_cm_data->connect.rail;
+	int ret;
+
+	handle = rxm_cmap_key2handle(rxm_ep->cmap,
+				     remote_cm_data->connect.client_conn_id);
+	if (!handle || index >= RXM_MAX_RAILS ||
+	    (handle->state != RXM_CMAP_CONNREQ_RECV &&
+	     handle->state != RXM_CMAP_CONNECTED)) {
+		FI_WARN(&rxm_prov, FI_LOG_EP_CTRL,
+			"rejecting rail %d: no matching connection\n", index);
+		ret = -FI_EINVAL;
+		goto reject;
+	}
+
+	rxm_conn = container_of(handle, struct rxm_conn, handle);
+	rail = &rxm_conn->rail[index - 1];
+	if (rail->msg_ep) {
+		ret = -FI_EALREADY;
+		goto reject;
+	}
+
+	ret = rxm_msg_ep_open(rxm_ep, msg_info, handle, true, &rail->msg_ep);
+	if (ret)
+		goto reject;
+
+	cm_data.accept.server_conn_id = handle->key;
+	cm_data.accept.rx_size = rxm_conn_get_rx_size(rxm_ep, msg_info);
+
+	ret = fi_accept(rail->msg_ep, &cm_data.accept.server_conn_id,
+			sizeof(cm_data.accept));
+	if (ret) {
+		FI_WARN(&rxm_prov, FI_LOG_EP_CTRL,
+			"Unable to accept incoming rail connection\n");
+		rxm_conn_close_rail(rail);
+		goto reject;
+	}
+	return 0;
+reject:
+	fi_reject(rxm_ep->msg_pep, msg_info->handle,
+		  &reject_cm_data.reject, sizeof(reject_cm_data.reject));
+	return ret;
+}
+
 static int
 rxm_msg_process_connreq(struct rxm_ep *rxm_ep, struct fi_info *msg_info,
 			union rxm_cm_data *remote_cm_data)
@@ -1094,6 +1389,10 @@ rxm_msg_process_connreq(struct rxm_ep *rxm_ep, struct fi_info *msg_info,
 		goto err1;
 	}
 
+	if (remote_cm_data->connect.rail)
+		return rxm_msg_process_rail_connreq(rxm_ep, msg_info,
+						    remote_cm_data);
+
 	memcpy(&remote_pep_addr, msg_info->dest_addr, msg_info->dest_addrlen);
 	ofi_addr_set_port((struct sockaddr *)&remote_pep_addr,
 			  remote_cm_data->connect.port);
@@ -1109,7 +1408,8 @@ rxm_msg_process_connreq(struct rxm_ep *rxm_ep, struct fi_info *msg_info,
 	rxm_conn->rndv_tx_credits = remote_cm_data->connect.rx_size;
 	assert(rxm_conn->rndv_tx_credits);
 
-	ret = rxm_msg_ep_open(rxm_ep, msg_info, rxm_conn, handle);
+	ret = rxm_msg_ep_open(rxm_ep, msg_info, handle, false,
+			      &rxm_conn->msg_ep);
 	if (ret)
 		goto err2;
 
@@ -1187,7 +1487,7 @@ static int rxm_conn_handle_notify(struct fi_eq_entry *eq_entry)
 		free(handle->peer);
 		handle->peer = NULL;
 	} else {
-		cmap->handles_av[handle->fi_addr] = NULL;
+		rxm_cmap_set_handle(cmap, handle->fi_addr, NULL);
 	}
 	rxm_conn_free(handle);
 	return 0;
@@ -1244,9 +1544,53 @@ rxm_conn_handle_reject(struct rxm_ep *rxm_ep, struct rxm_msg_eq_entry *entry)
 	return 0;
 }
 
+/* Returns true if the event was for one of the connection's rails */
+static bool
+rxm_conn_handle_rail_event(struct rxm_ep *rxm_ep, struct rxm_msg_eq_entry *entry)
+{
+	struct rxm_conn *rxm_conn;
+	struct fid *fid;
+	int i;
+
+	if (entry->rd == -FI_ECONNREFUSED)
+		fid = entry->err_entry.fid;
+	else if (entry->event == FI_CONNECTED || entry->event == FI_SHUTDOWN)
+		fid = entry->cm_entry.fid;
+	else
+		return false;
+
+	if (!fid->context)
+		return false;
+	rxm_conn = container_of(fid->context, struct rxm_conn, handle);
+
+	for (i = 0; i < RXM_MAX_RAILS - 1; i++) {
+		if (rxm_conn->rail[i].msg_ep &&
+		    &rxm_conn->rail[i].msg_ep->fid == fid)
+			break;
+	}
+	if (i == RXM_MAX_RAILS - 1)
+		return false;
+
+	if (entry->rd == -FI_ECONNREFUSED) {
+		FI_WARN(&rxm_prov, FI_LOG_EP_CTRL,
+			"rail %d rejected by peer\n", i + 1);
+		rxm_conn_close_rail(&rxm_conn->rail[i]);
+	} else if (entry->event == FI_CONNECTED) {
+		FI_DBG(&rxm_prov, FI_LOG_EP_CTRL, "rail %d connected\n", i + 1);
+		rxm_conn->rail[i].connected = true;
+	} else {
+		FI_DBG(&rxm_prov, FI_LOG_EP_CTRL, "rail %d shutdown\n", i + 1);
+		rxm_conn->rail[i].connected = false;
+	}
+	return true;
+}
+
 static int
 rxm_conn_handle_event(struct rxm_ep *rxm_ep, struct rxm_msg_eq_entry *entry)
 {
+	if (rxm_conn_handle_rail_event(rxm_ep, entry))
+		return 0;
+
 	if (entry->rd == -FI_ECONNREFUSED)
 		return rxm_conn_handle_reject(rxm_ep, entry);
 
@@ -1277,6 +1621,10 @@ rxm_conn_handle_event(struct rxm_ep *rxm_ep, struct rxm_msg_eq_entry *entry)
 			entry->cm_entry.fid->context,
 			entry->rd - sizeof(entry->cm_entry) > 0 ?
 			(union rxm_cm_data *) entry->cm_entry.data : NULL);
+		if (entry->rd - sizeof(entry->cm_entry) > 0)
+			rxm_conn_open_rails(rxm_ep,
+				container_of(entry->cm_entry.fid->context,
+					     struct rxm_conn, handle));
 		rxm_conn_wake_up_wait_obj(rxm_ep);
 		break;
 	case FI_SHUTDOWN:
@@ -1481,6 +1829,20 @@ static int rxm_prepare_cm_data(struct fid_pep *pep, struct rxm_cmap_handle *hand
 	return 0;
 }
 
+static int rxm_msg_info_set_dest(struct rxm_ep *ep, const void *addr)
+{
+	free(ep->msg_info->dest_addr);
+	ep->msg_info->dest_addrlen = ep->msg_info->src_addrlen;
+
+	ep->msg_info->dest_addr = mem_dup(addr, ep->msg_info->dest_addrlen);
+	if (!ep->msg_info->dest_addr) {
+		FI_WARN(&rxm_prov, FI_LOG_EP_CTRL, "mem_dup failed, len %zu\n",
+			ep->msg_info->dest_addrlen);
+		return -FI_ENOMEM;
+	}
+	return 0;
+}
+
 static int
 rxm_conn_connect(struct rxm_ep *ep, struct rxm_cmap_handle *handle,
 		 const void *addr)
@@ -1501,17 +1863,12 @@ rxm_conn_connect(struct rxm_ep *ep, struct rxm_cmap_handle *handle,
 	assert(sizeof(uint32_t) == sizeof(cm_data.connect.rx_size));
 	assert(ep->msg_info->rx_attr->size <= (uint32_t) -1);
 
-	free(ep->msg_info->dest_addr);
-	ep->msg_info->dest_addrlen = ep->msg_info->src_addrlen;
-
-	ep->msg_info->dest_addr = mem_dup(addr, ep->msg_info->dest_addrlen);
-	if (!ep->msg_info->dest_addr) {
-		FI_WARN(&rxm_prov, FI_LOG_EP_CTRL, "mem_dup failed, len %zu\n",
-			ep->msg_info->dest_addrlen);
-		return -FI_ENOMEM;
-	}
+	ret = rxm_msg_info_set_dest(ep, addr);
+	if (ret)
+		return ret;
 
-	ret = rxm_msg_ep_open(ep, ep->msg_info, rxm_conn, &rxm_conn->handle);
+	ret = rxm_msg_ep_open(ep, ep->msg_info, &rxm_conn->handle, false,
+			      &rxm_conn->msg_ep);
 	if (ret)
 		return ret;
 
@@ -1538,6 +1895,59 @@ err:
 	return ret;
 }
 
+/*
+ * Called on the connecting side once the main connection is up.  Rails
+ * are best effort: a rail that fails to connect is simply not used.
+ */
+static void rxm_conn_open_rails(struct rxm_ep *ep, struct rxm_conn *rxm_conn)
+{
+	struct rxm_rail *rail;
+	union rxm_cm_data cm_data = {
+		.connect = {
+			.version = RXM_CM_DATA_VERSION,
+			.ctrl_version = RXM_CTRL_VERSION,
+			.op_version = RXM_OP_VERSION,
+			.endianness = ofi_detect_endianness(),
+			.eager_size = rxm_eager_limit,
+		},
+	};
+	int i, ret;
+
+	if (rxm_rndv_rails == 1 || ep->rndv_ops != &rxm_rndv_ops_read ||
+	    rxm_conn->handle.fi_addr == FI_ADDR_NOTAVAIL)
+		return;
+
+	ret = rxm_msg_info_set_dest(ep, ofi_av_get_addr(ep->cmap->av,
+						rxm_conn->handle.fi_addr));
+	if (ret)
+		return;
+
+	ret = rxm_prepare_cm_data(ep->msg_pep, &rxm_conn->handle, &cm_data);
+	if (ret)
+		return;
+
+	cm_data.connect.rx_size = rxm_conn_get_rx_size(ep, ep->msg_info);
+	cm_data.connect.client_conn_id = rxm_conn->handle.remote_key;
+
+	for (i = 0; i < rxm_rndv_rails - 1; i++) {
+		rail = &rxm_conn->rail[i];
+		ret = rxm_msg_ep_open(ep, ep->msg_info, &rxm_conn->handle,
+				      true, &rail->msg_ep);
+		if (ret)
+			return;
+
+		cm_data.connect.rail = i + 1;
+		ret = fi_connect(rail->msg_ep, ep->msg_info->dest_addr,
+				 &cm_data, sizeof(cm_data));
+		if (ret) {
+			FI_WARN(&rxm_prov, FI_LOG_EP_CTRL,
+				"unable to connect rail %d\n", i + 1);
+			rxm_conn_close_rail(rail);
+			return;
+		}
+	}
+}
+
 static int rxm_conn_signal(struct rxm_ep *ep, void *context,
 			   enum rxm_cmap_signal signal)
 {
@@ -182,7 +182,7 @@ static void rxm_finish_recv(struct rxm_rx_buf *rx_buf, size_t done_len)
 		recv_entry->total_len -= recv_size;
 
 		if (recv_entry->total_len < rx_buf->ep->min_multi_recv_size) {
-			rxm_cq_write(rx_buf->ep->util_ep.rx_cq,
+			rxm_cq_write(rx_buf->ep, rx_buf->ep->util_ep.rx_cq,
 				     recv_entry->context, FI_MULTI_RECV,
 				     0, NULL, 0, 0);
 			goto release;
@@ -192,8 +192,7 @@ static void rxm_finish_recv(struct rxm_rx_buf *rx_buf, size_t done_len)
 				recv_entry->rxm_iov.iov[0].iov_base + recv_size;
 		recv_entry->rxm_iov.iov[0].iov_len -= recv_size;
 
-		dlist_insert_head(&recv_entry->entry,
-				  &recv_entry->recv_queue->recv_list);
+		rxm_recv_queue_requeue(recv_entry->recv_queue, recv_entry);
 		goto free_buf;
 	}
 
@@ -208,7 +207,7 @@ rxm_cq_write_tx_comp(struct rxm_ep *rxm_ep, uint64_t comp_flags,
 		     void *app_context,  uint64_t flags)
 {
 	if (flags & FI_COMPLETION) {
-		rxm_cq_write(rxm_ep->util_ep.tx_cq, app_context,
+		rxm_cq_write(rxm_ep, rxm_ep->util_ep.tx_cq, app_context,
 			     comp_flags, 0, NULL, 0, 0);
 	}
 }
@@ -260,6 +259,8 @@ static bool rxm_complete_sar(struct rxm_ep *rxm_ep,
 		first_tx_buf = ofi_bufpool_get_ibuf(rxm_ep->
 					buf_pools[RXM_BUF_POOL_TX_SAR].pool,
 					tx_buf->pkt.ctrl_hdr.msg_id);
+		rxm_tx_sample_end(rxm_ep, &first_tx_buf->sample,
+				  first_tx_buf->pkt.hdr.size, RXM_ADAPT_COPY);
 		ofi_buf_free(first_tx_buf);
 		ofi_buf_free(tx_buf);
 		return true;
@@ -307,6 +308,8 @@ static void rxm_rndv_tx_finish(struct rxm_ep *rxm_ep,
 	assert(ofi_tx_cq_flags(tx_buf->pkt.hdr.op) & FI_SEND);
 
 	RXM_UPDATE_STATE(FI_LOG_CQ, tx_buf, RXM_RNDV_FINISH);
+	rxm_tx_sample_end(rxm_ep, &tx_buf->sample, tx_buf->pkt.hdr.size,
+			  RXM_ADAPT_RNDV);
 	if (!rxm_ep->rdm_mr_local)
 		rxm_msg_mr_closev(tx_buf->mr, tx_buf->count);
 
@@ -480,64 +483,100 @@ static void rxm_handle_seg_data(struct rxm_rx_buf *rx_buf)
 	}
 }
 
-static ssize_t rxm_rndv_xfer(struct rxm_ep *rxm_ep, struct fid_ep *msg_ep,
+/*
+ * Issue the RMA ops moving total_len bytes between the local iov and the
+ * remote rndv buffers.  Remote iovs of at least 2 * RXM_RAIL_STRIPE_MIN
+ * bytes are split into chunks spread round-robin over msg_ep[], starting
+ * at *next_ep.  The number of ops issued, including deferred ones, is
+ * returned in op_cnt.
+ */
+static ssize_t rxm_rndv_xfer(struct rxm_ep *rxm_ep, struct fid_ep **msg_ep,
+			     size_t ep_cnt, uint8_t *next_ep,
 			     struct rxm_rndv_hdr *remote_hdr, struct iovec *local_iov,
 			     void **local_desc, size_t local_count, size_t total_len,
-			     void *context)
+			     void *context, size_t *op_cnt)
 {
-	size_t i, index = 0, offset = 0, count, copy_len;
+	size_t i, j, index = 0, offset = 0, count, copy_len, chunks, chunk_len;
+	size_t stripe_len;
 	struct iovec iov[RXM_IOV_LIMIT];
 	void *desc[RXM_IOV_LIMIT];
+	struct fi_rma_iov rma_iov;
+	struct fid_ep *ep;
 	ssize_t ret = FI_SUCCESS;
 
+	*op_cnt = 0;
 	for (i = 0; i < remote_hdr->count && total_len > 0; i++) {
 		copy_len = MIN(remote_hdr->iov[i].len, total_len);
-
-		ret = ofi_copy_iov_desc(&iov[0], &desc[0], &count,
-					&local_iov[0],
-					&local_desc[0],
-					local_count,
-					&index, &offset, copy_len);
-		if (ret)
-			return ret;
-		total_len -= copy_len;
-		ret = rxm_ep->rndv_ops->xfer(msg_ep, iov, desc, count, 0,
-			       remote_hdr->iov[i].addr, remote_hdr->iov[i].key,
-			       context);
-
-		if (ret) {
+		chunks = MIN(ep_cnt, MAX(copy_len / RXM_RAIL_STRIPE_MIN, 1));
+		stripe_len = copy_len / chunks;
+		rma_iov.addr = remote_hdr->iov[i].addr;
+		rma_iov.key = remote_hdr->iov[i].key;
+
+		for (j = 0; j < chunks; j++) {
+			chunk_len = (j == chunks - 1) ? copy_len : stripe_len;
+			ret = ofi_copy_iov_desc(&iov[0], &desc[0], &count,
+						&local_iov[0],
+						&local_desc[0],
+						local_count,
+						&index, &offset, chunk_len);
+			if (ret)
+				return ret;
+
+			ep = msg_ep[(*next_ep)++ % ep_cnt];
+			copy_len -= chunk_len;
+			total_len -= chunk_len;
+			(*op_cnt)++;
+			ret = rxm_ep->rndv_ops->xfer(ep, iov, desc, count, 0,
+						     rma_iov.addr, rma_iov.key,
+						     context);
 			if (ret == -FI_EAGAIN) {
 				struct rxm_deferred_tx_entry *def_tx_entry;
 
 				ret = rxm_ep->rndv_ops->defer_xfer(
-					&def_tx_entry, i, iov, desc, count,
-					context);
-
+					&def_tx_entry, ep, &rma_iov, iov, desc,
+					count, context);
 				if (ret)
-					break;
+					return ret;
 				rxm_ep_enqueue_deferred_tx_queue(def_tx_entry);
-				continue;
+			} else if (ret) {
+				return ret;
 			}
-			break;
+			rma_iov.addr += chunk_len;
 		}
 	}
 	assert(!total_len);
 	return ret;
 }
 
+static size_t rxm_rndv_rail_eps(struct rxm_conn *conn, struct fid_ep **msg_ep)
+{
+	size_t i, cnt = 0;
+
+	msg_ep[cnt++] = conn->msg_ep;
+	for (i = 0; i < RXM_MAX_RAILS - 1; i++) {
+		if (conn->rail[i].connected)
+			msg_ep[cnt++] = conn->rail[i].msg_ep;
+	}
+	return cnt;
+}
+
 ssize_t rxm_rndv_read(struct rxm_rx_buf *rx_buf)
 {
+	struct fid_ep *msg_ep[RXM_MAX_RAILS];
+	size_t ep_cnt;
 	ssize_t ret;
 	size_t total_len =
 		MIN(rx_buf->recv_entry->total_len, rx_buf->pkt.hdr.size);
 
 	RXM_UPDATE_STATE(FI_LOG_CQ, rx_buf, RXM_RNDV_READ);
 
-	ret = rxm_rndv_xfer(rx_buf->ep, rx_buf->conn->msg_ep, rx_buf->remote_rndv_hdr,
+	ep_cnt = rxm_rndv_rail_eps(rx_buf->conn, msg_ep);
+	ret = rxm_rndv_xfer(rx_buf->ep, msg_ep, ep_cnt, &rx_buf->conn->next_rail,
+			    rx_buf->remote_rndv_hdr,
 			    rx_buf->recv_entry->rxm_iov.iov,
 			    rx_buf->recv_entry->rxm_iov.desc,
 			    rx_buf->recv_entry->rxm_iov.count, total_len,
-			    rx_buf);
+			    rx_buf, &rx_buf->rndv_rma_count);
 
 	if (ret)
 		rxm_cq_write_error(rx_buf->ep->util_ep.rx_cq,
@@ -551,7 +590,8 @@ static ssize_t rxm_rndv_handle_wr_data(struct rxm_rx_buf *rx_buf)
 	int i;
 	ssize_t ret;
 	struct rxm_tx_rndv_buf *tx_buf;
-	size_t total_len, rma_len = 0;
+	size_t total_len, rma_len = 0, op_cnt;
+	uint8_t next_ep = 0;
 	struct rxm_rndv_hdr *rx_hdr = (struct rxm_rndv_hdr *) rx_buf->pkt.data;
 
 	tx_buf = ofi_bufpool_get_ibuf(
@@ -574,9 +614,12 @@ static ssize_t rxm_rndv_handle_wr_data(struct rxm_rx_buf *rx_buf)
 
 	RXM_UPDATE_STATE(FI_LOG_CQ, tx_buf, RXM_RNDV_WRITE);
 
-	ret = rxm_rndv_xfer(rx_buf->ep, tx_buf->write_rndv.conn->msg_ep, rx_hdr,
-			    tx_buf->write_rndv.iov, tx_buf->write_rndv.desc,
-			    tx_buf->count, total_len, tx_buf);
+	/* Writes stay on the main connection: the write done message must
+	 * not overtake the data it announces. */
+	ret = rxm_rndv_xfer(rx_buf->ep, &tx_buf->write_rndv.conn->msg_ep, 1,
+			    &next_ep, rx_hdr, tx_buf->write_rndv.iov,
+			    tx_buf->write_rndv.desc, tx_buf->count, total_len,
+			    tx_buf, &op_cnt);
 
 	if (ret)
 		rxm_cq_write_error(rx_buf->ep->util_ep.rx_cq,
@@ -713,7 +756,7 @@ rxm_match_rx_buf(struct rxm_rx_buf *rx_buf,
 		 struct rxm_recv_queue *recv_queue,
 		 struct rxm_recv_match_attr *match_attr)
 {
-	struct dlist_entry *entry;
+	struct rxm_recv_entry *recv_entry;
 
 	/* Dynamic receive buffers may have already matched */
 	if (rx_buf->recv_entry) {
@@ -727,10 +770,9 @@ rxm_match_rx_buf(struct rxm_rx_buf *rx_buf,
 	if (recv_queue->dyn_rbuf_unexp_cnt)
 		recv_queue->dyn_rbuf_unexp_cnt--;
 
-	entry = dlist_remove_first_match(&recv_queue->recv_list,
-					 recv_queue->match_recv, match_attr);
-	if (entry) {
-		rx_buf->recv_entry = container_of(entry, struct rxm_recv_entry, entry);
+	recv_entry = rxm_recv_queue_match(recv_queue, match_attr);
+	if (recv_entry) {
+		rx_buf->recv_entry = recv_entry;
 		return rxm_handle_rx_buf(rx_buf);
 	}
 
@@ -740,8 +782,7 @@ rxm_match_rx_buf(struct rxm_rx_buf *rx_buf,
 	rx_buf->unexp_msg.addr = match_attr->addr;
 	rx_buf->unexp_msg.tag = match_attr->tag;
 
-	dlist_insert_tail(&rx_buf->unexp_msg.entry,
-			  &recv_queue->unexp_msg_list);
+	rxm_unexp_msg_insert(recv_queue, rx_buf);
 
 	/* post a new buffer since we don't know when the unexpected buffer
 	 * will be consumed
@@ -988,8 +1029,8 @@ err:
 static void rxm_handle_remote_write(struct rxm_ep *rxm_ep,
 				   struct fi_cq_data_entry *comp)
 {
-	rxm_cq_write(rxm_ep->util_ep.rx_cq, NULL, comp->flags, 0, NULL,
-		     comp->data, 0);
+	rxm_cq_write(rxm_ep, rxm_ep->util_ep.rx_cq, NULL, comp->flags, 0,
+		     NULL, comp->data, 0);
 	ofi_ep_rem_wr_cntr_inc(&rxm_ep->util_ep);
 	if (comp->op_context)
 		rxm_rx_buf_free(comp->op_context);
@@ -1364,6 +1405,8 @@ ssize_t rxm_handle_comp(struct rxm_ep *rxm_ep, struct fi_cq_data_entry *comp)
 	switch (RXM_GET_PROTO_STATE(comp->op_context)) {
 	case RXM_TX:
 		tx_eager_buf = comp->op_context;
+		rxm_tx_sample_end(rxm_ep, &tx_eager_buf->sample,
+				  tx_eager_buf->pkt.hdr.size, RXM_ADAPT_COPY);
 		rxm_ep->eager_ops->comp_tx(rxm_ep, tx_eager_buf);
 		ofi_buf_free(tx_eager_buf);
 		return 0;
@@ -1433,7 +1476,7 @@ ssize_t rxm_handle_comp(struct rxm_ep *rxm_ep, struct fi_cq_data_entry *comp)
 	case RXM_RNDV_READ:
 		rx_buf = comp->op_context;
 		assert(comp->flags & FI_READ);
-		if (++rx_buf->rndv_rma_index < rx_buf->remote_rndv_hdr->count)
+		if (++rx_buf->rndv_rma_index < rx_buf->rndv_rma_count)
 			return 0;
 
 		rxm_rndv_send_rd_done(rx_buf);
@@ -1489,7 +1532,6 @@ static int rxm_get_recv_entry(struct rxm_rx_buf *rx_buf)
 {
 	struct rxm_recv_match_attr match_attr;
 	struct rxm_recv_queue *recv_queue;
-	struct dlist_entry *entry;
 
 	assert(!rx_buf->recv_entry);
 	if (rx_buf->ep->rxm_info->caps & (FI_SOURCE | FI_DIRECTED_RECV)) {
@@ -1514,15 +1556,10 @@ static int rxm_get_recv_entry(struct rxm_rx_buf *rx_buf)
 
 	/* See comment with rxm_get_dyn_rbuf */
 	if (recv_queue->dyn_rbuf_unexp_cnt == 0) {
-		entry = dlist_remove_first_match(&recv_queue->recv_list,
-						 recv_queue->match_recv,
-						 &match_attr);
-		if (entry) {
-			rx_buf->recv_entry = container_of(entry,
-						struct rxm_recv_entry, entry);
-		} else {
+		rx_buf->recv_entry = rxm_recv_queue_match(recv_queue,
+							  &match_attr);
+		if (!rx_buf->recv_entry)
 			recv_queue->dyn_rbuf_unexp_cnt++;
-		}
 	} else {
 		recv_queue->dyn_rbuf_unexp_cnt++;
 	}
@@ -1625,6 +1662,37 @@ ssize_t rxm_get_dyn_rbuf(struct fi_cq_data_entry *entry, struct iovec *iov,
 	return 0;
 }
 
+void rxm_cq_batch_flush(struct rxm_ep *rxm_ep)
+{
+	struct rxm_cq_batch *batch = &rxm_ep->cq_batch;
+	struct fi_cq_tagged_entry comp[RXM_CQ_BATCH_SIZE];
+	fi_addr_t src[RXM_CQ_BATCH_SIZE];
+	struct util_cq *cq;
+	size_t i, j, cnt;
+
+	for (i = 0; i < batch->count; i++) {
+		cq = batch->entry[i].cq;
+		if (!cq)
+			continue;
+
+		for (j = i, cnt = 0; j < batch->count; j++) {
+			if (batch->entry[j].cq != cq)
+				continue;
+
+			comp[cnt] = batch->entry[j].comp;
+			src[cnt++] = batch->entry[j].src;
+			batch->entry[j].cq = NULL;
+		}
+
+		if (ofi_cq_write_batch(cq, comp, src, cnt)) {
+			FI_WARN(&rxm_prov, FI_LOG_CQ,
+				"Unable to report completion\n");
+			assert(0);
+		}
+	}
+	batch->count = 0;
+}
+
 void rxm_cq_write_error(struct util_cq *cq, struct util_cntr *cntr,
 			void *op_context, int err)
 {
@@ -1647,6 +1715,8 @@ void rxm_cq_write_error_all(struct rxm_ep *rxm_ep, int err)
 	struct fi_cq_err_entry err_entry = {0};
 	ssize_t ret = 0;
 
+	rxm_cq_batch_flush(rxm_ep);
+
 	err_entry.prov_errno = err;
 	err_entry.err = -err;
 	if (rxm_ep->util_ep.tx_cq) {
@@ -1790,9 +1860,11 @@ void rxm_handle_comp_error(struct rxm_ep *rxm_ep)
 	}
 }
 
-static int rxm_post_recv(struct rxm_rx_buf *rx_buf)
+static int rxm_post_recv(struct rxm_rx_buf *rx_buf, uint64_t flags)
 {
 	struct rxm_domain *domain;
+	struct iovec iov;
+	struct fi_msg msg;
 	int ret, level;
 
 	if (rx_buf->ep->srx_ctx)
@@ -1802,9 +1874,16 @@ static int rxm_post_recv(struct rxm_rx_buf *rx_buf)
 
 	domain = container_of(rx_buf->ep->util_ep.domain,
 			      struct rxm_domain, util_domain);
-	ret = (int) fi_recv(rx_buf->rx_ep, &rx_buf->pkt,
-			    domain->rx_buf_post_size, rx_buf->hdr.desc,
-			    FI_ADDR_UNSPEC, rx_buf);
+	iov.iov_base = &rx_buf->pkt;
+	iov.iov_len = domain->rx_buf_post_size;
+	msg.msg_iov = &iov;
+	msg.desc = &rx_buf->hdr.desc;
+	msg.iov_count = 1;
+	msg.addr = FI_ADDR_UNSPEC;
+	msg.context = rx_buf;
+	msg.data = 0;
+
+	ret = (int) fi_recvmsg(rx_buf->rx_ep, &msg, flags);
 	if (!ret)
 		return 0;
 
@@ -1821,14 +1900,14 @@ int rxm_prepost_recv(struct rxm_ep *rxm_ep, struct fid_ep *rx_ep)
 {
 	struct rxm_rx_buf *rx_buf;
 	int ret;
-	size_t i;
+	size_t i, cnt = rxm_ep->msg_info->rx_attr->size;
 
-	for (i = 0; i < rxm_ep->msg_info->rx_attr->size; i++) {
+	for (i = 0; i < cnt; i++) {
 		rx_buf = rxm_rx_buf_alloc(rxm_ep, rx_ep, true);
 		if (!rx_buf)
 			return -FI_ENOMEM;
 
-		ret = rxm_post_recv(rx_buf);
+		ret = rxm_post_recv(rx_buf, (i < cnt - 1) ? FI_MORE : 0);
 		if (ret) {
 			ofi_buf_free(&rx_buf->hdr);
 			return ret;
@@ -1837,16 +1916,12 @@ int rxm_prepost_recv(struct rxm_ep *rxm_ep, struct fid_ep *rx_ep)
 	return 0;
 }
 
-void rxm_ep_do_progress(struct util_ep *util_ep)
+/* Consecutive buffers for the same msg ep are posted as one FI_MORE chain */
+static void rxm_ep_repost_ready_bufs(struct rxm_ep *rxm_ep)
 {
-	struct rxm_ep *rxm_ep = container_of(util_ep, struct rxm_ep, util_ep);
-	struct fi_cq_data_entry comp;
-	struct dlist_entry *conn_entry_tmp;
-	struct rxm_conn *rxm_conn;
-	struct rxm_rx_buf *buf;
+	struct rxm_rx_buf *buf, *next;
+	uint64_t flags;
 	ssize_t ret;
-	size_t comp_read = 0;
-	uint64_t timestamp;
 
 	while (!dlist_empty(&rxm_ep->repost_ready_list)) {
 		dlist_pop_front(&rxm_ep->repost_ready_list, struct rxm_rx_buf,
@@ -1858,29 +1933,59 @@ void rxm_ep_do_progress(struct util_ep *util_ep)
 			continue;
 		}
 
-		ret = rxm_post_recv(buf);
+		flags = 0;
+		if (!dlist_empty(&rxm_ep->repost_ready_list)) {
+			next = container_of(rxm_ep->repost_ready_list.next,
+					    struct rxm_rx_buf, repost_entry);
+			if (next->rx_ep == buf->rx_ep)
+				flags = FI_MORE;
+		}
+
+		ret = rxm_post_recv(buf, flags);
 		if (ret) {
 			if (ret == -FI_EAGAIN)
 				ofi_buf_free(&buf->hdr);
 		}
 	}
+}
+
+void rxm_ep_do_progress(struct util_ep *util_ep)
+{
+	struct rxm_ep *rxm_ep = container_of(util_ep, struct rxm_ep, util_ep);
+	struct fi_cq_data_entry comp[RXM_MSG_CQ_BATCH];
+	struct dlist_entry *conn_entry_tmp;
+	struct rxm_conn *rxm_conn;
+	ssize_t ret, i;
+	int err;
+	size_t comp_read = 0;
+	uint64_t timestamp;
+
+	rxm_ep_repost_ready_bufs(rxm_ep);
 
 	do {
-		ret = fi_cq_read(rxm_ep->msg_cq, &comp, 1);
+		ret = fi_cq_read(rxm_ep->msg_cq, comp,
+				 MIN(RXM_MSG_CQ_BATCH,
+				     rxm_ep->comp_per_progress - comp_read));
 		if (ret > 0) {
-			ret = rxm_handle_comp(rxm_ep, &comp);
-			if (ret) {
-				// We don't have enough info to write a good
-				// error entry to the CQ at this point
-				rxm_cq_write_error_all(rxm_ep, ret);
-			} else {
-				ret = 1;
+			rxm_ep->cq_batch.active = true;
+			for (i = 0; i < ret; i++) {
+				err = rxm_handle_comp(rxm_ep, &comp[i]);
+				if (err) {
+					// We don't have enough info to write a good
+					// error entry to the CQ at this point
+					rxm_cq_write_error_all(rxm_ep, err);
+				}
 			}
+			rxm_ep->cq_batch.active = false;
+			rxm_cq_batch_flush(rxm_ep);
+			rxm_ep_repost_ready_bufs(rxm_ep);
+			comp_read += ret;
+			rxm_ep->cq_eq_fairness -= (int) (ret - 1);
 		} else if (ret < 0 && (ret != -FI_EAGAIN)) {
 			if (ret == -FI_EAVAIL)
 				rxm_handle_comp_error(rxm_ep);
 			else
-				rxm_cq_write_error_all(rxm_ep, ret);
+				rxm_cq_write_error_all(rxm_ep, (int) ret);
 		}
 
 		if (ret == -FI_EAGAIN || --rxm_ep->cq_eq_fairness <= 0) {
@@ -1892,7 +1997,7 @@ void rxm_ep_do_progress(struct util_ep *util_ep)
 				rxm_msg_eq_progress(rxm_ep);
 			}
 		}
-	} while ((ret > 0) && (++comp_read < rxm_ep->comp_per_progress));
+	} while ((ret > 0) && (comp_read < rxm_ep->comp_per_progress));
 
 	if (!dlist_empty(&rxm_ep->deferred_tx_conn_queue)) {
 		dlist_foreach_container_safe(&rxm_ep->deferred_tx_conn_queue,
@@ -107,6 +107,117 @@ static int rxm_match_unexp_msg_tag_addr(struct dlist_entry *item, const void *ar
 		ofi_match_tag(attr->tag, attr->ignore, unexp_msg->tag);
 }
 
+static struct dlist_entry *
+rxm_recv_list(struct rxm_recv_queue *queue, struct rxm_recv_entry *recv_entry)
+{
+	if (rxm_recv_is_wild(queue, recv_entry->addr, recv_entry->ignore))
+		return &queue->recv_wild_list;
+
+	return &queue->recv_hash[rxm_match_hash(queue, recv_entry->addr,
+						recv_entry->tag)];
+}
+
+void rxm_recv_queue_insert(struct rxm_recv_queue *queue,
+			   struct rxm_recv_entry *recv_entry)
+{
+	recv_entry->seq = queue->recv_seq++;
+	dlist_insert_tail(&recv_entry->entry, rxm_recv_list(queue, recv_entry));
+}
+
+/* Put a partially consumed multi-recv buffer back in its posted order */
+void rxm_recv_queue_requeue(struct rxm_recv_queue *queue,
+			    struct rxm_recv_entry *recv_entry)
+{
+	struct dlist_entry *list, *item;
+
+	list = rxm_recv_list(queue, recv_entry);
+	dlist_foreach(list, item) {
+		if (container_of(item, struct rxm_recv_entry, entry)->seq >
+		    recv_entry->seq)
+			break;
+	}
+	dlist_insert_before(&recv_entry->entry, item);
+}
+
+struct rxm_recv_entry *
+rxm_recv_queue_match(struct rxm_recv_queue *queue,
+		     struct rxm_recv_match_attr *match_attr)
+{
+	struct rxm_recv_entry *recv_entry = NULL, *wild_entry;
+	struct dlist_entry *list, *item;
+
+	list = &queue->recv_hash[rxm_match_hash(queue, match_attr->addr,
+						match_attr->tag)];
+	dlist_foreach(list, item) {
+		if (queue->match_recv(item, match_attr)) {
+			recv_entry = container_of(item, struct rxm_recv_entry,
+						  entry);
+			break;
+		}
+	}
+
+	dlist_foreach(&queue->recv_wild_list, item) {
+		wild_entry = container_of(item, struct rxm_recv_entry, entry);
+		if (recv_entry && wild_entry->seq > recv_entry->seq)
+			break;
+		if (queue->match_recv(item, match_attr)) {
+			recv_entry = wild_entry;
+			break;
+		}
+	}
+
+	if (recv_entry)
+		dlist_remove(&recv_entry->entry);
+	return recv_entry;
+}
+
+static struct rxm_recv_entry *
+rxm_recv_queue_remove_context(struct rxm_recv_queue *queue, void *context)
+{
+	struct dlist_entry *entry;
+	size_t i;
+
+	entry = dlist_remove_first_match(&queue->recv_wild_list,
+					 rxm_match_recv_entry_context, context);
+	for (i = 0; !entry && i <= queue->hash_mask; i++) {
+		entry = dlist_remove_first_match(&queue->recv_hash[i],
+						 rxm_match_recv_entry_context,
+						 context);
+	}
+
+	return entry ? container_of(entry, struct rxm_recv_entry, entry) : NULL;
+}
+
+void rxm_unexp_msg_insert(struct rxm_recv_queue *queue,
+			  struct rxm_rx_buf *rx_buf)
+{
+	struct rxm_unexp_msg *unexp_msg = &rx_buf->unexp_msg;
+
+	unexp_msg->seq = queue->unexp_seq++;
+	dlist_insert_tail(&unexp_msg->entry, &queue->unexp_msg_list);
+	dlist_insert_tail(&unexp_msg->hash_entry,
+			  &queue->unexp_hash[rxm_match_hash(queue,
+					unexp_msg->addr, unexp_msg->tag)]);
+}
+
+/* The source address of a queued message was resolved after it arrived */
+void rxm_unexp_msg_rehash(struct rxm_recv_queue *queue,
+			  struct rxm_rx_buf *rx_buf)
+{
+	struct rxm_unexp_msg *unexp_msg = &rx_buf->unexp_msg;
+	struct dlist_entry *list, *item;
+
+	dlist_remove(&unexp_msg->hash_entry);
+	list = &queue->unexp_hash[rxm_match_hash(queue, unexp_msg->addr,
+						 unexp_msg->tag)];
+	dlist_foreach(list, item) {
+		if (container_of(item, struct rxm_unexp_msg, hash_entry)->seq >
+		    unexp_msg->seq)
+			break;
+	}
+	dlist_insert_before(&unexp_msg->hash_entry, item);
+}
+
 static int rxm_buf_reg(struct ofi_bufpool_region *region)
 {
 	struct rxm_buf_pool *pool = region->pool->attr.context;
@@ -339,6 +450,8 @@ static void rxm_recv_entry_init(struct rxm_recv_entry *entry, void *arg)
 static int rxm_recv_queue_init(struct rxm_ep *rxm_ep,  struct rxm_recv_queue *recv_queue,
 			       size_t size, enum rxm_recv_queue_type type)
 {
+	size_t i, hash_size;
+
 	recv_queue->rxm_ep = rxm_ep;
 	recv_queue->type = type;
 	recv_queue->fs = rxm_recv_fs_create(size, rxm_recv_entry_init,
@@ -346,8 +459,25 @@ static int rxm_recv_queue_init(struct rxm_ep *rxm_ep,  struct rxm_recv_queue *re
 	if (!recv_queue->fs)
 		return -FI_ENOMEM;
 
-	dlist_init(&recv_queue->recv_list);
+	hash_size = MIN(roundup_power_of_two(size), RXM_MATCH_HASH_MAX);
+	recv_queue->recv_hash = calloc(hash_size * 2,
+				       sizeof(*recv_queue->recv_hash));
+	if (!recv_queue->recv_hash) {
+		rxm_recv_fs_free(recv_queue->fs);
+		recv_queue->fs = NULL;
+		return -FI_ENOMEM;
+	}
+
+	recv_queue->unexp_hash = recv_queue->recv_hash + hash_size;
+	recv_queue->hash_mask = hash_size - 1;
+	for (i = 0; i < hash_size; i++) {
+		dlist_init(&recv_queue->recv_hash[i]);
+		dlist_init(&recv_queue->unexp_hash[i]);
+	}
+
+	dlist_init(&recv_queue->recv_wild_list);
 	dlist_init(&recv_queue->unexp_msg_list);
+	recv_queue->directed = !!(rxm_ep->rxm_info->caps & FI_DIRECTED_RECV);
 	if (type == RXM_RECV_QUEUE_MSG) {
 		if (rxm_ep->rxm_info->caps & FI_DIRECTED_RECV) {
 			recv_queue->match_recv = rxm_match_recv_entry;
@@ -375,7 +505,8 @@ static void rxm_recv_queue_close(struct rxm_recv_queue *recv_queue)
 	if (recv_queue->fs) {
 		rxm_recv_fs_free(recv_queue->fs);
 	}
-	// TODO cleanup recv_list and unexp msg list
+	free(recv_queue->recv_hash);
+	// TODO cleanup posted recvs and unexp msgs
 }
 
 static int rxm_ep_txrx_pool_create(struct rxm_ep *rxm_ep)
@@ -539,17 +670,13 @@ static bool rxm_ep_cancel_recv(struct rxm_ep *rxm_ep,
 {
 	struct fi_cq_err_entry err_entry;
 	struct rxm_recv_entry *recv_entry;
-	struct dlist_entry *entry;
 	int ret;
 
 	ofi_ep_lock_acquire(&rxm_ep->util_ep);
-	entry = dlist_remove_first_match(&recv_queue->recv_list,
-					 rxm_match_recv_entry_context,
-					 context);
-	if (!entry)
+	recv_entry = rxm_recv_queue_remove_context(recv_queue, context);
+	if (!recv_entry)
 		goto unlock;
 
-	recv_entry = container_of(entry, struct rxm_recv_entry, entry);
 	memset(&err_entry, 0, sizeof(err_entry));
 	err_entry.op_context = recv_entry->context;
 	err_entry.flags |= recv_entry->comp_flags;
@@ -565,7 +692,7 @@ static bool rxm_ep_cancel_recv(struct rxm_ep *rxm_ep,
 
 unlock:
 	ofi_ep_lock_release(&rxm_ep->util_ep);
-	return entry != NULL;
+	return recv_entry != NULL;
 }
 
 static ssize_t rxm_ep_cancel(fid_t fid_ep, void *context)
@@ -579,6 +706,29 @@ static ssize_t rxm_ep_cancel(fid_t fid_ep, void *context)
 	return 0;
 }
 
+static int rxm_ep_get_proto_limits(struct rxm_ep *rxm_ep,
+				   struct fi_rxm_proto_limits *limits)
+{
+	struct rxm_cmap_handle *handle = NULL;
+	struct rxm_conn *rxm_conn;
+
+	limits->eager_limit = rxm_eager_limit;
+	limits->sar_limit = rxm_ep->sar_limit;
+	if (limits->addr == FI_ADDR_UNSPEC)
+		return 0;
+
+	ofi_ep_lock_acquire(&rxm_ep->util_ep);
+	if (rxm_ep->cmap)
+		handle = rxm_cmap_acquire_handle(rxm_ep->cmap, limits->addr);
+	if (handle) {
+		rxm_conn = container_of(handle, struct rxm_conn, handle);
+		limits->eager_limit = rxm_conn->eager_limit;
+		limits->sar_limit = rxm_conn->sar_limit;
+	}
+	ofi_ep_lock_release(&rxm_ep->util_ep);
+	return 0;
+}
+
 static int rxm_ep_getopt(fid_t fid, int level, int optname, void *optval,
 			 size_t *optlen)
 {
@@ -604,6 +754,11 @@ static int rxm_ep_getopt(fid_t fid, int level, int optname, void *optval,
 		*(size_t *)optval = rxm_ep->buffered_limit;
 		*optlen = sizeof(size_t);
 		break;
+	case FI_OPT_RXM_PROTO_LIMITS:
+		if (*optlen < sizeof(struct fi_rxm_proto_limits))
+			return -FI_ETOOSMALL;
+		*optlen = sizeof(struct fi_rxm_proto_limits);
+		return rxm_ep_get_proto_limits(rxm_ep, optval);
 	default:
 		return -FI_ENOPROTOOPT;
 	}
@@ -687,7 +842,8 @@ rxm_get_unexp_msg(struct rxm_recv_queue *recv_queue, fi_addr_t addr,
 		  uint64_t tag, uint64_t ignore)
 {
 	struct rxm_recv_match_attr match_attr;
-	struct dlist_entry *entry;
+	struct rxm_rx_buf *rx_buf;
+	struct dlist_entry *list, *entry;
 
 	if (dlist_empty(&recv_queue->unexp_msg_list))
 		return NULL;
@@ -696,15 +852,30 @@ rxm_get_unexp_msg(struct rxm_recv_queue *recv_queue, fi_addr_t addr,
 	match_attr.tag = tag;
 	match_attr.ignore = ignore;
 
-	entry = dlist_find_first_match(&recv_queue->unexp_msg_list,
-				       recv_queue->match_unexp, &match_attr);
-	if (!entry)
-		return NULL;
+	if (rxm_recv_is_wild(recv_queue, addr, ignore)) {
+		entry = dlist_find_first_match(&recv_queue->unexp_msg_list,
+					       recv_queue->match_unexp,
+					       &match_attr);
+		if (!entry)
+			return NULL;
 
+		rx_buf = container_of(entry, struct rxm_rx_buf, unexp_msg.entry);
+		goto found;
+	}
+
+	list = &recv_queue->unexp_hash[rxm_match_hash(recv_queue, addr, tag)];
+	dlist_foreach_container(list, struct rxm_rx_buf, rx_buf,
+				unexp_msg.hash_entry) {
+		if (recv_queue->match_unexp(&rx_buf->unexp_msg.entry,
+					    &match_attr))
+			goto found;
+	}
+	return NULL;
+
+found:
 	RXM_DBG_ADDR_TAG(FI_LOG_EP_DATA, "Match for posted recv found in unexp"
 			 " msg list\n", match_attr.addr, match_attr.tag);
-
-	return container_of(entry, struct rxm_rx_buf, unexp_msg.entry);
+	return rx_buf;
 }
 
 static int rxm_handle_unexp_sar(struct rxm_recv_queue *recv_queue,
@@ -743,7 +914,7 @@ static int rxm_handle_unexp_sar(struct rxm_recv_queue *recv_queue,
 		if (recv_entry->sar.conn != rx_buf->conn)
 			continue;
 		rx_buf->recv_entry = recv_entry;
-		dlist_remove(&rx_buf->unexp_msg.entry);
+		rxm_unexp_msg_remove(rx_buf);
 		last = rxm_sar_get_seg_type(&rx_buf->pkt.ctrl_hdr) ==
 		       RXM_SAR_SEG_LAST;
 		ret = rxm_handle_rx_buf(rx_buf);
@@ -760,8 +931,9 @@ static void rxm_ep_discard_recv(struct rxm_ep *rxm_ep, struct rxm_rx_buf *rx_buf
 	RXM_DBG_ADDR_TAG(FI_LOG_EP_DATA, "Discarding message",
 			 rx_buf->unexp_msg.addr, rx_buf->unexp_msg.tag);
 
-	rxm_cq_write(rxm_ep->util_ep.rx_cq, context, FI_TAGGED | FI_RECV,
-		     0, NULL, rx_buf->pkt.hdr.data, rx_buf->pkt.hdr.tag);
+	rxm_cq_write(rxm_ep, rxm_ep->util_ep.rx_cq, context,
+		     FI_TAGGED | FI_RECV, 0, NULL, rx_buf->pkt.hdr.data,
+		     rx_buf->pkt.hdr.tag);
 	rxm_rx_buf_free(rx_buf);
 }
 
@@ -790,7 +962,7 @@ rxm_ep_peek_recv(struct rxm_ep *rxm_ep, fi_addr_t addr, uint64_t tag,
 	FI_DBG(&rxm_prov, FI_LOG_EP_DATA, "Message found\n");
 
 	if (flags & FI_DISCARD) {
-		dlist_remove(&rx_buf->unexp_msg.entry);
+		rxm_unexp_msg_remove(rx_buf);
 		rxm_ep_discard_recv(rxm_ep, rx_buf, context);
 		return;
 	}
@@ -798,11 +970,11 @@ rxm_ep_peek_recv(struct rxm_ep *rxm_ep, fi_addr_t addr, uint64_t tag,
 	if (flags & FI_CLAIM) {
 		FI_DBG(&rxm_prov, FI_LOG_EP_DATA, "Marking message for Claim\n");
 		((struct fi_context *)context)->internal[0] = rx_buf;
-		dlist_remove(&rx_buf->unexp_msg.entry);
+		rxm_unexp_msg_remove(rx_buf);
 	}
 
-	rxm_cq_write(rxm_ep->util_ep.rx_cq, context, FI_TAGGED | FI_RECV,
-		     rx_buf->pkt.hdr.size, NULL,
+	rxm_cq_write(rxm_ep, rxm_ep->util_ep.rx_cq, context,
+		     FI_TAGGED | FI_RECV, rx_buf->pkt.hdr.size, NULL,
 		     rx_buf->pkt.hdr.data, rx_buf->pkt.hdr.tag);
 }
 
@@ -867,12 +1039,11 @@ rxm_ep_post_mrecv(struct rxm_ep *ep, const struct iovec *iov,
 
 		rx_buf = rxm_get_unexp_msg(&ep->recv_queue, recv_entry->addr, 0,  0);
 		if (!rx_buf) {
-			dlist_insert_tail(&recv_entry->entry,
-					  &ep->recv_queue.recv_list);
+			rxm_recv_queue_insert(&ep->recv_queue, recv_entry);
 			return 0;
 		}
 
-		dlist_remove(&rx_buf->unexp_msg.entry);
+		rxm_unexp_msg_remove(rx_buf);
 		rx_buf->recv_entry = recv_entry;
 		recv_entry->flags &= ~FI_MULTI_RECV;
 		recv_entry->total_len = MIN(cur_iov.iov_len, rx_buf->pkt.hdr.size);
@@ -891,7 +1062,7 @@ rxm_ep_post_mrecv(struct rxm_ep *ep, const struct iovec *iov,
 
 	if ((cur_iov.iov_len < ep->min_multi_recv_size) ||
 	    (ret && cur_iov.iov_len != iov->iov_len)) {
-		rxm_cq_write(ep->util_ep.rx_cq, context, FI_MULTI_RECV,
+		rxm_cq_write(ep, ep->util_ep.rx_cq, context, FI_MULTI_RECV,
 			     0, NULL, 0, 0);
 	}
 
@@ -918,12 +1089,11 @@ rxm_ep_post_recv(struct rxm_ep *rxm_ep, const struct iovec *iov,
 
 	rx_buf = rxm_get_unexp_msg(&rxm_ep->recv_queue, recv_entry->addr, 0,  0);
 	if (!rx_buf) {
-		dlist_insert_tail(&recv_entry->entry,
-				  &rxm_ep->recv_queue.recv_list);
+		rxm_recv_queue_insert(&rxm_ep->recv_queue, recv_entry);
 		return FI_SUCCESS;
 	}
 
-	dlist_remove(&rx_buf->unexp_msg.entry);
+	rxm_unexp_msg_remove(rx_buf);
 	rx_buf->recv_entry = recv_entry;
 
 	if (rx_buf->pkt.ctrl_hdr.type != rxm_ctrl_seg)
@@ -1075,6 +1245,51 @@ rxm_ep_msg_normal_send(struct rxm_conn *rxm_conn, struct rxm_pkt *tx_pkt,
 	return fi_send(rxm_conn->msg_ep, tx_pkt, pkt_size, desc, 0, context);
 }
 
+/* Sends timed for adaptive protocol selection complete once the peer has
+ * the data, the same point a rendezvous send completes at.
+ */
+static ssize_t
+rxm_ep_msg_sample_sendv(struct rxm_conn *rxm_conn, const struct iovec *iov,
+			void **desc, size_t count, void *context)
+{
+	struct fi_msg msg = {
+		.msg_iov = iov,
+		.desc = desc,
+		.iov_count = count,
+		.addr = 0,
+		.context = context,
+		.data = 0,
+	};
+
+	return fi_sendmsg(rxm_conn->msg_ep, &msg,
+			  FI_COMPLETION | FI_DELIVERY_COMPLETE);
+}
+
+static ssize_t
+rxm_ep_sar_seg_send(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
+		    struct rxm_tx_sar_buf *tx_buf)
+{
+	struct rxm_tx_sar_buf *first_tx_buf;
+	struct iovec iov;
+
+	iov.iov_base = &tx_buf->pkt;
+	iov.iov_len = sizeof(tx_buf->pkt) + tx_buf->pkt.ctrl_hdr.seg_size;
+
+	if (OFI_UNLIKELY(rxm_conn->adapt != NULL) &&
+	    rxm_sar_get_seg_type(&tx_buf->pkt.ctrl_hdr) == RXM_SAR_SEG_LAST) {
+		first_tx_buf = ofi_bufpool_get_ibuf(rxm_ep->
+					buf_pools[RXM_BUF_POOL_TX_SAR].pool,
+					tx_buf->pkt.ctrl_hdr.msg_id);
+		if (first_tx_buf->sample.start)
+			return rxm_ep_msg_sample_sendv(rxm_conn, &iov,
+						       &tx_buf->hdr.desc, 1,
+						       tx_buf);
+	}
+
+	return fi_send(rxm_conn->msg_ep, iov.iov_base, iov.iov_len,
+		       tx_buf->hdr.desc, 0, tx_buf);
+}
+
 static ssize_t
 rxm_alloc_rndv_buf(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 		   void *context, uint8_t count, const struct iovec *iov,
@@ -1264,8 +1479,7 @@ rxm_ep_sar_tx_prepare_and_send_segment(struct rxm_ep *rxm_ep,
 
 	*out_tx_buf = tx_buf;
 
-	return fi_send(rxm_conn->msg_ep, &tx_buf->pkt, sizeof(struct rxm_pkt) +
-		       tx_buf->pkt.ctrl_hdr.seg_size, tx_buf->hdr.desc, 0, tx_buf);
+	return rxm_ep_sar_seg_send(rxm_ep, rxm_conn, tx_buf);
 }
 
 static ssize_t
@@ -1273,7 +1487,7 @@ rxm_ep_sar_tx_send(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 		   void *context, uint8_t count, const struct iovec *iov,
 		   size_t data_len, size_t segs_cnt, uint64_t data,
 		   uint64_t flags, uint64_t tag, uint8_t op,
-		   enum fi_hmem_iface iface, uint64_t device)
+		   enum fi_hmem_iface iface, uint64_t device, bool sample)
 {
 	struct rxm_tx_sar_buf *tx_buf, *first_tx_buf;
 	size_t i, iov_offset = 0, remain_len = data_len;
@@ -1290,6 +1504,7 @@ rxm_ep_sar_tx_send(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 	if (!first_tx_buf)
 		return -FI_EAGAIN;
 
+	rxm_tx_sample_start(rxm_conn, &first_tx_buf->sample, sample);
 	ret = ofi_copy_from_hmem_iov(first_tx_buf->pkt.data, rxm_eager_limit,
 				     iface, device, iov, count, iov_offset);
 	assert(ret == rxm_eager_limit);
@@ -1378,6 +1593,7 @@ rxm_ep_emulate_inject(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 	}
 	/* This is needed so that we don't report bogus context in fi_cq_err_entry */
 	tx_buf->app_context = NULL;
+	tx_buf->sample.start = 0;
 
 	rxm_ep_format_tx_buf_pkt(rxm_conn, len, op, data, tag, flags, &tx_buf->pkt);
 
@@ -1473,8 +1689,8 @@ rxm_direct_send(struct rxm_ep *ep, struct rxm_conn *rxm_conn,
 {
 	struct iovec send_iov[RXM_IOV_LIMIT];
 	void *send_desc[RXM_IOV_LIMIT];
+	void **msg_desc = NULL;
 	struct rxm_mr *mr;
-	ssize_t ret;
 	int i;
 
 	send_iov[0].iov_base = &tx_buf->pkt;
@@ -1489,14 +1705,15 @@ rxm_direct_send(struct rxm_ep *ep, struct rxm_conn *rxm_conn,
 			mr = desc[i];
 			send_desc[i + 1] = fi_mr_desc(mr->msg_mr);
 		}
-
-		ret = fi_sendv(rxm_conn->msg_ep, send_iov, send_desc,
-			       count + 1, 0, tx_buf);
-	} else {
-		ret = fi_sendv(rxm_conn->msg_ep, send_iov, NULL,
-			       count + 1, 0, tx_buf);
+		msg_desc = send_desc;
 	}
-	return ret;
+
+	if (OFI_UNLIKELY(tx_buf->sample.start))
+		return rxm_ep_msg_sample_sendv(rxm_conn, send_iov, msg_desc,
+					       count + 1, tx_buf);
+
+	return fi_sendv(rxm_conn->msg_ep, send_iov, msg_desc, count + 1, 0,
+			tx_buf);
 }
 
 static ssize_t
@@ -1510,6 +1727,9 @@ rxm_ep_send_common(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 	size_t data_len, total_len;
 	ssize_t ret;
 	enum fi_hmem_iface iface;
+	enum rxm_adapt_proto proto;
+	struct iovec pkt_iov;
+	bool sample = false;
 	uint64_t device;
 
 	data_len = ofi_total_iov_len(iov, count);
@@ -1522,7 +1742,14 @@ rxm_ep_send_common(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 
 	iface = rxm_mr_desc_to_hmem_iface_dev(desc, count, &device);
 
-	if (data_len <= rxm_eager_limit) {
+	if (OFI_UNLIKELY(rxm_conn->adapt != NULL))
+		proto = rxm_conn_adapt_select(rxm_ep, rxm_conn, data_len, flags,
+					      &sample);
+	else
+		proto = (data_len <= rxm_conn->sar_limit) ?
+			RXM_ADAPT_COPY : RXM_ADAPT_RNDV;
+
+	if (proto == RXM_ADAPT_COPY && data_len <= rxm_eager_limit) {
 		eager_buf = rxm_tx_buf_alloc(rxm_ep, RXM_BUF_POOL_TX);
 		if (!eager_buf) {
 			FI_WARN(&rxm_prov, FI_LOG_EP_DATA,
@@ -1532,6 +1759,7 @@ rxm_ep_send_common(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 
 		eager_buf->app_context = context;
 		eager_buf->flags = flags;
+		rxm_tx_sample_start(rxm_conn, &eager_buf->sample, sample);
 		rxm_ep_format_tx_buf_pkt(rxm_conn, data_len, op, data, tag,
 					 flags, &eager_buf->pkt);
 
@@ -1545,32 +1773,40 @@ rxm_ep_send_common(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 						     count, 0);
 			assert(ret == eager_buf->pkt.hdr.size);
 
-			ret = rxm_ep_msg_normal_send(rxm_conn, &eager_buf->pkt,
-						     total_len,
-						     eager_buf->hdr.desc,
-						     eager_buf);
+			if (OFI_UNLIKELY(sample)) {
+				pkt_iov.iov_base = &eager_buf->pkt;
+				pkt_iov.iov_len = total_len;
+				ret = rxm_ep_msg_sample_sendv(rxm_conn,
+						&pkt_iov, &eager_buf->hdr.desc,
+						1, eager_buf);
+			} else {
+				ret = rxm_ep_msg_normal_send(rxm_conn,
+						&eager_buf->pkt, total_len,
+						eager_buf->hdr.desc, eager_buf);
+			}
 		}
 		if (ret) {
 			if (ret == -FI_EAGAIN)
 				rxm_ep_do_progress(&rxm_ep->util_ep);
 			ofi_buf_free(eager_buf);
 		}
-	} else if (data_len <= rxm_ep->sar_limit &&
-		   /* SAR uses eager_limit as segment size */
-		   (rxm_eager_limit <
-		    (1ULL << (8 * sizeof_field(struct ofi_ctrl_hdr, seg_size))))) {
+	} else if (proto == RXM_ADAPT_COPY) {
 		ret = rxm_ep_sar_tx_send(rxm_ep, rxm_conn, context,
 					 count, iov, data_len,
 					 rxm_ep_sar_calc_segs_cnt(rxm_ep, data_len),
-					 data, flags, tag, op, iface, device);
+					 data, flags, tag, op, iface, device,
+					 sample);
 	} else {
 		ret = rxm_alloc_rndv_buf(rxm_ep, rxm_conn, context,
 					 (uint8_t) count, iov, desc,
 					 data_len, data, flags, tag, op,
 					 iface, device, &rndv_buf);
-		if (ret >= 0)
+		if (ret >= 0) {
+			rxm_tx_sample_start(rxm_conn, &rndv_buf->sample,
+					    sample);
 			ret = rxm_ep_rndv_tx_send(rxm_ep, rxm_conn,
 						  rndv_buf, ret);
+		}
 	}
 
 	return ret;
@@ -1589,6 +1825,8 @@ rxm_ep_alloc_deferred_tx_entry(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 	def_tx_entry->rxm_ep = rxm_ep;
 	def_tx_entry->rxm_conn = rxm_conn;
 	def_tx_entry->type = type;
+	if (OFI_UNLIKELY(rxm_conn->adapt != NULL))
+		def_tx_entry->queue_time = ofi_gettime_ns();
 	dlist_init(&def_tx_entry->entry);
 
 	return def_tx_entry;
@@ -1614,9 +1852,8 @@ rxm_ep_progress_sar_deferred_segments(struct rxm_deferred_tx_entry *def_tx_entry
 	struct rxm_tx_sar_buf *tx_buf = def_tx_entry->sar_seg.cur_seg_tx_buf;
 
 	if (tx_buf) {
-		ret = fi_send(def_tx_entry->rxm_conn->msg_ep, &tx_buf->pkt,
-			      sizeof(tx_buf->pkt) + tx_buf->pkt.ctrl_hdr.seg_size,
-			      tx_buf->hdr.desc, 0, tx_buf);
+		ret = rxm_ep_sar_seg_send(def_tx_entry->rxm_ep,
+					  def_tx_entry->rxm_conn, tx_buf);
 		if (ret) {
 			if (ret != -FI_EAGAIN) {
 				rxm_ep_sar_handle_segment_failure(def_tx_entry,
@@ -1671,6 +1908,35 @@ rxm_ep_progress_sar_deferred_segments(struct rxm_deferred_tx_entry *def_tx_entry
 	return 0;
 }
 
+static void
+rxm_ep_deferred_tx_sample_resume(struct rxm_deferred_tx_entry *def_tx_entry)
+{
+	struct rxm_tx_sar_buf *first_tx_buf;
+
+	if (OFI_LIKELY(!def_tx_entry->queue_time))
+		return;
+
+	switch (def_tx_entry->type) {
+	case RXM_DEFERRED_TX_SAR_SEG:
+		first_tx_buf = ofi_bufpool_get_ibuf(def_tx_entry->rxm_ep->
+					buf_pools[RXM_BUF_POOL_TX_SAR].pool,
+					def_tx_entry->sar_seg.msg_id);
+		rxm_tx_sample_resume(&first_tx_buf->sample,
+				     def_tx_entry->queue_time);
+		break;
+	case RXM_DEFERRED_TX_RNDV_WRITE:
+		rxm_tx_sample_resume(&def_tx_entry->rndv_write.tx_buf->sample,
+				     def_tx_entry->queue_time);
+		break;
+	case RXM_DEFERRED_TX_RNDV_DONE:
+		rxm_tx_sample_resume(&def_tx_entry->rndv_done.tx_buf->sample,
+				     def_tx_entry->queue_time);
+		break;
+	default:
+		break;
+	}
+}
+
 void rxm_ep_progress_deferred_queue(struct rxm_ep *rxm_ep,
 				    struct rxm_conn *rxm_conn)
 {
@@ -1732,7 +1998,7 @@ void rxm_ep_progress_deferred_queue(struct rxm_ep *rxm_ep,
 			break;
 		case RXM_DEFERRED_TX_RNDV_READ:
 			ret = rxm_ep->rndv_ops->xfer(
-				def_tx_entry->rxm_conn->msg_ep,
+				def_tx_entry->rndv_read.msg_ep,
 				def_tx_entry->rndv_read.rxm_iov.iov,
 				def_tx_entry->rndv_read.rxm_iov.desc,
 				def_tx_entry->rndv_read.rxm_iov.count, 0,
@@ -1750,7 +2016,7 @@ void rxm_ep_progress_deferred_queue(struct rxm_ep *rxm_ep,
 			break;
 		case RXM_DEFERRED_TX_RNDV_WRITE:
 			ret = rxm_ep->rndv_ops->xfer(
-				def_tx_entry->rxm_conn->msg_ep,
+				def_tx_entry->rndv_write.msg_ep,
 				def_tx_entry->rndv_write.rxm_iov.iov,
 				def_tx_entry->rndv_write.rxm_iov.desc,
 				def_tx_entry->rndv_write.rxm_iov.count, 0,
@@ -1804,6 +2070,8 @@ void rxm_ep_progress_deferred_queue(struct rxm_ep *rxm_ep,
 			break;
 		}
 
+		if (!ret)
+			rxm_ep_deferred_tx_sample_resume(def_tx_entry);
 		rxm_ep_dequeue_deferred_tx_queue(def_tx_entry);
 		free(def_tx_entry);
 	}
@@ -2023,12 +2291,11 @@ rxm_ep_post_trecv(struct rxm_ep *rxm_ep, const struct iovec *iov,
 	rx_buf = rxm_get_unexp_msg(&rxm_ep->trecv_queue, recv_entry->addr,
 				   recv_entry->tag, recv_entry->ignore);
 	if (!rx_buf) {
-		dlist_insert_tail(&recv_entry->entry,
-				  &rxm_ep->trecv_queue.recv_list);
+		rxm_recv_queue_insert(&rxm_ep->trecv_queue, recv_entry);
 		return FI_SUCCESS;
 	}
 
-	dlist_remove(&rx_buf->unexp_msg.entry);
+	rxm_unexp_msg_remove(rx_buf);
 	rx_buf->recv_entry = recv_entry;
 
 	if (rx_buf->pkt.ctrl_hdr.type != rxm_ctrl_seg)
@@ -2678,12 +2945,12 @@ static void rxm_ep_settings_init(struct rxm_ep *rxm_ep)
 	        "\t\t FI_EP_MSG provider inject size: %zu\n"
 	        "\t\t rxm inject size: %zu\n"
 		"\t\t Protocol limits: Eager: %zu, "
-				      "SAR: %zu\n",
+				      "SAR: %zu, adaptive: %d\n",
 		rxm_ep->msg_mr_local, rxm_ep->rdm_mr_local,
 		rxm_ep->comp_per_progress, rxm_ep->buffered_min,
 		rxm_ep->min_multi_recv_size, rxm_ep->inject_limit,
 		rxm_ep->rxm_info->tx_attr->inject_size,
-		rxm_eager_limit, rxm_ep->sar_limit);
+		rxm_eager_limit, rxm_ep->sar_limit, rxm_adaptive_proto);
 }
 
 static int rxm_ep_txrx_res_open(struct rxm_ep *rxm_ep)
@@ -2891,9 +3158,10 @@ err1:
 
 static ssize_t
 rxm_prepare_deferred_rndv_read(struct rxm_deferred_tx_entry **def_tx_entry,
-			       size_t index, struct iovec *iov,
-			       void *desc[RXM_IOV_LIMIT], size_t count,
-			       void *buf)
+			       struct fid_ep *msg_ep,
+			       const struct fi_rma_iov *rma_iov,
+			       struct iovec *iov, void *desc[RXM_IOV_LIMIT],
+			       size_t count, void *buf)
 {
 	uint8_t i;
 	struct rxm_rx_buf *rx_buf = buf;
@@ -2904,10 +3172,9 @@ rxm_prepare_deferred_rndv_read(struct rxm_deferred_tx_entry **def_tx_entry,
 		return -FI_ENOMEM;
 
 	(*def_tx_entry)->rndv_read.rx_buf = rx_buf;
-	(*def_tx_entry)->rndv_read.rma_iov.addr =
-			rx_buf->remote_rndv_hdr->iov[index].addr;
-	(*def_tx_entry)->rndv_read.rma_iov.key =
-			rx_buf->remote_rndv_hdr->iov[index].key;
+	(*def_tx_entry)->rndv_read.msg_ep = msg_ep;
+	(*def_tx_entry)->rndv_read.rma_iov.addr = rma_iov->addr;
+	(*def_tx_entry)->rndv_read.rma_iov.key = rma_iov->key;
 
 	for (i = 0; i < count; i++) {
 		(*def_tx_entry)->rndv_read.rxm_iov.iov[i] = iov[i];
@@ -2920,9 +3187,10 @@ rxm_prepare_deferred_rndv_read(struct rxm_deferred_tx_entry **def_tx_entry,
 
 static ssize_t
 rxm_prepare_deferred_rndv_write(struct rxm_deferred_tx_entry **def_tx_entry,
-			       size_t index, struct iovec *iov,
-			       void *desc[RXM_IOV_LIMIT], size_t count,
-			       void *buf)
+			       struct fid_ep *msg_ep,
+			       const struct fi_rma_iov *rma_iov,
+			       struct iovec *iov, void *desc[RXM_IOV_LIMIT],
+			       size_t count, void *buf)
 {
 	uint8_t i;
 	struct rxm_tx_rndv_buf *tx_buf = buf;
@@ -2934,10 +3202,9 @@ rxm_prepare_deferred_rndv_write(struct rxm_deferred_tx_entry **def_tx_entry,
 		return -FI_ENOMEM;
 
 	(*def_tx_entry)->rndv_write.tx_buf = tx_buf;
-	(*def_tx_entry)->rndv_write.rma_iov.addr =
-			tx_buf->write_rndv.remote_hdr.iov[index].addr;
-	(*def_tx_entry)->rndv_write.rma_iov.key =
-			tx_buf->write_rndv.remote_hdr.iov[index].key;
+	(*def_tx_entry)->rndv_write.msg_ep = msg_ep;
+	(*def_tx_entry)->rndv_write.rma_iov.addr = rma_iov->addr;
+	(*def_tx_entry)->rndv_write.rma_iov.key = rma_iov->key;
 
 	for (i = 0; i < count; i++) {
 		(*def_tx_entry)->rndv_write.rxm_iov.iov[i] = iov[i];
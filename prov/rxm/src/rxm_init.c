@@ -54,6 +54,8 @@ size_t rxm_eager_limit		= RXM_BUF_SIZE - sizeof(struct rxm_pkt);
 size_t rxm_rx_buf_post_size	= RXM_BUF_SIZE;
 int force_auto_progress		= 0;
 int rxm_use_write_rndv		= 0;
+int rxm_adaptive_proto		= 0;
+int rxm_rndv_rails		= 1;
 enum fi_wait_obj def_wait_obj = FI_WAIT_FD, def_tcp_wait_obj = FI_WAIT_UNSPEC;
 
 char *rxm_proto_state_str[] = {
@@ -521,6 +523,24 @@ RXM_INI
 			"RMA writes rather than RMA reads during Rendezvous "
 			"transactions. (default: false/no).");
 
+	fi_param_define(&rxm_prov, "adaptive_proto", FI_PARAM_BOOL,
+			"Tune the eager, SAR, and rendezvous crossover points "
+			"per connection at runtime.  RxM times completed sends "
+			"by size class, periodically probes the alternative "
+			"protocol, and moves the thresholds to whichever "
+			"protocol completes faster, starting from the static "
+			"limits.  The eager buffer size still bounds eager "
+			"sends.  The chosen thresholds can be read with "
+			"fi_getopt(FI_OPT_RXM_PROTO_LIMITS). (default: false/no)");
+
+	fi_param_define(&rxm_prov, "rndv_rails", FI_PARAM_INT,
+			"Number of msg endpoint connections (rails) to open "
+			"to each peer for rendezvous reads.  Large reads are "
+			"striped across the rails, which lets a transport "
+			"such as tcp drive several sockets per peer.  Extra "
+			"rails only carry RMA traffic.  Ignored when "
+			"use_rndv_write is set. (default: 1, max: 8)");
+
 	fi_param_define(&rxm_prov, "enable_dyn_rbuf", FI_PARAM_BOOL,
 			"Enable support for dynamic receive buffering, if "
 			"available by the message endpoint provider. "
@@ -548,6 +568,13 @@ RXM_INI
 		rxm_cq_eq_fairness = 128;
 	fi_param_get_bool(&rxm_prov, "data_auto_progress", &force_auto_progress);
 	fi_param_get_bool(&rxm_prov, "use_rndv_write", &rxm_use_write_rndv);
+	fi_param_get_bool(&rxm_prov, "adaptive_proto", &rxm_adaptive_proto);
+	fi_param_get_int(&rxm_prov, "rndv_rails", &rxm_rndv_rails);
+	if (rxm_rndv_rails < 1 || rxm_rndv_rails > RXM_MAX_RAILS) {
+		FI_WARN(&rxm_prov, FI_LOG_CORE, "rndv_rails must be between "
+			"1 and %d, using 1\n", RXM_MAX_RAILS);
+		rxm_rndv_rails = 1;
+	}
 
 	rxm_get_def_wait();
 
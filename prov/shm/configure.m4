@@ -11,6 +11,7 @@ AC_DEFUN([FI_SHM_CONFIGURE],[
 	# Determine if we can support the shm provider
 	shm_happy=0
 	cma_happy=0
+	xpmem_happy=0
 	AS_IF([test x"$enable_shm" != x"no"],
 	      [
 	       # check if CMA support are present
@@ -37,8 +38,33 @@ AC_DEFUN([FI_SHM_CONFIGURE],[
 				[],
 				[shm_happy=1],
 				[shm_happy=0])])
+
+	       # XPMEM is optional and only used for single-copy transfers
+	       AS_IF([test x"$with_xpmem" != x"no"],
+		     [FI_CHECK_PACKAGE([shm_xpmem],
+				[xpmem.h],
+				[xpmem],
+				[xpmem_make],
+				[],
+				[$with_xpmem],
+				[],
+				[xpmem_happy=1],
+				[xpmem_happy=0])])
+
+	       AS_IF([test $xpmem_happy -eq 0 && \
+		      test x"$with_xpmem" != x"" && test x"$with_xpmem" != x"no"],
+		     [AC_MSG_ERROR([XPMEM support requested but not found])])
 	      ])
 
+	AC_DEFINE_UNQUOTED([HAVE_XPMEM], [$xpmem_happy],
+			   [Define to 1 if XPMEM is available for shm])
+
 	AS_IF([test $shm_happy -eq 1 && \
 	       test $cma_happy -eq 1], [$1], [$2])
 ])
+
+AC_ARG_WITH([xpmem],
+	    AC_HELP_STRING([--with-xpmem=DIR],
+			   [Enable XPMEM single-copy support in the shm
+			    provider, optionally with the path to where
+			    XPMEM is installed]))
@@ -68,6 +68,10 @@
 
 struct smr_env {
 	size_t sar_threshold;
+	size_t sar_depth;
+	size_t sar_size;
+	int disable_cma;
+	int disable_xpmem;
 };
 
 extern struct smr_env smr_env;
@@ -183,6 +187,8 @@ static inline enum fi_hmem_iface smr_get_mr_hmem_iface(struct util_domain *domai
 struct smr_unexp_msg {
 	struct dlist_entry entry;
 	struct smr_cmd cmd;
+	/* continuation of cmd.msg.data for multi-entry inline msgs */
+	uint8_t inline_data[SMR_INLINE_SIZE - SMR_MSG_DATA_LEN];
 };
 
 OFI_DECLARE_FREESTACK(struct smr_rx_entry, smr_recv_fs);
@@ -235,6 +241,84 @@ static inline void *smr_get_ptr(void *base, uint64_t offset)
 	return (char *) base + (uintptr_t) offset;
 }
 
+/* Takes cnt cmd credits from the peer, which guarantees that the cmd
+ * queue has room and that an inject buffer is available for each cmd.
+ */
+static inline bool smr_get_cmds(struct smr_region *peer_smr, int cnt)
+{
+	if (ofi_atomic_get64(&peer_smr->cmd_cnt) < cnt)
+		return false;
+
+	if (ofi_atomic_sub64(&peer_smr->cmd_cnt, cnt) < 0) {
+		ofi_atomic_add64(&peer_smr->cmd_cnt, cnt);
+		return false;
+	}
+	return true;
+}
+
+static inline void smr_put_cmds(struct smr_region *peer_smr, int cnt)
+{
+	ofi_atomic_add64(&peer_smr->cmd_cnt, cnt);
+}
+
+/* Copies cnt consecutive cmds into the peer's cmd queue.  The entries
+ * are committed last to first, so that the peer never sees a partially
+ * written cmd sequence (e.g. a RMA cmd without its rma_iov cmd).
+ */
+static inline void smr_insert_cmds(struct smr_region *peer_smr,
+				   const struct smr_cmd *cmds, int cnt)
+{
+	struct smr_cmd_queue *queue = smr_cmd_queue(peer_smr);
+	int64_t pos;
+	int i;
+
+	pos = smr_cmd_queue_reserve(queue, cnt);
+	for (i = 0; i < cnt; i++)
+		*smr_cmd_queue_claim(queue, pos + i) = cmds[i];
+	for (i = cnt - 1; i >= 0; i--)
+		smr_cmd_queue_commit(queue, pos + i);
+}
+
+static inline struct smr_inject_buf *smr_pop_inject_buf(struct smr_region *smr)
+{
+	struct smr_inject_buf *tx_buf;
+
+	fastlock_acquire(&smr->lock);
+	tx_buf = smr_freestack_pop(smr_inject_pool(smr));
+	fastlock_release(&smr->lock);
+	return tx_buf;
+}
+
+static inline void smr_push_inject_buf(struct smr_region *smr,
+				       struct smr_inject_buf *tx_buf)
+{
+	fastlock_acquire(&smr->lock);
+	smr_freestack_push(smr_inject_pool(smr), tx_buf);
+	fastlock_release(&smr->lock);
+}
+
+static inline struct smr_sar_msg *smr_pop_sar_msg(struct smr_region *smr)
+{
+	struct smr_sar_msg *sar_msg = NULL;
+
+	fastlock_acquire(&smr->lock);
+	if (smr->sar_cnt) {
+		sar_msg = smr_freestack_pop(smr_sar_pool(smr));
+		smr->sar_cnt--;
+	}
+	fastlock_release(&smr->lock);
+	return sar_msg;
+}
+
+static inline void smr_push_sar_msg(struct smr_region *smr,
+				    struct smr_sar_msg *sar_msg)
+{
+	fastlock_acquire(&smr->lock);
+	smr_freestack_push(smr_sar_pool(smr), sar_msg);
+	smr->sar_cnt++;
+	fastlock_release(&smr->lock);
+}
+
 extern struct dlist_entry sock_name_list;
 extern pthread_mutex_t sock_list_lock;
 
@@ -265,6 +349,8 @@ struct smr_sock_info {
 	struct smr_cmap_entry	peers[SMR_MAX_PEERS];
 };
 
+struct smr_xpmem_cache;
+
 struct smr_ep {
 	struct util_ep		util_ep;
 	smr_rx_comp_func	rx_comp;
@@ -287,6 +373,7 @@ struct smr_ep {
 
 	int			ep_idx;
 	struct smr_sock_info	*sock_info;
+	struct smr_xpmem_cache	*xpmem_cache; /* protected by rx_cq lock */
 };
 
 #define smr_ep_rx_flags(smr_ep) ((smr_ep)->util_ep.rx_op_flags)
@@ -324,6 +411,9 @@ void smr_format_inject(struct smr_cmd *cmd, enum fi_hmem_iface iface, uint64_t d
 void smr_format_iov(struct smr_cmd *cmd, const struct iovec *iov, size_t count,
 		    size_t total_len, struct smr_region *smr,
 		    struct smr_resp *resp);
+void smr_format_xpmem(struct smr_cmd *cmd, const struct iovec *iov,
+		      size_t count, size_t total_len, struct smr_region *smr,
+		      struct smr_resp *resp);
 int smr_format_ze_ipc(struct smr_ep *ep, int64_t id, struct smr_cmd *cmd,
 		      const struct iovec *iov, uint64_t device,
 		      size_t total_len, struct smr_region *smr,
@@ -336,14 +426,27 @@ void smr_format_sar(struct smr_cmd *cmd, enum fi_hmem_iface iface, uint64_t deiv
 		    size_t total_len, struct smr_region *smr,
 		    struct smr_region *peer_smr, struct smr_sar_msg *sar_msg,
 		    struct smr_tx_entry *pending, struct smr_resp *resp);
-size_t smr_copy_to_sar(struct smr_sar_msg *sar_msg, struct smr_resp *resp,
-		       struct smr_cmd *cmd, enum fi_hmem_iface,
-		       uint64_t device, const struct iovec *iov, size_t count,
+size_t smr_copy_to_sar(struct smr_region *smr, struct smr_sar_msg *sar_msg,
+		       struct smr_resp *resp, struct smr_cmd *cmd,
+		       enum fi_hmem_iface iface, uint64_t device,
+		       const struct iovec *iov, size_t count,
 		       size_t *bytes_done, int *next);
-size_t smr_copy_from_sar(struct smr_sar_msg *sar_msg, struct smr_resp *resp,
-			 struct smr_cmd *cmd, enum fi_hmem_iface iface,
-			 uint64_t device, const struct iovec *iov, size_t count,
+size_t smr_copy_from_sar(struct smr_region *smr, struct smr_sar_msg *sar_msg,
+			 struct smr_resp *resp, struct smr_cmd *cmd,
+			 enum fi_hmem_iface iface, uint64_t device,
+			 const struct iovec *iov, size_t count,
 			 size_t *bytes_done, int *next);
+static inline bool smr_sar_msg_free(struct smr_region *smr,
+				    struct smr_sar_msg *sar_msg)
+{
+	size_t i;
+
+	for (i = 0; i < smr->sar_depth; i++) {
+		if (smr_sar_buf(smr, sar_msg, i)->status != SMR_SAR_FREE)
+			return false;
+	}
+	return true;
+}
 
 int smr_complete_tx(struct smr_ep *ep, void *context, uint32_t op,
 		uint16_t flags, uint64_t err);
@@ -380,6 +483,13 @@ static inline bool smr_cma_enabled(struct smr_ep *ep,
 		return ep->region->cma_cap_peer == SMR_CMA_CAP_ON;
 }
 
+static inline bool smr_xpmem_enabled(struct smr_ep *ep,
+				     struct smr_region *peer_smr)
+{
+	return (ep->region->flags & SMR_FLAG_XPMEM) &&
+	       (peer_smr->flags & SMR_FLAG_XPMEM);
+}
+
 static inline bool smr_ze_ipc_enabled(struct smr_region *smr,
 				      struct smr_region *peer_smr)
 {
@@ -416,6 +526,21 @@ static inline int smr_cma_loop(pid_t pid, struct iovec *local,
 	}
 }
 
+/*
+ * XPMEM single-copy support.  Each process exports its whole address
+ * space once, and receivers attach the sender's buffers on demand.
+ * Attachments are cached per endpoint so that repeated transfers from
+ * the same buffers are a plain memcpy.
+ */
+int smr_xpmem_init(struct smr_ep *ep);
+void smr_xpmem_close(struct smr_ep *ep);
+void smr_xpmem_del_peer(struct smr_ep *ep, int64_t id);
+void smr_xpmem_cleanup(void);
+int smr_xpmem_copy(struct smr_ep *ep, struct smr_region *peer_smr,
+		   struct iovec *local, size_t local_cnt,
+		   struct iovec *remote, size_t remote_cnt,
+		   size_t total, bool write);
+
 int smr_progress_unexp_queue(struct smr_ep *ep, struct smr_rx_entry *entry,
 			     struct smr_queue *unexp_queue);
 
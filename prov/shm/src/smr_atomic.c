@@ -137,7 +137,7 @@ static ssize_t smr_generic_atomic(struct smr_ep *ep,
 	struct smr_inject_buf *tx_buf;
 	struct smr_tx_entry *pend;
 	struct smr_resp *resp = NULL;
-	struct smr_cmd *cmd;
+	struct smr_cmd cmd_buf[2], *cmd = &cmd_buf[0];
 	struct iovec iov[SMR_IOV_LIMIT];
 	struct iovec compare_iov[SMR_IOV_LIMIT];
 	struct iovec result_iov[SMR_IOV_LIMIT];
@@ -161,11 +161,9 @@ static ssize_t smr_generic_atomic(struct smr_ep *ep,
 	peer_id = smr_peer_data(ep->region)[id].addr.id;
 	peer_smr = smr_peer_region(ep->region, id);
 
-	fastlock_acquire(&peer_smr->lock);
-	if (peer_smr->cmd_cnt < 2 || smr_peer_data(ep->region)[id].sar_status) {
-		ret = -FI_EAGAIN;
-		goto unlock_region;
-	}
+	if (smr_peer_data(ep->region)[id].sar_status ||
+	    !smr_get_cmds(peer_smr, 2))
+		return -FI_EAGAIN;
 
 	fastlock_acquire(&ep->util_ep.tx_cq->cq_lock);
 	if (ofi_cirque_isfull(ep->util_ep.tx_cq->cirq)) {
@@ -173,7 +171,6 @@ static ssize_t smr_generic_atomic(struct smr_ep *ep,
 		goto unlock_cq;
 	}
 
-	cmd = ofi_cirque_next(smr_cmd_queue(peer_smr));
 	total_len = ofi_datatype_size(datatype) * ofi_total_ioc_cnt(ioc, count);
 
 	switch (op) {
@@ -211,13 +208,13 @@ static ssize_t smr_generic_atomic(struct smr_ep *ep,
 		smr_format_inline_atomic(cmd, iface, device, iov, count, compare_iov,
 					 compare_count);
 	} else if (total_len <= SMR_INJECT_SIZE) {
-		tx_buf = smr_freestack_pop(smr_inject_pool(peer_smr));
+		tx_buf = smr_pop_inject_buf(peer_smr);
 		smr_format_inject_atomic(cmd, iface, device, iov, count, result_iov,
 					 result_count, compare_iov, compare_count,
 					 peer_smr, tx_buf);
 		if (flags & SMR_RMA_REQ || op_flags & FI_DELIVERY_COMPLETE) {
 			if (ofi_cirque_isfull(smr_resp_queue(ep->region))) {
-				smr_freestack_push(smr_inject_pool(peer_smr), tx_buf);
+				smr_push_inject_buf(peer_smr, tx_buf);
 				ret = -FI_EAGAIN;
 				goto unlock_cq;
 			}
@@ -235,9 +232,8 @@ static ssize_t smr_generic_atomic(struct smr_ep *ep,
 		goto unlock_cq;
 	}
 	cmd->msg.hdr.op_flags |= flags;
-
-	ofi_cirque_commit(smr_cmd_queue(peer_smr));
-	peer_smr->cmd_cnt--;
+	smr_format_rma_ioc(&cmd_buf[1], rma_ioc, rma_count);
+	smr_insert_cmds(peer_smr, cmd_buf, 2);
 
 	if (!resp) {
 		ret = smr_complete_tx(ep, context, op, cmd->msg.hdr.op_flags,
@@ -247,15 +243,12 @@ static ssize_t smr_generic_atomic(struct smr_ep *ep,
 				"unable to process tx completion\n");
 		}
 	}
+	fastlock_release(&ep->util_ep.tx_cq->cq_lock);
+	return ret;
 
-	cmd = ofi_cirque_next(smr_cmd_queue(peer_smr));
-	smr_format_rma_ioc(cmd, rma_ioc, rma_count);
-	ofi_cirque_commit(smr_cmd_queue(peer_smr));
-	peer_smr->cmd_cnt--;
 unlock_cq:
 	fastlock_release(&ep->util_ep.tx_cq->cq_lock);
-unlock_region:
-	fastlock_release(&peer_smr->lock);
+	smr_put_cmds(peer_smr, 2);
 	return ret;
 }
 
@@ -322,11 +315,10 @@ static ssize_t smr_atomic_inject(struct fid_ep *ep_fid, const void *buf,
 	struct smr_ep *ep;
 	struct smr_region *peer_smr;
 	struct smr_inject_buf *tx_buf;
-	struct smr_cmd *cmd;
+	struct smr_cmd cmd[2];
 	struct iovec iov;
 	struct fi_rma_ioc rma_ioc;
 	int64_t id, peer_id;
-	ssize_t ret = 0;
 	size_t total_len;
 
 	assert(count <= SMR_INJECT_SIZE);
@@ -340,13 +332,10 @@ static ssize_t smr_atomic_inject(struct fid_ep *ep_fid, const void *buf,
 	peer_id = smr_peer_data(ep->region)[id].addr.id;
 	peer_smr = smr_peer_region(ep->region, id);
 
-	fastlock_acquire(&peer_smr->lock);
-	if (peer_smr->cmd_cnt < 2 || smr_peer_data(ep->region)[id].sar_status) {
-		ret = -FI_EAGAIN;
-		goto unlock_region;
-	}
+	if (smr_peer_data(ep->region)[id].sar_status ||
+	    !smr_get_cmds(peer_smr, 2))
+		return -FI_EAGAIN;
 
-	cmd = ofi_cirque_next(smr_cmd_queue(peer_smr));
 	total_len = count * ofi_datatype_size(datatype);
 
 	iov.iov_base = (void *) buf;
@@ -356,28 +345,22 @@ static ssize_t smr_atomic_inject(struct fid_ep *ep_fid, const void *buf,
 	rma_ioc.count = count;
 	rma_ioc.key = key;
 
-	smr_generic_format(cmd, peer_id, ofi_op_atomic, 0, 0, 0);
-	smr_generic_atomic_format(cmd, datatype, op);
+	smr_generic_format(&cmd[0], peer_id, ofi_op_atomic, 0, 0, 0);
+	smr_generic_atomic_format(&cmd[0], datatype, op);
 
 	if (total_len <= SMR_MSG_DATA_LEN) {
-		smr_format_inline_atomic(cmd, FI_HMEM_SYSTEM, 0, &iov, 1, NULL, 0);
+		smr_format_inline_atomic(&cmd[0], FI_HMEM_SYSTEM, 0, &iov, 1,
+					 NULL, 0);
 	} else if (total_len <= SMR_INJECT_SIZE) {
-		tx_buf = smr_freestack_pop(smr_inject_pool(peer_smr));
-		smr_format_inject_atomic(cmd, FI_HMEM_SYSTEM, 0, &iov, 1, NULL,
-					 0, NULL, 0, peer_smr, tx_buf);
+		tx_buf = smr_pop_inject_buf(peer_smr);
+		smr_format_inject_atomic(&cmd[0], FI_HMEM_SYSTEM, 0, &iov, 1,
+					 NULL, 0, NULL, 0, peer_smr, tx_buf);
 	}
-
-	ofi_cirque_commit(smr_cmd_queue(peer_smr));
-	peer_smr->cmd_cnt--;
-	cmd = ofi_cirque_next(smr_cmd_queue(peer_smr));
-	smr_format_rma_ioc(cmd, &rma_ioc, 1);
-	ofi_cirque_commit(smr_cmd_queue(peer_smr));
-	peer_smr->cmd_cnt--;
+	smr_format_rma_ioc(&cmd[1], &rma_ioc, 1);
+	smr_insert_cmds(peer_smr, cmd, 2);
 
 	ofi_ep_tx_cntr_inc_func(&ep->util_ep, ofi_op_atomic);
-unlock_region:
-	fastlock_release(&peer_smr->lock);
-	return ret;
+	return 0;
 }
 
 static ssize_t smr_atomic_readwritemsg(struct fid_ep *ep_fid,
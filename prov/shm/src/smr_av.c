@@ -98,7 +98,7 @@ static int smr_av_insert(struct fid_av *av_fid, const void *addr, size_t count,
 			continue;
 		} else {
 			assert(shm_id >= 0 && shm_id < SMR_MAX_PEERS);
-			smr_av->smr_map->peers[shm_id].fiaddr = util_addr;
+			smr_map_peer(smr_av->smr_map, shm_id)->fiaddr = util_addr;
 			succ_count++;
 			smr_av->used++;
 		}
@@ -141,6 +141,12 @@ static int smr_av_remove(struct fid_av *av_fid, fi_addr_t *fi_addr, size_t count
 			break;
 		}
 
+		dlist_foreach(&util_av->ep_list, av_entry) {
+			util_ep = container_of(av_entry, struct util_ep, av_entry);
+			smr_ep = container_of(util_ep, struct smr_ep, util_ep);
+			smr_xpmem_del_peer(smr_ep, id);
+		}
+
 		smr_map_del(smr_av->smr_map, id);
 		dlist_foreach(&util_av->ep_list, av_entry) {
 			util_ep = container_of(av_entry, struct util_ep, av_entry);
@@ -159,21 +165,24 @@ static int smr_av_lookup(struct fid_av *av, fi_addr_t fi_addr, void *addr,
 {
 	struct util_av *util_av;
 	struct smr_av *smr_av;
-	struct smr_region *peer_smr;
+	const char *name;
 	int64_t id;
 
 	util_av = container_of(av, struct util_av, av_fid);
 	smr_av = container_of(util_av, struct smr_av, util_av);
 
+	/* Peers are mapped lazily, so report the name held by the map */
 	id = smr_addr_lookup(util_av, fi_addr);
-	peer_smr = smr_map_get(smr_av->smr_map, id);
+	if (id < 0 || id >= smr_av->smr_map->peer_cnt)
+		return -FI_ENODATA;
 
-	if (!peer_smr)
+	name = smr_map_peer(smr_av->smr_map, id)->peer.name;
+	if (!name[0])
 		return -FI_ENODATA;
 
-	strncpy((char *)addr, smr_name(peer_smr), *addrlen);
-	((char *) addr)[MIN(*addrlen - 1, strlen(smr_name(peer_smr)))] = '\0';
-	*addrlen = strlen(smr_name(peer_smr) + 1);
+	strncpy((char *)addr, name, *addrlen);
+	((char *) addr)[MIN(*addrlen - 1, strlen(name))] = '\0';
+	*addrlen = strlen(name) + 1;
 	return 0;
 }
 
@@ -246,7 +255,7 @@ int smr_av_open(struct fid_domain *domain, struct fi_av_attr *attr,
 	(*av)->fid.ops = &smr_av_fi_ops;
 	(*av)->ops = &smr_av_ops;
 
-	ret = smr_map_create(&smr_prov, SMR_MAX_PEERS, &smr_av->smr_map);
+	ret = smr_map_create(&smr_prov, attr->count, &smr_av->smr_map);
 	if (ret)
 		goto close;
 
@@ -131,7 +131,7 @@ int smr_complete_rx(struct smr_ep *ep, void *context, uint32_t op,
 		return 0;
 
 	if (ep->util_ep.domain->info_domain_caps & FI_SOURCE)
-		fiaddr = ep->region->map->peers[id].fiaddr;
+		fiaddr = smr_map_peer(ep->region->map, id)->fiaddr;
 
 	return ep->rx_comp(ep, context, op, flags, len, buf,
 			   fiaddr, tag, data, err);
@@ -185,33 +185,26 @@ static struct fi_ops_ep smr_ep_ops = {
 static void smr_send_name(struct smr_ep *ep, int64_t id)
 {
 	struct smr_region *peer_smr;
-	struct smr_cmd *cmd;
+	struct smr_cmd cmd;
 	struct smr_inject_buf *tx_buf;
 
 	peer_smr = smr_peer_region(ep->region, id);
 
-	fastlock_acquire(&peer_smr->lock);
-
-	if (smr_peer_data(ep->region)[id].name_sent || !peer_smr->cmd_cnt)
-		goto out;
-
-	cmd = ofi_cirque_next(smr_cmd_queue(peer_smr));
+	if (smr_peer_data(ep->region)[id].name_sent ||
+	    !smr_get_cmds(peer_smr, 1))
+		return;
 
-	cmd->msg.hdr.op = SMR_OP_MAX + ofi_ctrl_connreq;
-	cmd->msg.hdr.id = id;
+	cmd.msg.hdr.op = SMR_OP_MAX + ofi_ctrl_connreq;
+	cmd.msg.hdr.id = id;
 
-	tx_buf = smr_freestack_pop(smr_inject_pool(peer_smr));
-	cmd->msg.hdr.src_data = smr_get_offset(peer_smr, tx_buf);
+	tx_buf = smr_pop_inject_buf(peer_smr);
+	cmd.msg.hdr.src_data = smr_get_offset(peer_smr, tx_buf);
 
-	cmd->msg.hdr.size = strlen(smr_name(ep->region)) + 1;
-	memcpy(tx_buf->data, smr_name(ep->region), cmd->msg.hdr.size);
+	cmd.msg.hdr.size = strlen(smr_name(ep->region)) + 1;
+	memcpy(tx_buf->data, smr_name(ep->region), cmd.msg.hdr.size);
 
 	smr_peer_data(ep->region)[id].name_sent = 1;
-	ofi_cirque_commit(smr_cmd_queue(peer_smr));
-	peer_smr->cmd_cnt--;
-
-out:
-	fastlock_release(&peer_smr->lock);
+	smr_insert_cmds(peer_smr, &cmd, 1);
 }
 
 int64_t smr_verify_peer(struct smr_ep *ep, fi_addr_t fi_addr)
@@ -222,16 +215,18 @@ int64_t smr_verify_peer(struct smr_ep *ep, fi_addr_t fi_addr)
 	id = smr_addr_lookup(ep->util_ep.av, fi_addr);
 	assert(id < SMR_MAX_PEERS);
 
+	smr_reserve_peer_data(ep->region, id);
 	if (smr_peer_data(ep->region)[id].addr.id >= 0)
 		return id;
 
-	if (ep->region->map->peers[id].peer.id < 0) {
-		ret = smr_map_to_region(&smr_prov, &ep->region->map->peers[id]);
-		if (ret == -ENOENT)
+	if (smr_map_peer(ep->region->map, id)->peer.id < 0) {
+		ret = smr_map_region(&smr_prov, ep->region->map, id);
+		if (ret)
 			return -1;
-
 	}
 
+	if (!smr_peer_data(ep->region)[id].name_sent)
+		smr_map_to_endpoint(ep->region, id);
 	smr_send_name(ep, id);
 
 	return -1;
@@ -323,12 +318,13 @@ void smr_generic_format(struct smr_cmd *cmd, int64_t peer_id, uint32_t op,
 		cmd->msg.hdr.op_flags |= SMR_TX_COMPLETION;
 }
 
+/* cmd must have room for smr_inline_cmds(total_len) consecutive cmds */
 void smr_format_inline(struct smr_cmd *cmd, enum fi_hmem_iface iface,
 		       uint64_t device, const struct iovec *iov, size_t count)
 {
 	cmd->msg.hdr.op_src = smr_src_inline;
 	cmd->msg.hdr.size = ofi_copy_from_hmem_iov(cmd->msg.data.msg,
-						SMR_MSG_DATA_LEN, iface, device,
+						SMR_INLINE_SIZE, iface, device,
 						iov, count, 0);
 }
 
@@ -353,6 +349,14 @@ void smr_format_iov(struct smr_cmd *cmd, const struct iovec *iov, size_t count,
 	memcpy(cmd->msg.data.iov, iov, sizeof(*iov) * count);
 }
 
+void smr_format_xpmem(struct smr_cmd *cmd, const struct iovec *iov,
+		      size_t count, size_t total_len, struct smr_region *smr,
+		      struct smr_resp *resp)
+{
+	smr_format_iov(cmd, iov, count, total_len, smr, resp);
+	cmd->msg.hdr.op_src = smr_src_xpmem;
+}
+
 int smr_format_ze_ipc(struct smr_ep *ep, int64_t id, struct smr_cmd *cmd,
 		      const struct iovec *iov, uint64_t device,
 		      size_t total_len, struct smr_region *smr,
@@ -467,62 +471,54 @@ remove_entry:
 	return ret;
 }
 
-size_t smr_copy_to_sar(struct smr_sar_msg *sar_msg, struct smr_resp *resp,
-		       struct smr_cmd *cmd, enum fi_hmem_iface iface,
-		       uint64_t device, const struct iovec *iov, size_t count,
+size_t smr_copy_to_sar(struct smr_region *smr, struct smr_sar_msg *sar_msg,
+		       struct smr_resp *resp, struct smr_cmd *cmd,
+		       enum fi_hmem_iface iface, uint64_t device,
+		       const struct iovec *iov, size_t count,
 		       size_t *bytes_done, int *next)
 {
+	struct smr_sar_buf *sar_buf;
 	size_t start = *bytes_done;
 
-	if (sar_msg->sar[0].status == SMR_SAR_FREE && !*next) {
-		*bytes_done += ofi_copy_from_hmem_iov(sar_msg->sar[0].buf,
-					SMR_SAR_SIZE, iface, device,
-					iov, count, *bytes_done);
-		sar_msg->sar[0].status = SMR_SAR_READY;
-		if (cmd->msg.hdr.op == ofi_op_read_req)
-			resp->status = FI_SUCCESS;
-		*next = 1;
-	}
+	while (*bytes_done < cmd->msg.hdr.size) {
+		sar_buf = smr_sar_buf(smr, sar_msg, *next);
+		if (sar_buf->status != SMR_SAR_FREE)
+			break;
 
-	if (*bytes_done < cmd->msg.hdr.size &&
-	    sar_msg->sar[1].status == SMR_SAR_FREE && *next) {
-		*bytes_done += ofi_copy_from_hmem_iov(sar_msg->sar[1].buf,
-					SMR_SAR_SIZE, iface, device,
+		*bytes_done += ofi_copy_from_hmem_iov(sar_buf->buf,
+					smr->sar_size, iface, device,
 					iov, count, *bytes_done);
-		sar_msg->sar[1].status = SMR_SAR_READY;
+		sar_buf->status = SMR_SAR_READY;
 		if (cmd->msg.hdr.op == ofi_op_read_req)
 			resp->status = FI_SUCCESS;
-		*next = 0;
+		if (++*next == smr->sar_depth)
+			*next = 0;
 	}
 	return *bytes_done - start;
 }
 
-size_t smr_copy_from_sar(struct smr_sar_msg *sar_msg, struct smr_resp *resp,
-			 struct smr_cmd *cmd, enum fi_hmem_iface iface,
-			 uint64_t device, const struct iovec *iov, size_t count,
+size_t smr_copy_from_sar(struct smr_region *smr, struct smr_sar_msg *sar_msg,
+			 struct smr_resp *resp, struct smr_cmd *cmd,
+			 enum fi_hmem_iface iface, uint64_t device,
+			 const struct iovec *iov, size_t count,
 			 size_t *bytes_done, int *next)
 {
+	struct smr_sar_buf *sar_buf;
 	size_t start = *bytes_done;
 
-	if (sar_msg->sar[0].status == SMR_SAR_READY && !*next) {
-		*bytes_done += ofi_copy_to_hmem_iov(iface, device, iov, count,
-					*bytes_done, sar_msg->sar[0].buf,
-					SMR_SAR_SIZE);
-		sar_msg->sar[0].status = SMR_SAR_FREE;
-		if (cmd->msg.hdr.op != ofi_op_read_req)
-			resp->status = FI_SUCCESS;
-		*next = 1;
-	}
+	while (*bytes_done < cmd->msg.hdr.size) {
+		sar_buf = smr_sar_buf(smr, sar_msg, *next);
+		if (sar_buf->status != SMR_SAR_READY)
+			break;
 
-	if (*bytes_done < cmd->msg.hdr.size &&
-	    sar_msg->sar[1].status == SMR_SAR_READY && *next) {
 		*bytes_done += ofi_copy_to_hmem_iov(iface, device, iov, count,
-					*bytes_done, sar_msg->sar[1].buf,
-					SMR_SAR_SIZE);
-		sar_msg->sar[1].status = SMR_SAR_FREE;
+					*bytes_done, sar_buf->buf,
+					smr->sar_size);
+		sar_buf->status = SMR_SAR_FREE;
 		if (cmd->msg.hdr.op != ofi_op_read_req)
 			resp->status = FI_SUCCESS;
-		*next = 0;
+		if (++*next == smr->sar_depth)
+			*next = 0;
 	}
 	return *bytes_done - start;
 }
@@ -533,6 +529,8 @@ void smr_format_sar(struct smr_cmd *cmd, enum fi_hmem_iface iface, uint64_t devi
 		    struct smr_region *peer_smr, struct smr_sar_msg *sar_msg,
 		    struct smr_tx_entry *pending, struct smr_resp *resp)
 {
+	size_t i;
+
 	cmd->msg.hdr.op_src = smr_src_sar;
 	cmd->msg.hdr.src_data = smr_get_offset(smr, resp);
 	cmd->msg.data.sar = smr_get_offset(peer_smr, sar_msg);
@@ -540,11 +538,12 @@ void smr_format_sar(struct smr_cmd *cmd, enum fi_hmem_iface iface, uint64_t devi
 
 	pending->bytes_done = 0;
 	pending->next = 0;
-	sar_msg->sar[0].status = SMR_SAR_FREE;
-	sar_msg->sar[1].status = SMR_SAR_FREE;
+	for (i = 0; i < peer_smr->sar_depth; i++)
+		smr_sar_buf(peer_smr, sar_msg, i)->status = SMR_SAR_FREE;
 	if (cmd->msg.hdr.op != ofi_op_read_req)
-		smr_copy_to_sar(sar_msg, NULL, cmd, iface, device ,iov, count,
-				&pending->bytes_done, &pending->next);
+		smr_copy_to_sar(peer_smr, sar_msg, NULL, cmd, iface, device,
+				iov, count, &pending->bytes_done,
+				&pending->next);
 }
 
 static void smr_cleanup_epoll(struct smr_sock_info *sock_info)
@@ -570,6 +569,7 @@ static int smr_ep_close(struct fid *fid)
 
 	ofi_endpoint_close(&ep->util_ep);
 
+	smr_xpmem_close(ep);
 	if (ep->region)
 		smr_free(ep->region);
 
@@ -1033,6 +1033,8 @@ static int smr_ep_ctrl(struct fid *fid, int command, void *arg)
 		attr.name = ep->name;
 		attr.rx_count = ep->rx_size;
 		attr.tx_count = ep->tx_size;
+		attr.sar_depth = smr_env.sar_depth;
+		attr.sar_size = smr_env.sar_size;
 		ret = smr_create(&smr_prov, av->smr_map, &attr, &ep->region);
 		if (ret)
 			return ret;
@@ -1042,8 +1044,15 @@ static int smr_ep_ctrl(struct fid *fid, int command, void *arg)
 			ep->region->cma_cap_self = SMR_CMA_CAP_OFF;
 			if (ze_hmem_p2p_enabled())
 				smr_init_ipc_socket(ep);
+		} else if (smr_env.disable_cma) {
+			ep->region->cma_cap_peer = SMR_CMA_CAP_OFF;
+			ep->region->cma_cap_self = SMR_CMA_CAP_OFF;
 		}
 
+		ret = smr_xpmem_init(ep);
+		if (ret)
+			return ret;
+
 		smr_exchange_all_peers(ep->region);
 		break;
 	default:
@@ -40,11 +40,36 @@
 extern struct sigaction *old_action;
 struct smr_env smr_env = {
 	.sar_threshold = SIZE_MAX,
+	.sar_depth = SMR_SAR_DEPTH,
+	.sar_size = SMR_SAR_SIZE,
+	.disable_cma = 0,
+	.disable_xpmem = 0,
 };
 
 static void smr_init_env(void)
 {
 	fi_param_get_size_t(&smr_prov, "sar_threshold", &smr_env.sar_threshold);
+	fi_param_get_size_t(&smr_prov, "sar_depth", &smr_env.sar_depth);
+	if (smr_env.sar_depth < 1 || smr_env.sar_depth > SMR_SAR_MAX_DEPTH) {
+		FI_WARN(&smr_prov, FI_LOG_CORE,
+			"Invalid sar_depth (%zu), using %d\n",
+			smr_env.sar_depth, SMR_SAR_DEPTH);
+		smr_env.sar_depth = SMR_SAR_DEPTH;
+	}
+	fi_param_get_size_t(&smr_prov, "sar_size", &smr_env.sar_size);
+	if (smr_env.sar_size < SMR_INJECT_SIZE) {
+		FI_WARN(&smr_prov, FI_LOG_CORE,
+			"Invalid sar_size (%zu), using %d\n",
+			smr_env.sar_size, SMR_SAR_SIZE);
+		smr_env.sar_size = SMR_SAR_SIZE;
+	} else if (smr_env.sar_size > SMR_SAR_MAX_SIZE) {
+		FI_WARN(&smr_prov, FI_LOG_CORE,
+			"sar_size (%zu) too large, using %d\n",
+			smr_env.sar_size, SMR_SAR_MAX_SIZE);
+		smr_env.sar_size = SMR_SAR_MAX_SIZE;
+	}
+	fi_param_get_bool(&smr_prov, "disable_cma", &smr_env.disable_cma);
+	fi_param_get_bool(&smr_prov, "disable_xpmem", &smr_env.disable_xpmem);
 	fi_param_get_size_t(&smr_prov, "tx_size", &smr_info.tx_attr->size);
 	fi_param_get_size_t(&smr_prov, "rx_size", &smr_info.rx_attr->size);
 }
@@ -98,9 +123,11 @@ static int smr_shm_space_check(size_t tx_count, size_t rx_count)
 	}
 	shm_size_needed = num_of_core *
 			  smr_calculate_size_offsets(tx_count, rx_count,
+						     smr_env.sar_depth,
+						     smr_env.sar_size,
 						     NULL, NULL, NULL,
 						     NULL, NULL, NULL,
-						     NULL);
+						     NULL, NULL);
 	err = statvfs(shm_fs, &stat);
 	if (err) {
 		FI_WARN(&smr_prov, FI_LOG_CORE,
@@ -181,6 +208,7 @@ static void smr_fini(void)
 	ofi_hmem_cleanup();
 #endif
 	smr_cleanup();
+	smr_xpmem_cleanup();
 	free(old_action);
 }
 
@@ -208,6 +236,22 @@ SHM_INI
 			"Max size to use for alternate SAR protocol if CMA \
 			 is not available before switching to mmap protocol \
 			 Default: SIZE_MAX (18446744073709551615)");
+	fi_param_define(&smr_prov, "sar_depth", FI_PARAM_SIZE_T,
+			"Number of segments of a SAR message that may be in \
+			 flight between sender and receiver (1-64) \
+			 Default: 2");
+	fi_param_define(&smr_prov, "sar_size", FI_PARAM_SIZE_T,
+			"Size of each SAR segment in bytes (4096-1048576) \
+			 Default: 16384");
+	fi_param_define(&smr_prov, "disable_cma", FI_PARAM_BOOL,
+			"Disable use of CMA (Cross Memory Attach) for copying \
+			 data directly between processes, so that large \
+			 transfers use the SAR or mmap protocols \
+			 Default: no");
+	fi_param_define(&smr_prov, "disable_xpmem", FI_PARAM_BOOL,
+			"Disable use of XPMEM for single-copy transfers \
+			 when the provider was built with XPMEM support \
+			 Default: no");
 	fi_param_define(&smr_prov, "tx_size", FI_PARAM_SIZE_T,
 			"Max number of outstanding tx operations \
 			 Default: 1024");
@@ -94,7 +94,6 @@ ssize_t smr_generic_recv(struct smr_ep *ep, const struct iovec *iov, void **desc
 	assert(iov_count <= SMR_IOV_LIMIT);
 	assert(!(flags & FI_MULTI_RECV) || iov_count == 1);
 
-	fastlock_acquire(&ep->region->lock);
 	fastlock_acquire(&ep->util_ep.rx_cq->cq_lock);
 
 	entry = smr_get_recv_entry(ep, iov, desc, iov_count, addr, context, tag,
@@ -106,7 +105,6 @@ ssize_t smr_generic_recv(struct smr_ep *ep, const struct iovec *iov, void **desc
 	ret = smr_progress_unexp_queue(ep, entry, unexp_queue);
 out:
 	fastlock_release(&ep->util_ep.rx_cq->cq_lock);
-	fastlock_release(&ep->region->lock);
 	return ret;
 }
 
@@ -160,13 +158,14 @@ static ssize_t smr_generic_sendmsg(struct smr_ep *ep, const struct iovec *iov,
 	struct smr_inject_buf *tx_buf;
 	struct smr_sar_msg *sar;
 	struct smr_resp *resp;
-	struct smr_cmd *cmd;
+	struct smr_cmd cmd_buf[SMR_INLINE_MAX_CMDS], *cmd = cmd_buf;
 	struct smr_tx_entry *pend;
 	enum fi_hmem_iface iface;
 	uint64_t device;
 	int64_t id, peer_id;
 	ssize_t ret = 0;
 	size_t total_len;
+	int cmd_cnt = 1;
 
 	assert(iov_count <= SMR_IOV_LIMIT);
 
@@ -177,11 +176,13 @@ static ssize_t smr_generic_sendmsg(struct smr_ep *ep, const struct iovec *iov,
 	peer_id = smr_peer_data(ep->region)[id].addr.id;
 	peer_smr = smr_peer_region(ep->region, id);
 
-	fastlock_acquire(&peer_smr->lock);
-	if (!peer_smr->cmd_cnt || smr_peer_data(ep->region)[peer_id].sar_status) {
-		ret = -FI_EAGAIN;
-		goto unlock_region;
-	}
+	total_len = ofi_total_iov_len(iov, iov_count);
+	if (total_len <= SMR_INLINE_SIZE && !(op_flags & FI_DELIVERY_COMPLETE))
+		cmd_cnt = smr_inline_cmds(total_len);
+
+	if (smr_peer_data(ep->region)[peer_id].sar_status ||
+	    !smr_get_cmds(peer_smr, cmd_cnt))
+		return -FI_EAGAIN;
 
 	fastlock_acquire(&ep->util_ep.tx_cq->cq_lock);
 	if (ofi_cirque_isfull(ep->util_ep.tx_cq->cirq)) {
@@ -191,16 +192,13 @@ static ssize_t smr_generic_sendmsg(struct smr_ep *ep, const struct iovec *iov,
 
 	iface = smr_get_mr_hmem_iface(ep->util_ep.domain, desc, &device);
 
-	total_len = ofi_total_iov_len(iov, iov_count);
-
-	cmd = ofi_cirque_next(smr_cmd_queue(peer_smr));
 	smr_generic_format(cmd, peer_id, op, tag, data, op_flags);
 
-	if (total_len <= SMR_MSG_DATA_LEN && !(op_flags & FI_DELIVERY_COMPLETE)) {
+	if (total_len <= SMR_INLINE_SIZE && !(op_flags & FI_DELIVERY_COMPLETE)) {
 		smr_format_inline(cmd, iface, device, iov, iov_count);
 	} else if (total_len <= SMR_INJECT_SIZE &&
 		   !(op_flags & FI_DELIVERY_COMPLETE)) {
-		tx_buf = smr_freestack_pop(smr_inject_pool(peer_smr));
+		tx_buf = smr_pop_inject_buf(peer_smr);
 		smr_format_inject(cmd, iface, device, iov, iov_count, peer_smr, tx_buf);
 	} else {
 		if (ofi_cirque_isfull(smr_resp_queue(ep->region))) {
@@ -209,7 +207,12 @@ static ssize_t smr_generic_sendmsg(struct smr_ep *ep, const struct iovec *iov,
 		}
 		resp = ofi_cirque_next(smr_resp_queue(ep->region));
 		pend = ofi_freestack_pop(ep->pend_fs);
-		if (smr_cma_enabled(ep, peer_smr) && iface == FI_HMEM_SYSTEM) {
+		if (iface == FI_HMEM_SYSTEM &&
+		    smr_xpmem_enabled(ep, peer_smr)) {
+			smr_format_xpmem(cmd, iov, iov_count, total_len,
+					 ep->region, resp);
+		} else if (smr_cma_enabled(ep, peer_smr) &&
+			   iface == FI_HMEM_SYSTEM) {
 			smr_format_iov(cmd, iov, iov_count, total_len, ep->region,
 				       resp);
 		} else {
@@ -220,15 +223,14 @@ static ssize_t smr_generic_sendmsg(struct smr_ep *ep, const struct iovec *iov,
 					resp, pend);
 			} else if (total_len <= smr_env.sar_threshold ||
 				   iface != FI_HMEM_SYSTEM) {
-				if (!peer_smr->sar_cnt) {
+				sar = smr_pop_sar_msg(peer_smr);
+				if (!sar) {
 					ret = -FI_EAGAIN;
 				} else {
-					sar = smr_freestack_pop(smr_sar_pool(peer_smr));
 					smr_format_sar(cmd, iface, device, iov,
 						       iov_count, total_len,
 						       ep->region, peer_smr, sar,
 						       pend, resp);
-					peer_smr->sar_cnt--;
 					smr_peer_data(ep->region)[id].sar_status = 1;
 				}
 			} else {
@@ -254,12 +256,13 @@ static ssize_t smr_generic_sendmsg(struct smr_ep *ep, const struct iovec *iov,
 	}
 
 commit:
-	ofi_cirque_commit(smr_cmd_queue(peer_smr));
-	peer_smr->cmd_cnt--;
+	smr_insert_cmds(peer_smr, cmd, cmd_cnt);
+	fastlock_release(&ep->util_ep.tx_cq->cq_lock);
+	return 0;
+
 unlock_cq:
 	fastlock_release(&ep->util_ep.tx_cq->cq_lock);
-unlock_region:
-	fastlock_release(&peer_smr->lock);
+	smr_put_cmds(peer_smr, cmd_cnt);
 	return ret;
 }
 
@@ -309,10 +312,10 @@ static ssize_t smr_generic_inject(struct fid_ep *ep_fid, const void *buf,
 	struct smr_ep *ep;
 	struct smr_region *peer_smr;
 	struct smr_inject_buf *tx_buf;
-	struct smr_cmd *cmd;
+	struct smr_cmd cmd[SMR_INLINE_MAX_CMDS];
 	int64_t id, peer_id;
-	ssize_t ret = 0;
 	struct iovec msg_iov;
+	int cmd_cnt;
 
 	assert(len <= SMR_INJECT_SIZE);
 
@@ -328,29 +331,24 @@ static ssize_t smr_generic_inject(struct fid_ep *ep_fid, const void *buf,
 	peer_id = smr_peer_data(ep->region)[id].addr.id;
 	peer_smr = smr_peer_region(ep->region, id);
 
-	fastlock_acquire(&peer_smr->lock);
-	if (!peer_smr->cmd_cnt || smr_peer_data(ep->region)[id].sar_status) {
-		ret = -FI_EAGAIN;
-		goto unlock;
-	}
+	cmd_cnt = len <= SMR_INLINE_SIZE ? smr_inline_cmds(len) : 1;
+	if (smr_peer_data(ep->region)[id].sar_status ||
+	    !smr_get_cmds(peer_smr, cmd_cnt))
+		return -FI_EAGAIN;
 
-	cmd = ofi_cirque_next(smr_cmd_queue(peer_smr));
 	smr_generic_format(cmd, peer_id, op, tag, data, op_flags);
 
-	if (len <= SMR_MSG_DATA_LEN) {
+	if (len <= SMR_INLINE_SIZE) {
 		smr_format_inline(cmd, FI_HMEM_SYSTEM, 0, &msg_iov, 1);
 	} else {
-		tx_buf = smr_freestack_pop(smr_inject_pool(peer_smr));
+		tx_buf = smr_pop_inject_buf(peer_smr);
 		smr_format_inject(cmd, FI_HMEM_SYSTEM, 0, &msg_iov, 1,
 				  peer_smr, tx_buf);
 	}
+	smr_insert_cmds(peer_smr, cmd, cmd_cnt);
 	ofi_ep_tx_cntr_inc_func(&ep->util_ep, op);
-	peer_smr->cmd_cnt--;
-	ofi_cirque_commit(smr_cmd_queue(peer_smr));
-unlock:
-	fastlock_release(&peer_smr->lock);
 
-	return ret;
+	return 0;
 }
 
 ssize_t smr_inject(struct fid_ep *ep_fid, const void *buf, size_t len,
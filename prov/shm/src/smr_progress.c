@@ -39,25 +39,27 @@
 #include "smr.h"
 
 
-static inline void smr_try_progress_to_sar(struct smr_sar_msg *sar_msg,
+static inline void smr_try_progress_to_sar(struct smr_region *smr,
+				struct smr_sar_msg *sar_msg,
 				struct smr_resp *resp,
 				struct smr_cmd *cmd, enum fi_hmem_iface iface,
 				uint64_t device, struct iovec *iov,
 				size_t iov_count, size_t *bytes_done, int *next)
 {
 	while (*bytes_done < cmd->msg.hdr.size &&
-	       smr_copy_to_sar(sar_msg, resp, cmd, iface, device, iov,
+	       smr_copy_to_sar(smr, sar_msg, resp, cmd, iface, device, iov,
 			       iov_count, bytes_done, next));
 }
 
-static inline void smr_try_progress_from_sar(struct smr_sar_msg *sar_msg,
+static inline void smr_try_progress_from_sar(struct smr_region *smr,
+				struct smr_sar_msg *sar_msg,
 				struct smr_resp *resp,
 				struct smr_cmd *cmd, enum fi_hmem_iface iface,
 				uint64_t device, struct iovec *iov,
 				size_t iov_count, size_t *bytes_done, int *next)
 {
 	while (*bytes_done < cmd->msg.hdr.size &&
-	       smr_copy_from_sar(sar_msg, resp, cmd, iface, device, iov,
+	       smr_copy_from_sar(smr, sar_msg, resp, cmd, iface, device, iov,
 				 iov_count, bytes_done, next));
 }
 
@@ -77,28 +79,28 @@ static int smr_progress_resp_entry(struct smr_ep *ep, struct smr_resp *resp,
 	case smr_src_ipc:
 		close(pending->fd);
 		break;
+	case smr_src_xpmem:
+		break;
 	case smr_src_sar:
 		sar_msg = smr_get_ptr(peer_smr, pending->cmd.msg.data.sar);
 		if (pending->bytes_done == pending->cmd.msg.hdr.size &&
-		    sar_msg->sar[0].status == SMR_SAR_FREE &&
-		    sar_msg->sar[1].status == SMR_SAR_FREE)
+		    smr_sar_msg_free(peer_smr, sar_msg))
 			break;
 
 		if (pending->cmd.msg.hdr.op == ofi_op_read_req)
-			smr_try_progress_from_sar(sar_msg, resp,
+			smr_try_progress_from_sar(peer_smr, sar_msg, resp,
 					&pending->cmd, pending->iface,
 					pending->device, pending->iov,
 				        pending->iov_count, &pending->bytes_done,
 					&pending->next);
 		else
-			smr_try_progress_to_sar(sar_msg, resp,
+			smr_try_progress_to_sar(peer_smr, sar_msg, resp,
 					&pending->cmd, pending->iface,
 					pending->device, pending->iov,
 					pending->iov_count, &pending->bytes_done,
 					&pending->next);
 		if (pending->bytes_done != pending->cmd.msg.hdr.size ||
-		    sar_msg->sar[0].status != SMR_SAR_FREE ||
-		    sar_msg->sar[1].status != SMR_SAR_FREE)
+		    !smr_sar_msg_free(peer_smr, sar_msg))
 			return -FI_EAGAIN;
 		break;
 	case smr_src_mmap:
@@ -146,24 +148,13 @@ static int smr_progress_resp_entry(struct smr_ep *ep, struct smr_resp *resp,
 			"unidentified operation type\n");
 	}
 
-	//Skip locking on transfers from self since we already have
-	//the ep->region->lock
-	if (peer_smr != ep->region) {
-		if (fastlock_tryacquire(&peer_smr->lock))
-			return -FI_EAGAIN;
-	}
-
-	peer_smr->cmd_cnt++;
 	if (tx_buf) {
-		smr_freestack_push(smr_inject_pool(peer_smr), tx_buf);
+		smr_push_inject_buf(peer_smr, tx_buf);
 	} else if (sar_msg) {
-		smr_freestack_push(smr_sar_pool(peer_smr), sar_msg);
-		peer_smr->sar_cnt++;
+		smr_push_sar_msg(peer_smr, sar_msg);
 		smr_peer_data(ep->region)[pending->peer_id].sar_status = 0;
 	}
-
-	if (peer_smr != ep->region)
-		fastlock_release(&peer_smr->lock);
+	smr_put_cmds(peer_smr, 1);
 
 	return 0;
 }
@@ -174,7 +165,6 @@ static void smr_progress_resp(struct smr_ep *ep)
 	struct smr_tx_entry *pending;
 	int ret;
 
-	fastlock_acquire(&ep->region->lock);
 	fastlock_acquire(&ep->util_ep.tx_cq->cq_lock);
 	while (!ofi_cirque_isempty(smr_resp_queue(ep->region)) &&
 	       !ofi_cirque_isfull(ep->util_ep.tx_cq->cirq)) {
@@ -198,7 +188,6 @@ static void smr_progress_resp(struct smr_ep *ep)
 		ofi_cirque_discard(smr_resp_queue(ep->region));
 	}
 	fastlock_release(&ep->util_ep.tx_cq->cq_lock);
-	fastlock_release(&ep->region->lock);
 }
 
 static int smr_progress_inline(struct smr_cmd *cmd, enum fi_hmem_iface iface,
@@ -227,7 +216,7 @@ static int smr_progress_inject(struct smr_cmd *cmd, enum fi_hmem_iface iface,
 	tx_buf = smr_get_ptr(ep->region, inj_offset);
 
 	if (err) {
-		smr_freestack_push(smr_inject_pool(ep->region), tx_buf);
+		smr_push_inject_buf(ep->region, tx_buf);
 		return err;
 	}
 
@@ -237,7 +226,7 @@ static int smr_progress_inject(struct smr_cmd *cmd, enum fi_hmem_iface iface,
 	} else {
 		*total_len = ofi_copy_to_hmem_iov(iface, device, iov, iov_count, 0,
 						  tx_buf->data, cmd->msg.hdr.size);
-		smr_freestack_push(smr_inject_pool(ep->region), tx_buf);
+		smr_push_inject_buf(ep->region, tx_buf);
 	}
 
 	if (*total_len != cmd->msg.hdr.size) {
@@ -278,6 +267,41 @@ out:
 	return -ret;
 }
 
+static int smr_progress_xpmem(struct smr_cmd *cmd, struct iovec *iov,
+			      size_t iov_count, size_t *total_len,
+			      struct smr_ep *ep, int err)
+{
+	struct smr_region *peer_smr;
+	struct smr_resp *resp;
+	int ret;
+
+	peer_smr = smr_peer_region(ep->region, cmd->msg.hdr.id);
+	resp = smr_get_ptr(peer_smr, cmd->msg.hdr.src_data);
+
+	if (err) {
+		ret = -err;
+		goto out;
+	}
+
+	ret = smr_xpmem_copy(ep, peer_smr, iov, iov_count, cmd->msg.data.iov,
+			     cmd->msg.data.iov_count, cmd->msg.hdr.size,
+			     cmd->msg.hdr.op == ofi_op_read_req);
+	/* The peer's pages could not be attached, copy them with CMA */
+	if (ret == -FI_EIO && smr_cma_enabled(ep, peer_smr))
+		ret = smr_cma_loop(peer_smr->pid, iov, iov_count,
+				   cmd->msg.data.iov, cmd->msg.data.iov_count,
+				   0, cmd->msg.hdr.size,
+				   cmd->msg.hdr.op == ofi_op_read_req);
+	if (!ret)
+		*total_len = cmd->msg.hdr.size;
+
+out:
+	//Status must be set last (signals peer: op done, valid resp entry)
+	resp->status = ret;
+
+	return -ret;
+}
+
 static int smr_mmap_peer_copy(struct smr_ep *ep, struct smr_cmd *cmd,
 				 struct iovec *iov, size_t iov_count,
 				 size_t *total_len)
@@ -288,7 +312,8 @@ static int smr_mmap_peer_copy(struct smr_ep *ep, struct smr_cmd *cmd,
 	int ret = 0;
 
 	num = smr_mmap_name(shm_name,
-			ep->region->map->peers[cmd->msg.hdr.id].peer.name,
+			smr_map_peer(ep->region->map,
+				     cmd->msg.hdr.id)->peer.name,
 			cmd->msg.hdr.msg_id);
 	if (num < 0) {
 		FI_WARN(&smr_prov, FI_LOG_AV, "generating shm file name failed\n");
@@ -376,11 +401,13 @@ static struct smr_sar_entry *smr_progress_sar(struct smr_cmd *cmd,
 	(void) ofi_truncate_iov(sar_iov, &iov_count, cmd->msg.hdr.size);
 
 	if (cmd->msg.hdr.op == ofi_op_read_req)
-		smr_try_progress_to_sar(sar_msg, resp, cmd, iface, device,
-					sar_iov, iov_count, total_len, &next);
+		smr_try_progress_to_sar(ep->region, sar_msg, resp, cmd, iface,
+					device, sar_iov, iov_count, total_len,
+					&next);
 	else
-		smr_try_progress_from_sar(sar_msg, resp, cmd, iface, device,
-					  sar_iov, iov_count, total_len, &next);
+		smr_try_progress_from_sar(ep->region, sar_msg, resp, cmd, iface,
+					  device, sar_iov, iov_count, total_len,
+					  &next);
 
 	if (*total_len == cmd->msg.hdr.size)
 		return NULL;
@@ -576,7 +603,7 @@ static int smr_progress_inject_atomic(struct smr_cmd *cmd, struct fi_ioc *ioc,
 
 out:
 	if (!(cmd->msg.hdr.op_flags & SMR_RMA_REQ))
-		smr_freestack_push(smr_inject_pool(ep->region), tx_buf);
+		smr_push_inject_buf(ep->region, tx_buf);
 
 	return err;
 }
@@ -596,18 +623,23 @@ static int smr_progress_msg_common(struct smr_ep *ep, struct smr_cmd *cmd,
 		entry->err = smr_progress_inline(cmd, entry->iface, entry->device,
 						 entry->iov, entry->iov_count,
 						 &total_len);
-		ep->region->cmd_cnt++;
+		smr_put_cmds(ep->region, smr_inline_cmds(cmd->msg.hdr.size));
 		break;
 	case smr_src_inject:
 		entry->err = smr_progress_inject(cmd, entry->iface, entry->device,
 						 entry->iov, entry->iov_count,
 						 &total_len, ep, 0);
-		ep->region->cmd_cnt++;
+		smr_put_cmds(ep->region, 1);
 		break;
 	case smr_src_iov:
 		entry->err = smr_progress_iov(cmd, entry->iov, entry->iov_count,
 					      &total_len, ep, 0);
 		break;
+	case smr_src_xpmem:
+		entry->err = smr_progress_xpmem(cmd, entry->iov,
+						entry->iov_count, &total_len,
+						ep, 0);
+		break;
 	case smr_src_mmap:
 		entry->err = smr_progress_mmap(cmd, entry->iov, entry->iov_count,
 					       &total_len, ep);
@@ -670,28 +702,36 @@ static void smr_progress_connreq(struct smr_ep *ep, struct smr_cmd *cmd)
 
 	ret = smr_map_add(&smr_prov, ep->region->map,
 			  (char *) tx_buf->data, &idx);
-	if (ret)
+	if (!ret)
+		ret = smr_map_region(&smr_prov, ep->region->map, idx);
+	if (ret) {
 		FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
 			"Error processing mapping request\n");
+		goto out;
+	}
 
+	smr_map_to_endpoint(ep->region, idx);
 	peer_smr = smr_peer_region(ep->region, idx);
 
 	smr_peer_data(peer_smr)[cmd->msg.hdr.id].addr.id = idx;
 
 	smr_peer_data(ep->region)[idx].addr.id = cmd->msg.hdr.id;
 
-	smr_freestack_push(smr_inject_pool(ep->region), tx_buf);
-	ofi_cirque_discard(smr_cmd_queue(ep->region));
-	ep->region->cmd_cnt++;
+out:
+	smr_push_inject_buf(ep->region, tx_buf);
+	smr_cmd_queue_discard(smr_cmd_queue(ep->region));
+	smr_put_cmds(ep->region, 1);
 }
 
 static int smr_progress_cmd_msg(struct smr_ep *ep, struct smr_cmd *cmd)
 {
+	struct smr_cmd_queue *queue = smr_cmd_queue(ep->region);
+	struct smr_cmd inline_cmds[SMR_INLINE_MAX_CMDS];
 	struct smr_queue *recv_queue;
 	struct smr_match_attr match_attr;
 	struct dlist_entry *dlist_entry;
 	struct smr_unexp_msg *unexp;
-	int ret;
+	int ret, i, cmd_cnt = 1;
 
 	if (ofi_cirque_isfull(ep->util_ep.rx_cq->cirq)) {
 		FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
@@ -708,12 +748,24 @@ static int smr_progress_cmd_msg(struct smr_ep *ep, struct smr_cmd *cmd)
 	dlist_entry = dlist_find_first_match(&recv_queue->list,
 					     recv_queue->match_func,
 					     &match_attr);
+	if (!dlist_entry && ofi_freestack_isempty(ep->unexp_fs))
+		return -FI_EAGAIN;
+
+	/* Gather the data of a multi-entry inline msg after its cmd */
+	if (cmd->msg.hdr.op_src == smr_src_inline)
+		cmd_cnt = smr_inline_cmds(cmd->msg.hdr.size);
+	if (cmd_cnt > 1) {
+		inline_cmds[0] = *cmd;
+		for (i = 1; i < cmd_cnt; i++)
+			inline_cmds[i] = *smr_cmd_queue_peek(queue, i);
+		cmd = inline_cmds;
+	}
+
 	if (!dlist_entry) {
-		if (ofi_freestack_isempty(ep->unexp_fs))
-			return -FI_EAGAIN;
 		unexp = ofi_freestack_pop(ep->unexp_fs);
-		memcpy(&unexp->cmd, cmd, sizeof(*cmd));
-		ofi_cirque_discard(smr_cmd_queue(ep->region));
+		memcpy(&unexp->cmd, cmd, sizeof(*cmd) * cmd_cnt);
+		for (i = 0; i < cmd_cnt; i++)
+			smr_cmd_queue_discard(queue);
 		if (cmd->msg.hdr.op == ofi_op_msg) {
 			dlist_insert_tail(&unexp->entry, &ep->unexp_msg_queue.list);
 		} else {
@@ -724,14 +776,17 @@ static int smr_progress_cmd_msg(struct smr_ep *ep, struct smr_cmd *cmd)
 	}
 	ret = smr_progress_msg_common(ep, cmd,
 			container_of(dlist_entry, struct smr_rx_entry, entry));
-	ofi_cirque_discard(smr_cmd_queue(ep->region));
+	for (i = 0; i < cmd_cnt; i++)
+		smr_cmd_queue_discard(queue);
 	return ret < 0 ? ret : 0;
 }
 
-static int smr_progress_cmd_rma(struct smr_ep *ep, struct smr_cmd *cmd)
+static int smr_progress_cmd_rma(struct smr_ep *ep, struct smr_cmd *queued_cmd)
 {
 	struct smr_region *peer_smr;
 	struct smr_domain *domain;
+	/* Senders may reuse the queue entry as soon as it is discarded */
+	struct smr_cmd cmd_buf = *queued_cmd, *cmd = &cmd_buf;
 	struct smr_cmd *rma_cmd;
 	struct smr_resp *resp;
 	struct iovec iov[SMR_IOV_LIMIT];
@@ -752,9 +807,9 @@ static int smr_progress_cmd_rma(struct smr_ep *ep, struct smr_cmd *cmd)
 		return -FI_ENOSPC;
 	}
 
-	ofi_cirque_discard(smr_cmd_queue(ep->region));
-	ep->region->cmd_cnt++;
-	rma_cmd = ofi_cirque_head(smr_cmd_queue(ep->region));
+	smr_cmd_queue_discard(smr_cmd_queue(ep->region));
+	smr_put_cmds(ep->region, 1);
+	rma_cmd = smr_cmd_queue_head(smr_cmd_queue(ep->region));
 
 	fastlock_acquire(&domain->util_domain.lock);
 	for (iov_count = 0; iov_count < rma_cmd->rma.rma_count; iov_count++) {
@@ -778,9 +833,9 @@ static int smr_progress_cmd_rma(struct smr_ep *ep, struct smr_cmd *cmd)
 	}
 	fastlock_release(&domain->util_domain.lock);
 
-	ofi_cirque_discard(smr_cmd_queue(ep->region));
+	smr_cmd_queue_discard(smr_cmd_queue(ep->region));
 	if (ret) {
-		ep->region->cmd_cnt++;
+		smr_put_cmds(ep->region, 1);
 		return ret;
 	}
 
@@ -788,7 +843,7 @@ static int smr_progress_cmd_rma(struct smr_ep *ep, struct smr_cmd *cmd)
 	case smr_src_inline:
 		err = smr_progress_inline(cmd, iface, device, iov, iov_count,
 					  &total_len);
-		ep->region->cmd_cnt++;
+		smr_put_cmds(ep->region, 1);
 		break;
 	case smr_src_inject:
 		err = smr_progress_inject(cmd, iface, device, iov, iov_count,
@@ -798,12 +853,16 @@ static int smr_progress_cmd_rma(struct smr_ep *ep, struct smr_cmd *cmd)
 			resp = smr_get_ptr(peer_smr, cmd->msg.hdr.data);
 			resp->status = -err;
 		} else {
-			ep->region->cmd_cnt++;
+			smr_put_cmds(ep->region, 1);
 		}
 		break;
 	case smr_src_iov:
 		err = smr_progress_iov(cmd, iov, iov_count, &total_len, ep, ret);
 		break;
+	case smr_src_xpmem:
+		err = smr_progress_xpmem(cmd, iov, iov_count, &total_len, ep,
+					 ret);
+		break;
 	case smr_src_mmap:
 		err = smr_progress_mmap(cmd, iov, iov_count, &total_len, ep);
 		break;
@@ -834,10 +893,13 @@ static int smr_progress_cmd_rma(struct smr_ep *ep, struct smr_cmd *cmd)
 	return ret;
 }
 
-static int smr_progress_cmd_atomic(struct smr_ep *ep, struct smr_cmd *cmd)
+static int smr_progress_cmd_atomic(struct smr_ep *ep,
+				   struct smr_cmd *queued_cmd)
 {
 	struct smr_region *peer_smr;
 	struct smr_domain *domain;
+	/* Senders may reuse the queue entry as soon as it is discarded */
+	struct smr_cmd cmd_buf = *queued_cmd, *cmd = &cmd_buf;
 	struct smr_cmd *rma_cmd;
 	struct smr_resp *resp;
 	struct fi_ioc ioc[SMR_IOV_LIMIT];
@@ -848,9 +910,9 @@ static int smr_progress_cmd_atomic(struct smr_ep *ep, struct smr_cmd *cmd)
 	domain = container_of(ep->util_ep.domain, struct smr_domain,
 			      util_domain);
 
-	ofi_cirque_discard(smr_cmd_queue(ep->region));
-	ep->region->cmd_cnt++;
-	rma_cmd = ofi_cirque_head(smr_cmd_queue(ep->region));
+	smr_cmd_queue_discard(smr_cmd_queue(ep->region));
+	smr_put_cmds(ep->region, 1);
+	rma_cmd = smr_cmd_queue_head(smr_cmd_queue(ep->region));
 
 	for (ioc_count = 0; ioc_count < rma_cmd->rma.rma_count; ioc_count++) {
 		ret = ofi_mr_verify(&domain->util_domain.mr_map,
@@ -866,9 +928,9 @@ static int smr_progress_cmd_atomic(struct smr_ep *ep, struct smr_cmd *cmd)
 		ioc[ioc_count].addr = (void *) rma_cmd->rma.rma_ioc[ioc_count].addr;
 		ioc[ioc_count].count = rma_cmd->rma.rma_ioc[ioc_count].count;
 	}
-	ofi_cirque_discard(smr_cmd_queue(ep->region));
+	smr_cmd_queue_discard(smr_cmd_queue(ep->region));
 	if (ret) {
-		ep->region->cmd_cnt++;
+		smr_put_cmds(ep->region, 1);
 		return ret;
 	}
 
@@ -889,7 +951,7 @@ static int smr_progress_cmd_atomic(struct smr_ep *ep, struct smr_cmd *cmd)
 		resp = smr_get_ptr(peer_smr, cmd->msg.hdr.data);
 		resp->status = -err;
 	} else {
-		ep->region->cmd_cnt++;
+		smr_put_cmds(ep->region, 1);
 	}
 
 	if (err)
@@ -910,11 +972,9 @@ static void smr_progress_cmd(struct smr_ep *ep)
 	struct smr_cmd *cmd;
 	int ret = 0;
 
-	fastlock_acquire(&ep->region->lock);
 	fastlock_acquire(&ep->util_ep.rx_cq->cq_lock);
 
-	while (!ofi_cirque_isempty(smr_cmd_queue(ep->region))) {
-		cmd = ofi_cirque_head(smr_cmd_queue(ep->region));
+	while ((cmd = smr_cmd_queue_head(smr_cmd_queue(ep->region)))) {
 
 		switch (cmd->msg.hdr.op) {
 		case ofi_op_msg:
@@ -929,8 +989,8 @@ static void smr_progress_cmd(struct smr_ep *ep)
 		case ofi_op_read_async:
 			ofi_ep_rx_cntr_inc_func(&ep->util_ep,
 						cmd->msg.hdr.op);
-			ofi_cirque_discard(smr_cmd_queue(ep->region));
-			ep->region->cmd_cnt++;
+			smr_cmd_queue_discard(smr_cmd_queue(ep->region));
+			smr_put_cmds(ep->region, 1);
 			break;
 		case ofi_op_atomic:
 		case ofi_op_atomic_fetch:
@@ -954,7 +1014,6 @@ static void smr_progress_cmd(struct smr_ep *ep)
 		}
 	}
 	fastlock_release(&ep->util_ep.rx_cq->cq_lock);
-	fastlock_release(&ep->region->lock);
 }
 
 static void smr_progress_sar_list(struct smr_ep *ep)
@@ -966,7 +1025,6 @@ static void smr_progress_sar_list(struct smr_ep *ep)
 	struct dlist_entry *tmp;
 	int ret;
 
-	fastlock_acquire(&ep->region->lock);
 	fastlock_acquire(&ep->util_ep.rx_cq->cq_lock);
 
 	dlist_foreach_container_safe(&ep->sar_list, struct smr_sar_entry,
@@ -975,12 +1033,14 @@ static void smr_progress_sar_list(struct smr_ep *ep)
 		peer_smr = smr_peer_region(ep->region, sar_entry->cmd.msg.hdr.id);
 		resp = smr_get_ptr(peer_smr, sar_entry->cmd.msg.hdr.src_data);
 		if (sar_entry->cmd.msg.hdr.op == ofi_op_read_req)
-			smr_try_progress_to_sar(sar_msg, resp, &sar_entry->cmd,
+			smr_try_progress_to_sar(ep->region, sar_msg, resp,
+					&sar_entry->cmd,
 					sar_entry->iface, sar_entry->device,
 					sar_entry->iov, sar_entry->iov_count,
 					&sar_entry->bytes_done, &sar_entry->next);
 		else
-			smr_try_progress_from_sar(sar_msg, resp, &sar_entry->cmd,
+			smr_try_progress_from_sar(ep->region, sar_msg, resp,
+					&sar_entry->cmd,
 					sar_entry->iface, sar_entry->device,
 					sar_entry->iov, sar_entry->iov_count,
 					&sar_entry->bytes_done, &sar_entry->next);
@@ -1003,7 +1063,6 @@ static void smr_progress_sar_list(struct smr_ep *ep)
 		}
 	}
 	fastlock_release(&ep->util_ep.rx_cq->cq_lock);
-	fastlock_release(&ep->region->lock);
 }
 
 void smr_ep_progress(struct util_ep *util_ep)
@@ -94,7 +94,7 @@ ssize_t smr_generic_rma(struct smr_ep *ep, const struct iovec *iov,
 	struct smr_inject_buf *tx_buf;
 	struct smr_sar_msg *sar;
 	struct smr_resp *resp;
-	struct smr_cmd *cmd;
+	struct smr_cmd cmd_buf[2], *cmd = &cmd_buf[0];
 	struct smr_tx_entry *pend;
 	enum fi_hmem_iface iface;
 	uint64_t device;
@@ -120,12 +120,9 @@ ssize_t smr_generic_rma(struct smr_ep *ep, const struct iovec *iov,
 		    (FI_REMOTE_CQ_DATA | FI_DELIVERY_COMPLETE)) &&
 		     rma_count == 1 && smr_cma_enabled(ep, peer_smr));
 
-	fastlock_acquire(&peer_smr->lock);
-	if (peer_smr->cmd_cnt < cmds ||
-	    smr_peer_data(ep->region)[id].sar_status) {
-		ret = -FI_EAGAIN;
-		goto unlock_region;
-	}
+	if (smr_peer_data(ep->region)[id].sar_status ||
+	    !smr_get_cmds(peer_smr, cmds))
+		return -FI_EAGAIN;
 
 	fastlock_acquire(&ep->util_ep.tx_cq->cq_lock);
 	if (ofi_cirque_isfull(ep->util_ep.tx_cq->cirq)) {
@@ -133,8 +130,6 @@ ssize_t smr_generic_rma(struct smr_ep *ep, const struct iovec *iov,
 		goto unlock_cq;
 	}
 
-	cmd = ofi_cirque_next(smr_cmd_queue(peer_smr));
-
 	if (cmds == 1) {
 		err = smr_rma_fast(peer_smr, cmd, iov, iov_count, rma_iov,
 				   rma_count, desc, peer_id,  context, op,
@@ -153,11 +148,11 @@ ssize_t smr_generic_rma(struct smr_ep *ep, const struct iovec *iov,
 		smr_format_inline(cmd, iface, device, iov, iov_count);
 	} else if (total_len <= SMR_INJECT_SIZE &&
 		   !(op_flags & FI_DELIVERY_COMPLETE)) {
-		tx_buf = smr_freestack_pop(smr_inject_pool(peer_smr));
+		tx_buf = smr_pop_inject_buf(peer_smr);
 		smr_format_inject(cmd, iface, device, iov, iov_count, peer_smr, tx_buf);
 		if (op == ofi_op_read_req) {
 			if (ofi_cirque_isfull(smr_resp_queue(ep->region))) {
-				smr_freestack_push(smr_inject_pool(peer_smr), tx_buf);
+				smr_push_inject_buf(peer_smr, tx_buf);
 				ret = -FI_EAGAIN;
 				goto unlock_cq;
 			}
@@ -177,7 +172,12 @@ ssize_t smr_generic_rma(struct smr_ep *ep, const struct iovec *iov,
 		}
 		resp = ofi_cirque_next(smr_resp_queue(ep->region));
 		pend = ofi_freestack_pop(ep->pend_fs);
-		if (smr_cma_enabled(ep, peer_smr) && iface == FI_HMEM_SYSTEM) {
+		if (iface == FI_HMEM_SYSTEM &&
+		    smr_xpmem_enabled(ep, peer_smr)) {
+			smr_format_xpmem(cmd, iov, iov_count, total_len,
+					 ep->region, resp);
+		} else if (smr_cma_enabled(ep, peer_smr) &&
+			   iface == FI_HMEM_SYSTEM) {
 			smr_format_iov(cmd, iov, iov_count, total_len, ep->region,
 				       resp);
 		} else {
@@ -188,15 +188,14 @@ ssize_t smr_generic_rma(struct smr_ep *ep, const struct iovec *iov,
 					resp, pend);
 			} else if (total_len <= smr_env.sar_threshold ||
 			    iface != FI_HMEM_SYSTEM) {
-				if (!peer_smr->sar_cnt) {
+				sar = smr_pop_sar_msg(peer_smr);
+				if (!sar) {
 					ret = -FI_EAGAIN;
 				} else {
-					sar = smr_freestack_pop(smr_sar_pool(peer_smr));
 					smr_format_sar(cmd, iface, device, iov,
 						       iov_count, total_len,
 						       ep->region, peer_smr, sar,
 						       pend, resp);
-					peer_smr->sar_cnt--;
 					smr_peer_data(ep->region)[id].sar_status = 1;
 				}
 			} else {
@@ -216,28 +215,24 @@ ssize_t smr_generic_rma(struct smr_ep *ep, const struct iovec *iov,
 	}
 
 	comp_flags = cmd->msg.hdr.op_flags;
-	ofi_cirque_commit(smr_cmd_queue(peer_smr));
-	peer_smr->cmd_cnt--;
-	cmd = ofi_cirque_next(smr_cmd_queue(peer_smr));
-	smr_format_rma_iov(cmd, rma_iov, rma_count);
+	smr_format_rma_iov(&cmd_buf[1], rma_iov, rma_count);
 
 commit_comp:
-	ofi_cirque_commit(smr_cmd_queue(peer_smr));
-	peer_smr->cmd_cnt--;
+	smr_insert_cmds(peer_smr, cmd_buf, cmds);
 
-	if (!comp)
-		goto unlock_cq;
-
-	ret = smr_complete_tx(ep, context, op, comp_flags, err);
-	if (ret) {
-		FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
-			"unable to process tx completion\n");
+	if (comp) {
+		ret = smr_complete_tx(ep, context, op, comp_flags, err);
+		if (ret) {
+			FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
+				"unable to process tx completion\n");
+		}
 	}
+	fastlock_release(&ep->util_ep.tx_cq->cq_lock);
+	return ret;
 
 unlock_cq:
 	fastlock_release(&ep->util_ep.tx_cq->cq_lock);
-unlock_region:
-	fastlock_release(&peer_smr->lock);
+	smr_put_cmds(peer_smr, cmds);
 	return ret;
 }
 
@@ -354,7 +349,7 @@ ssize_t smr_generic_rma_inject(struct fid_ep *ep_fid, const void *buf,
 	struct smr_domain *domain;
 	struct smr_region *peer_smr;
 	struct smr_inject_buf *tx_buf;
-	struct smr_cmd *cmd;
+	struct smr_cmd cmd[2];
 	struct iovec iov;
 	struct fi_rma_iov rma_iov;
 	int64_t id, peer_id;
@@ -375,12 +370,9 @@ ssize_t smr_generic_rma_inject(struct fid_ep *ep_fid, const void *buf,
 	cmds = 1 + !(domain->fast_rma && !(flags & FI_REMOTE_CQ_DATA) &&
 		     smr_cma_enabled(ep, peer_smr));
 
-	fastlock_acquire(&peer_smr->lock);
-	if (peer_smr->cmd_cnt < cmds ||
-	    smr_peer_data(ep->region)[id].sar_status) {
-		ret = -FI_EAGAIN;
-		goto unlock_region;
-	}
+	if (smr_peer_data(ep->region)[id].sar_status ||
+	    !smr_get_cmds(peer_smr, cmds))
+		return -FI_EAGAIN;
 
 	iov.iov_base = (void *) buf;
 	iov.iov_len = len;
@@ -388,37 +380,30 @@ ssize_t smr_generic_rma_inject(struct fid_ep *ep_fid, const void *buf,
 	rma_iov.len = len;
 	rma_iov.key = key;
 
-	cmd = ofi_cirque_next(smr_cmd_queue(peer_smr));
-
 	if (cmds == 1) {
-		ret = smr_rma_fast(peer_smr, cmd, &iov, 1, &rma_iov, 1, NULL,
-				   peer_id, NULL, ofi_op_write, flags);
-		if (ret)
-			goto unlock_region;
+		ret = smr_rma_fast(peer_smr, &cmd[0], &iov, 1, &rma_iov, 1,
+				   NULL, peer_id, NULL, ofi_op_write, flags);
+		if (ret) {
+			smr_put_cmds(peer_smr, cmds);
+			return ret;
+		}
 		goto commit;
 	}
 
-	smr_generic_format(cmd, peer_id, ofi_op_write, 0, data, flags);
+	smr_generic_format(&cmd[0], peer_id, ofi_op_write, 0, data, flags);
 	if (len <= SMR_MSG_DATA_LEN) {
-		smr_format_inline(cmd, FI_HMEM_SYSTEM, 0, &iov, 1);
+		smr_format_inline(&cmd[0], FI_HMEM_SYSTEM, 0, &iov, 1);
 	} else {
-		tx_buf = smr_freestack_pop(smr_inject_pool(peer_smr));
-		smr_format_inject(cmd, FI_HMEM_SYSTEM, 0, &iov, 1,
+		tx_buf = smr_pop_inject_buf(peer_smr);
+		smr_format_inject(&cmd[0], FI_HMEM_SYSTEM, 0, &iov, 1,
 				  peer_smr, tx_buf);
 	}
-
-	ofi_cirque_commit(smr_cmd_queue(peer_smr));
-	peer_smr->cmd_cnt--;
-	cmd = ofi_cirque_next(smr_cmd_queue(peer_smr));
-	smr_format_rma_iov(cmd, &rma_iov, 1);
+	smr_format_rma_iov(&cmd[1], &rma_iov, 1);
 
 commit:
-	ofi_cirque_commit(smr_cmd_queue(peer_smr));
-	peer_smr->cmd_cnt--;
+	smr_insert_cmds(peer_smr, cmd, cmds);
 	ofi_ep_tx_cntr_inc_func(&ep->util_ep, ofi_op_write);
-unlock_region:
-	fastlock_release(&peer_smr->lock);
-	return ret;
+	return 0;
 }
 
 ssize_t smr_writedata(struct fid_ep *ep_fid, const void *buf, size_t len,
@@ -0,0 +1,406 @@
+/*
+ * Copyright (c) 2021 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "smr.h"
+
+#if HAVE_XPMEM
+
+#include <xpmem.h>
+
+/* Number of attachments cached by each endpoint */
+#define SMR_XPMEM_CACHE_SIZE	256
+
+/*
+ * Attaching a peer's pages is expensive (a syscall plus page faults on
+ * first touch), so attachments are kept until evicted.  An attachment
+ * mirrors the peer's address space rather than a snapshot of its pages,
+ * so a cached entry never becomes stale while the peer is alive.
+ */
+struct smr_xpmem_peer {
+	xpmem_segid_t		segid;
+	xpmem_apid_t		apid;
+};
+
+struct smr_xpmem_entry {
+	xpmem_segid_t		segid;
+	uintptr_t		base;
+	size_t			len;
+	void			*addr;
+	struct ofi_rbnode	*node;
+	struct dlist_entry	lru_entry;
+};
+
+struct smr_xpmem_cache {
+	struct ofi_rbmap	peer_map;
+	struct ofi_rbmap	attach_map;
+	struct dlist_entry	lru_list;
+	size_t			cnt;
+};
+
+static pthread_mutex_t smr_xpmem_lock = PTHREAD_MUTEX_INITIALIZER;
+static xpmem_segid_t smr_xpmem_segid = -1;
+
+static int smr_xpmem_peer_compare(struct ofi_rbmap *map, void *key,
+				  void *data)
+{
+	xpmem_segid_t segid = *(xpmem_segid_t *) key;
+	struct smr_xpmem_peer *peer = data;
+
+	if (segid == peer->segid)
+		return 0;
+	return segid < peer->segid ? -1 : 1;
+}
+
+/* Entries compare equal if they overlap */
+static int smr_xpmem_entry_compare(struct ofi_rbmap *map, void *key,
+				   void *data)
+{
+	struct smr_xpmem_entry *key_entry = key;
+	struct smr_xpmem_entry *entry = data;
+
+	if (key_entry->segid != entry->segid)
+		return key_entry->segid < entry->segid ? -1 : 1;
+	if (key_entry->base + key_entry->len <= entry->base)
+		return -1;
+	if (key_entry->base >= entry->base + entry->len)
+		return 1;
+	return 0;
+}
+
+static int smr_xpmem_get_apid(struct smr_xpmem_cache *cache,
+			      xpmem_segid_t segid, xpmem_apid_t *apid,
+			      bool *cached)
+{
+	struct smr_xpmem_peer *peer;
+	struct ofi_rbnode *node;
+	int ret;
+
+	node = ofi_rbmap_find(&cache->peer_map, &segid);
+	*cached = node != NULL;
+	if (node) {
+		*apid = ((struct smr_xpmem_peer *) node->data)->apid;
+		return FI_SUCCESS;
+	}
+
+	peer = calloc(1, sizeof(*peer));
+	if (!peer)
+		return -FI_ENOMEM;
+
+	peer->segid = segid;
+	peer->apid = xpmem_get(segid, XPMEM_RDWR, XPMEM_PERMIT_MODE, NULL);
+	if (peer->apid == -1) {
+		FI_INFO(&smr_prov, FI_LOG_EP_DATA,
+			"xpmem_get failed: %s\n", strerror(errno));
+		free(peer);
+		return -FI_EIO;
+	}
+
+	ret = ofi_rbmap_insert(&cache->peer_map, &peer->segid, peer, NULL);
+	if (ret) {
+		xpmem_release(peer->apid);
+		free(peer);
+		return ret;
+	}
+
+	*apid = peer->apid;
+	return FI_SUCCESS;
+}
+
+static void smr_xpmem_detach(struct smr_xpmem_cache *cache,
+			     struct smr_xpmem_entry *entry)
+{
+	xpmem_detach(entry->addr);
+	ofi_rbmap_delete(&cache->attach_map, entry->node);
+	dlist_remove(&entry->lru_entry);
+	cache->cnt--;
+	free(entry);
+}
+
+/* Drops the apid and attachments of a peer that has gone away.  Its
+ * segid may be reused by a later process.
+ */
+static void smr_xpmem_evict(struct smr_xpmem_cache *cache,
+			    xpmem_segid_t segid)
+{
+	struct smr_xpmem_entry *entry;
+	struct smr_xpmem_peer *peer;
+	struct ofi_rbnode *node;
+	struct dlist_entry *tmp;
+
+	dlist_foreach_container_safe(&cache->lru_list, struct smr_xpmem_entry,
+				     entry, lru_entry, tmp) {
+		if (entry->segid == segid)
+			smr_xpmem_detach(cache, entry);
+	}
+
+	node = ofi_rbmap_find(&cache->peer_map, &segid);
+	if (!node)
+		return;
+
+	peer = node->data;
+	xpmem_release(peer->apid);
+	ofi_rbmap_delete(&cache->peer_map, node);
+	free(peer);
+}
+
+static int smr_xpmem_attach(struct smr_xpmem_cache *cache,
+			    xpmem_segid_t segid, void *buf, size_t len,
+			    void **local_buf)
+{
+	struct smr_xpmem_entry key, *entry;
+	struct xpmem_addr xaddr;
+	struct ofi_rbnode *node;
+	uintptr_t end;
+	size_t page_size = ofi_get_page_size();
+	bool cached;
+	int ret;
+
+	key.segid = segid;
+	key.base = (uintptr_t) ofi_get_page_start(buf, page_size);
+	key.len = ofi_get_page_bytes(buf, len, page_size);
+
+	node = ofi_rbmap_find(&cache->attach_map, &key);
+	if (node) {
+		entry = node->data;
+		if (entry->base <= key.base &&
+		    entry->base + entry->len >= key.base + key.len)
+			goto out;
+
+		/* Replace all overlapping attachments with their union */
+		do {
+			entry = node->data;
+			end = MAX(key.base + key.len, entry->base + entry->len);
+			key.base = MIN(key.base, entry->base);
+			key.len = end - key.base;
+			smr_xpmem_detach(cache, entry);
+		} while ((node = ofi_rbmap_find(&cache->attach_map, &key)));
+	}
+
+	if (cache->cnt == SMR_XPMEM_CACHE_SIZE) {
+		entry = container_of(cache->lru_list.prev,
+				     struct smr_xpmem_entry, lru_entry);
+		smr_xpmem_detach(cache, entry);
+	}
+
+	entry = malloc(sizeof(*entry));
+	if (!entry)
+		return -FI_ENOMEM;
+
+	*entry = key;
+	xaddr.offset = entry->base;
+	do {
+		ret = smr_xpmem_get_apid(cache, segid, &xaddr.apid, &cached);
+		if (ret)
+			goto free;
+
+		entry->addr = xpmem_attach(xaddr, entry->len, NULL);
+		if (entry->addr != (void *) -1)
+			break;
+
+		/* A cached apid may be left from an exited peer */
+		FI_INFO(&smr_prov, FI_LOG_EP_DATA,
+			"xpmem_attach failed: %s\n", strerror(errno));
+		smr_xpmem_evict(cache, segid);
+		ret = -FI_EIO;
+	} while (cached);
+
+	if (ret)
+		goto free;
+
+	ret = ofi_rbmap_insert(&cache->attach_map, entry, entry, &entry->node);
+	if (ret) {
+		xpmem_detach(entry->addr);
+		goto free;
+	}
+	dlist_insert_head(&entry->lru_entry, &cache->lru_list);
+	cache->cnt++;
+	*local_buf = (char *) entry->addr + ((uintptr_t) buf - entry->base);
+	return FI_SUCCESS;
+
+out:
+	dlist_remove(&entry->lru_entry);
+	dlist_insert_head(&entry->lru_entry, &cache->lru_list);
+	*local_buf = (char *) entry->addr + ((uintptr_t) buf - entry->base);
+	return FI_SUCCESS;
+free:
+	free(entry);
+	return ret;
+}
+
+int smr_xpmem_copy(struct smr_ep *ep, struct smr_region *peer_smr,
+		   struct iovec *local, size_t local_cnt,
+		   struct iovec *remote, size_t remote_cnt,
+		   size_t total, bool write)
+{
+	size_t i, len, offset = 0;
+	void *buf;
+	int ret;
+
+	for (i = 0; i < remote_cnt && offset < total; i++) {
+		len = MIN(remote[i].iov_len, total - offset);
+		if (!len)
+			continue;
+
+		ret = smr_xpmem_attach(ep->xpmem_cache, peer_smr->xpmem_segid,
+				       remote[i].iov_base, len, &buf);
+		if (ret)
+			return ret;
+
+		if (write)
+			ret = ofi_copy_from_iov(buf, len, local, local_cnt,
+						offset) != len;
+		else
+			ret = ofi_copy_to_iov(local, local_cnt, offset,
+					      buf, len) != len;
+		if (ret)
+			return -FI_ETRUNC;
+		offset += len;
+	}
+
+	return offset == total ? FI_SUCCESS : -FI_ETRUNC;
+}
+
+int smr_xpmem_init(struct smr_ep *ep)
+{
+	struct smr_xpmem_cache *cache;
+
+	if (smr_env.disable_xpmem)
+		return FI_SUCCESS;
+
+	pthread_mutex_lock(&smr_xpmem_lock);
+	if (smr_xpmem_segid == -1) {
+		smr_xpmem_segid = xpmem_make(0, XPMEM_MAXADDR_SIZE,
+					     XPMEM_PERMIT_MODE,
+					     (void *) 0600);
+		if (smr_xpmem_segid == -1)
+			FI_INFO(&smr_prov, FI_LOG_EP_CTRL,
+				"XPMEM not available: %s\n", strerror(errno));
+	}
+	pthread_mutex_unlock(&smr_xpmem_lock);
+	if (smr_xpmem_segid == -1)
+		return FI_SUCCESS;
+
+	cache = calloc(1, sizeof(*cache));
+	if (!cache)
+		return -FI_ENOMEM;
+
+	ofi_rbmap_init(&cache->peer_map, smr_xpmem_peer_compare);
+	ofi_rbmap_init(&cache->attach_map, smr_xpmem_entry_compare);
+	dlist_init(&cache->lru_list);
+	ep->xpmem_cache = cache;
+
+	ep->region->xpmem_segid = smr_xpmem_segid;
+	ep->region->flags |= SMR_FLAG_XPMEM;
+	return FI_SUCCESS;
+}
+
+void smr_xpmem_close(struct smr_ep *ep)
+{
+	struct smr_xpmem_cache *cache = ep->xpmem_cache;
+	struct smr_xpmem_entry *entry;
+	struct smr_xpmem_peer *peer;
+	struct ofi_rbnode *node;
+
+	if (!cache)
+		return;
+
+	while (!dlist_empty(&cache->lru_list)) {
+		entry = container_of(cache->lru_list.next,
+				     struct smr_xpmem_entry, lru_entry);
+		smr_xpmem_detach(cache, entry);
+	}
+
+	while ((node = ofi_rbmap_get_root(&cache->peer_map))) {
+		peer = node->data;
+		xpmem_release(peer->apid);
+		ofi_rbmap_delete(&cache->peer_map, node);
+		free(peer);
+	}
+
+	ofi_rbmap_cleanup(&cache->attach_map);
+	ofi_rbmap_cleanup(&cache->peer_map);
+	free(cache);
+	ep->xpmem_cache = NULL;
+}
+
+void smr_xpmem_del_peer(struct smr_ep *ep, int64_t id)
+{
+	struct smr_region *peer_smr;
+
+	if (!ep->xpmem_cache)
+		return;
+
+	peer_smr = smr_peer_region(ep->region, id);
+	if (!peer_smr || !(peer_smr->flags & SMR_FLAG_XPMEM))
+		return;
+
+	fastlock_acquire(&ep->util_ep.rx_cq->cq_lock);
+	smr_xpmem_evict(ep->xpmem_cache, peer_smr->xpmem_segid);
+	fastlock_release(&ep->util_ep.rx_cq->cq_lock);
+}
+
+void smr_xpmem_cleanup(void)
+{
+	if (smr_xpmem_segid != -1) {
+		xpmem_remove(smr_xpmem_segid);
+		smr_xpmem_segid = -1;
+	}
+}
+
+#else /* HAVE_XPMEM */
+
+int smr_xpmem_init(struct smr_ep *ep)
+{
+	return FI_SUCCESS;
+}
+
+void smr_xpmem_close(struct smr_ep *ep)
+{
+}
+
+void smr_xpmem_del_peer(struct smr_ep *ep, int64_t id)
+{
+}
+
+void smr_xpmem_cleanup(void)
+{
+}
+
+int smr_xpmem_copy(struct smr_ep *ep, struct smr_region *peer_smr,
+		   struct iovec *local, size_t local_cnt,
+		   struct iovec *remote, size_t remote_cnt,
+		   size_t total, bool write)
+{
+	return -FI_ENOSYS;
+}
+
+#endif /* HAVE_XPMEM */
@@ -11,5 +11,36 @@ AC_DEFUN([FI_TCP_CONFIGURE],[
        # Determine if we can support the tcp provider
        tcp_h_happy=0
        AS_IF([test x"$enable_tcp" != x"no"], [tcp_h_happy=1])
+
+       # io_uring progress is optional, the rings are driven through raw
+       # syscalls so only the kernel uapi header is needed
+       tcp_io_uring=0
+       AS_IF([test $tcp_h_happy -eq 1],
+	     [AC_CHECK_HEADER([linux/io_uring.h],
+		[AC_CHECK_DECL([__NR_io_uring_setup],
+			[AC_CHECK_DECL([IORING_OP_RECV],
+				[tcp_io_uring=1],
+				[],
+				[[#include <linux/io_uring.h>]])],
+			[],
+			[[#include <sys/syscall.h>]])])])
+       AC_DEFINE_UNQUOTED([HAVE_TCP_IO_URING], [$tcp_io_uring],
+			  [Define to 1 if tcp io_uring progress is supported])
+
+       # zero-copy transmit needs the socket option and the error queue
+       # notification format
+       tcp_zerocopy=0
+       AS_IF([test $tcp_h_happy -eq 1],
+	     [AC_CHECK_HEADER([linux/errqueue.h],
+		[AC_CHECK_DECL([SO_EE_ORIGIN_ZEROCOPY],
+			[AC_CHECK_DECL([MSG_ZEROCOPY],
+				[tcp_zerocopy=1],
+				[],
+				[[#include <sys/socket.h>]])],
+			[],
+			[[#include <time.h>
+			  #include <linux/errqueue.h>]])])])
+       AC_DEFINE_UNQUOTED([HAVE_TCP_ZEROCOPY], [$tcp_zerocopy],
+			  [Define to 1 if tcp zero-copy transmit is supported])
        AS_IF([test $tcp_h_happy -eq 1], [$1], [$2])
 ])
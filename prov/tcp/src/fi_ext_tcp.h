@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2020 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef FI_EXT_TCP_H
+#define FI_EXT_TCP_H
+
+#include <rdma/fabric.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Provider specific FI_OPT_ENDPOINT options for fi_setopt() / fi_getopt() */
+#define FI_OPT_TCP_BUSY_POLL	(1U | FI_PROV_SPECIFIC)	/* int, usec */
+#define FI_OPT_TCP_RX_STATS	(2U | FI_PROV_SPECIFIC)	/* struct fi_tcp_rx_stats */
+#define FI_OPT_TCP_BUSY_POLL_STATS (3U | FI_PROV_SPECIFIC) /* struct fi_tcp_busy_poll_stats */
+
+/* Received payload bytes, by how they reached the user's buffers */
+struct fi_tcp_rx_stats {
+	uint64_t	copied;		/* out of the staging buffer */
+	uint64_t	direct;		/* straight from the socket */
+};
+
+/* Blocking CQ reads that completed while busy polling or after waiting,
+ * and the time spent in each, in usec
+ */
+struct fi_tcp_busy_poll_stats {
+	uint64_t	spin_cnt;
+	uint64_t	spin_time;
+	uint64_t	wait_cnt;
+	uint64_t	wait_time;
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FI_EXT_TCP_H */
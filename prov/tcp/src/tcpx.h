@@ -59,6 +59,8 @@
 #include <ofi_util.h>
 #include <ofi_proto.h>
 
+#include "fi_ext_tcp.h"
+
 #ifndef _TCP_H_
 #define _TCP_H_
 
@@ -75,13 +77,35 @@
 
 #define TCPX_PORT_MAX_RANGE	(USHRT_MAX)
 
+#define TCPX_MAX_STRIPES	(8)
+#define TCPX_STRIPE_ALIGN	(4096)
+
+/* tcpx_base_hdr::flags, above the OFI_* completion flags */
+#define TCPX_STRIPED		(1 << 8)
+
+/* Zero-copy sends awaiting release by the kernel, a multiple of 64 */
+#define TCPX_ZC_WINDOW		(1024)
+
+#if HAVE_TCP_ZEROCOPY
+#define TCPX_MSG_ZEROCOPY	MSG_ZEROCOPY
+#else
+#define TCPX_MSG_ZEROCOPY	0
+#endif
+
 extern struct fi_provider	tcpx_prov;
 extern struct util_prov		tcpx_util_prov;
 extern struct fi_info		tcpx_info;
 extern struct tcpx_port_range	port_range;
 extern int			tcpx_nodelay;
+extern int			tcpx_io_uring;
+extern size_t			tcpx_zerocopy_size;
+extern int			tcpx_stripes;
+extern size_t			tcpx_stripe_size;
+extern size_t			tcpx_rx_direct_size;
+extern int			tcpx_busy_poll;
 struct tcpx_xfer_entry;
 struct tcpx_ep;
+struct tcpx_uring;
 
 enum tcpx_xfer_op_codes {
 	TCPX_OP_MSG_SEND,
@@ -102,6 +126,7 @@ enum tcpx_cm_state {
 	TCPX_CM_REQ_SENT,
 	TCPX_CM_REQ_RVCD,
 	TCPX_CM_RESP_READY,
+	TCPX_CM_STRIPE_WAIT,
 	/* CM context is freed once connected */
 };
 
@@ -114,6 +139,10 @@ struct tcpx_cm_context {
 	fid_t			fid;
 	enum tcpx_cm_state	state;
 	size_t			cm_data_sz;
+	/* stripe negotiation, carried in otherwise unused header fields */
+	uint64_t		stripe_token;
+	uint32_t		stripe_idx;
+	uint32_t		stripe_cnt;
 	struct tcpx_cm_msg	msg;
 };
 
@@ -127,6 +156,7 @@ struct tcpx_conn_handle {
 	struct tcpx_pep		*pep;
 	SOCKET			sock;
 	bool			endian_match;
+	uint32_t		stripe_cnt;
 };
 
 struct tcpx_pep {
@@ -184,16 +214,52 @@ struct tcpx_rx_ctx {
 	fastlock_t		lock;
 };
 
+/* An additional socket of a connection.  Each striped transfer sends
+ * one slice of its payload over every stripe, while the header and the
+ * first slice go over the primary socket.  Only the transfer at the head
+ * of the queue in each direction is striped at any time.
+ *
+ * The active side connects the stripes to the peer's listening socket
+ * once it receives the accept response, then confirms the number of
+ * stripes over the primary socket.  The passive side reports the
+ * connection after the confirmation and all stripes have arrived.
+ */
+struct tcpx_stripe {
+	SOCKET			sock;
+	bool			pollout_set;
+	size_t			tx_len;
+	size_t			tx_iov_cnt;
+	struct iovec		tx_iov[TCPX_IOV_LIMIT + 1];
+	size_t			rx_len;
+	size_t			rx_iov_cnt;
+	struct iovec		rx_iov[TCPX_IOV_LIMIT + 1];
+};
+
+static inline size_t tcpx_stripe_slice(size_t len, int stripe_cnt)
+{
+	return ofi_get_aligned_size(ofi_div_ceil(len, (size_t) stripe_cnt + 1),
+				    TCPX_STRIPE_ALIGN);
+}
+
 typedef int (*tcpx_rx_process_fn_t)(struct tcpx_xfer_entry *rx_entry);
 
 enum {
-	STAGE_BUF_SIZE = 512
+	STAGE_BUF_INLINE_SIZE = 512,
+	STAGE_BUF_SIZE = 16384
 };
 
+/* Data read ahead of the message being received.  The amount read at a
+ * time, size, adapts to the size of the received messages.  buf starts
+ * out as inline_buf and is replaced by a STAGE_BUF_SIZE allocation the
+ * first time a larger read is wanted.
+ */
 struct stage_buf {
-	uint8_t			buf[STAGE_BUF_SIZE];
+	uint8_t			*buf;
+	size_t			buf_size;
+	size_t			size;
 	size_t			bytes_avail;
 	size_t			cur_pos;
+	uint8_t			inline_buf[STAGE_BUF_INLINE_SIZE];
 };
 
 struct tcpx_ep {
@@ -214,12 +280,40 @@ struct tcpx_ep {
 	int (*start_op[ofi_op_write + 1])(struct tcpx_ep *ep);
 	void (*hdr_bswap)(struct tcpx_base_hdr *hdr);
 	struct stage_buf	stage_buf;
+	/* payload bytes copied out of stage_buf and received directly */
+	uint64_t		rx_copied;
+	uint64_t		rx_direct;
 	size_t			min_multi_recv_size;
+	/* SO_BUSY_POLL time, and CQ spin budget, in usec */
+	int			busy_poll;
 	bool			pollout_set;
+	/* zero-copy sends, numbered in the order the kernel reports them */
+	bool			zerocopy;
+	uint32_t		zc_next;
+	uint32_t		zc_done;
+	/* sends released out of order, past zc_done */
+	uint64_t		zc_map[TCPX_ZC_WINDOW / 64];
+	struct slist		zc_queue;
+	/* io_uring progress state, protected by lock */
+	uint8_t			uring_pending;
+	int			uring_rx_err;
+	struct msghdr		uring_tx_msg;
+	/* additional sockets, striped once all have joined */
+	struct tcpx_stripe	*stripes;
+	int			stripe_cnt;
+	int			stripe_ready;
+	bool			stripe_confirmed;
+	uint64_t		stripe_token;
+	struct dlist_entry	stripe_entry;
+	struct tcpx_xfer_entry	*stripe_tx;
+	struct tcpx_xfer_entry	*stripe_rx;
 };
 
 struct tcpx_fabric {
 	struct util_fabric	util_fabric;
+	/* accepted endpoints waiting for stripes, protected by lock */
+	struct dlist_entry	stripe_list;
+	uint64_t		stripe_token;
 };
 
 struct tcpx_xfer_entry {
@@ -236,13 +330,23 @@ struct tcpx_xfer_entry {
 	void			*context;
 	uint64_t		rem_len;
 	void			*mrecv_msg_start;
+	bool			zerocopy;
+	uint32_t		zc_seq;
+	bool			striped;
 };
 
 struct tcpx_domain {
 	struct util_domain		util_domain;
 	struct ofi_ops_dynamic_rbuf	*dynamic_rbuf;
+	struct tcpx_uring		*uring;
 };
 
+static inline struct tcpx_uring *tcpx_ep_uring(struct tcpx_ep *ep)
+{
+	return container_of(ep->util_ep.domain, struct tcpx_domain,
+			    util_domain)->uring;
+}
+
 static inline struct ofi_ops_dynamic_rbuf *tcpx_dynamic_rbuf(struct tcpx_ep *ep)
 {
 	struct tcpx_domain *domain;
@@ -261,6 +365,16 @@ struct tcpx_cq {
 	struct util_cq		util_cq;
 	/* buf_pools protected by util.cq_lock */
 	struct tcpx_buf_pool	buf_pools[TCPX_OP_CODE_MAX];
+	bool			user_wait;
+	/* largest busy_poll of the bound endpoints */
+	int			busy_poll;
+	/* blocking reads completed while spinning or after waiting, and
+	 * the time spent in each in usec, protected by util.cq_lock
+	 */
+	uint64_t		spin_cnt;
+	uint64_t		spin_time;
+	uint64_t		wait_cnt;
+	uint64_t		wait_time;
 };
 
 struct tcpx_eq {
@@ -288,6 +402,10 @@ int tcpx_domain_open(struct fid_fabric *fabric, struct fi_info *info,
 int tcpx_endpoint(struct fid_domain *domain, struct fi_info *info,
 		  struct fid_ep **ep_fid, void *context);
 void tcpx_ep_disable(struct tcpx_ep *ep, int cm_err);
+int tcpx_ep_alloc_stripes(struct tcpx_ep *ep);
+void tcpx_ep_free_stripes(struct tcpx_ep *ep);
+int tcpx_ep_add_stripe(struct tcpx_ep *ep, struct tcpx_stripe *stripe);
+void tcpx_ep_busy_poll(struct tcpx_ep *ep);
 
 
 int tcpx_cq_open(struct fid_domain *domain, struct fi_cq_attr *attr,
@@ -297,12 +415,16 @@ void tcpx_cq_report_success(struct util_cq *cq,
 void tcpx_cq_report_error(struct util_cq *cq,
 			  struct tcpx_xfer_entry *xfer_entry,
 			  int err);
+void tcpx_cq_busy_poll(struct util_cq *cq);
+void tcpx_cq_busy_poll_stats(struct util_cq *cq,
+			     struct fi_tcp_busy_poll_stats *stats);
 
 
 ssize_t tcpx_recv_hdr(SOCKET sock, struct stage_buf *stage_buf,
 		      struct tcpx_cur_rx_msg *cur_rx_msg);
 int tcpx_recv_msg_data(struct tcpx_xfer_entry *recv_entry);
 int tcpx_send_msg(struct tcpx_xfer_entry *tx_entry);
+void tcpx_grow_stage_buf(struct stage_buf *stage_buf);
 int tcpx_read_to_buffer(SOCKET sock, struct stage_buf *stage_buf);
 
 struct tcpx_xfer_entry *tcpx_xfer_entry_alloc(struct tcpx_cq *cq,
@@ -319,6 +441,61 @@ void tcpx_progress_tx(struct tcpx_ep *ep);
 void tcpx_progress_rx(struct tcpx_ep *ep);
 int tcpx_try_func(void *util_ep);
 
+/* Optional io_uring based progress engine, enabled with FI_TCP_IO_URING.
+ * Each domain owns a ring that is reaped by progress on any of its CQs.
+ * An endpoint has at most one transmit and one receive operation
+ * outstanding, tracked in ep->uring_pending.
+ */
+enum {
+	TCPX_URING_TX = (1 << 0),
+	TCPX_URING_RX = (1 << 1),
+};
+
+#if HAVE_TCP_IO_URING
+int tcpx_uring_open(struct tcpx_uring **uring, size_t ep_cnt);
+void tcpx_uring_close(struct tcpx_uring *uring);
+int tcpx_uring_add_wait(struct tcpx_uring *uring, struct util_cq *cq);
+void tcpx_uring_del_wait(struct tcpx_uring *uring, struct util_cq *cq);
+void tcpx_uring_progress(struct tcpx_uring *uring);
+void tcpx_uring_flush(struct tcpx_uring *uring);
+int tcpx_uring_send(struct tcpx_xfer_entry *tx_entry);
+int tcpx_uring_recv(struct tcpx_ep *ep);
+int tcpx_uring_readv(struct tcpx_xfer_entry *rx_entry);
+void tcpx_uring_ep_drain(struct tcpx_ep *ep);
+#else
+static inline int tcpx_uring_open(struct tcpx_uring **uring,
+				  size_t ep_cnt)
+{
+	return -FI_ENOSYS;
+}
+static inline void tcpx_uring_close(struct tcpx_uring *uring) { }
+static inline int tcpx_uring_add_wait(struct tcpx_uring *uring,
+				      struct util_cq *cq)
+{
+	return -FI_ENOSYS;
+}
+static inline void tcpx_uring_del_wait(struct tcpx_uring *uring,
+				       struct util_cq *cq) { }
+static inline void tcpx_uring_progress(struct tcpx_uring *uring) { }
+static inline void tcpx_uring_flush(struct tcpx_uring *uring) { }
+static inline int tcpx_uring_send(struct tcpx_xfer_entry *tx_entry)
+{
+	return -FI_ENOSYS;
+}
+static inline int tcpx_uring_recv(struct tcpx_ep *ep)
+{
+	return -FI_ENOSYS;
+}
+static inline int tcpx_uring_readv(struct tcpx_xfer_entry *rx_entry)
+{
+	return -FI_ENOSYS;
+}
+static inline void tcpx_uring_ep_drain(struct tcpx_ep *ep) { }
+#endif
+
+void tcpx_uring_tx_done(struct tcpx_ep *ep, int res);
+void tcpx_uring_rx_done(struct tcpx_ep *ep, int res);
+
 void tcpx_hdr_none(struct tcpx_base_hdr *hdr);
 void tcpx_hdr_bswap(struct tcpx_base_hdr *hdr);
 
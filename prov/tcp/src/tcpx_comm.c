@@ -37,17 +37,32 @@
 #include <ofi_iov.h>
 #include "tcpx.h"
 
-int tcpx_send_msg(struct tcpx_xfer_entry *tx_entry)
+static int tcpx_send_sock(struct tcpx_xfer_entry *tx_entry)
 {
 	ssize_t bytes_sent;
 	struct msghdr msg = {0};
+	bool zerocopy;
 
 	msg.msg_iov = tx_entry->iov;
 	msg.msg_iovlen = tx_entry->iov_cnt;
 
-	bytes_sent = ofi_sendmsg_tcp(tx_entry->ep->sock, &msg, MSG_NOSIGNAL);
-	if (bytes_sent < 0)
+	zerocopy = tx_entry->ep->zerocopy &&
+		   (tx_entry->rem_len >= tcpx_zerocopy_size) &&
+		   (tx_entry->ep->zc_next - tx_entry->ep->zc_done <
+		    TCPX_ZC_WINDOW);
+	bytes_sent = ofi_sendmsg_tcp(tx_entry->ep->sock, &msg, MSG_NOSIGNAL |
+				     (zerocopy ? TCPX_MSG_ZEROCOPY : 0));
+	if (bytes_sent < 0) {
+		/* Out of notification space until completions are reaped */
+		if (zerocopy && ofi_sockerr() == ENOBUFS)
+			return -FI_EAGAIN;
 		return ofi_sockerr() == EPIPE ? -FI_ENOTCONN : -ofi_sockerr();
+	}
+
+	if (zerocopy) {
+		tx_entry->zerocopy = true;
+		tx_entry->zc_seq = tx_entry->ep->zc_next++;
+	}
 
 	tx_entry->rem_len -= bytes_sent;
 	if (tx_entry->rem_len) {
@@ -57,6 +72,114 @@ int tcpx_send_msg(struct tcpx_xfer_entry *tx_entry)
 	return FI_SUCCESS;
 }
 
+/* Divide the remaining iov of a transfer with 'len' payload bytes.  The
+ * entry keeps the next 'first' bytes, which complete the first slice on
+ * the primary socket, and each stripe takes one of the following slices.
+ */
+static void tcpx_stripe_iov(struct tcpx_xfer_entry *xfer_entry,
+			    size_t first, size_t len, size_t slice, bool tx)
+{
+	struct iovec iov[TCPX_IOV_LIMIT + 1];
+	struct tcpx_stripe *stripe;
+	size_t iov_cnt, index = 0, offset = 0;
+	size_t *stripe_len, *stripe_cnt;
+	int i;
+
+	iov_cnt = xfer_entry->iov_cnt;
+	memcpy(iov, xfer_entry->iov, iov_cnt * sizeof(*iov));
+	if (first)
+		(void) ofi_copy_iov_desc(xfer_entry->iov, NULL,
+					 &xfer_entry->iov_cnt, iov, NULL,
+					 iov_cnt, &index, &offset, first);
+	else
+		xfer_entry->iov_cnt = 0;
+
+	len -= MIN(len, slice);
+	for (i = 0; i < xfer_entry->ep->stripe_cnt; i++) {
+		stripe = &xfer_entry->ep->stripes[i];
+		stripe_len = tx ? &stripe->tx_len : &stripe->rx_len;
+		stripe_cnt = tx ? &stripe->tx_iov_cnt : &stripe->rx_iov_cnt;
+
+		*stripe_len = MIN(len, slice);
+		*stripe_cnt = 0;
+		if (*stripe_len)
+			(void) ofi_copy_iov_desc(tx ? stripe->tx_iov :
+						 stripe->rx_iov, NULL,
+						 stripe_cnt, iov, NULL, iov_cnt,
+						 &index, &offset, *stripe_len);
+		len -= *stripe_len;
+	}
+}
+
+static int tcpx_send_stripes(struct tcpx_xfer_entry *tx_entry)
+{
+	struct tcpx_ep *ep = tx_entry->ep;
+	struct tcpx_stripe *stripe;
+	struct msghdr msg = {0};
+	ssize_t bytes_sent;
+	bool pending = false;
+	int i;
+
+	for (i = 0; i < ep->stripe_cnt; i++) {
+		stripe = &ep->stripes[i];
+		if (!stripe->tx_len)
+			continue;
+
+		msg.msg_iov = stripe->tx_iov;
+		msg.msg_iovlen = stripe->tx_iov_cnt;
+		bytes_sent = ofi_sendmsg_tcp(stripe->sock, &msg, MSG_NOSIGNAL);
+		if (bytes_sent < 0) {
+			if (!OFI_SOCK_TRY_SND_RCV_AGAIN(ofi_sockerr()))
+				return ofi_sockerr() == EPIPE ?
+				       -FI_ENOTCONN : -ofi_sockerr();
+			pending = true;
+			continue;
+		}
+
+		stripe->tx_len -= bytes_sent;
+		if (stripe->tx_len) {
+			ofi_consume_iov(stripe->tx_iov, &stripe->tx_iov_cnt,
+					bytes_sent);
+			pending = true;
+		}
+	}
+
+	if (pending || tx_entry->rem_len)
+		return -FI_EAGAIN;
+
+	ep->stripe_tx = NULL;
+	return FI_SUCCESS;
+}
+
+int tcpx_send_msg(struct tcpx_xfer_entry *tx_entry)
+{
+	size_t len, slice;
+	int ret;
+
+	if (tcpx_ep_uring(tx_entry->ep))
+		return tcpx_uring_send(tx_entry);
+
+	if (!tx_entry->striped)
+		return tcpx_send_sock(tx_entry);
+
+	if (tx_entry->ep->stripe_tx != tx_entry) {
+		len = tx_entry->rem_len - tx_entry->hdr.base_hdr.payload_off;
+		slice = tcpx_stripe_slice(len, tx_entry->ep->stripe_cnt);
+		tcpx_stripe_iov(tx_entry, tx_entry->hdr.base_hdr.payload_off +
+				MIN(len, slice), len, slice, true);
+		tx_entry->rem_len = ofi_total_iov_len(tx_entry->iov,
+						      tx_entry->iov_cnt);
+		tx_entry->ep->stripe_tx = tx_entry;
+	}
+
+	if (tx_entry->rem_len) {
+		ret = tcpx_send_sock(tx_entry);
+		if (ret && !OFI_SOCK_TRY_SND_RCV_AGAIN(-ret))
+			return ret;
+	}
+	return tcpx_send_stripes(tx_entry);
+}
+
 static ssize_t tcpx_read_from_buffer(struct stage_buf *stage_buf,
 				     uint8_t *buf, size_t len)
 {
@@ -124,7 +247,7 @@ static ssize_t tcpx_readv_from_buffer(struct stage_buf *stage_buf,
 	return ret;
 }
 
-int tcpx_recv_msg_data(struct tcpx_xfer_entry *rx_entry)
+static int tcpx_recv_sock_data(struct tcpx_xfer_entry *rx_entry)
 {
 	struct stage_buf *stage_buf;
 	ssize_t bytes_recvd, bytes_read;
@@ -138,12 +261,16 @@ int tcpx_recv_msg_data(struct tcpx_xfer_entry *rx_entry)
 						    rx_entry->iov,
 						    rx_entry->iov_cnt);
 		ofi_consume_iov(rx_entry->iov, &rx_entry->iov_cnt, bytes_read);
+		rx_entry->ep->rx_copied += bytes_read;
 		if (!rx_entry->iov_cnt || !rx_entry->iov[0].iov_len)
 			return FI_SUCCESS;
 	} else {
 		bytes_read = 0;
 	}
 
+	if (tcpx_ep_uring(rx_entry->ep))
+		return tcpx_uring_readv(rx_entry);
+
 	bytes_recvd = ofi_readv_socket(rx_entry->ep->sock, rx_entry->iov,
 				       rx_entry->iov_cnt);
 	if (bytes_recvd < 0)
@@ -152,16 +279,120 @@ int tcpx_recv_msg_data(struct tcpx_xfer_entry *rx_entry)
 		return -FI_ENOTCONN;
 
 	ofi_consume_iov(rx_entry->iov, &rx_entry->iov_cnt, bytes_recvd);
+	rx_entry->ep->rx_direct += bytes_recvd;
 	return (!rx_entry->iov_cnt || !rx_entry->iov[0].iov_len) ?
 		FI_SUCCESS : -FI_EAGAIN;
 }
 
+static int tcpx_recv_stripes(struct tcpx_xfer_entry *rx_entry)
+{
+	struct tcpx_ep *ep = rx_entry->ep;
+	struct tcpx_stripe *stripe;
+	ssize_t bytes_recvd;
+	size_t len, slice, first, done;
+	bool pending = false;
+	int i, ret;
+
+	if (ep->stripe_rx != rx_entry) {
+		len = rx_entry->hdr.base_hdr.size -
+		      rx_entry->hdr.base_hdr.payload_off;
+		slice = tcpx_stripe_slice(len, ep->stripe_cnt);
+		first = MIN(len, slice);
+		done = len - rx_entry->rem_len -
+		       ofi_total_iov_len(rx_entry->iov, rx_entry->iov_cnt);
+		if (!ep->stripe_cnt || done > first ||
+		    (rx_entry->rem_len && len - rx_entry->rem_len > first)) {
+			FI_WARN(&tcpx_prov, FI_LOG_EP_DATA,
+				"unable to receive striped transfer\n");
+			return -FI_EIO;
+		}
+
+		/* A dynamically provided buffer is requested once the
+		 * first part of the slice on the primary socket arrives.
+		 */
+		if (rx_entry->rem_len)
+			return tcpx_recv_sock_data(rx_entry);
+
+		tcpx_stripe_iov(rx_entry, first - done, len, slice, false);
+		ep->stripe_rx = rx_entry;
+	}
+
+	ret = tcpx_recv_sock_data(rx_entry);
+	if (ret) {
+		if (!OFI_SOCK_TRY_SND_RCV_AGAIN(-ret))
+			return ret;
+		pending = true;
+	}
+
+	for (i = 0; i < ep->stripe_cnt; i++) {
+		stripe = &ep->stripes[i];
+		if (!stripe->rx_len)
+			continue;
+
+		bytes_recvd = ofi_readv_socket(stripe->sock, stripe->rx_iov,
+					       stripe->rx_iov_cnt);
+		if (bytes_recvd < 0) {
+			if (!OFI_SOCK_TRY_SND_RCV_AGAIN(ofi_sockerr()))
+				return -ofi_sockerr();
+			pending = true;
+			continue;
+		} else if (bytes_recvd == 0) {
+			return -FI_ENOTCONN;
+		}
+
+		ep->rx_direct += bytes_recvd;
+		stripe->rx_len -= bytes_recvd;
+		if (stripe->rx_len) {
+			ofi_consume_iov(stripe->rx_iov, &stripe->rx_iov_cnt,
+					bytes_recvd);
+			pending = true;
+		}
+	}
+
+	if (pending)
+		return -FI_EAGAIN;
+
+	ep->stripe_rx = NULL;
+	return FI_SUCCESS;
+}
+
+int tcpx_recv_msg_data(struct tcpx_xfer_entry *rx_entry)
+{
+	if (rx_entry->hdr.base_hdr.flags & TCPX_STRIPED)
+		return tcpx_recv_stripes(rx_entry);
+
+	return tcpx_recv_sock_data(rx_entry);
+}
+
+/* Move the staged data into a STAGE_BUF_SIZE buffer.  Callers only grow
+ * the buffer while no read into it is outstanding.  On allocation failure,
+ * keep reading into the inline buffer.
+ */
+void tcpx_grow_stage_buf(struct stage_buf *stage_buf)
+{
+	uint8_t *buf;
+
+	assert(stage_buf->buf == stage_buf->inline_buf);
+	buf = malloc(STAGE_BUF_SIZE);
+	if (!buf) {
+		stage_buf->size = stage_buf->buf_size;
+		return;
+	}
+
+	stage_buf->bytes_avail -= stage_buf->cur_pos;
+	memcpy(buf, &stage_buf->buf[stage_buf->cur_pos],
+	       stage_buf->bytes_avail);
+	stage_buf->cur_pos = 0;
+	stage_buf->buf = buf;
+	stage_buf->buf_size = STAGE_BUF_SIZE;
+}
+
 int tcpx_read_to_buffer(SOCKET sock, struct stage_buf *stage_buf)
 {
 	int bytes_recvd;
 
 	bytes_recvd = ofi_recv_socket(sock, stage_buf->buf,
-				      sizeof(stage_buf->buf), 0);
+				      stage_buf->size, 0);
 	if (bytes_recvd <= 0)
 		return (bytes_recvd) ? -ofi_sockerr(): -FI_ENOTCONN;
 
@@ -36,6 +36,7 @@
 #include "tcpx.h"
 #include <poll.h>
 #include <sys/types.h>
+#include <netinet/tcp.h>
 #include <ofi_util.h>
 
 
@@ -102,6 +103,9 @@ static int rx_cm_data(SOCKET fd, int type, struct tcpx_cm_context *cm_ctx)
 		goto out;
 	}
 
+	cm_ctx->stripe_token = ntohll(cm_ctx->msg.hdr.conn_id);
+	cm_ctx->stripe_idx = ntohl(cm_ctx->msg.hdr.seg_no);
+	cm_ctx->stripe_cnt = (uint32_t) ntohll(cm_ctx->msg.hdr.msg_id);
 	ret = 0;
 out:
 	cm_ctx->cm_data_sz = data_size;
@@ -122,6 +126,9 @@ static int tx_cm_data(SOCKET fd, uint8_t type, struct tcpx_cm_context *cm_ctx)
 	cm_ctx->msg.hdr.type = type;
 	cm_ctx->msg.hdr.seg_size = htons((uint16_t) cm_ctx->cm_data_sz);
 	cm_ctx->msg.hdr.conn_data = 1; /* tests endianess mismatch at peer */
+	cm_ctx->msg.hdr.conn_id = htonll(cm_ctx->stripe_token);
+	cm_ctx->msg.hdr.seg_no = htonl(cm_ctx->stripe_idx);
+	cm_ctx->msg.hdr.msg_id = htonll(cm_ctx->stripe_cnt);
 
 	ret = ofi_send_socket(fd, &cm_ctx->msg, sizeof(cm_ctx->msg.hdr) +
 			      cm_ctx->cm_data_sz, MSG_NOSIGNAL);
@@ -131,9 +138,31 @@ static int tx_cm_data(SOCKET fd, uint8_t type, struct tcpx_cm_context *cm_ctx)
 	return FI_SUCCESS;
 }
 
+static void tcpx_ep_enable_zerocopy(struct tcpx_ep *ep)
+{
+#if HAVE_TCP_ZEROCOPY
+	int optval = 1;
+
+	/* Sent headers are swapped back in place, which would corrupt a
+	 * retransmission of a zero-copy send.
+	 */
+	if (tcpx_zerocopy_size == SIZE_MAX || tcpx_ep_uring(ep) ||
+	    ep->hdr_bswap != tcpx_hdr_none)
+		return;
+
+	if (setsockopt(ep->sock, SOL_SOCKET, SO_ZEROCOPY, &optval,
+		       sizeof(optval))) {
+		FI_INFO(&tcpx_prov, FI_LOG_EP_CTRL,
+			"SO_ZEROCOPY unavailable, sends will be copied\n");
+		return;
+	}
+	ep->zerocopy = true;
+#endif
+}
+
 static int tcpx_ep_enable(struct tcpx_ep *ep)
 {
-	int ret = 0;
+	int i, ret = 0;
 
 	if (!ep->util_ep.rx_cq && !ep->util_ep.tx_cq) {
 		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
@@ -150,9 +179,13 @@ static int tcpx_ep_enable(struct tcpx_ep *ep)
 	}
 
 	ep->state = TCPX_CONNECTED;
+	tcpx_ep_enable_zerocopy(ep);
+	if (tcpx_ep_uring(ep))
+		(void) tcpx_uring_recv(ep);
 	fastlock_release(&ep->lock);
 
-	if (ep->util_ep.rx_cq) {
+	/* With io_uring progress, the CQ waits on the ring instead */
+	if (ep->util_ep.rx_cq && !tcpx_ep_uring(ep)) {
 		ret = ofi_wait_add_fd(ep->util_ep.rx_cq->wait,
 				      ep->sock, POLLIN, tcpx_try_func,
 				      (void *) &ep->util_ep,
@@ -164,7 +197,7 @@ static int tcpx_ep_enable(struct tcpx_ep *ep)
 		}
 	}
 
-	if (ep->util_ep.tx_cq) {
+	if (ep->util_ep.tx_cq && !tcpx_ep_uring(ep)) {
 		ret = ofi_wait_add_fd(ep->util_ep.tx_cq->wait,
 				      ep->sock, POLLIN, tcpx_try_func,
 				      (void *) &ep->util_ep,
@@ -176,6 +209,18 @@ static int tcpx_ep_enable(struct tcpx_ep *ep)
 		}
 	}
 
+	for (i = 0; ep->stripes && i < ep->stripe_cnt; i++) {
+		ret = tcpx_ep_add_stripe(ep, &ep->stripes[i]);
+		if (ret) {
+			FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
+				"Failed to add stripe fd to cq\n");
+			return ret;
+		}
+	}
+
+	if (ep->busy_poll)
+		tcpx_ep_busy_poll(ep);
+
 	/* TODO: Move writing CONNECTED event here */
 
 	return ret;
@@ -184,9 +229,71 @@ unlock:
 	return ret;
 }
 
+static int tcpx_setup_stripe(SOCKET sock)
+{
+	int ret, optval = 1;
+
+	/* The last segment of each slice completes a transfer */
+	ret = setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (char *) &optval,
+			 sizeof(optval));
+	if (ret)
+		return -ofi_sockerr();
+
+	return fi_fd_nonblock(sock);
+}
+
+/* The peer's listening socket completes the connections without any
+ * action by the peer application, so blocking connects only wait for
+ * the handshakes.  The join requests are sent once all stripes are
+ * connected, so that a failure usually leaves the peer with none.
+ */
+static void tcpx_cm_connect_stripes(struct tcpx_ep *ep, uint64_t token)
+{
+	struct tcpx_cm_context join = {0};
+	union ofi_sock_ip addr;
+	socklen_t len = sizeof(addr);
+	int i, ret;
+
+	ret = ofi_getpeername(ep->sock, &addr.sa, &len);
+	if (ret)
+		goto err;
+
+	ret = tcpx_ep_alloc_stripes(ep);
+	if (ret)
+		goto err;
+
+	for (i = 0; i < ep->stripe_cnt; i++) {
+		ep->stripes[i].sock = ofi_socket(addr.sa.sa_family,
+						 SOCK_STREAM, 0);
+		if (ep->stripes[i].sock == INVALID_SOCKET ||
+		    connect(ep->stripes[i].sock, &addr.sa, len))
+			goto err;
+	}
+
+	join.stripe_token = token;
+	for (i = 0; i < ep->stripe_cnt; i++) {
+		join.stripe_idx = i + 1;
+		ret = tx_cm_data(ep->stripes[i].sock, ofi_ctrl_connreq, &join);
+		if (ret)
+			goto err;
+
+		ret = tcpx_setup_stripe(ep->stripes[i].sock);
+		if (ret)
+			goto err;
+	}
+	ep->stripe_ready = ep->stripe_cnt;
+	return;
+
+err:
+	FI_INFO(&tcpx_prov, FI_LOG_EP_CTRL,
+		"unable to open stripes, using a single socket\n");
+	tcpx_ep_free_stripes(ep);
+}
+
 static void tcpx_cm_recv_resp(struct util_wait *wait,
 			      struct tcpx_cm_context *cm_ctx)
 {
+	struct tcpx_cm_context confirm = {0};
 	struct fi_eq_cm_entry *cm_entry;
 	struct tcpx_ep *ep;
 	int ret;
@@ -225,6 +332,18 @@ static void tcpx_cm_recv_resp(struct util_wait *wait,
 	ep->hdr_bswap = (cm_ctx->msg.hdr.conn_data == 1) ?
 			tcpx_hdr_none : tcpx_hdr_bswap;
 
+	ep->stripe_cnt = (int) MIN((uint32_t) ep->stripe_cnt,
+				   cm_ctx->stripe_cnt);
+	if (cm_ctx->stripe_cnt) {
+		if (ep->stripe_cnt)
+			tcpx_cm_connect_stripes(ep, cm_ctx->stripe_token);
+
+		confirm.stripe_cnt = ep->stripe_cnt;
+		ret = tx_cm_data(ep->sock, ofi_ctrl_ack, &confirm);
+		if (ret)
+			goto err2;
+	}
+
 	ret = tcpx_ep_enable(ep);
 	if (ret)
 		goto err2;
@@ -250,10 +369,29 @@ int tcpx_eq_wait_try_func(void *arg)
 	return FI_SUCCESS;
 }
 
+static void tcpx_cm_accepted(struct tcpx_ep *ep)
+{
+	struct fi_eq_cm_entry cm_entry = {0};
+	int ret;
+
+	cm_entry.fid = &ep->util_ep.ep_fid.fid;
+	ret = (int) fi_eq_write(&ep->util_ep.eq->eq_fid, FI_CONNECTED,
+				&cm_entry, sizeof(cm_entry), 0);
+	if (ret < 0)
+		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL, "Error writing to EQ\n");
+
+	ret = tcpx_ep_enable(ep);
+	if (ret) {
+		tcpx_ep_disable(ep, -ret);
+		return;
+	}
+
+	FI_DBG(&tcpx_prov, FI_LOG_EP_CTRL, "Connection Accept Successful\n");
+}
+
 static void tcpx_cm_send_resp(struct util_wait *wait,
 			      struct tcpx_cm_context *cm_ctx)
 {
-	struct fi_eq_cm_entry cm_entry = {0};
 	struct tcpx_ep *ep;
 	int ret;
 
@@ -277,17 +415,16 @@ static void tcpx_cm_send_resp(struct util_wait *wait,
 		goto disable;
 	}
 
-	cm_entry.fid =  cm_ctx->fid;
-	ret = (int) fi_eq_write(&ep->util_ep.eq->eq_fid, FI_CONNECTED,
-				&cm_entry, sizeof(cm_entry), 0);
-	if (ret < 0)
-		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL, "Error writing to EQ\n");
-
-	ret = tcpx_ep_enable(ep);
-	if (ret)
-		goto disable;
+	if (ep->stripe_cnt) {
+		cm_ctx->state = TCPX_CM_STRIPE_WAIT;
+		ret = ofi_wait_add_fd(wait, ep->sock, POLLIN,
+				      tcpx_eq_wait_try_func, NULL, cm_ctx);
+		if (ret)
+			goto disable;
+		return;
+	}
 
-	FI_DBG(&tcpx_prov, FI_LOG_EP_CTRL, "Connection Accept Successful\n");
+	tcpx_cm_accepted(ep);
 	free(cm_ctx);
 	return;
 
@@ -298,6 +435,111 @@ disable:
 	free(cm_ctx);
 }
 
+/* The peer confirms the number of stripes it opened, either all that
+ * were negotiated or none.
+ */
+static void tcpx_cm_recv_stripes(struct util_wait *wait,
+				 struct tcpx_cm_context *cm_ctx)
+{
+	struct tcpx_fabric *fabric;
+	struct tcpx_ep *ep;
+	bool accepted;
+	int ret;
+
+	assert(cm_ctx->fid->fclass == FI_CLASS_EP);
+	ep = container_of(cm_ctx->fid, struct tcpx_ep, util_ep.ep_fid.fid);
+
+	ret = rx_cm_data(ep->sock, ofi_ctrl_ack, cm_ctx);
+	if (ret) {
+		if (ret == -FI_EAGAIN)
+			return;
+		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
+			"Failed to receive stripe confirmation\n");
+		ofi_wait_del_fd(wait, ep->sock);
+		goto disable;
+	}
+
+	ret = ofi_wait_del_fd(wait, ep->sock);
+	if (ret) {
+		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
+			"Could not remove fd from wait\n");
+		goto disable;
+	}
+
+	fabric = container_of(ep->util_ep.domain->fabric, struct tcpx_fabric,
+			      util_fabric);
+	fastlock_acquire(&fabric->util_fabric.lock);
+	ep->stripe_confirmed = true;
+	if (cm_ctx->stripe_cnt != (uint32_t) ep->stripe_cnt) {
+		dlist_remove_init(&ep->stripe_entry);
+		fastlock_release(&fabric->util_fabric.lock);
+
+		FI_INFO(&tcpx_prov, FI_LOG_EP_CTRL,
+			"peer opened no stripes, using a single socket\n");
+		tcpx_ep_free_stripes(ep);
+		accepted = true;
+	} else {
+		accepted = (ep->stripe_ready == ep->stripe_cnt);
+		fastlock_release(&fabric->util_fabric.lock);
+	}
+
+	if (accepted)
+		tcpx_cm_accepted(ep);
+	free(cm_ctx);
+	return;
+
+disable:
+	tcpx_ep_disable(ep, -ret);
+	free(cm_ctx);
+}
+
+/* A stripe joins the accepted endpoint with the token returned in the
+ * accept response.
+ */
+static void tcpx_cm_recv_join(struct tcpx_conn_handle *handle,
+			      struct tcpx_cm_context *cm_ctx)
+{
+	struct tcpx_fabric *fabric;
+	struct tcpx_ep *ep;
+	bool accepted;
+
+	fabric = container_of(handle->pep->util_pep.fabric,
+			      struct tcpx_fabric, util_fabric);
+	fastlock_acquire(&fabric->util_fabric.lock);
+	dlist_foreach_container(&fabric->stripe_list, struct tcpx_ep,
+				ep, stripe_entry) {
+		if (ep->stripe_token == cm_ctx->stripe_token)
+			goto found;
+	}
+	FI_INFO(&tcpx_prov, FI_LOG_EP_CTRL, "stripe of unknown connection\n");
+	goto err;
+
+found:
+	if (cm_ctx->stripe_idx > (uint32_t) ep->stripe_cnt ||
+	    ep->stripes[cm_ctx->stripe_idx - 1].sock != INVALID_SOCKET ||
+	    ep->state != TCPX_ACCEPTING || tcpx_setup_stripe(handle->sock)) {
+		FI_INFO(&tcpx_prov, FI_LOG_EP_CTRL, "unexpected stripe\n");
+		goto err;
+	}
+
+	ep->stripes[cm_ctx->stripe_idx - 1].sock = handle->sock;
+	accepted = (++ep->stripe_ready == ep->stripe_cnt) &&
+		   ep->stripe_confirmed;
+	if (ep->stripe_ready == ep->stripe_cnt)
+		dlist_remove_init(&ep->stripe_entry);
+	fastlock_release(&fabric->util_fabric.lock);
+
+	if (accepted)
+		tcpx_cm_accepted(ep);
+	free(handle);
+	return;
+
+err:
+	fastlock_release(&fabric->util_fabric.lock);
+	ofi_close_socket(handle->sock);
+	free(handle);
+}
+
 static void tcpx_cm_recv_req(struct util_wait *wait,
 			     struct tcpx_cm_context *cm_ctx)
 {
@@ -324,6 +566,12 @@ static void tcpx_cm_recv_req(struct util_wait *wait,
 		goto err1;
 	}
 
+	if (cm_ctx->stripe_idx) {
+		tcpx_cm_recv_join(handle, cm_ctx);
+		free(cm_ctx);
+		return;
+	}
+
 	cm_entry = calloc(1, sizeof(*cm_entry) + cm_ctx->cm_data_sz);
 	if (!cm_entry)
 		goto err1;
@@ -343,6 +591,7 @@ static void tcpx_cm_recv_req(struct util_wait *wait,
 		goto err3;
 
 	handle->endian_match = (cm_ctx->msg.hdr.conn_data == 1);
+	handle->stripe_cnt = cm_ctx->stripe_cnt;
 	cm_entry->info->handle = &handle->handle;
 	memcpy(cm_entry->data, cm_ctx->msg.data, cm_ctx->cm_data_sz);
 	cm_ctx->state = TCPX_CM_REQ_RVCD;
@@ -493,6 +742,13 @@ static void process_cm_ctx(struct util_wait *wait,
 							  TCPX_ACCEPTING));
 		tcpx_cm_send_resp(wait, cm_ctx);
 		break;
+	case TCPX_CM_STRIPE_WAIT:
+		assert((cm_ctx->fid->fclass == FI_CLASS_EP) &&
+		       (container_of(cm_ctx->fid, struct tcpx_ep,
+				     util_ep.ep_fid.fid)->state ==
+							  TCPX_ACCEPTING));
+		tcpx_cm_recv_stripes(wait, cm_ctx);
+		break;
 	case TCPX_CM_REQ_SENT:
 		assert((cm_ctx->fid->fclass == FI_CLASS_EP) &&
 		       (container_of(cm_ctx->fid, struct tcpx_ep,
@@ -32,6 +32,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
 
 #include "tcpx.h"
 
@@ -44,25 +45,39 @@ void tcpx_cq_progress(struct util_cq *cq)
 	struct fid_list_entry *fid_entry;
 	struct util_wait_fd *wait_fd;
 	struct dlist_entry *item;
+	struct tcpx_uring *uring;
 	struct tcpx_ep *ep;
 	struct fid *fid;
 	int nfds, i;
 
 	wait_fd = container_of(cq->wait, struct util_wait_fd, util_wait);
+	uring = container_of(cq->domain, struct tcpx_domain,
+			     util_domain)->uring;
 
 	cq->cq_fastlock_acquire(&cq->ep_list_lock);
 	dlist_foreach(&cq->ep_list, item) {
 		fid_entry = container_of(item, struct fid_list_entry, entry);
 		ep = container_of(fid_entry->fid, struct tcpx_ep,
 				  util_ep.ep_fid.fid);
-		tcpx_try_func(&ep->util_ep);
+		if (!uring)
+			tcpx_try_func(&ep->util_ep);
 		fastlock_acquire(&ep->lock);
 		tcpx_progress_tx(ep);
-		if (ep->stage_buf.cur_pos < ep->stage_buf.bytes_avail)
+		if ((ep->stage_buf.cur_pos < ep->stage_buf.bytes_avail) ||
+		    (uring && ep->state == TCPX_CONNECTED &&
+		     !(ep->uring_pending & TCPX_URING_RX)))
 			tcpx_progress_rx(ep);
 		fastlock_release(&ep->lock);
 	}
 
+	/* Submissions and completions for all endpoints in one syscall */
+	if (uring) {
+		if (ofi_atomic_get32(&wait_fd->signal.state) == OFI_SIGNAL_SET)
+			fd_signal_reset(&wait_fd->signal);
+		tcpx_uring_progress(uring);
+		goto unlock;
+	}
+
 	nfds = (wait_fd->util_wait.wait_obj == FI_WAIT_FD) ?
 	       ofi_epoll_wait(wait_fd->epoll_fd, wait_contexts,
 			      MAX_POLL_EVENTS, 0) :
@@ -87,6 +102,121 @@ unlock:
 	cq->cq_fastlock_release(&cq->ep_list_lock);
 }
 
+/* Spin for the busy poll time before blocking on the wait object */
+static ssize_t tcpx_cq_sreadfrom(struct fid_cq *cq_fid, void *buf,
+				 size_t count, fi_addr_t *src_addr,
+				 const void *cond, int timeout)
+{
+	struct tcpx_cq *cq;
+	uint64_t start, now, endtime;
+	ssize_t ret;
+
+	cq = container_of(cq_fid, struct tcpx_cq, util_cq.cq_fid);
+	start = ofi_gettime_us();
+	if (cq->busy_poll > 0) {
+		endtime = start + cq->busy_poll;
+		if (timeout >= 0)
+			endtime = MIN(endtime, start + (uint64_t) timeout * 1000);
+
+		do {
+			ret = ofi_cq_readfrom(cq_fid, buf, count, src_addr);
+			now = ofi_gettime_us();
+		} while (ret == -FI_EAGAIN && now < endtime);
+
+		if (ret != -FI_EAGAIN || !timeout) {
+			cq->util_cq.cq_fastlock_acquire(&cq->util_cq.cq_lock);
+			cq->spin_cnt += (ret != -FI_EAGAIN);
+			cq->spin_time += now - start;
+			cq->util_cq.cq_fastlock_release(&cq->util_cq.cq_lock);
+			return ret;
+		}
+
+		if (timeout > 0)
+			timeout = MAX(timeout - (int) ((now - start) / 1000), 0);
+	} else {
+		now = start;
+	}
+
+	ret = ofi_cq_sreadfrom(cq_fid, buf, count, src_addr, cond, timeout);
+
+	cq->util_cq.cq_fastlock_acquire(&cq->util_cq.cq_lock);
+	cq->spin_time += now - start;
+	cq->wait_cnt += (ret != -FI_EAGAIN);
+	cq->wait_time += ofi_gettime_us() - now;
+	cq->util_cq.cq_fastlock_release(&cq->util_cq.cq_lock);
+	return ret;
+}
+
+static ssize_t tcpx_cq_sread(struct fid_cq *cq_fid, void *buf, size_t count,
+			     const void *cond, int timeout)
+{
+	return tcpx_cq_sreadfrom(cq_fid, buf, count, NULL, cond, timeout);
+}
+
+static void tcpx_cq_epoll_busy_poll(struct tcpx_cq *cq)
+{
+#if defined(HAVE_EPOLL) && defined(EPIOCSPARAMS)
+	struct util_wait_fd *wait_fd;
+	struct epoll_params params = {
+		.busy_poll_usecs = (uint32_t) cq->busy_poll,
+		.busy_poll_budget = 8,	/* kernel default */
+		.prefer_busy_poll = (cq->busy_poll > 0),
+	};
+
+	if (cq->util_cq.wait->wait_obj != FI_WAIT_FD)
+		return;
+
+	wait_fd = container_of(cq->util_cq.wait, struct util_wait_fd,
+			       util_wait);
+	if (ioctl(wait_fd->epoll_fd, EPIOCSPARAMS, &params))
+		FI_INFO(&tcpx_prov, FI_LOG_CQ,
+			"unable to set epoll busy poll: %s\n",
+			strerror(errno));
+#endif
+}
+
+/* The CQ spins, and its epoll set busy polls, for the longest time
+ * requested by any bound endpoint.
+ */
+void tcpx_cq_busy_poll(struct util_cq *util_cq)
+{
+	struct fid_list_entry *fid_entry;
+	struct dlist_entry *item;
+	struct tcpx_cq *cq;
+	struct tcpx_ep *ep;
+	int busy_poll = 0;
+
+	cq = container_of(util_cq, struct tcpx_cq, util_cq);
+	cq->util_cq.cq_fastlock_acquire(&cq->util_cq.ep_list_lock);
+	dlist_foreach(&cq->util_cq.ep_list, item) {
+		fid_entry = container_of(item, struct fid_list_entry, entry);
+		ep = container_of(fid_entry->fid, struct tcpx_ep,
+				  util_ep.ep_fid.fid);
+		busy_poll = MAX(busy_poll, ep->busy_poll);
+	}
+
+	if (busy_poll != cq->busy_poll) {
+		cq->busy_poll = busy_poll;
+		tcpx_cq_epoll_busy_poll(cq);
+	}
+	cq->util_cq.cq_fastlock_release(&cq->util_cq.ep_list_lock);
+}
+
+/* Add the blocking read counts of the CQ to stats */
+void tcpx_cq_busy_poll_stats(struct util_cq *util_cq,
+			     struct fi_tcp_busy_poll_stats *stats)
+{
+	struct tcpx_cq *cq;
+
+	cq = container_of(util_cq, struct tcpx_cq, util_cq);
+	cq->util_cq.cq_fastlock_acquire(&cq->util_cq.cq_lock);
+	stats->spin_cnt += cq->spin_cnt;
+	stats->spin_time += cq->spin_time;
+	stats->wait_cnt += cq->wait_cnt;
+	stats->wait_time += cq->wait_time;
+	cq->util_cq.cq_fastlock_release(&cq->util_cq.cq_lock);
+}
+
 static void tcpx_buf_pools_destroy(struct tcpx_buf_pool *buf_pools)
 {
 	int i;
@@ -99,8 +229,19 @@ static int tcpx_cq_close(struct fid *fid)
 {
 	int ret;
 	struct tcpx_cq *tcpx_cq;
+	struct tcpx_uring *uring;
 
 	tcpx_cq = container_of(fid, struct tcpx_cq, util_cq.cq_fid.fid);
+	uring = container_of(tcpx_cq->util_cq.domain, struct tcpx_domain,
+			     util_domain)->uring;
+	if (uring)
+		tcpx_uring_del_wait(uring, &tcpx_cq->util_cq);
+
+	FI_INFO(&tcpx_prov, FI_LOG_CQ, "blocking reads: %" PRIu64
+		" completed spinning in %" PRIu64 " us, %" PRIu64
+		" completed waiting in %" PRIu64 " us\n", tcpx_cq->spin_cnt,
+		tcpx_cq->spin_time, tcpx_cq->wait_cnt, tcpx_cq->wait_time);
+
 	tcpx_buf_pools_destroy(tcpx_cq->buf_pools);
 	ret = ofi_cq_cleanup(&tcpx_cq->util_cq);
 	if (ret)
@@ -130,12 +271,18 @@ void tcpx_xfer_entry_free(struct tcpx_cq *tcpx_cq,
 {
 	if (xfer_entry->ep->cur_rx_entry == xfer_entry)
 		xfer_entry->ep->cur_rx_entry = NULL;
+	if (xfer_entry->ep->stripe_rx == xfer_entry)
+		xfer_entry->ep->stripe_rx = NULL;
+	if (xfer_entry->ep->stripe_tx == xfer_entry)
+		xfer_entry->ep->stripe_tx = NULL;
 
 	xfer_entry->hdr.base_hdr.flags = 0;
 
 	xfer_entry->flags = 0;
 	xfer_entry->context = 0;
 	xfer_entry->rem_len = 0;
+	xfer_entry->zerocopy = false;
+	xfer_entry->striped = false;
 
 	tcpx_cq->util_cq.cq_fastlock_acquire(&tcpx_cq->util_cq.cq_lock);
 	ofi_buf_free(xfer_entry);
@@ -218,6 +365,17 @@ static int tcpx_cq_control(struct fid *fid, int command, void *arg)
 	return ret;
 }
 
+static struct fi_ops_cq tcpx_cq_ops = {
+	.size = sizeof(struct fi_ops_cq),
+	.read = ofi_cq_read,
+	.readfrom = ofi_cq_readfrom,
+	.readerr = ofi_cq_readerr,
+	.sread = tcpx_cq_sread,
+	.sreadfrom = tcpx_cq_sreadfrom,
+	.signal = ofi_cq_signal,
+	.strerror = ofi_cq_strerror,
+};
+
 static struct fi_ops tcpx_cq_fi_ops = {
 	.size = sizeof(struct fi_ops),
 	.close = tcpx_cq_close,
@@ -294,6 +452,7 @@ int tcpx_cq_open(struct fid_domain *domain, struct fi_cq_attr *attr,
 {
 	struct tcpx_cq *tcpx_cq;
 	struct fi_cq_attr cq_attr;
+	struct tcpx_uring *uring;
 	int ret;
 
 	tcpx_cq = calloc(1, sizeof(*tcpx_cq));
@@ -307,6 +466,7 @@ int tcpx_cq_open(struct fid_domain *domain, struct fi_cq_attr *attr,
 	if (ret)
 		goto free_cq;
 
+	tcpx_cq->user_wait = (attr->wait_obj != FI_WAIT_NONE);
 	if (attr->wait_obj == FI_WAIT_NONE ||
 	    attr->wait_obj == FI_WAIT_UNSPEC) {
 		cq_attr = *attr;
@@ -319,10 +479,21 @@ int tcpx_cq_open(struct fid_domain *domain, struct fi_cq_attr *attr,
 	if (ret)
 		goto destroy_pool;
 
+	uring = container_of(domain, struct tcpx_domain,
+			     util_domain.domain_fid)->uring;
+	if (uring) {
+		ret = tcpx_uring_add_wait(uring, &tcpx_cq->util_cq);
+		if (ret)
+			goto cleanup;
+	}
+
 	*cq_fid = &tcpx_cq->util_cq.cq_fid;
 	(*cq_fid)->fid.ops = &tcpx_cq_fi_ops;
+	(*cq_fid)->ops = &tcpx_cq_ops;
 	return 0;
 
+cleanup:
+	ofi_cq_cleanup(&tcpx_cq->util_cq);
 destroy_pool:
 	tcpx_buf_pools_destroy(tcpx_cq->buf_pools);
 free_cq:
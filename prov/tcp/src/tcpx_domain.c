@@ -153,6 +153,8 @@ static int tcpx_domain_close(fid_t fid)
 	if (ret)
 		return ret;
 
+	if (tcpx_domain->uring)
+		tcpx_uring_close(tcpx_domain->uring);
 	free(tcpx_domain);
 	return FI_SUCCESS;
 }
@@ -192,6 +194,14 @@ int tcpx_domain_open(struct fid_fabric *fabric, struct fi_info *info,
 	if (ret)
 		goto err;
 
+	if (tcpx_io_uring) {
+		ret = tcpx_uring_open(&tcpx_domain->uring,
+				      info->domain_attr->ep_cnt);
+		if (ret)
+			FI_WARN(&tcpx_prov, FI_LOG_DOMAIN, "io_uring progress "
+				"unavailable, using sockets progress\n");
+	}
+
 	*domain = &tcpx_domain->util_domain.domain_fid;
 	(*domain)->fid.ops = &tcpx_domain_fi_ops;
 	(*domain)->ops = &tcpx_domain_ops;
@@ -132,6 +132,7 @@ static int tcpx_ep_connect(struct fid_ep *ep, const void *addr,
 
 	cm_ctx->fid = &tcpx_ep->util_ep.ep_fid.fid;
 	cm_ctx->state = TCPX_CM_CONNECTING;
+	cm_ctx->stripe_cnt = tcpx_ep->stripe_cnt;
 
 	if (paramlen) {
 		cm_ctx->cm_data_sz = paramlen;
@@ -152,6 +153,118 @@ free:
 	return ret;
 }
 
+int tcpx_ep_alloc_stripes(struct tcpx_ep *ep)
+{
+	int i;
+
+	ep->stripes = calloc(ep->stripe_cnt, sizeof(*ep->stripes));
+	if (!ep->stripes)
+		return -FI_ENOMEM;
+
+	for (i = 0; i < ep->stripe_cnt; i++)
+		ep->stripes[i].sock = INVALID_SOCKET;
+	return FI_SUCCESS;
+}
+
+void tcpx_ep_free_stripes(struct tcpx_ep *ep)
+{
+	int i;
+
+	for (i = 0; ep->stripes && i < ep->stripe_cnt; i++) {
+		if (ep->stripes[i].sock == INVALID_SOCKET)
+			continue;
+
+		if (ep->util_ep.rx_cq)
+			ofi_wait_del_fd(ep->util_ep.rx_cq->wait,
+					ep->stripes[i].sock);
+		if (ep->util_ep.tx_cq)
+			ofi_wait_del_fd(ep->util_ep.tx_cq->wait,
+					ep->stripes[i].sock);
+		ofi_close_socket(ep->stripes[i].sock);
+	}
+
+	free(ep->stripes);
+	ep->stripes = NULL;
+	ep->stripe_cnt = 0;
+	ep->stripe_ready = 0;
+}
+
+static void tcpx_set_busy_poll(SOCKET sock, int busy_poll)
+{
+#ifdef SO_BUSY_POLL
+	int prefer = (busy_poll > 0);
+
+	/* Raising either option above the system default is privileged */
+	if (setsockopt(sock, SOL_SOCKET, SO_BUSY_POLL, (char *) &busy_poll,
+		       sizeof(busy_poll)))
+		FI_INFO(&tcpx_prov, FI_LOG_EP_CTRL,
+			"unable to set SO_BUSY_POLL: %s\n",
+			strerror(ofi_sockerr()));
+#ifdef SO_PREFER_BUSY_POLL
+	if (setsockopt(sock, SOL_SOCKET, SO_PREFER_BUSY_POLL, (char *) &prefer,
+		       sizeof(prefer)))
+		FI_INFO(&tcpx_prov, FI_LOG_EP_CTRL,
+			"unable to set SO_PREFER_BUSY_POLL: %s\n",
+			strerror(ofi_sockerr()));
+#endif
+#endif
+}
+
+void tcpx_ep_busy_poll(struct tcpx_ep *ep)
+{
+	int i;
+
+	tcpx_set_busy_poll(ep->sock, ep->busy_poll);
+	for (i = 0; ep->stripes && i < ep->stripe_cnt; i++) {
+		if (ep->stripes[i].sock != INVALID_SOCKET)
+			tcpx_set_busy_poll(ep->stripes[i].sock, ep->busy_poll);
+	}
+}
+
+int tcpx_ep_add_stripe(struct tcpx_ep *ep, struct tcpx_stripe *stripe)
+{
+	int ret;
+
+	if (ep->util_ep.rx_cq) {
+		ret = ofi_wait_add_fd(ep->util_ep.rx_cq->wait, stripe->sock,
+				      POLLIN, tcpx_try_func,
+				      (void *) &ep->util_ep,
+				      &ep->util_ep.ep_fid.fid);
+		if (ret)
+			return ret;
+	}
+
+	if (ep->util_ep.tx_cq) {
+		ret = ofi_wait_add_fd(ep->util_ep.tx_cq->wait, stripe->sock,
+				      POLLIN, tcpx_try_func,
+				      (void *) &ep->util_ep,
+				      &ep->util_ep.ep_fid.fid);
+		if (ret)
+			return ret;
+	}
+	return FI_SUCCESS;
+}
+
+/* The peer connects the stripes to our listening endpoint once it
+ * receives the accept response, identifying the connection by token.
+ */
+static void tcpx_ep_listen_stripes(struct tcpx_ep *ep)
+{
+	struct tcpx_fabric *fabric;
+
+	if (tcpx_ep_alloc_stripes(ep)) {
+		ep->stripe_cnt = 0;
+		return;
+	}
+
+	fabric = container_of(ep->util_ep.domain->fabric, struct tcpx_fabric,
+			      util_fabric);
+	fastlock_acquire(&fabric->util_fabric.lock);
+	ep->stripe_token = ++fabric->stripe_token;
+	dlist_insert_tail(&ep->stripe_entry, &fabric->stripe_list);
+	fastlock_release(&fabric->util_fabric.lock);
+}
+
 static int tcpx_ep_accept(struct fid_ep *ep, const void *param, size_t paramlen)
 {
 	struct tcpx_ep *tcpx_ep = container_of(ep, struct tcpx_ep, util_ep.ep_fid);
@@ -168,9 +281,14 @@ static int tcpx_ep_accept(struct fid_ep *ep, const void *param, size_t paramlen)
 		return -FI_ENOMEM;
 	}
 
+	if (tcpx_ep->stripe_cnt && !tcpx_ep->stripes)
+		tcpx_ep_listen_stripes(tcpx_ep);
+
 	tcpx_ep->state = TCPX_ACCEPTING;
 	cm_ctx->fid = &tcpx_ep->util_ep.ep_fid.fid;
 	cm_ctx->state = TCPX_CM_RESP_READY;
+	cm_ctx->stripe_cnt = tcpx_ep->stripe_cnt;
+	cm_ctx->stripe_token = tcpx_ep->stripe_token;
 	if (paramlen) {
 		cm_ctx->cm_data_sz = paramlen;
 		memcpy(cm_ctx->msg.data, param, paramlen);
@@ -213,6 +331,7 @@ static void tcpx_ep_flush_all_queues(struct tcpx_ep *ep)
 	tcpx_ep_flush_queue(&ep->tx_queue, tcpx_cq);
 	tcpx_ep_flush_queue(&ep->rma_read_queue, tcpx_cq);
 	tcpx_ep_flush_queue(&ep->tx_rsp_pend_queue, tcpx_cq);
+	tcpx_ep_flush_queue(&ep->zc_queue, tcpx_cq);
 
 	tcpx_cq = container_of(ep->util_ep.rx_cq, struct tcpx_cq, util_cq);
 	tcpx_ep_flush_queue(&ep->rx_queue, tcpx_cq);
@@ -224,6 +343,7 @@ void tcpx_ep_disable(struct tcpx_ep *ep, int cm_err)
 	struct util_wait_fd *wait;
 	struct fi_eq_cm_entry cm_entry = {0};
 	struct fi_eq_err_entry err_entry = {0};
+	int i;
 
 	switch (ep->state) {
 	case TCPX_RCVD_REQ:
@@ -244,6 +364,23 @@ void tcpx_ep_disable(struct tcpx_ep *ep, int cm_err)
 					    struct util_wait_fd, util_wait);
 			ofi_wait_fdset_del(wait, ep->sock);
 		}
+
+		for (i = 0; ep->stripes && i < ep->stripe_cnt; i++) {
+			if (ep->stripes[i].sock == INVALID_SOCKET)
+				continue;
+			if (ep->util_ep.tx_cq) {
+				wait = container_of(ep->util_ep.tx_cq->wait,
+						    struct util_wait_fd,
+						    util_wait);
+				ofi_wait_fdset_del(wait, ep->stripes[i].sock);
+			}
+			if (ep->util_ep.rx_cq) {
+				wait = container_of(ep->util_ep.rx_cq->wait,
+						    struct util_wait_fd,
+						    util_wait);
+				ofi_wait_fdset_del(wait, ep->stripes[i].sock);
+			}
+		}
 		/* fall through */
 	case TCPX_ACCEPTING:
 	case TCPX_CONNECTING:
@@ -256,6 +393,10 @@ void tcpx_ep_disable(struct tcpx_ep *ep, int cm_err)
 		return;
 	}
 
+	/* Complete io_uring operations that still reference the socket */
+	if (ep->uring_pending)
+		ofi_shutdown(ep->sock, SHUT_RDWR);
+
 	tcpx_ep_flush_all_queues(ep);
 
 	if (cm_err) {
@@ -276,16 +417,23 @@ void tcpx_ep_disable(struct tcpx_ep *ep, int cm_err)
 static int tcpx_ep_shutdown(struct fid_ep *ep, uint64_t flags)
 {
 	struct tcpx_ep *tcpx_ep;
-	int ret;
+	int i, ret;
 
 	tcpx_ep = container_of(ep, struct tcpx_ep, util_ep.ep_fid);
 
+	if (tcpx_ep_uring(tcpx_ep))
+		tcpx_uring_flush(tcpx_ep_uring(tcpx_ep));
+
 	ret = ofi_shutdown(tcpx_ep->sock, SHUT_RDWR);
 	if (ret && ofi_sockerr() != ENOTCONN) {
 		FI_WARN(&tcpx_prov, FI_LOG_EP_DATA, "ep shutdown unsuccessful\n");
 	}
 
 	fastlock_acquire(&tcpx_ep->lock);
+	for (i = 0; tcpx_ep->stripes && i < tcpx_ep->stripe_cnt; i++) {
+		if (tcpx_ep->stripes[i].sock != INVALID_SOCKET)
+			ofi_shutdown(tcpx_ep->stripes[i].sock, SHUT_RDWR);
+	}
 	tcpx_ep_disable(tcpx_ep, 0);
 	fastlock_release(&tcpx_ep->lock);
 
@@ -487,6 +635,8 @@ static ssize_t tcpx_ep_cancel(fid_t fid, void *context)
 
 static int tcpx_ep_close(struct fid *fid)
 {
+	struct tcpx_fabric *fabric;
+	struct util_cq *rx_cq, *tx_cq;
 	struct tcpx_ep *ep;
 	struct tcpx_eq *eq;
 
@@ -494,6 +644,13 @@ static int tcpx_ep_close(struct fid *fid)
 	eq = ep->util_ep.eq ?
 	     container_of(ep->util_ep.eq, struct tcpx_eq, util_eq) : NULL;
 
+	/* Stop stripe joins from reaching the endpoint */
+	fabric = container_of(ep->util_ep.domain->fabric, struct tcpx_fabric,
+			      util_fabric);
+	fastlock_acquire(&fabric->util_fabric.lock);
+	dlist_remove_init(&ep->stripe_entry);
+	fastlock_release(&fabric->util_fabric.lock);
+
 	/* eq->close_lock protects from processing stale connection events */
 	if (eq)
 		fastlock_acquire(&eq->close_lock);
@@ -507,9 +664,17 @@ static int tcpx_ep_close(struct fid *fid)
 	if (ep->util_ep.eq && ep->util_ep.eq->wait)
 		ofi_wait_del_fd(ep->util_ep.eq->wait, ep->sock);
 
+	tcpx_ep_free_stripes(ep);
+
 	if (eq)
 		fastlock_release(&eq->close_lock);
 
+	FI_INFO(&tcpx_prov, FI_LOG_EP_DATA, "rx payload bytes: copied %"
+		PRIu64 ", placed directly %" PRIu64 "\n", ep->rx_copied,
+		ep->rx_direct);
+
+	tcpx_uring_ep_drain(ep);
+
 	/* Lock not technically needed, since we're freeing the EP.  But it's
 	 * harmless to acquire and silences static code analysis tools.
 	 */
@@ -522,9 +687,20 @@ static int tcpx_ep_close(struct fid *fid)
 					 &ep->util_ep.ep_fid.fid);
 	}
 	ofi_close_socket(ep->sock);
+
+	rx_cq = ep->util_ep.rx_cq;
+	tx_cq = ep->util_ep.tx_cq;
 	ofi_endpoint_close(&ep->util_ep);
+	if (ep->busy_poll) {
+		if (rx_cq)
+			tcpx_cq_busy_poll(rx_cq);
+		if (tx_cq && tx_cq != rx_cq)
+			tcpx_cq_busy_poll(tx_cq);
+	}
 	fastlock_destroy(&ep->lock);
 
+	if (ep->stage_buf.buf != ep->stage_buf.inline_buf)
+		free(ep->stage_buf.buf);
 	free(ep);
 	return 0;
 }
@@ -549,6 +725,7 @@ static int tcpx_ep_bind(struct fid *fid, struct fid *bfid, uint64_t flags)
 {
 	struct tcpx_ep *tcpx_ep;
 	struct tcpx_rx_ctx *rx_ctx;
+	int ret;
 
 	tcpx_ep = container_of(fid, struct tcpx_ep, util_ep.ep_fid.fid);
 
@@ -558,7 +735,11 @@ static int tcpx_ep_bind(struct fid *fid, struct fid *bfid, uint64_t flags)
 		return FI_SUCCESS;
 	}
 
-	return ofi_ep_bind(&tcpx_ep->util_ep, bfid, flags);
+	ret = ofi_ep_bind(&tcpx_ep->util_ep, bfid, flags);
+	if (!ret && bfid->fclass == FI_CLASS_CQ && tcpx_ep->busy_poll)
+		tcpx_cq_busy_poll(container_of(bfid, struct util_cq,
+					       cq_fid.fid));
+	return ret;
 }
 
 static struct fi_ops tcpx_ep_fi_ops = {
@@ -577,7 +758,7 @@ static int tcpx_ep_getopt(fid_t fid, int level, int optname,
 	if (level != FI_OPT_ENDPOINT)
 		return -ENOPROTOOPT;
 
-	switch (optname) {
+	switch ((unsigned) optname) {
 	case FI_OPT_MIN_MULTI_RECV:
 		if (*optlen < sizeof(size_t)) {
 			*optlen = sizeof(size_t);
@@ -596,25 +777,86 @@ static int tcpx_ep_getopt(fid_t fid, int level, int optname,
 		*((size_t *) optval) = TCPX_MAX_CM_DATA_SIZE;
 		*optlen = sizeof(size_t);
 		break;
+	case FI_OPT_TCP_BUSY_POLL:
+		if (*optlen < sizeof(int)) {
+			*optlen = sizeof(int);
+			return -FI_ETOOSMALL;
+		}
+		ep = container_of(fid, struct tcpx_ep,
+				  util_ep.ep_fid.fid);
+		*((int *) optval) = ep->busy_poll;
+		*optlen = sizeof(int);
+		break;
+	case FI_OPT_TCP_RX_STATS:
+		if (*optlen < sizeof(struct fi_tcp_rx_stats)) {
+			*optlen = sizeof(struct fi_tcp_rx_stats);
+			return -FI_ETOOSMALL;
+		}
+		ep = container_of(fid, struct tcpx_ep,
+				  util_ep.ep_fid.fid);
+		fastlock_acquire(&ep->lock);
+		((struct fi_tcp_rx_stats *) optval)->copied = ep->rx_copied;
+		((struct fi_tcp_rx_stats *) optval)->direct = ep->rx_direct;
+		fastlock_release(&ep->lock);
+		*optlen = sizeof(struct fi_tcp_rx_stats);
+		break;
+	case FI_OPT_TCP_BUSY_POLL_STATS:
+		if (*optlen < sizeof(struct fi_tcp_busy_poll_stats)) {
+			*optlen = sizeof(struct fi_tcp_busy_poll_stats);
+			return -FI_ETOOSMALL;
+		}
+		ep = container_of(fid, struct tcpx_ep,
+				  util_ep.ep_fid.fid);
+		memset(optval, 0, sizeof(struct fi_tcp_busy_poll_stats));
+		if (ep->util_ep.rx_cq)
+			tcpx_cq_busy_poll_stats(ep->util_ep.rx_cq, optval);
+		if (ep->util_ep.tx_cq && ep->util_ep.tx_cq != ep->util_ep.rx_cq)
+			tcpx_cq_busy_poll_stats(ep->util_ep.tx_cq, optval);
+		*optlen = sizeof(struct fi_tcp_busy_poll_stats);
+		break;
 	default:
 		return -FI_ENOPROTOOPT;
 	}
 	return FI_SUCCESS;
 }
 
+static int tcpx_ep_set_busy_poll(struct tcpx_ep *ep, const void *optval,
+				 size_t optlen)
+{
+	if (optlen != sizeof(int) || *(int *) optval < 0)
+		return -FI_EINVAL;
+
+	ep->busy_poll = *(int *) optval;
+	if (ep->state == TCPX_CONNECTED)
+		tcpx_ep_busy_poll(ep);
+	if (ep->util_ep.rx_cq)
+		tcpx_cq_busy_poll(ep->util_ep.rx_cq);
+	if (ep->util_ep.tx_cq && ep->util_ep.tx_cq != ep->util_ep.rx_cq)
+		tcpx_cq_busy_poll(ep->util_ep.tx_cq);
+
+	FI_INFO(&tcpx_prov, FI_LOG_EP_CTRL,
+		"FI_OPT_TCP_BUSY_POLL set to %d\n", ep->busy_poll);
+	return FI_SUCCESS;
+}
+
 int tcpx_ep_setopt(fid_t fid, int level, int optname,
 		   const void *optval, size_t optlen)
 {
 	struct tcpx_ep *ep;
 
-	if (level != FI_OPT_ENDPOINT ||
-	    optname != FI_OPT_MIN_MULTI_RECV)
+	if (level != FI_OPT_ENDPOINT)
+		return -ENOPROTOOPT;
+
+	ep = container_of(fid, struct tcpx_ep, util_ep.ep_fid.fid);
+	if ((unsigned) optname == FI_OPT_TCP_BUSY_POLL)
+		return tcpx_ep_set_busy_poll(ep, optval, optlen);
+
+	if (optname != FI_OPT_MIN_MULTI_RECV)
 		return -ENOPROTOOPT;
 
 	if (optlen != sizeof(size_t))
 		return -FI_EINVAL;
 
-	ep = container_of(fid, struct tcpx_ep, util_ep.ep_fid.fid);
 	ep->min_multi_recv_size = *(size_t *) optval;
 
 	FI_INFO(&tcpx_prov, FI_LOG_EP_CTRL,
@@ -664,6 +906,8 @@ int tcpx_endpoint(struct fid_domain *domain, struct fi_info *info,
 			ep->sock = handle->sock;
 			ep->hdr_bswap = handle->endian_match ?
 					tcpx_hdr_none : tcpx_hdr_bswap;
+			ep->stripe_cnt = (int) MIN(handle->stripe_cnt,
+						   (uint32_t) tcpx_stripes - 1);
 			free(handle);
 
 			ret = tcpx_setup_socket(ep->sock, info);
@@ -676,6 +920,7 @@ int tcpx_endpoint(struct fid_domain *domain, struct fi_info *info,
 			ret = -ofi_sockerr();
 			goto err2;
 		}
+		ep->stripe_cnt = tcpx_stripes - 1;
 
 		ret = tcpx_setup_socket(ep->sock, info);
 		if (ret)
@@ -690,10 +935,20 @@ int tcpx_endpoint(struct fid_domain *domain, struct fi_info *info,
 	slist_init(&ep->tx_queue);
 	slist_init(&ep->rma_read_queue);
 	slist_init(&ep->tx_rsp_pend_queue);
+	slist_init(&ep->zc_queue);
+	dlist_init(&ep->stripe_entry);
+
+	/* Striping relies on sockets progress */
+	if (tcpx_ep_uring(ep))
+		ep->stripe_cnt = 0;
 
 	ep->cur_rx_msg.done_len = 0;
 	ep->cur_rx_msg.hdr_len = sizeof(ep->cur_rx_msg.hdr.base_hdr);
+	ep->stage_buf.buf = ep->stage_buf.inline_buf;
+	ep->stage_buf.buf_size = sizeof(ep->stage_buf.inline_buf);
+	ep->stage_buf.size = TCPX_MAX_HDR_SZ;
 	ep->min_multi_recv_size = TCPX_MIN_MULTI_RECV;
+	ep->busy_poll = tcpx_busy_poll;
 
 	*ep_fid = &ep->util_ep.ep_fid;
 	(*ep_fid)->fid.ops = &tcpx_ep_fi_ops;
@@ -91,6 +91,9 @@ int tcpx_create_fabric(struct fi_fabric_attr *attr, struct fid_fabric **fabric,
 		return ret;
 	}
 
+	dlist_init(&tcpx_fabric->stripe_list);
+	tcpx_fabric->stripe_token = (uint64_t) ofi_generate_seed() << 32;
+
 	*fabric = &tcpx_fabric->util_fabric.fabric_fid;
 	(*fabric)->fid.ops = &tcpx_fabric_fi_ops;
 	(*fabric)->ops = &tcpx_fabric_ops;
@@ -53,6 +53,12 @@ struct tcpx_port_range port_range = {
 };
 
 int tcpx_nodelay = -1;
+int tcpx_io_uring = 0;
+size_t tcpx_zerocopy_size = SIZE_MAX;
+int tcpx_stripes = 1;
+size_t tcpx_stripe_size = 262144;
+size_t tcpx_rx_direct_size = 4096;
+int tcpx_busy_poll = 0;
 
 
 static void tcpx_init_env(void)
@@ -70,6 +76,52 @@ static void tcpx_init_env(void)
 			"overrides default TCP_NODELAY socket setting");
 	fi_param_get_bool(&tcpx_prov, "nodelay", &tcpx_nodelay);
 
+	fi_param_define(&tcpx_prov, "io_uring", FI_PARAM_BOOL,
+			"use io_uring to batch socket operations during "
+			"CQ progress (default: no)");
+	fi_param_get_bool(&tcpx_prov, "io_uring", &tcpx_io_uring);
+
+	fi_param_define(&tcpx_prov, "zerocopy_size", FI_PARAM_SIZE_T,
+			"minimum size of a transfer, including its header, "
+			"to send using MSG_ZEROCOPY (default: disabled)");
+	fi_param_get_size_t(&tcpx_prov, "zerocopy_size", &tcpx_zerocopy_size);
+
+	fi_param_define(&tcpx_prov, "stripes", FI_PARAM_INT,
+			"number of sockets opened per connection, over which "
+			"large transfers are striped (default: 1, max: 8)");
+	fi_param_get_int(&tcpx_prov, "stripes", &tcpx_stripes);
+
+	fi_param_define(&tcpx_prov, "stripe_size", FI_PARAM_SIZE_T,
+			"minimum payload size of a transfer to stripe across "
+			"the sockets of a connection (default: 256k)");
+	fi_param_get_size_t(&tcpx_prov, "stripe_size", &tcpx_stripe_size);
+
+	fi_param_define(&tcpx_prov, "rx_direct_size", FI_PARAM_SIZE_T,
+			"minimum payload size of a received message, after "
+			"which data is no longer read ahead of the following "
+			"message, but placed directly into the posted receive "
+			"buffers (default: 4k)");
+	fi_param_get_size_t(&tcpx_prov, "rx_direct_size",
+			    &tcpx_rx_direct_size);
+
+	fi_param_define(&tcpx_prov, "busy_poll", FI_PARAM_INT,
+			"time in microseconds to busy poll sockets for data, "
+			"and to spin reading a CQ before blocking in "
+			"fi_cq_sread (default: 0)");
+	fi_param_get_int(&tcpx_prov, "busy_poll", &tcpx_busy_poll);
+
+	if (tcpx_busy_poll < 0) {
+		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL, "User provided "
+			"busy poll time invalid. Ignoring. \n");
+		tcpx_busy_poll = 0;
+	}
+
+	if (tcpx_stripes < 1 || tcpx_stripes > TCPX_MAX_STRIPES) {
+		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL, "User provided "
+			"stripe count invalid. Ignoring. \n");
+		tcpx_stripes = 1;
+	}
+
 	fi_param_get_int(&tcpx_prov, "port_high_range", &port_range.high);
 	fi_param_get_int(&tcpx_prov, "port_low_range", &port_range.low);
 
@@ -42,19 +42,20 @@
 #include <ofi_util.h>
 #include <ofi_iov.h>
 
+#if HAVE_TCP_ZEROCOPY
+#include <linux/errqueue.h>
+#endif
 
-static void tcpx_process_tx_entry(struct tcpx_xfer_entry *tx_entry)
-{
-	struct tcpx_cq *tcpx_cq;
-	int ret;
 
-	ret = tcpx_send_msg(tx_entry);
-	if (OFI_SOCK_TRY_SND_RCV_AGAIN(-ret))
-		return;
+/* Must hold ep lock */
+static bool tcpx_zerocopy_pending(struct tcpx_ep *ep, uint32_t seq)
+{
+	return (int32_t) (seq - ep->zc_done) >= 0;
+}
 
-	/* Keep this path below as a single pass path.*/
-	tx_entry->ep->hdr_bswap(&tx_entry->hdr.base_hdr);
-	slist_remove_head(&tx_entry->ep->tx_queue);
+static void tcpx_report_tx(struct tcpx_xfer_entry *tx_entry, int ret)
+{
+	struct tcpx_cq *tcpx_cq;
 
 	if (ret) {
 		FI_WARN(&tcpx_prov, FI_LOG_DOMAIN, "msg send failed\n");
@@ -75,6 +76,38 @@ static void tcpx_process_tx_entry(struct tcpx_xfer_entry *tx_entry)
 	tcpx_xfer_entry_free(tcpx_cq, tx_entry);
 }
 
+static void tcpx_complete_tx(struct tcpx_xfer_entry *tx_entry, int ret)
+{
+	slist_remove_head(&tx_entry->ep->tx_queue);
+
+	/* The kernel references the buffers of a zero-copy send until it
+	 * reports them released.  Transfers that wait for a response from
+	 * the peer are covered by its acknowledgment of the data.
+	 */
+	if (!ret && tx_entry->zerocopy &&
+	    tcpx_zerocopy_pending(tx_entry->ep, tx_entry->zc_seq) &&
+	    !(tx_entry->hdr.base_hdr.flags &
+	      (OFI_DELIVERY_COMPLETE | OFI_COMMIT_COMPLETE))) {
+		slist_insert_tail(&tx_entry->entry, &tx_entry->ep->zc_queue);
+		return;
+	}
+
+	/* Keep this path below as a single pass path.*/
+	tx_entry->ep->hdr_bswap(&tx_entry->hdr.base_hdr);
+	tcpx_report_tx(tx_entry, ret);
+}
+
+static void tcpx_process_tx_entry(struct tcpx_xfer_entry *tx_entry)
+{
+	int ret;
+
+	ret = tcpx_send_msg(tx_entry);
+	if (OFI_SOCK_TRY_SND_RCV_AGAIN(-ret))
+		return;
+
+	tcpx_complete_tx(tx_entry, ret);
+}
+
 static int tcpx_prepare_rx_entry_resp(struct tcpx_xfer_entry *rx_entry)
 {
 	struct tcpx_cq *tcpx_tx_cq;
@@ -583,11 +616,44 @@ int tcpx_op_read_rsp(struct tcpx_ep *tcpx_ep)
 	return FI_SUCCESS;
 }
 
+static ssize_t tcpx_recv_next_hdr(struct tcpx_ep *ep)
+{
+	/* With io_uring, the rest of the header arrives through the
+	 * staging buffer receive posted once the buffer drains.
+	 */
+	if (tcpx_ep_uring(ep) &&
+	    ep->stage_buf.cur_pos == ep->stage_buf.bytes_avail)
+		return -FI_EAGAIN;
+
+	return tcpx_recv_hdr(ep->sock, &ep->stage_buf, &ep->cur_rx_msg);
+}
+
+/* Size the next read into the staging buffer for the traffic seen.  Runs
+ * of small messages are coalesced into fewer, larger reads.  After a
+ * large message, only a header is read ahead, so that the payload of the
+ * next one lands directly in the receive buffers instead of being copied
+ * out of the staging buffer.
+ */
+static void tcpx_update_stage_size(struct tcpx_ep *ep)
+{
+	struct stage_buf *stage_buf = &ep->stage_buf;
+
+	if (ep->cur_rx_msg.hdr.base_hdr.size - ep->cur_rx_msg.hdr_len >=
+	    tcpx_rx_direct_size) {
+		stage_buf->size = TCPX_MAX_HDR_SZ;
+		return;
+	}
+
+	stage_buf->size = MIN(stage_buf->size << 1, STAGE_BUF_SIZE);
+	if (stage_buf->size > stage_buf->buf_size)
+		tcpx_grow_stage_buf(stage_buf);
+}
+
 static int tcpx_get_next_rx_hdr(struct tcpx_ep *ep)
 {
 	ssize_t ret;
 
-	ret = tcpx_recv_hdr(ep->sock, &ep->stage_buf, &ep->cur_rx_msg);
+	ret = tcpx_recv_next_hdr(ep);
 	if (ret < 0)
 		return (int) ret;
 
@@ -602,8 +668,7 @@ static int tcpx_get_next_rx_hdr(struct tcpx_ep *ep)
 						  base_hdr.payload_off;
 
 		if (ep->cur_rx_msg.hdr_len > ep->cur_rx_msg.done_len) {
-			ret = tcpx_recv_hdr(ep->sock, &ep->stage_buf,
-					    &ep->cur_rx_msg);
+			ret = tcpx_recv_next_hdr(ep);
 			if (ret < 0)
 				return (int) ret;
 
@@ -615,6 +680,7 @@ static int tcpx_get_next_rx_hdr(struct tcpx_ep *ep)
 		return -FI_EAGAIN;
 
 	ep->hdr_bswap(&ep->cur_rx_msg.hdr.base_hdr);
+	tcpx_update_stage_size(ep);
 	return FI_SUCCESS;
 }
 
@@ -623,9 +689,14 @@ void tcpx_progress_rx(struct tcpx_ep *ep)
 {
 	int ret;
 
+	/* The kernel owns the receive buffers until the operation completes */
+	if (ep->uring_pending & TCPX_URING_RX)
+		return;
+
 	if (!ep->cur_rx_entry &&
 	    (ep->stage_buf.cur_pos == ep->stage_buf.bytes_avail)) {
-		ret = tcpx_read_to_buffer(ep->sock, &ep->stage_buf);
+		ret = tcpx_ep_uring(ep) ? tcpx_uring_recv(ep) :
+		      tcpx_read_to_buffer(ep->sock, &ep->stage_buf);
 		if (ret)
 			goto err;
 	}
@@ -663,6 +734,95 @@ err:
 		tcpx_ep_disable(ep, 0);
 }
 
+#if HAVE_TCP_ZEROCOPY
+static void tcpx_zerocopy_complete(struct tcpx_ep *ep)
+{
+	struct tcpx_xfer_entry *tx_entry;
+
+	while (!slist_empty(&ep->zc_queue)) {
+		tx_entry = container_of(ep->zc_queue.head,
+					struct tcpx_xfer_entry, entry);
+		if (tcpx_zerocopy_pending(ep, tx_entry->zc_seq))
+			break;
+
+		slist_remove_head(&ep->zc_queue);
+		ep->hdr_bswap(&tx_entry->hdr.base_hdr);
+		tcpx_report_tx(tx_entry, FI_SUCCESS);
+	}
+}
+
+/* Ranges may be released out of order, e.g. after a retransmit, so
+ * zc_done only advances over the sends released without a gap.
+ */
+static void tcpx_zerocopy_release(struct tcpx_ep *ep, uint32_t lo,
+				  uint32_t hi)
+{
+	uint32_t seq, bit;
+
+	if ((int32_t) (lo - ep->zc_done) < 0)
+		lo = ep->zc_done;
+
+	for (seq = lo; (int32_t) (hi - seq) >= 0 &&
+	     (int32_t) (seq - ep->zc_next) < 0; seq++) {
+		bit = seq % TCPX_ZC_WINDOW;
+		ep->zc_map[bit / 64] |= 1ULL << (bit % 64);
+	}
+
+	for (;;) {
+		bit = ep->zc_done % TCPX_ZC_WINDOW;
+		if (!(ep->zc_map[bit / 64] & (1ULL << (bit % 64))))
+			break;
+		ep->zc_map[bit / 64] &= ~(1ULL << (bit % 64));
+		ep->zc_done++;
+	}
+}
+
+/* Notifications arrive on the socket error queue, each covering the
+ * range of zero-copy send calls [ee_info, ee_data].
+ */
+static void tcpx_zerocopy_reap(struct tcpx_ep *ep)
+{
+	struct sock_extended_err *serr;
+	struct cmsghdr *cmsg;
+	struct msghdr msg = {0};
+	char control[CMSG_SPACE(sizeof(*serr) + sizeof(struct sockaddr_in6))];
+
+	for (;;) {
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		if (recvmsg(ep->sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+			break;
+
+		cmsg = CMSG_FIRSTHDR(&msg);
+		if (!cmsg || !((cmsg->cmsg_level == SOL_IP &&
+				cmsg->cmsg_type == IP_RECVERR) ||
+			       (cmsg->cmsg_level == SOL_IPV6 &&
+				cmsg->cmsg_type == IPV6_RECVERR)))
+			continue;
+
+		serr = (struct sock_extended_err *) CMSG_DATA(cmsg);
+		if (serr->ee_errno || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+			continue;
+
+		tcpx_zerocopy_release(ep, serr->ee_info, serr->ee_data);
+
+		/* The kernel copied the data anyway, e.g. over loopback */
+		if ((serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) &&
+		    ep->zerocopy) {
+			FI_INFO(&tcpx_prov, FI_LOG_EP_DATA,
+				"zero-copy sends copied, disabling\n");
+			ep->zerocopy = false;
+		}
+	}
+
+	tcpx_zerocopy_complete(ep);
+}
+#else
+static void tcpx_zerocopy_reap(struct tcpx_ep *ep)
+{
+}
+#endif
+
 /* Must hold ep lock */
 void tcpx_progress_tx(struct tcpx_ep *ep)
 {
@@ -674,44 +834,129 @@ void tcpx_progress_tx(struct tcpx_ep *ep)
 		tx_entry = container_of(entry, struct tcpx_xfer_entry, entry);
 		tcpx_process_tx_entry(tx_entry);
 	}
+
+	if (ep->zc_next != ep->zc_done)
+		tcpx_zerocopy_reap(ep);
 }
 
-int tcpx_try_func(void *util_ep)
+/* Must hold ep lock */
+static bool tcpx_uring_rx_idle(struct tcpx_ep *ep)
+{
+	return !(ep->uring_pending & TCPX_URING_RX) && !ep->cur_rx_entry &&
+	       (ep->stage_buf.cur_pos == ep->stage_buf.bytes_avail) &&
+	       ep->state == TCPX_CONNECTED;
+}
+
+void tcpx_uring_tx_done(struct tcpx_ep *ep, int res)
+{
+	struct tcpx_xfer_entry *tx_entry;
+
+	fastlock_acquire(&ep->lock);
+	ep->uring_pending &= ~TCPX_URING_TX;
+
+	/* Queued transfers were flushed when the ep was disabled */
+	if (ep->state == TCPX_DISCONNECTED || slist_empty(&ep->tx_queue))
+		goto unlock;
+
+	tx_entry = container_of(ep->tx_queue.head, struct tcpx_xfer_entry,
+				entry);
+	if (res < 0) {
+		if (!OFI_SOCK_TRY_SND_RCV_AGAIN(-res))
+			tcpx_complete_tx(tx_entry, res == -EPIPE ?
+					 -FI_ENOTCONN : res);
+	} else {
+		tx_entry->rem_len -= res;
+		if (tx_entry->rem_len)
+			ofi_consume_iov(tx_entry->iov, &tx_entry->iov_cnt, res);
+		else
+			tcpx_complete_tx(tx_entry, FI_SUCCESS);
+	}
+
+	/* Resubmit the remainder or start the next queued transfer */
+	tcpx_progress_tx(ep);
+unlock:
+	fastlock_release(&ep->lock);
+}
+
+void tcpx_uring_rx_done(struct tcpx_ep *ep, int res)
+{
+	fastlock_acquire(&ep->lock);
+	ep->uring_pending &= ~TCPX_URING_RX;
+	if (ep->state != TCPX_CONNECTED)
+		goto unlock;
+
+	if (res > 0) {
+		if (ep->cur_rx_entry) {
+			ofi_consume_iov(ep->cur_rx_entry->iov,
+					&ep->cur_rx_entry->iov_cnt, res);
+			ep->rx_direct += res;
+		} else {
+			ep->stage_buf.bytes_avail = res;
+			ep->stage_buf.cur_pos = 0;
+		}
+	} else if (!OFI_SOCK_TRY_SND_RCV_AGAIN(-res)) {
+		/* reported by the next receive attempt */
+		ep->uring_rx_err = res ? res : -FI_ENOTCONN;
+	}
+
+	tcpx_progress_rx(ep);
+	if (tcpx_uring_rx_idle(ep))
+		(void) tcpx_uring_recv(ep);
+unlock:
+	fastlock_release(&ep->lock);
+}
+
+static int tcpx_update_pollout(struct util_wait_fd *wait_fd, struct tcpx_ep *ep,
+			       SOCKET sock, bool *pollout_set, bool pollout)
 {
 	uint32_t events;
+	int ret;
+
+	if (*pollout_set == pollout)
+		return FI_SUCCESS;
+
+	*pollout_set = pollout;
+	if (wait_fd->util_wait.wait_obj == FI_WAIT_FD) {
+		events = pollout ? (OFI_EPOLL_IN | OFI_EPOLL_OUT) : OFI_EPOLL_IN;
+		ret = ofi_epoll_mod(wait_fd->epoll_fd, sock, events,
+				    &ep->util_ep.ep_fid.fid);
+	} else {
+		events = pollout ? (POLLIN | POLLOUT) : POLLIN;
+		ret = ofi_pollfds_mod(wait_fd->pollfds, sock, events,
+				      &ep->util_ep.ep_fid.fid);
+	}
+	if (ret)
+		FI_WARN(&tcpx_prov, FI_LOG_EP_DATA,
+			"epoll modify failed\n");
+	return ret;
+}
+
+int tcpx_try_func(void *util_ep)
+{
 	struct util_wait_fd *wait_fd;
+	struct tcpx_stripe *stripe;
 	struct tcpx_ep *ep;
-	int ret;
+	bool pollout;
+	int i, ret;
 
 	ep = container_of(util_ep, struct tcpx_ep, util_ep);
 	wait_fd = container_of(((struct util_ep *) util_ep)->tx_cq->wait,
 			       struct util_wait_fd, util_wait);
 
 	fastlock_acquire(&ep->lock);
-	if (!slist_empty(&ep->tx_queue) && !ep->pollout_set) {
-		ep->pollout_set = true;
-		events = (wait_fd->util_wait.wait_obj == FI_WAIT_FD) ?
-			 (OFI_EPOLL_IN | OFI_EPOLL_OUT) : (POLLIN | POLLOUT);
-		goto epoll_mod;
-	} else if (slist_empty(&ep->tx_queue) && ep->pollout_set) {
-		ep->pollout_set = false;
-		events = (wait_fd->util_wait.wait_obj == FI_WAIT_FD) ?
-			 OFI_EPOLL_IN : POLLIN;
-		goto epoll_mod;
+	/* A striped transfer may only be waiting on its stripes */
+	pollout = !slist_empty(&ep->tx_queue) &&
+		  !(ep->stripe_tx && !ep->stripe_tx->rem_len);
+	ret = tcpx_update_pollout(wait_fd, ep, ep->sock, &ep->pollout_set,
+				  pollout);
+
+	for (i = 0; !ret && ep->stripes && i < ep->stripe_cnt; i++) {
+		stripe = &ep->stripes[i];
+		ret = tcpx_update_pollout(wait_fd, ep, stripe->sock,
+					  &stripe->pollout_set,
+					  stripe->tx_len != 0);
 	}
 	fastlock_release(&ep->lock);
-	return FI_SUCCESS;
-
-epoll_mod:
-	ret = (wait_fd->util_wait.wait_obj == FI_WAIT_FD) ?
-	      ofi_epoll_mod(wait_fd->epoll_fd, ep->sock, events,
-			    &ep->util_ep.ep_fid.fid) :
-	      ofi_pollfds_mod(wait_fd->pollfds, ep->sock, events,
-			      &ep->util_ep.ep_fid.fid);
-	if (ret)
-		FI_WARN(&tcpx_prov, FI_LOG_EP_DATA,
-			"epoll modify failed\n");
-	fastlock_release(&ep->lock);
 	return ret;
 }
 
@@ -721,13 +966,24 @@ void tcpx_tx_queue_insert(struct tcpx_ep *tcpx_ep,
 	int empty;
 	struct util_wait *wait = tcpx_ep->util_ep.tx_cq->wait;
 
+	if (tcpx_ep->stripe_cnt && tcpx_ep->stripe_ready == tcpx_ep->stripe_cnt &&
+	    (tx_entry->rem_len - tx_entry->hdr.base_hdr.payload_off >=
+	     tcpx_stripe_size)) {
+		tx_entry->striped = true;
+		tx_entry->hdr.base_hdr.flags |=
+			(tcpx_ep->hdr_bswap == tcpx_hdr_none) ?
+			TCPX_STRIPED : htons(TCPX_STRIPED);
+	}
+
 	empty = slist_empty(&tcpx_ep->tx_queue);
 	slist_insert_tail(&tx_entry->entry, &tcpx_ep->tx_queue);
 
 	if (empty) {
 		tcpx_process_tx_entry(tx_entry);
 
-		if (!slist_empty(&tcpx_ep->tx_queue) && wait)
+		/* io_uring posting signals the CQ itself when needed */
+		if (!slist_empty(&tcpx_ep->tx_queue) && wait &&
+		    !tcpx_ep_uring(tcpx_ep))
 			wait->signal(wait);
 	}
 }
@@ -43,6 +43,8 @@ void tcpx_srx_entry_free(struct tcpx_rx_ctx *srx_ctx,
 {
 	if (xfer_entry->ep->cur_rx_entry == xfer_entry)
 		xfer_entry->ep->cur_rx_entry = NULL;
+	if (xfer_entry->ep->stripe_rx == xfer_entry)
+		xfer_entry->ep->stripe_rx = NULL;
 
 	fastlock_acquire(&srx_ctx->lock);
 	ofi_buf_free(xfer_entry);
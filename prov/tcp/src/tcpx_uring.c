@@ -0,0 +1,562 @@
+/*
+ * Copyright (c) 2021 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *	   Redistribution and use in source and binary forms, with or
+ *	   without modification, are permitted provided that the following
+ *	   conditions are met:
+ *
+ *		- Redistributions of source code must retain the above
+ *		  copyright notice, this list of conditions and the following
+ *		  disclaimer.
+ *
+ *		- Redistributions in binary form must reproduce the above
+ *		  copyright notice, this list of conditions and the following
+ *		  disclaimer in the documentation and/or other materials
+ *		  provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "tcpx.h"
+
+#if HAVE_TCP_IO_URING
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <unistd.h>
+
+#define TCPX_URING_DEPTH	1024
+
+/* Older uapi headers predate the overflow flag, its value is fixed */
+#ifndef IORING_SQ_CQ_OVERFLOW
+#define IORING_SQ_CQ_OVERFLOW	(1U << 1)
+#endif
+
+/* The low bits of the endpoint pointer carry the operation type */
+#define TCPX_URING_OP_MASK	(TCPX_URING_TX | TCPX_URING_RX)
+
+struct tcpx_uring {
+	int			fd;
+	/* protects the submission queue */
+	fastlock_t		lock;
+	/* serializes reaping of the completion queue */
+	fastlock_t		cq_lock;
+
+	unsigned		*sq_head;
+	unsigned		*sq_tail;
+	unsigned		*sq_flags;
+	unsigned		sq_mask;
+	unsigned		sq_entries;
+	unsigned		sq_pending;
+	struct io_uring_sqe	*sqes;
+
+	unsigned		*cq_head;
+	unsigned		*cq_tail;
+	unsigned		cq_mask;
+	unsigned		cq_entries;
+	struct io_uring_cqe	*cqes;
+
+	/* Operations queued or in flight whose completion is not yet
+	 * reaped.  Kept within cq_entries so the CQ cannot overflow.
+	 */
+	unsigned		inflight;
+
+	void			*sq_ring;
+	size_t			sq_ring_size;
+	void			*cq_ring;
+	size_t			cq_ring_size;
+	size_t			sqes_size;
+};
+
+static int tcpx_uring_setup(unsigned entries, struct io_uring_params *params)
+{
+	return (int) syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int tcpx_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+			    unsigned flags)
+{
+	return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+			     flags, NULL, 0);
+}
+
+static int tcpx_uring_map(struct tcpx_uring *uring,
+			  struct io_uring_params *params)
+{
+	unsigned *sq_array;
+	unsigned i;
+	int ret;
+
+	uring->sq_ring_size = params->sq_off.array +
+			      params->sq_entries * sizeof(unsigned);
+	uring->cq_ring_size = params->cq_off.cqes +
+			      params->cq_entries * sizeof(struct io_uring_cqe);
+	if (params->features & IORING_FEAT_SINGLE_MMAP)
+		uring->sq_ring_size = uring->cq_ring_size =
+			MAX(uring->sq_ring_size, uring->cq_ring_size);
+
+	uring->sq_ring = mmap(NULL, uring->sq_ring_size,
+			      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			      uring->fd, IORING_OFF_SQ_RING);
+	if (uring->sq_ring == MAP_FAILED)
+		return -errno;
+
+	if (params->features & IORING_FEAT_SINGLE_MMAP) {
+		uring->cq_ring = uring->sq_ring;
+	} else {
+		uring->cq_ring = mmap(NULL, uring->cq_ring_size,
+				      PROT_READ | PROT_WRITE,
+				      MAP_SHARED | MAP_POPULATE,
+				      uring->fd, IORING_OFF_CQ_RING);
+		if (uring->cq_ring == MAP_FAILED) {
+			ret = -errno;
+			goto unmap_sq;
+		}
+	}
+
+	uring->sqes_size = params->sq_entries * sizeof(struct io_uring_sqe);
+	uring->sqes = mmap(NULL, uring->sqes_size, PROT_READ | PROT_WRITE,
+			   MAP_SHARED | MAP_POPULATE, uring->fd,
+			   IORING_OFF_SQES);
+	if (uring->sqes == MAP_FAILED) {
+		ret = -errno;
+		goto unmap_cq;
+	}
+
+	uring->sq_head = (unsigned *) ((char *) uring->sq_ring +
+				       params->sq_off.head);
+	uring->sq_tail = (unsigned *) ((char *) uring->sq_ring +
+				       params->sq_off.tail);
+	uring->sq_flags = (unsigned *) ((char *) uring->sq_ring +
+					params->sq_off.flags);
+	uring->sq_mask = *(unsigned *) ((char *) uring->sq_ring +
+					params->sq_off.ring_mask);
+	uring->sq_entries = params->sq_entries;
+
+	/* Submission slots map 1:1 onto the sqe array */
+	sq_array = (unsigned *) ((char *) uring->sq_ring +
+				 params->sq_off.array);
+	for (i = 0; i < uring->sq_entries; i++)
+		sq_array[i] = i;
+
+	uring->cq_head = (unsigned *) ((char *) uring->cq_ring +
+				       params->cq_off.head);
+	uring->cq_tail = (unsigned *) ((char *) uring->cq_ring +
+				       params->cq_off.tail);
+	uring->cq_mask = *(unsigned *) ((char *) uring->cq_ring +
+					params->cq_off.ring_mask);
+	uring->cq_entries = params->cq_entries;
+	uring->cqes = (struct io_uring_cqe *) ((char *) uring->cq_ring +
+					       params->cq_off.cqes);
+	return 0;
+
+unmap_cq:
+	if (uring->cq_ring != uring->sq_ring)
+		munmap(uring->cq_ring, uring->cq_ring_size);
+unmap_sq:
+	munmap(uring->sq_ring, uring->sq_ring_size);
+	return ret;
+}
+
+static void tcpx_uring_unmap(struct tcpx_uring *uring)
+{
+	munmap(uring->sqes, uring->sqes_size);
+	if (uring->cq_ring != uring->sq_ring)
+		munmap(uring->cq_ring, uring->cq_ring_size);
+	munmap(uring->sq_ring, uring->sq_ring_size);
+}
+
+static bool tcpx_uring_cq_overflow(struct tcpx_uring *uring)
+{
+	return __atomic_load_n(uring->sq_flags, __ATOMIC_ACQUIRE) &
+	       IORING_SQ_CQ_OVERFLOW;
+}
+
+/* Must hold uring->lock.  Completions held on the kernel's overflow list
+ * are moved into the CQ whenever the ring is entered for events.
+ */
+static int tcpx_uring_submit(struct tcpx_uring *uring, unsigned min_complete)
+{
+	unsigned flags = 0;
+	int ret;
+
+	if (min_complete || tcpx_uring_cq_overflow(uring))
+		flags |= IORING_ENTER_GETEVENTS;
+
+	if (!uring->sq_pending && !flags)
+		return 0;
+
+	do {
+		ret = tcpx_uring_enter(uring->fd, uring->sq_pending,
+				       min_complete, flags);
+	} while (ret < 0 && errno == EINTR && !min_complete);
+
+	if (ret < 0) {
+		ret = -errno;
+		/* EBUSY: the CQ overflowed, submissions resume once the
+		 * caller has reaped completions.
+		 */
+		if (ret != -FI_EAGAIN && ret != -EBUSY && ret != -EINTR)
+			FI_WARN(&tcpx_prov, FI_LOG_EP_DATA,
+				"io_uring_enter failed: %s\n", strerror(-ret));
+		return ret;
+	}
+
+	uring->sq_pending -= ret;
+	return 0;
+}
+
+static bool tcpx_uring_cq_ready(struct tcpx_uring *uring)
+{
+	return __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE) !=
+	       *uring->cq_head;
+}
+
+/* Completions are posted by task_work, which interrupts a thread blocked
+ * in the wait set with EINTR though no signal reached the application.
+ * Reporting them here lets the wait return them as a wakeup.
+ */
+static int tcpx_uring_try_func(void *arg)
+{
+	struct tcpx_uring *uring = arg;
+
+	/* Nothing reaches the kernel until it is submitted, so flush
+	 * the submission queue before the caller blocks on the ring fd.
+	 */
+	fastlock_acquire(&uring->lock);
+	(void) tcpx_uring_submit(uring, 0);
+	fastlock_release(&uring->lock);
+	return tcpx_uring_cq_ready(uring) ? -FI_EAGAIN : FI_SUCCESS;
+}
+
+/* Must hold uring->lock */
+static struct io_uring_sqe *tcpx_uring_get_sqe(struct tcpx_uring *uring)
+{
+	struct io_uring_sqe *sqe;
+	unsigned head, tail;
+
+	/* Every operation owns a CQ entry until its completion is reaped */
+	if (__atomic_load_n(&uring->inflight, __ATOMIC_RELAXED) >=
+	    uring->cq_entries)
+		return NULL;
+
+	tail = *uring->sq_tail;
+	head = __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE);
+	if (tail - head >= uring->sq_entries) {
+		if (tcpx_uring_submit(uring, 0))
+			return NULL;
+
+		head = __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE);
+		if (tail - head >= uring->sq_entries)
+			return NULL;
+	}
+
+	sqe = &uring->sqes[tail & uring->sq_mask];
+	memset(sqe, 0, sizeof(*sqe));
+	return sqe;
+}
+
+/* Must hold uring->lock */
+static void tcpx_uring_commit_sqe(struct tcpx_uring *uring)
+{
+	__atomic_store_n(uring->sq_tail, *uring->sq_tail + 1,
+			 __ATOMIC_RELEASE);
+	__atomic_add_fetch(&uring->inflight, 1, __ATOMIC_RELAXED);
+	uring->sq_pending++;
+}
+
+static bool tcpx_uring_user_wait(struct util_cq *cq)
+{
+	return cq && container_of(cq, struct tcpx_cq, util_cq)->user_wait;
+}
+
+/* Must hold ep->lock */
+static int tcpx_uring_post(struct tcpx_ep *ep, uint8_t op, uint8_t opcode,
+			   void *addr, uint32_t len, uint32_t msg_flags)
+{
+	struct tcpx_uring *uring = tcpx_ep_uring(ep);
+	struct io_uring_sqe *sqe;
+
+	assert(!(ep->uring_pending & op));
+	if (ep->state != TCPX_CONNECTED)
+		return -FI_ENOTCONN;
+
+	fastlock_acquire(&uring->lock);
+	sqe = tcpx_uring_get_sqe(uring);
+	if (!sqe) {
+		fastlock_release(&uring->lock);
+		return -FI_EAGAIN;
+	}
+
+	sqe->opcode = opcode;
+	sqe->fd = ep->sock;
+	sqe->addr = (uintptr_t) addr;
+	sqe->len = len;
+	sqe->msg_flags = msg_flags;
+	sqe->user_data = (uintptr_t) ep | op;
+	tcpx_uring_commit_sqe(uring);
+
+	/* A thread may be blocked on the ring fd of either CQ, waiting for
+	 * a completion that cannot occur until the operation is submitted.
+	 */
+	if (tcpx_uring_user_wait(ep->util_ep.tx_cq) ||
+	    tcpx_uring_user_wait(ep->util_ep.rx_cq))
+		(void) tcpx_uring_submit(uring, 0);
+	fastlock_release(&uring->lock);
+
+	ep->uring_pending |= op;
+	return -FI_EAGAIN;
+}
+
+/* Must hold ep->lock */
+int tcpx_uring_send(struct tcpx_xfer_entry *tx_entry)
+{
+	struct tcpx_ep *ep = tx_entry->ep;
+
+	if (ep->uring_pending & TCPX_URING_TX)
+		return -FI_EAGAIN;
+
+	memset(&ep->uring_tx_msg, 0, sizeof(ep->uring_tx_msg));
+	ep->uring_tx_msg.msg_iov = tx_entry->iov;
+	ep->uring_tx_msg.msg_iovlen = tx_entry->iov_cnt;
+
+	return tcpx_uring_post(ep, TCPX_URING_TX, IORING_OP_SENDMSG,
+			       &ep->uring_tx_msg, 1, MSG_NOSIGNAL);
+}
+
+/* Must hold ep->lock */
+int tcpx_uring_recv(struct tcpx_ep *ep)
+{
+	int ret;
+
+	if (ep->uring_rx_err) {
+		ret = ep->uring_rx_err;
+		ep->uring_rx_err = 0;
+		return ret;
+	}
+
+	if (ep->uring_pending & TCPX_URING_RX)
+		return -FI_EAGAIN;
+
+	return tcpx_uring_post(ep, TCPX_URING_RX, IORING_OP_RECV,
+			       ep->stage_buf.buf, ep->stage_buf.size, 0);
+}
+
+/* Must hold ep->lock */
+int tcpx_uring_readv(struct tcpx_xfer_entry *rx_entry)
+{
+	struct tcpx_ep *ep = rx_entry->ep;
+	int ret;
+
+	if (ep->uring_rx_err) {
+		ret = ep->uring_rx_err;
+		ep->uring_rx_err = 0;
+		return ret;
+	}
+
+	if (ep->uring_pending & TCPX_URING_RX)
+		return -FI_EAGAIN;
+
+	return tcpx_uring_post(ep, TCPX_URING_RX, IORING_OP_READV,
+			       rx_entry->iov, (uint32_t) rx_entry->iov_cnt, 0);
+}
+
+/* Queued sends, such as responses owed to the peer, must reach the socket
+ * before it is shut down.
+ */
+void tcpx_uring_flush(struct tcpx_uring *uring)
+{
+	fastlock_acquire(&uring->lock);
+	(void) tcpx_uring_submit(uring, 0);
+	fastlock_release(&uring->lock);
+}
+
+/* Must hold uring->cq_lock.  Returns true if completions were moved from
+ * the kernel's overflow list into the CQ.
+ */
+static bool tcpx_uring_flush_overflow(struct tcpx_uring *uring)
+{
+	int ret;
+
+	if (!tcpx_uring_cq_overflow(uring))
+		return false;
+
+	FI_DBG(&tcpx_prov, FI_LOG_EP_DATA, "flushing io_uring CQ overflow\n");
+	fastlock_acquire(&uring->lock);
+	ret = tcpx_uring_submit(uring, 0);
+	fastlock_release(&uring->lock);
+	return !ret || ret == -EBUSY;
+}
+
+static void tcpx_uring_reap(struct tcpx_uring *uring)
+{
+	struct io_uring_cqe cqes[MAX_POLL_EVENTS];
+	struct tcpx_ep *ep;
+	unsigned head, tail;
+	int i, cnt;
+
+	do {
+		head = *uring->cq_head;
+		tail = __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE);
+		for (cnt = 0; head != tail && cnt < MAX_POLL_EVENTS; cnt++)
+			cqes[cnt] = uring->cqes[head++ & uring->cq_mask];
+		__atomic_store_n(uring->cq_head, head, __ATOMIC_RELEASE);
+		__atomic_sub_fetch(&uring->inflight, cnt, __ATOMIC_RELAXED);
+
+		for (i = 0; i < cnt; i++) {
+			ep = (struct tcpx_ep *) (uintptr_t)
+			     (cqes[i].user_data & ~TCPX_URING_OP_MASK);
+			if (cqes[i].user_data & TCPX_URING_TX)
+				tcpx_uring_tx_done(ep, cqes[i].res);
+			else
+				tcpx_uring_rx_done(ep, cqes[i].res);
+		}
+	} while (cnt == MAX_POLL_EVENTS || tcpx_uring_flush_overflow(uring));
+}
+
+/* Submits all queued operations and dispatches available completions.
+ * Completions are left to the other thread if one is already reaping.
+ */
+void tcpx_uring_progress(struct tcpx_uring *uring)
+{
+	int ret;
+
+	fastlock_acquire(&uring->lock);
+	ret = tcpx_uring_submit(uring, 0);
+	fastlock_release(&uring->lock);
+
+	if (fastlock_tryacquire(&uring->cq_lock))
+		return;
+
+	tcpx_uring_reap(uring);
+	fastlock_release(&uring->cq_lock);
+
+	/* Reaping made room for the submissions that were refused */
+	if (ret == -EBUSY) {
+		fastlock_acquire(&uring->lock);
+		(void) tcpx_uring_submit(uring, 0);
+		fastlock_release(&uring->lock);
+	}
+}
+
+/* Waits for all operations that reference the endpoint to complete.  The
+ * socket is shut down, so outstanding receives finish promptly.
+ */
+void tcpx_uring_ep_drain(struct tcpx_ep *ep)
+{
+	struct tcpx_uring *uring = tcpx_ep_uring(ep);
+
+	if (!uring)
+		return;
+
+	tcpx_uring_flush(uring);
+
+	fastlock_acquire(&ep->lock);
+	ep->state = TCPX_DISCONNECTED;
+	if (ep->uring_pending)
+		ofi_shutdown(ep->sock, SHUT_RDWR);
+	fastlock_release(&ep->lock);
+
+	/* Pending bits only clear while reaping, so holding the reap lock
+	 * keeps a completion from slipping past the wait below.
+	 */
+	fastlock_acquire(&uring->cq_lock);
+	while (ep->uring_pending) {
+		fastlock_acquire(&uring->lock);
+		(void) tcpx_uring_submit(uring, 1);
+		fastlock_release(&uring->lock);
+		tcpx_uring_reap(uring);
+	}
+	fastlock_release(&uring->cq_lock);
+}
+
+int tcpx_uring_add_wait(struct tcpx_uring *uring, struct util_cq *cq)
+{
+	return ofi_wait_add_fd(cq->wait, uring->fd, POLLIN,
+			       tcpx_uring_try_func, uring, &cq->cq_fid.fid);
+}
+
+void tcpx_uring_del_wait(struct tcpx_uring *uring, struct util_cq *cq)
+{
+	ofi_wait_del_fd(cq->wait, uring->fd);
+}
+
+/* Each endpoint has at most one send and one receive outstanding, so the
+ * CQ is sized to hold a completion for every operation of ep_cnt
+ * endpoints.  The kernel clamps the size to its limit.
+ */
+int tcpx_uring_open(struct tcpx_uring **uring_ptr, size_t ep_cnt)
+{
+	struct io_uring_params params;
+	struct tcpx_uring *uring;
+	int ret;
+
+	uring = calloc(1, sizeof(*uring));
+	if (!uring)
+		return -FI_ENOMEM;
+
+	memset(&params, 0, sizeof(params));
+	params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+	params.cq_entries = (unsigned) MIN(MAX(2 * ep_cnt,
+					       2 * TCPX_URING_DEPTH), UINT32_MAX);
+	uring->fd = tcpx_uring_setup(TCPX_URING_DEPTH, &params);
+	if (uring->fd < 0) {
+		ret = -errno;
+		FI_WARN(&tcpx_prov, FI_LOG_DOMAIN,
+			"io_uring_setup failed: %s\n", strerror(-ret));
+		goto free;
+	}
+
+	ret = tcpx_uring_map(uring, &params);
+	if (ret) {
+		FI_WARN(&tcpx_prov, FI_LOG_DOMAIN,
+			"unable to map io_uring: %s\n", strerror(-ret));
+		goto close;
+	}
+
+	ret = fastlock_init(&uring->lock);
+	if (ret)
+		goto unmap;
+
+	ret = fastlock_init(&uring->cq_lock);
+	if (ret)
+		goto destroy;
+
+	*uring_ptr = uring;
+	return 0;
+
+destroy:
+	fastlock_destroy(&uring->lock);
+unmap:
+	tcpx_uring_unmap(uring);
+close:
+	close(uring->fd);
+free:
+	free(uring);
+	return ret;
+}
+
+void tcpx_uring_close(struct tcpx_uring *uring)
+{
+	fastlock_destroy(&uring->cq_lock);
+	fastlock_destroy(&uring->lock);
+	tcpx_uring_unmap(uring);
+	close(uring->fd);
+	free(uring);
+}
+
+#endif /* HAVE_TCP_IO_URING */
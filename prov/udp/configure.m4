@@ -15,5 +15,33 @@ AC_DEFUN([FI_UDP_CONFIGURE],[
 	                       [udp_h_happy=0])
 	      ])
 
+	# batched datagram I/O needs recvmmsg and sendmmsg
+	udp_mmsg=0
+	AS_IF([test $udp_h_happy -eq 1],
+	      [AC_CHECK_DECL([recvmmsg],
+		[AC_CHECK_DECL([sendmmsg],
+			[udp_mmsg=1],
+			[],
+			[[#define _GNU_SOURCE
+			  #include <sys/socket.h>]])],
+		[],
+		[[#define _GNU_SOURCE
+		  #include <sys/socket.h>]])])
+	AC_DEFINE_UNQUOTED([HAVE_UDP_MMSG], [$udp_mmsg],
+			   [Define to 1 if udp batched datagram I/O is supported])
+
+	# segmentation offload needs the UDP_SEGMENT and UDP_GRO options
+	udp_gso=0
+	AS_IF([test $udp_mmsg -eq 1],
+	      [AC_CHECK_DECL([UDP_SEGMENT],
+		[AC_CHECK_DECL([UDP_GRO],
+			[udp_gso=1],
+			[],
+			[[#include <netinet/udp.h>]])],
+		[],
+		[[#include <netinet/udp.h>]])])
+	AC_DEFINE_UNQUOTED([HAVE_UDP_GSO], [$udp_gso],
+			   [Define to 1 if udp segmentation offload is supported])
+
 	AS_IF([test $udp_h_happy -eq 1], [$1], [$2])
 ])
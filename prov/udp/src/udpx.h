@@ -41,6 +41,9 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
+#if HAVE_UDP_GSO
+#include <netinet/udp.h>
+#endif
 
 #include <rdma/fabric.h>
 #include <rdma/fi_atomic.h>
@@ -57,6 +60,7 @@
 #include <ofi_enosys.h>
 #include <ofi_rbuf.h>
 #include <ofi_list.h>
+#include <ofi_iov.h>
 #include <ofi_signal.h>
 #include <ofi_util.h>
 
@@ -79,6 +83,17 @@ int udpx_eq_open(struct fid_fabric *fabric, struct fi_eq_attr *attr,
 
 #define UDPX_FLAG_MULTI_RECV	1
 #define UDPX_IOV_LIMIT		4
+#define UDPX_BATCH_MAX		64
+/* Largest payload of one GSO send, less IPv6 and UDP headers */
+#define UDPX_GSO_MAX_SIZE	(UINT16_MAX - 40 - 8)
+/* A GRO aggregate can exceed the IPv6 limit for IPv4 traffic */
+#define UDPX_GRO_MAX_SIZE	UINT16_MAX
+#define UDPX_GSO_MAX_SEGS	64
+
+/* Datagrams received or sent per recvmmsg/sendmmsg call */
+extern size_t udpx_batch_size;
+extern int udpx_gso;
+extern int udpx_gro;
 
 struct udpx_ep_entry {
 	void			*context;
@@ -90,6 +105,21 @@ struct udpx_ep_entry {
 
 OFI_DECLARE_CIRQUE(struct udpx_ep_entry, udpx_rx_cirq);
 
+/* Send posted with FI_MORE, held until flushed through sendmmsg */
+struct udpx_tx_entry {
+	void			*context;
+	struct iovec		iov[UDPX_IOV_LIMIT];
+	uint8_t			iov_count;
+	socklen_t		addrlen;
+	size_t			len;
+	union {
+		struct sockaddr_in	sin;
+		struct sockaddr_in6	sin6;
+	} addr;
+};
+
+OFI_DECLARE_CIRQUE(struct udpx_tx_entry, udpx_tx_cirq);
+
 struct udpx_ep;
 typedef void (*udpx_rx_comp_func)(struct udpx_ep *ep, void *context,
 		uint64_t flags, size_t len, void *buf, void *addr);
@@ -100,8 +130,17 @@ struct udpx_ep {
 	udpx_rx_comp_func	rx_comp;
 	udpx_tx_comp_func	tx_comp;
 	struct udpx_rx_cirq	*rxq;    /* protected by rx_cq lock */
+	struct udpx_tx_cirq	*txq;    /* protected by tx_cq lock */
 	SOCKET			sock;
 	int			is_bound;
+	int			gso;
+
+	/* GRO receive buffer, split into posted receives by progress */
+	char			*gro_buf;
+	size_t			gro_len;
+	size_t			gro_off;
+	size_t			gro_seg;
+	struct sockaddr_in6	gro_addr;
 	ofi_atomic32_t		ref;
 };
 
@@ -225,7 +225,7 @@ static void udpx_tx_comp(struct udpx_ep *ep, void *context)
 	comp->len = 0;
 	comp->buf = NULL;
 	comp->data = 0;
-	ofi_cirque_commit(ep->util_ep.tx_cq->cirq);
+	ofi_cq_commit(ep->util_ep.tx_cq);
 }
 
 static void udpx_tx_comp_signal(struct udpx_ep *ep, void *context)
@@ -245,7 +245,7 @@ static void udpx_rx_comp(struct udpx_ep *ep, void *context, uint64_t flags,
 	comp->len = len;
 	comp->buf = buf;
 	comp->data = 0;
-	ofi_cirque_commit(ep->util_ep.rx_cq->cirq);
+	ofi_cq_commit(ep->util_ep.rx_cq);
 }
 
 static void udpx_rx_src_comp(struct udpx_ep *ep, void *context, uint64_t flags,
@@ -270,6 +270,302 @@ static void udpx_rx_src_comp_signal(struct udpx_ep *ep, void *context,
 	ep->util_ep.rx_cq->wait->signal(ep->util_ep.rx_cq->wait);
 }
 
+#if HAVE_UDP_MMSG
+static inline struct udpx_tx_entry *
+udpx_tx_entry_at(struct udpx_ep *ep, size_t i)
+{
+	return &ep->txq->buf[(ep->txq->rcnt + i) & ep->txq->size_mask];
+}
+
+/*
+ * A GSO send carries segments of one size to one peer, of which only the
+ * last may be shorter.
+ */
+static bool udpx_tx_gso_next(struct udpx_ep *ep, struct udpx_tx_entry *first,
+			     struct udpx_tx_entry *last,
+			     struct udpx_tx_entry *next, size_t len, int segs)
+{
+	return ep->gso && segs < UDPX_GSO_MAX_SEGS && first->len &&
+	       last->len == first->len && next->len &&
+	       next->len <= first->len &&
+	       len + next->len <= UDPX_GSO_MAX_SIZE &&
+	       next->addrlen == first->addrlen &&
+	       !memcmp(&next->addr, &first->addr, first->addrlen);
+}
+
+static void udpx_tx_fail(struct udpx_ep *ep, int err)
+{
+	struct udpx_tx_entry *entry;
+	struct fi_cq_err_entry err_entry;
+
+	entry = ofi_cirque_remove(ep->txq);
+	memset(&err_entry, 0, sizeof err_entry);
+	err_entry.op_context = entry->context;
+	err_entry.flags = FI_SEND;
+	err_entry.err = err;
+	err_entry.prov_errno = err;
+	ofi_cq_insert_error(ep->util_ep.tx_cq, &err_entry);
+	if (ep->util_ep.tx_cq->wait)
+		ep->util_ep.tx_cq->wait->signal(ep->util_ep.tx_cq->wait);
+}
+
+/* Caller must hold the tx_cq lock */
+static void udpx_tx_flush(struct udpx_ep *ep)
+{
+	struct mmsghdr msgs[UDPX_BATCH_MAX];
+	struct iovec iov[UDPX_BATCH_MAX * UDPX_IOV_LIMIT];
+	int segs[UDPX_BATCH_MAX];
+#if HAVE_UDP_GSO
+	union {
+		char		buf[CMSG_SPACE(sizeof(uint16_t))];
+		struct cmsghdr	align;
+	} ctrl[UDPX_BATCH_MAX];
+	struct cmsghdr *cmsg;
+	uint16_t gso_size;
+#endif
+	struct udpx_tx_entry *first, *last, *next;
+	struct msghdr *hdr;
+	size_t i, cnt, len, iov_cnt;
+	int n, j, ret;
+
+	while (!ofi_cirque_isempty(ep->txq)) {
+		cnt = MIN(ofi_cirque_usedcnt(ep->txq), UDPX_BATCH_MAX);
+		for (i = 0, n = 0, iov_cnt = 0; i < cnt; n++) {
+			first = udpx_tx_entry_at(ep, i);
+			hdr = &msgs[n].msg_hdr;
+			hdr->msg_name = &first->addr;
+			hdr->msg_namelen = first->addrlen;
+			hdr->msg_iov = &iov[iov_cnt];
+			hdr->msg_control = NULL;
+			hdr->msg_controllen = 0;
+			hdr->msg_flags = 0;
+
+			for (segs[n] = 0, len = 0, last = first; ; last = next) {
+				memcpy(&iov[iov_cnt], last->iov,
+				       last->iov_count * sizeof(*iov));
+				iov_cnt += last->iov_count;
+				len += last->len;
+				segs[n]++;
+				if (++i == cnt)
+					break;
+
+				next = udpx_tx_entry_at(ep, i);
+				if (!udpx_tx_gso_next(ep, first, last, next,
+						      len, segs[n]))
+					break;
+			}
+			hdr->msg_iovlen = &iov[iov_cnt] - hdr->msg_iov;
+
+#if HAVE_UDP_GSO
+			if (segs[n] > 1) {
+				hdr->msg_control = ctrl[n].buf;
+				hdr->msg_controllen = sizeof(ctrl[n].buf);
+				cmsg = CMSG_FIRSTHDR(hdr);
+				cmsg->cmsg_level = SOL_UDP;
+				cmsg->cmsg_type = UDP_SEGMENT;
+				cmsg->cmsg_len = CMSG_LEN(sizeof(gso_size));
+				gso_size = (uint16_t) first->len;
+				memcpy(CMSG_DATA(cmsg), &gso_size,
+				       sizeof(gso_size));
+			}
+#endif
+		}
+
+		ret = sendmmsg(ep->sock, msgs, n, 0);
+		if (ret > 0) {
+			for (n = 0; n < ret; n++) {
+				for (j = 0; j < segs[n]; j++) {
+					first = ofi_cirque_remove(ep->txq);
+					ep->tx_comp(ep, first->context);
+				}
+			}
+			continue;
+		}
+
+		if (OFI_SOCK_TRY_SND_RCV_AGAIN(errno))
+			return;
+
+		/* The device or path cannot segment this send (EIO without
+		 * checksum offload, EINVAL for an unsupported segment size),
+		 * send the datagrams individually instead */
+		if (segs[0] > 1 && (errno == EIO || errno == EINVAL)) {
+			FI_WARN(&udpx_prov, FI_LOG_EP_DATA, "GSO send failed "
+				"%d (%s), disabling GSO\n", errno,
+				strerror(errno));
+			ep->gso = 0;
+			continue;
+		}
+
+		/* The head datagram failed, report it and move on */
+		udpx_tx_fail(ep, errno);
+	}
+}
+
+static ssize_t udpx_tx_queue(struct udpx_ep *ep, const struct iovec *iov,
+			     size_t iov_count, const void *addr,
+			     size_t addrlen, void *context, uint64_t flags)
+{
+	struct udpx_tx_entry *entry;
+
+	if (iov_count > UDPX_IOV_LIMIT)
+		return -FI_EINVAL;
+
+	/* Every queued send needs room for its completion */
+	if (ofi_cirque_freecnt(ep->util_ep.tx_cq->cirq) <=
+	    ofi_cirque_usedcnt(ep->txq)) {
+		udpx_tx_flush(ep);
+		if (ofi_cirque_freecnt(ep->util_ep.tx_cq->cirq) <=
+		    ofi_cirque_usedcnt(ep->txq))
+			return -FI_EAGAIN;
+	}
+
+	if (ofi_cirque_isfull(ep->txq)) {
+		udpx_tx_flush(ep);
+		if (ofi_cirque_isfull(ep->txq))
+			return -FI_EAGAIN;
+	}
+
+	entry = ofi_cirque_next(ep->txq);
+	entry->context = context;
+	for (entry->iov_count = 0; entry->iov_count < iov_count;
+	     entry->iov_count++)
+		entry->iov[entry->iov_count] = iov[entry->iov_count];
+	entry->len = ofi_total_iov_len(iov, iov_count);
+	memcpy(&entry->addr, addr, addrlen);
+	entry->addrlen = (socklen_t) addrlen;
+	ofi_cirque_commit(ep->txq);
+
+	if (!(flags & FI_MORE) || ofi_cirque_isfull(ep->txq))
+		udpx_tx_flush(ep);
+	return 0;
+}
+
+/*
+ * Queued sends only reference the caller's buffers, which an inject
+ * may reuse on return.  Injects therefore go out directly, once the
+ * sends queued ahead of them have been flushed.
+ */
+static int udpx_tx_drain(struct udpx_ep *ep)
+{
+	if (!ep->txq || ofi_cirque_isempty(ep->txq))
+		return 0;
+
+	udpx_tx_flush(ep);
+	return ofi_cirque_isempty(ep->txq) ? 0 : -FI_EAGAIN;
+}
+
+/* Caller must hold the rx_cq lock */
+static void udpx_rx_batch(struct udpx_ep *ep)
+{
+	struct mmsghdr msgs[UDPX_BATCH_MAX];
+	struct sockaddr_in6 addr[UDPX_BATCH_MAX];
+	struct udpx_ep_entry *entry;
+	size_t cnt;
+	int i, ret;
+
+	cnt = MIN(ofi_cirque_usedcnt(ep->rxq),
+		  ofi_cirque_freecnt(ep->util_ep.rx_cq->cirq));
+	cnt = MIN(cnt, udpx_batch_size);
+	if (!cnt)
+		return;
+
+	for (i = 0; i < (int) cnt; i++) {
+		entry = &ep->rxq->buf[(ep->rxq->rcnt + i) &
+				      ep->rxq->size_mask];
+		msgs[i].msg_hdr.msg_name = &addr[i];
+		msgs[i].msg_hdr.msg_namelen = sizeof(addr[i]);
+		msgs[i].msg_hdr.msg_iov = entry->iov;
+		msgs[i].msg_hdr.msg_iovlen = entry->iov_count;
+		msgs[i].msg_hdr.msg_control = NULL;
+		msgs[i].msg_hdr.msg_controllen = 0;
+		msgs[i].msg_hdr.msg_flags = 0;
+	}
+
+	ret = recvmmsg(ep->sock, msgs, (unsigned int) cnt, 0, NULL);
+	for (i = 0; i < ret; i++) {
+		entry = ofi_cirque_remove(ep->rxq);
+		ep->rx_comp(ep, entry->context, 0, msgs[i].msg_len,
+			    NULL, &addr[i]);
+	}
+}
+#endif
+
+#if HAVE_UDP_GSO
+static ssize_t udpx_rx_gro_recv(struct udpx_ep *ep)
+{
+	union {
+		char		buf[CMSG_SPACE(sizeof(int))];
+		struct cmsghdr	align;
+	} ctrl;
+	struct cmsghdr *cmsg;
+	struct msghdr hdr;
+	struct iovec iov;
+	ssize_t ret;
+	int seg;
+
+again:
+	iov.iov_base = ep->gro_buf;
+	iov.iov_len = UDPX_GRO_MAX_SIZE;
+	hdr.msg_name = &ep->gro_addr;
+	hdr.msg_namelen = sizeof(ep->gro_addr);
+	hdr.msg_iov = &iov;
+	hdr.msg_iovlen = 1;
+	hdr.msg_control = ctrl.buf;
+	hdr.msg_controllen = sizeof(ctrl.buf);
+	hdr.msg_flags = 0;
+
+	ret = ofi_recvmsg_udp(ep->sock, &hdr, 0);
+	if (ret < 0)
+		return ret;
+
+	/* The segment boundaries of a truncated aggregate are unknown */
+	if (hdr.msg_flags & MSG_TRUNC) {
+		FI_WARN(&udpx_prov, FI_LOG_EP_DATA,
+			"dropping truncated GRO receive of %zd bytes\n", ret);
+		goto again;
+	}
+
+	ep->gro_len = ret;
+	ep->gro_off = 0;
+	ep->gro_seg = ret;
+	for (cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+		if (cmsg->cmsg_level == SOL_UDP &&
+		    cmsg->cmsg_type == UDP_GRO) {
+			memcpy(&seg, CMSG_DATA(cmsg), sizeof(seg));
+			if (seg > 0)
+				ep->gro_seg = seg;
+		}
+	}
+	return ret;
+}
+
+/*
+ * The kernel may hand back several datagrams from one peer as a single
+ * buffer of equally sized segments.  Each segment completes one posted
+ * receive; segments left over wait for more receives to be posted.
+ */
+static void udpx_rx_gro(struct udpx_ep *ep)
+{
+	struct udpx_ep_entry *entry;
+	size_t len;
+
+	while (!ofi_cirque_isempty(ep->rxq) &&
+	       !ofi_cirque_isfull(ep->util_ep.rx_cq->cirq)) {
+		if (ep->gro_off == ep->gro_len &&
+		    udpx_rx_gro_recv(ep) < 0)
+			return;
+
+		len = MIN(ep->gro_seg, ep->gro_len - ep->gro_off);
+		entry = ofi_cirque_remove(ep->rxq);
+		ep->rx_comp(ep, entry->context, 0,
+			    ofi_copy_to_iov(entry->iov, entry->iov_count, 0,
+					    ep->gro_buf + ep->gro_off, len),
+			    NULL, &ep->gro_addr);
+		ep->gro_off += len;
+	}
+}
+#endif
+
 static void udpx_ep_progress(struct util_ep *util_ep)
 {
 	struct udpx_ep *ep;
@@ -279,6 +575,14 @@ static void udpx_ep_progress(struct util_ep *util_ep)
 	ssize_t ret;
 
 	ep = container_of(util_ep, struct udpx_ep, util_ep);
+#if HAVE_UDP_MMSG
+	if (ep->txq && !ofi_cirque_isempty(ep->txq)) {
+		fastlock_acquire(&ep->util_ep.tx_cq->cq_lock);
+		udpx_tx_flush(ep);
+		fastlock_release(&ep->util_ep.tx_cq->cq_lock);
+	}
+#endif
+
 	hdr.msg_name = &addr;
 	hdr.msg_namelen = sizeof(addr);
 	hdr.msg_control = NULL;
@@ -289,6 +593,20 @@ static void udpx_ep_progress(struct util_ep *util_ep)
 	if (ofi_cirque_isempty(ep->rxq))
 		goto out;
 
+#if HAVE_UDP_GSO
+	if (ep->gro_buf) {
+		udpx_rx_gro(ep);
+		goto out;
+	}
+#endif
+
+#if HAVE_UDP_MMSG
+	if (udpx_batch_size > 1) {
+		udpx_rx_batch(ep);
+		goto out;
+	}
+#endif
+
 	entry = ofi_cirque_head(ep->rxq);
 	hdr.msg_iov = entry->iov;
 	hdr.msg_iovlen = entry->iov_count;
@@ -398,6 +716,19 @@ static ssize_t udpx_sendto(struct udpx_ep *ep, const void *buf, size_t len,
 		goto out;
 	}
 
+#if HAVE_UDP_MMSG
+	/* Keep completions in order behind sends queued with FI_MORE */
+	if (ep->txq && !ofi_cirque_isempty(ep->txq)) {
+		struct iovec iov = {
+			.iov_base = (void *) buf,
+			.iov_len = len,
+		};
+
+		ret = udpx_tx_queue(ep, &iov, 1, addr, addrlen, context, 0);
+		goto out;
+	}
+#endif
+
 	ret = ofi_sendto_socket(ep->sock, buf, len, 0,
 				addr, (socklen_t)addrlen);
 	if (ret == (ssize_t)len) {
@@ -454,6 +785,20 @@ static ssize_t udpx_sendmsg(struct fid_ep *ep_fid, const struct fi_msg *msg,
 		goto out;
 	}
 
+#if HAVE_UDP_MMSG
+	if (flags & FI_INJECT) {
+		ret = udpx_tx_drain(ep);
+		if (ret)
+			goto out;
+	} else if (ep->txq &&
+		   ((flags & FI_MORE) || !ofi_cirque_isempty(ep->txq))) {
+		ret = udpx_tx_queue(ep, msg->msg_iov, msg->iov_count,
+				    hdr.msg_name, hdr.msg_namelen,
+				    msg->context, flags);
+		goto out;
+	}
+#endif
+
 	ret = ofi_sendmsg_udp(ep->sock, &hdr, 0);
 	if (ret >= 0) {
 		ep->tx_comp(ep, msg->context);
@@ -494,30 +839,49 @@ static ssize_t udpx_sendv_mc(struct fid_ep *ep_fid, const struct iovec *iov,
 	return udpx_sendmsg(ep_fid, &msg, FI_MULTICAST);
 }
 
+static ssize_t udpx_inject_to(struct udpx_ep *ep, const void *buf,
+			      size_t len, const void *addr, size_t addrlen)
+{
+	ssize_t ret;
+
+#if HAVE_UDP_MMSG
+	if (ep->txq) {
+		fastlock_acquire(&ep->util_ep.tx_cq->cq_lock);
+		ret = udpx_tx_drain(ep);
+		if (!ret) {
+			ret = ofi_sendto_socket(ep->sock, buf, len, 0, addr,
+						(socklen_t) addrlen);
+			ret = ret == (ssize_t) len ? 0 : -errno;
+		}
+		fastlock_release(&ep->util_ep.tx_cq->cq_lock);
+		return ret;
+	}
+#endif
+
+	ret = ofi_sendto_socket(ep->sock, buf, len, 0, addr,
+				(socklen_t) addrlen);
+	return ret == (ssize_t)len ? 0 : -errno;
+}
+
 static ssize_t udpx_inject(struct fid_ep *ep_fid, const void *buf, size_t len,
 			   fi_addr_t dest_addr)
 {
 	struct udpx_ep *ep;
-	ssize_t ret;
 
 	ep = container_of(ep_fid, struct udpx_ep, util_ep.ep_fid.fid);
-	ret = ofi_sendto_socket(ep->sock, buf, len, 0,
-				ofi_ip_av_get_addr(ep->util_ep.av, (int)dest_addr),
-				(socklen_t)ep->util_ep.av->addrlen);
-	return ret == (ssize_t)len ? 0 : -errno;
+	return udpx_inject_to(ep, buf, len,
+			      ofi_ip_av_get_addr(ep->util_ep.av, (int)dest_addr),
+			      ep->util_ep.av->addrlen);
 }
 
 static ssize_t udpx_inject_mc(struct fid_ep *ep_fid, const void *buf,
 			      size_t len, fi_addr_t dest_addr)
 {
 	struct udpx_ep *ep;
-	ssize_t ret;
 
 	ep = container_of(ep_fid, struct udpx_ep, util_ep.ep_fid.fid);
-	ret = ofi_sendto_socket(ep->sock, buf, len, 0,
-				(const void *)(uintptr_t)dest_addr,
-				(socklen_t)ofi_sizeofaddr((const void *)(uintptr_t)dest_addr));
-	return ret == (ssize_t)len ? 0 : -errno;
+	return udpx_inject_to(ep, buf, len, (const void *)(uintptr_t)dest_addr,
+			      ofi_sizeofaddr((const void *)(uintptr_t)dest_addr));
 }
 
 static struct fi_ops_msg udpx_msg_ops = {
@@ -568,7 +932,17 @@ static int udpx_ep_close(struct fid *fid)
 				&ep->util_ep.ep_fid.fid);
 	}
 
+	if (ep->txq && ep->util_ep.tx_cq &&
+	    ep->util_ep.tx_cq != ep->util_ep.rx_cq) {
+		fid_list_remove(&ep->util_ep.tx_cq->ep_list,
+				&ep->util_ep.tx_cq->ep_list_lock,
+				&ep->util_ep.ep_fid.fid);
+	}
+
+	if (ep->txq)
+		udpx_tx_cirq_free(ep->txq);
 	udpx_rx_cirq_free(ep->rxq);
+	free(ep->gro_buf);
 	ofi_close_socket(ep->sock);
 	ofi_endpoint_close(&ep->util_ep);
 	free(ep);
@@ -590,6 +964,14 @@ static int udpx_ep_bind_cq(struct udpx_ep *ep, struct util_cq *cq,
 		ofi_atomic_inc32(&cq->ref);
 		ep->tx_comp = cq->wait ? udpx_tx_comp_signal :
 					 udpx_tx_comp;
+
+		/* Sends queued with FI_MORE are flushed by CQ progress */
+		if (ep->txq) {
+			ret = fid_list_insert(&cq->ep_list, &cq->ep_list_lock,
+					      &ep->util_ep.ep_fid.fid);
+			if (ret)
+				return ret;
+		}
 	}
 
 	if (flags & FI_RECV) {
@@ -720,6 +1102,39 @@ static struct fi_ops udpx_ep_fi_ops = {
 	.ops_open = fi_no_ops_open,
 };
 
+#if HAVE_UDP_GSO
+/* Segmentation offload is best effort, kernels without it fall back */
+static int udpx_ep_init_offload(struct udpx_ep *ep)
+{
+	int val = 0;
+
+	if (udpx_gso && ep->txq) {
+		/* A socket default segment size of 0 only probes support */
+		ep->gso = !setsockopt(ep->sock, SOL_UDP, UDP_SEGMENT,
+				      (void *) &val, sizeof(val));
+		if (!ep->gso)
+			FI_WARN(&udpx_prov, FI_LOG_EP_CTRL,
+				"UDP_SEGMENT not supported %d (%s)\n",
+				errno, strerror(errno));
+	}
+
+	if (!udpx_gro)
+		return 0;
+
+	val = 1;
+	if (setsockopt(ep->sock, SOL_UDP, UDP_GRO, (void *) &val,
+		       sizeof(val))) {
+		FI_WARN(&udpx_prov, FI_LOG_EP_CTRL,
+			"UDP_GRO not supported %d (%s)\n",
+			errno, strerror(errno));
+		return 0;
+	}
+
+	ep->gro_buf = malloc(UDPX_GRO_MAX_SIZE);
+	return ep->gro_buf ? 0 : -FI_ENOMEM;
+}
+#endif
+
 static int udpx_ep_init(struct udpx_ep *ep, struct fi_info *info)
 {
 	int family;
@@ -732,6 +1147,16 @@ static int udpx_ep_init(struct udpx_ep *ep, struct fi_info *info)
 		return ret;
 	}
 
+#if HAVE_UDP_MMSG
+	if (udpx_batch_size > 1) {
+		ep->txq = udpx_tx_cirq_create(udpx_batch_size);
+		if (!ep->txq) {
+			ret = -FI_ENOMEM;
+			goto err1;
+		}
+	}
+#endif
+
 	family = info->src_addr ?
 		 ((struct sockaddr *) info->src_addr)->sa_family : AF_INET;
 	ep->sock = socket(family, SOCK_DGRAM, IPPROTO_UDP);
@@ -751,10 +1176,17 @@ static int udpx_ep_init(struct udpx_ep *ep, struct fi_info *info)
 	if (ret)
 		goto err2;
 
+#if HAVE_UDP_GSO
+	ret = udpx_ep_init_offload(ep);
+	if (ret)
+		goto err2;
+#endif
 	return 0;
 err2:
 	ofi_close_socket(ep->sock);
 err1:
+	if (ep->txq)
+		udpx_tx_cirq_free(ep->txq);
 	udpx_rx_cirq_free(ep->rxq);
 	return ret;
 }
@@ -37,6 +37,10 @@
 
 #include <sys/types.h>
 
+size_t udpx_batch_size = 16;
+int udpx_gso = 0;
+int udpx_gro = 0;
+
 
 static int udpx_getinfo(uint32_t version, const char *node, const char *service,
 			uint64_t flags, const struct fi_info *hints,
@@ -65,5 +69,26 @@ UDP_INI
 	fi_param_define(&udpx_prov, "iface", FI_PARAM_STRING,
 			"Specify interface name");
 
+	fi_param_define(&udpx_prov, "batch_size", FI_PARAM_SIZE_T,
+			"maximum number of datagrams received, or sent with "
+			"FI_MORE, per system call (default: 16, max: 64)");
+	fi_param_get_size_t(&udpx_prov, "batch_size", &udpx_batch_size);
+	if (udpx_batch_size > UDPX_BATCH_MAX) {
+		FI_WARN(&udpx_prov, FI_LOG_EP_CTRL, "User provided "
+			"batch size too large, using %d\n", UDPX_BATCH_MAX);
+		udpx_batch_size = UDPX_BATCH_MAX;
+	}
+
+	fi_param_define(&udpx_prov, "gso", FI_PARAM_BOOL,
+			"send runs of equally sized datagrams queued with "
+			"FI_MORE to the same peer as one UDP_SEGMENT send "
+			"(default: no)");
+	fi_param_get_bool(&udpx_prov, "gso", &udpx_gso);
+
+	fi_param_define(&udpx_prov, "gro", FI_PARAM_BOOL,
+			"receive coalesced datagrams using UDP_GRO and split "
+			"them into posted receives (default: no)");
+	fi_param_get_bool(&udpx_prov, "gro", &udpx_gro);
+
 	return &udpx_prov;
 }
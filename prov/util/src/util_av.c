@@ -274,48 +274,221 @@ int ofi_verify_av_insert(struct util_av *av, uint64_t flags, void *context)
 	return 0;
 }
 
-/*
- * Must hold AV lock
- */
-int ofi_av_insert_addr(struct util_av *av, const void *addr, fi_addr_t *fi_addr)
+/* Keep the table at most 3/4 full, so that probe sequences stay short */
+#define UTIL_AV_HASH_LOAD(size)	((size) / 4 * 3)
+#define UTIL_AV_HASH_MIN_SIZE	64
+
+static uint64_t util_av_hash_addr(const void *addr, size_t len)
+{
+	const uint8_t *buf = addr;
+	uint64_t hash, word;
+
+	hash = len * 0x9e3779b97f4a7c15ULL;
+	for (; len >= sizeof(word); len -= sizeof(word), buf += sizeof(word)) {
+		memcpy(&word, buf, sizeof(word));
+		hash = (hash ^ word) * 0xff51afd7ed558ccdULL;
+		hash ^= hash >> 32;
+	}
+	if (len) {
+		word = 0;
+		memcpy(&word, buf, len);
+		hash = (hash ^ word) * 0xc4ceb9fe1a85ec53ULL;
+	}
+	hash ^= hash >> 29;
+
+	return hash ? hash : 1;
+}
+
+static int util_av_hash_init(struct util_av_hash *hash, size_t cnt)
+{
+	size_t size;
+
+	size = roundup_power_of_two(MAX(cnt + cnt / 3 + 1,
+					UTIL_AV_HASH_MIN_SIZE));
+	hash->slot = calloc(size, sizeof(*hash->slot));
+	if (!hash->slot)
+		return -FI_ENOMEM;
+
+	hash->size = size;
+	hash->cnt = 0;
+	return 0;
+}
+
+static void util_av_hash_place(struct util_av_hash *hash, uint64_t key,
+			       fi_addr_t fi_addr)
+{
+	size_t i;
+
+	for (i = key & (hash->size - 1); hash->slot[i].hash;
+	     i = (i + 1) & (hash->size - 1))
+		;
+
+	hash->slot[i].hash = key;
+	hash->slot[i].fi_addr = fi_addr;
+	hash->cnt++;
+}
+
+/* Makes room for cnt more addresses without rehashing */
+static int util_av_hash_reserve(struct util_av_hash *hash, size_t cnt)
+{
+	struct util_av_hash new_hash;
+	size_t i;
+	int ret;
+
+	if (hash->cnt + cnt <= UTIL_AV_HASH_LOAD(hash->size))
+		return 0;
+
+	ret = util_av_hash_init(&new_hash, hash->cnt + cnt);
+	if (ret)
+		return ret;
+
+	for (i = 0; i < hash->size; i++) {
+		if (hash->slot[i].hash)
+			util_av_hash_place(&new_hash, hash->slot[i].hash,
+					   hash->slot[i].fi_addr);
+	}
+
+	free(hash->slot);
+	*hash = new_hash;
+	return 0;
+}
+
+static fi_addr_t util_av_hash_find(struct util_av *av, const void *addr,
+				   uint64_t key)
 {
-	struct util_av_entry *entry = NULL;
+	struct util_av_hash_slot *slot;
+	size_t i, mask = av->hash.size - 1;
+
+	for (i = key & mask; av->hash.slot[i].hash; i = (i + 1) & mask) {
+		slot = &av->hash.slot[i];
+		if (slot->hash == key &&
+		    !memcmp(ofi_av_get_addr(av, slot->fi_addr), addr,
+			    av->addrlen))
+			return slot->fi_addr;
+	}
+	return FI_ADDR_NOTAVAIL;
+}
+
+/* Backward shift deletion, which leaves no tombstones behind */
+static void util_av_hash_remove(struct util_av *av, fi_addr_t fi_addr)
+{
+	struct util_av_hash *hash = &av->hash;
+	size_t i, j, home, mask = hash->size - 1;
+	uint64_t key;
+
+	key = util_av_hash_addr(ofi_av_get_addr(av, fi_addr), av->addrlen);
+	for (i = key & mask; hash->slot[i].hash; i = (i + 1) & mask) {
+		if (hash->slot[i].hash == key &&
+		    hash->slot[i].fi_addr == fi_addr)
+			break;
+	}
+	if (OFI_UNLIKELY(!hash->slot[i].hash)) {
+		assert(0);
+		return;
+	}
+
+	for (j = (i + 1) & mask; hash->slot[j].hash; j = (j + 1) & mask) {
+		home = hash->slot[j].hash & mask;
+		/* Move j into the hole at i unless its home lies in (i, j] */
+		if ((i <= j) ? (home <= i || home > j) :
+			       (home <= i && home > j)) {
+			hash->slot[i] = hash->slot[j];
+			i = j;
+		}
+	}
+	hash->slot[i].hash = 0;
+	hash->cnt--;
+}
 
-	HASH_FIND(hh, av->hash, addr, av->addrlen, entry);
-	if (entry) {
+/* Caller must hold AV lock and have reserved a slot in the hash */
+static int util_av_insert_addr_hash(struct util_av *av, const void *addr,
+				    uint64_t key, fi_addr_t *fi_addr)
+{
+	struct util_av_entry *entry;
+	fi_addr_t index;
+
+	index = util_av_hash_find(av, addr, key);
+	if (index != FI_ADDR_NOTAVAIL) {
 		if (fi_addr)
-			*fi_addr = ofi_buf_index(entry);
+			*fi_addr = index;
+		entry = ofi_bufpool_get_ibuf(av->av_entry_pool, index);
 		ofi_atomic_inc32(&entry->use_cnt);
 		return 0;
-	} else {
-		entry = ofi_ibuf_alloc(av->av_entry_pool);
-		if (!entry) {
-			if (fi_addr)
-				*fi_addr = FI_ADDR_NOTAVAIL;
-			return -FI_ENOMEM;
-		}
+	}
 
+	entry = ofi_ibuf_alloc(av->av_entry_pool);
+	if (!entry) {
 		if (fi_addr)
-			*fi_addr = ofi_buf_index(entry);
-		memcpy(entry->data, addr, av->addrlen);
-		ofi_atomic_initialize32(&entry->use_cnt, 1);
-		HASH_ADD(hh, av->hash, data, av->addrlen, entry);
+			*fi_addr = FI_ADDR_NOTAVAIL;
+		return -FI_ENOMEM;
 	}
+
+	index = ofi_buf_index(entry);
+	if (fi_addr)
+		*fi_addr = index;
+	memcpy(entry->data, addr, av->addrlen);
+	ofi_atomic_initialize32(&entry->use_cnt, 1);
+	util_av_hash_place(&av->hash, key, index);
 	return 0;
 }
 
-int ofi_av_elements_iter(struct util_av *av, ofi_av_apply_func apply, void *arg)
+/*
+ * Must hold AV lock
+ */
+int ofi_av_insert_addr(struct util_av *av, const void *addr, fi_addr_t *fi_addr)
 {
-	struct util_av_entry *av_entry = NULL, *av_entry_tmp = NULL;
 	int ret;
 
-	HASH_ITER(hh, av->hash, av_entry, av_entry_tmp) {
-		ret = apply(av, av_entry->data,
-			    ofi_buf_index(av_entry), arg);
+	ret = util_av_hash_reserve(&av->hash, 1);
+	if (ret) {
+		if (fi_addr)
+			*fi_addr = FI_ADDR_NOTAVAIL;
+		return ret;
+	}
+
+	return util_av_insert_addr_hash(av, addr,
+					util_av_hash_addr(addr, av->addrlen),
+					fi_addr);
+}
+
+static int util_av_cmp_fi_addr(const void *a, const void *b)
+{
+	fi_addr_t x = *(const fi_addr_t *) a, y = *(const fi_addr_t *) b;
+
+	return (x > y) - (x < y);
+}
+
+/* Visits entries in fi_addr order, which callers such as the collective
+ * world set rely on for a stable rank assignment. */
+int ofi_av_elements_iter(struct util_av *av, ofi_av_apply_func apply, void *arg)
+{
+	fi_addr_t *fi_addrs;
+	size_t i, cnt = 0;
+	int ret = 0;
+
+	if (!av->hash.cnt)
+		return 0;
+
+	fi_addrs = malloc(av->hash.cnt * sizeof(*fi_addrs));
+	if (!fi_addrs)
+		return -FI_ENOMEM;
+
+	for (i = 0; i < av->hash.size; i++) {
+		if (av->hash.slot[i].hash)
+			fi_addrs[cnt++] = av->hash.slot[i].fi_addr;
+	}
+	assert(cnt == av->hash.cnt);
+	qsort(fi_addrs, cnt, sizeof(*fi_addrs), util_av_cmp_fi_addr);
+
+	for (i = 0; i < cnt; i++) {
+		ret = apply(av, ofi_av_get_addr(av, fi_addrs[i]),
+			    fi_addrs[i], arg);
 		if (OFI_UNLIKELY(ret))
-			return ret;
+			break;
 	}
-	return 0;
+
+	free(fi_addrs);
+	return ret;
 }
 
 /*
@@ -332,17 +505,15 @@ int ofi_av_remove_addr(struct util_av *av, fi_addr_t fi_addr)
 	if (ofi_atomic_dec32(&av_entry->use_cnt))
 		return FI_SUCCESS;
 
-	HASH_DELETE(hh, av->hash, av_entry);
+	util_av_hash_remove(av, fi_addr);
 	ofi_ibuf_free(av_entry);
 	return 0;
 }
 
 fi_addr_t ofi_av_lookup_fi_addr_unsafe(struct util_av *av, const void *addr)
 {
-	struct util_av_entry *entry = NULL;
-
-	HASH_FIND(hh, av->hash, addr, av->addrlen, entry);
-	return entry ? ofi_buf_index(entry) : FI_ADDR_NOTAVAIL;
+	return util_av_hash_find(av, addr,
+				 util_av_hash_addr(addr, av->addrlen));
 }
 
 fi_addr_t ofi_av_lookup_fi_addr(struct util_av *av, const void *addr)
@@ -392,7 +563,7 @@ int ofi_av_bind(struct fid *av_fid, struct fid *eq_fid, uint64_t flags)
 
 static void util_av_close(struct util_av *av)
 {
-	HASH_CLEAR(hh, av->hash);
+	free(av->hash.slot);
 	ofi_bufpool_destroy(av->av_entry_pool);
 }
 
@@ -477,10 +648,16 @@ static int util_av_init(struct util_av *av, const struct fi_av_attr *attr,
 	av->addrlen = util_attr->addrlen;
 	av->context_offset = offset + av->addrlen;
 	av->flags = util_attr->flags | attr->flags;
-	av->hash = NULL;
+
+	ret = util_av_hash_init(&av->hash, orig_size);
+	if (ret)
+		return ret;
 
 	pool_attr.chunk_cnt = orig_size;
-	return ofi_bufpool_create_attr(&pool_attr, &av->av_entry_pool);
+	ret = ofi_bufpool_create_attr(&pool_attr, &av->av_entry_pool);
+	if (ret)
+		free(av->hash.slot);
+	return ret;
 }
 
 static int util_verify_av_attr(struct util_domain *domain,
@@ -593,37 +770,47 @@ fi_addr_t ofi_ip_av_get_fi_addr(struct util_av *av, const void *addr)
 	return ofi_av_lookup_fi_addr(av, addr);
 }
 
-static int ip_av_insert_addr(struct util_av *av, const void *addr,
-			     fi_addr_t *fi_addr, void *context)
-{
-	int ret;
+/* Number of addresses hashed outside of, then inserted under, one AV lock */
+#define IP_AV_INSERT_BATCH	256
 
-	if (ofi_valid_dest_ipaddr(addr)) {
-		fastlock_acquire(&av->lock);
-		ret = ofi_av_insert_addr(av, addr, fi_addr);
-		fastlock_release(&av->lock);
-	} else {
-		ret = -FI_EADDRNOTAVAIL;
-		if (fi_addr)
-			*fi_addr = FI_ADDR_NOTAVAIL;
+static void ip_av_insert_report(struct util_av *av, const void *addr,
+				size_t index, int ret, fi_addr_t *fi_addr,
+				int *sync_err, void *context)
+{
+	if (ret == -FI_EADDRNOTAVAIL)
 		FI_WARN(av->prov, FI_LOG_AV, "invalid address\n");
-	}
 
 	ofi_straddr_dbg(av->prov, FI_LOG_AV, "av_insert addr", addr);
 	if (fi_addr)
 		FI_DBG(av->prov, FI_LOG_AV, "av_insert fi_addr: %" PRIu64 "\n",
 		       *fi_addr);
 
-	return ret;
+	if (!ret)
+		return;
+
+	if (av->eq)
+		ofi_av_write_event(av, index, -ret, context);
+	else if (sync_err)
+		sync_err[index] = -ret;
 }
 
+/*
+ * Addresses are validated and hashed before the AV lock is taken, and the
+ * lock is then held once per batch rather than once per address.  The hash
+ * table is sized for the whole vector up front, so that large inserts do
+ * not rehash repeatedly.
+ */
 int ofi_ip_av_insertv(struct util_av *av, const void *addr, size_t addrlen,
 		      size_t count, fi_addr_t *fi_addr, uint64_t flags,
 		      void *context)
 {
-	int ret, success_cnt = 0;
+	uint64_t key[IP_AV_INSERT_BATCH];
+	int ret[IP_AV_INSERT_BATCH];
+	int success_cnt = 0;
 	int *sync_err = NULL;
-	size_t i;
+	const char *cur_addr;
+	size_t i, j, batch;
+	int res;
 
 	FI_DBG(av->prov, FI_LOG_AV, "inserting %zu addresses\n", count);
 	if (flags & FI_SYNC_ERR) {
@@ -631,25 +818,64 @@ int ofi_ip_av_insertv(struct util_av *av, const void *addr, size_t addrlen,
 		memset(sync_err, 0, sizeof(*sync_err) * count);
 	}
 
-	for (i = 0; i < count; i++) {
-		ret = ip_av_insert_addr(av, (const char *) addr + i * addrlen,
-					fi_addr ? &fi_addr[i] : NULL, context);
-		if (!ret)
-			success_cnt++;
-		else if (av->eq)
-			ofi_av_write_event(av, i, -ret, context);
-		else if (sync_err)
-			sync_err[i] = -ret;
+	fastlock_acquire(&av->lock);
+	/* Failure is not fatal, the table grows per address instead */
+	(void) util_av_hash_reserve(&av->hash, count);
+	fastlock_release(&av->lock);
+
+	for (i = 0; i < count; i += batch) {
+		batch = MIN(count - i, IP_AV_INSERT_BATCH);
+
+		for (j = 0; j < batch; j++) {
+			cur_addr = (const char *) addr + (i + j) * addrlen;
+			if (ofi_valid_dest_ipaddr((const struct sockaddr *)
+						  cur_addr))
+				key[j] = util_av_hash_addr(cur_addr, av->addrlen);
+			else
+				key[j] = 0;
+		}
+
+		fastlock_acquire(&av->lock);
+		for (j = 0; j < batch; j++) {
+			cur_addr = (const char *) addr + (i + j) * addrlen;
+			if (!key[j]) {
+				ret[j] = -FI_EADDRNOTAVAIL;
+				if (fi_addr)
+					fi_addr[i + j] = FI_ADDR_NOTAVAIL;
+				continue;
+			}
+
+			res = util_av_hash_reserve(&av->hash, 1);
+			if (res) {
+				ret[j] = res;
+				if (fi_addr)
+					fi_addr[i + j] = FI_ADDR_NOTAVAIL;
+				continue;
+			}
+
+			ret[j] = util_av_insert_addr_hash(av, cur_addr, key[j],
+						fi_addr ? &fi_addr[i + j] : NULL);
+		}
+		fastlock_release(&av->lock);
+
+		for (j = 0; j < batch; j++) {
+			if (!ret[j])
+				success_cnt++;
+			ip_av_insert_report(av, (const char *) addr +
+					    (i + j) * addrlen, i + j, ret[j],
+					    fi_addr ? &fi_addr[i + j] : NULL,
+					    sync_err, context);
+		}
 	}
 
 	FI_DBG(av->prov, FI_LOG_AV, "%d addresses successful\n", success_cnt);
 	if (av->eq) {
 		ofi_av_write_event(av, success_cnt, 0, context);
-		ret = 0;
+		res = 0;
 	} else {
-		ret = success_cnt;
+		res = success_cnt;
 	}
-	return ret;
+	return res;
 }
 
 int ofi_ip_av_insert(struct fid_av *av_fid, const void *addr, size_t count,
@@ -44,6 +44,15 @@ enum {
 	OFI_BUFPOOL_REGION_CHUNK_CNT = 16
 };
 
+struct ofi_bufpool_cache {
+	struct dlist_entry	entry;
+	struct ofi_bufpool	*pool;
+	uint64_t		alloc_cnt;
+	uint64_t		free_cnt;
+	size_t			cnt;
+	struct ofi_bufpool_hdr	*buf[];
+};
+
 
 int ofi_bufpool_grow(struct ofi_bufpool *pool)
 {
@@ -86,6 +95,18 @@ retry:
 		goto err1;
 	}
 
+	if (pool->attr.flags & OFI_BUFPOOL_NUMA_NODE) {
+		/* Bind before the memset below first touches the pages */
+		ret = ofi_mbind_node(buf_region->alloc_region, pool->alloc_size,
+				     pool->attr.numa_node);
+		if (ret) {
+			FI_DBG(&core_prov, FI_LOG_CORE,
+			       "Unable to bind region to NUMA node %d: %s\n",
+			       pool->attr.numa_node, fi_strerror(-ret));
+			pool->attr.flags &= ~OFI_BUFPOOL_NUMA_NODE;
+		}
+	}
+
 	memset(buf_region->alloc_region, 0, pool->alloc_size);
 	buf_region->mem_region = buf_region->alloc_region + pool->entry_size;
 	if (pool->attr.alloc_fn) {
@@ -163,6 +184,150 @@ err1:
 	return ret;
 }
 
+/* Caller must hold pool lock */
+static void ofi_bufpool_cache_flush(struct ofi_bufpool_cache *cache, size_t cnt)
+{
+	struct ofi_bufpool_hdr *buf_hdr;
+
+	if (!cnt)
+		return;
+
+	for (; cnt; cnt--) {
+		buf_hdr = cache->buf[--cache->cnt];
+		assert(buf_hdr->region->use_cnt--);
+		slist_insert_head(&buf_hdr->entry.slist,
+				  &cache->pool->free_list.entries);
+	}
+	cache->pool->flush_cnt++;
+}
+
+static int ofi_bufpool_cache_refill(struct ofi_bufpool_cache *cache)
+{
+	struct ofi_bufpool *pool = cache->pool;
+	struct ofi_bufpool_hdr *buf_hdr;
+	size_t i;
+
+	fastlock_acquire(&pool->lock);
+	for (i = 0; i < pool->attr.cache_cnt; i++) {
+		if (OFI_UNLIKELY(ofi_bufpool_empty(pool)) &&
+		    ofi_bufpool_grow(pool))
+			break;
+
+		slist_remove_head_container(&pool->free_list.entries,
+				struct ofi_bufpool_hdr, buf_hdr, entry.slist);
+		assert(++buf_hdr->region->use_cnt);
+		cache->buf[cache->cnt++] = buf_hdr;
+	}
+	pool->refill_cnt++;
+	fastlock_release(&pool->lock);
+
+	return cache->cnt ? 0 : -FI_ENOMEM;
+}
+
+/* Thread exit: hand the cached buffers and counters back to the pool */
+static void ofi_bufpool_cache_release(void *arg)
+{
+	struct ofi_bufpool_cache *cache = arg;
+	struct ofi_bufpool *pool = cache->pool;
+
+	fastlock_acquire(&pool->lock);
+	ofi_bufpool_cache_flush(cache, cache->cnt);
+	pool->alloc_cnt += cache->alloc_cnt;
+	pool->free_cnt += cache->free_cnt;
+	dlist_remove(&cache->entry);
+	fastlock_release(&pool->lock);
+	free(cache);
+}
+
+static struct ofi_bufpool_cache *ofi_bufpool_get_cache(struct ofi_bufpool *pool)
+{
+	struct ofi_bufpool_cache *cache;
+
+	cache = pthread_getspecific(pool->cache_key);
+	if (OFI_LIKELY(cache != NULL))
+		return cache;
+
+	cache = calloc(1, sizeof(*cache) +
+		       2 * pool->attr.cache_cnt * sizeof(cache->buf[0]));
+	if (!cache)
+		return NULL;
+
+	cache->pool = pool;
+	if (pthread_setspecific(pool->cache_key, cache)) {
+		free(cache);
+		return NULL;
+	}
+
+	fastlock_acquire(&pool->lock);
+	dlist_insert_tail(&cache->entry, &pool->cache_list);
+	fastlock_release(&pool->lock);
+	return cache;
+}
+
+void *ofi_bufpool_cache_alloc(struct ofi_bufpool *pool)
+{
+	struct ofi_bufpool_cache *cache;
+
+	cache = ofi_bufpool_get_cache(pool);
+	if (OFI_UNLIKELY(!cache))
+		return NULL;
+
+	if (OFI_UNLIKELY(!cache->cnt) && ofi_bufpool_cache_refill(cache))
+		return NULL;
+
+	cache->alloc_cnt++;
+	return ofi_buf_data(cache->buf[--cache->cnt]);
+}
+
+void ofi_bufpool_cache_free(struct ofi_bufpool *pool, void *buf)
+{
+	struct ofi_bufpool_cache *cache;
+
+	cache = ofi_bufpool_get_cache(pool);
+	if (OFI_UNLIKELY(!cache)) {
+		fastlock_acquire(&pool->lock);
+		assert(ofi_buf_region(buf)->use_cnt--);
+		slist_insert_head(&ofi_buf_hdr(buf)->entry.slist,
+				  &pool->free_list.entries);
+		pool->free_cnt++;
+		fastlock_release(&pool->lock);
+		return;
+	}
+
+	if (OFI_UNLIKELY(cache->cnt == 2 * pool->attr.cache_cnt)) {
+		fastlock_acquire(&pool->lock);
+		ofi_bufpool_cache_flush(cache, pool->attr.cache_cnt);
+		fastlock_release(&pool->lock);
+	}
+
+	cache->free_cnt++;
+	cache->buf[cache->cnt++] = ofi_buf_hdr(buf);
+}
+
+void ofi_bufpool_get_stats(struct ofi_bufpool *pool,
+			   struct ofi_bufpool_stats *stats)
+{
+	struct ofi_bufpool_cache *cache;
+
+	if (pool->attr.flags & OFI_BUFPOOL_THREAD_CACHE)
+		fastlock_acquire(&pool->lock);
+
+	stats->alloc_cnt = pool->alloc_cnt;
+	stats->free_cnt = pool->free_cnt;
+	stats->refill_cnt = pool->refill_cnt;
+	stats->flush_cnt = pool->flush_cnt;
+	stats->entry_cnt = pool->entry_cnt;
+
+	if (pool->attr.flags & OFI_BUFPOOL_THREAD_CACHE) {
+		dlist_foreach_container(&pool->cache_list,
+					struct ofi_bufpool_cache, cache, entry) {
+			stats->alloc_cnt += cache->alloc_cnt;
+			stats->free_cnt += cache->free_cnt;
+		}
+		fastlock_release(&pool->lock);
+	}
+}
+
 int ofi_bufpool_create_attr(struct ofi_bufpool_attr *attr,
 			      struct ofi_bufpool **buf_pool)
 {
@@ -170,12 +335,28 @@ int ofi_bufpool_create_attr(struct ofi_bufpool_attr *attr,
 	size_t entry_sz;
 	ssize_t hp_size;
 
+	if ((attr->flags & OFI_BUFPOOL_THREAD_CACHE) &&
+	    (attr->flags & OFI_BUFPOOL_INDEXED))
+		return -FI_EINVAL;
+
 	pool = calloc(1, sizeof(**buf_pool));
 	if (!pool)
 		return -FI_ENOMEM;
 
 	pool->attr = *attr;
 
+	if (pool->attr.flags & OFI_BUFPOOL_THREAD_CACHE) {
+		if (pthread_key_create(&pool->cache_key,
+				       ofi_bufpool_cache_release)) {
+			free(pool);
+			return -FI_ENOMEM;
+		}
+		if (!pool->attr.cache_cnt)
+			pool->attr.cache_cnt = OFI_BUFPOOL_DEF_CACHE_CNT;
+		fastlock_init(&pool->lock);
+		dlist_init(&pool->cache_list);
+	}
+
 	entry_sz = (attr->size + sizeof(struct ofi_bufpool_hdr));
 	pool->entry_size = ofi_get_aligned_size(entry_sz, attr->alignment);
 
@@ -208,9 +389,23 @@ int ofi_bufpool_create_attr(struct ofi_bufpool_attr *attr,
 void ofi_bufpool_destroy(struct ofi_bufpool *pool)
 {
 	struct ofi_bufpool_region *buf_region;
+	struct ofi_bufpool_cache *cache;
 	int ret;
 	size_t i;
 
+	if (pool->attr.flags & OFI_BUFPOOL_THREAD_CACHE) {
+		/* Threads still holding a cache must not release it into
+		 * the destroyed pool on exit */
+		pthread_key_delete(pool->cache_key);
+		while (!dlist_empty(&pool->cache_list)) {
+			dlist_pop_front(&pool->cache_list,
+					struct ofi_bufpool_cache, cache, entry);
+			ofi_bufpool_cache_flush(cache, cache->cnt);
+			free(cache);
+		}
+		fastlock_destroy(&pool->lock);
+	}
+
 	for (i = 0; i < pool->region_cnt; i++) {
 		buf_region = pool->region_table[i];
 
@@ -45,12 +45,33 @@
 static void ofi_cq_insert_aux(struct util_cq *cq,
 			      struct util_cq_aux_entry *entry)
 {
-	if (!ofi_cirque_isfull(cq->cirq))
-		ofi_cirque_commit(cq->cirq);
+	fastlock_acquire(&cq->aux_lock);
+	if (!ofi_cirque_isfull(cq->cirq)) {
+		/* Mark the slot before lock-free readers can see it */
+		entry->cq_slot = ofi_cirque_next(cq->cirq);
+		entry->cq_slot->flags = UTIL_FLAG_AUX;
+		slist_insert_tail(&entry->list_entry, &cq->aux_queue);
+		ofi_cq_commit(cq);
+	} else {
+		entry->cq_slot = ofi_cirque_tail(cq->cirq);
+		entry->cq_slot->flags = UTIL_FLAG_AUX;
+		slist_insert_tail(&entry->list_entry, &cq->aux_queue);
+	}
+	fastlock_release(&cq->aux_lock);
+}
 
-	entry->cq_slot = ofi_cirque_tail(cq->cirq);
-	entry->cq_slot->flags = UTIL_FLAG_AUX;
-	slist_insert_tail(&entry->list_entry, &cq->aux_queue);
+/* Caller must hold aux_lock and have removed the head aux entry */
+static void util_cq_discard_aux_slot(struct util_cq *cq)
+{
+	struct util_cq_aux_entry *aux_entry;
+
+	if (!slist_empty(&cq->aux_queue)) {
+		aux_entry = container_of(cq->aux_queue.head,
+					 struct util_cq_aux_entry, list_entry);
+		if (aux_entry->cq_slot == ofi_cirque_head(cq->cirq))
+			return;
+	}
+	ofi_cirque_discard(cq->cirq);
 }
 
 /* Caller must hold 'cq lock' */
@@ -79,6 +100,40 @@ int ofi_cq_write_overflow(struct util_cq *cq, void *context, uint64_t flags,
 	return 0;
 }
 
+/* Writes 'count' completions with one lock round trip.  'src' may be
+ * NULL if the source addresses are not known.
+ */
+int ofi_cq_write_batch(struct util_cq *cq,
+		       const struct fi_cq_tagged_entry *comp,
+		       const fi_addr_t *src, size_t count)
+{
+	fi_addr_t addr;
+	size_t i;
+	int ret = 0;
+
+	cq->cq_fastlock_acquire(&cq->cq_lock);
+	for (i = 0; i < count; i++) {
+		addr = src ? src[i] : FI_ADDR_NOTAVAIL;
+		if (ofi_cirque_freecnt(cq->cirq) > 1) {
+			if (cq->src)
+				cq->src[ofi_cirque_windex(cq->cirq)] = addr;
+			ofi_cq_write_entry(cq, comp[i].op_context,
+					   comp[i].flags, comp[i].len,
+					   comp[i].buf, comp[i].data,
+					   comp[i].tag);
+		} else {
+			ret = ofi_cq_write_overflow(cq, comp[i].op_context,
+						    comp[i].flags, comp[i].len,
+						    comp[i].buf, comp[i].data,
+						    comp[i].tag, addr);
+			if (ret)
+				break;
+		}
+	}
+	cq->cq_fastlock_release(&cq->cq_lock);
+	return ret;
+}
+
 /* Caller must hold 'cq lock' */
 int ofi_cq_insert_error(struct util_cq *cq,
 			const struct fi_cq_err_entry *err_entry)
@@ -190,37 +245,80 @@ int ofi_check_cq_attr(const struct fi_provider *prov,
 	return 0;
 }
 
-static void util_cq_read_ctx(void **dst, void *src)
+static void util_cq_read_ctx(void **dst, void *src, size_t cnt)
+{
+	struct fi_cq_tagged_entry *comp = src;
+	struct fi_cq_entry *entry = *dst;
+	size_t i;
+
+	for (i = 0; i < cnt; i++)
+		entry[i].op_context = comp[i].op_context;
+	*dst = &entry[cnt];
+}
+
+static void util_cq_read_msg(void **dst, void *src, size_t cnt)
 {
-	*(struct fi_cq_entry *) *dst = *(struct fi_cq_entry *) src;
-	*(char**)dst += sizeof(struct fi_cq_entry);
+	struct fi_cq_tagged_entry *comp = src;
+	struct fi_cq_msg_entry *entry = *dst;
+	size_t i;
+
+	for (i = 0; i < cnt; i++)
+		entry[i] = *(struct fi_cq_msg_entry *) &comp[i];
+	*dst = &entry[cnt];
 }
 
-static void util_cq_read_msg(void **dst, void *src)
+static void util_cq_read_data(void **dst, void *src, size_t cnt)
 {
-	*(struct fi_cq_msg_entry *) *dst = *(struct fi_cq_msg_entry *) src;
-	*(char**)dst += sizeof(struct fi_cq_msg_entry);
+	struct fi_cq_tagged_entry *comp = src;
+	struct fi_cq_data_entry *entry = *dst;
+	size_t i;
+
+	for (i = 0; i < cnt; i++)
+		entry[i] = *(struct fi_cq_data_entry *) &comp[i];
+	*dst = &entry[cnt];
 }
 
-static void util_cq_read_data(void **dst, void *src)
+static void util_cq_read_tagged(void **dst, void *src, size_t cnt)
 {
-	*(struct fi_cq_data_entry *) *dst = *(struct fi_cq_data_entry *) src;
-	*(char**)dst += sizeof(struct fi_cq_data_entry);
+	memcpy(*dst, src, cnt * sizeof(struct fi_cq_tagged_entry));
+	*(char **) dst += cnt * sizeof(struct fi_cq_tagged_entry);
 }
 
-static void util_cq_read_tagged(void **dst, void *src)
+/* Returns -FI_EAVAIL if the entry at the head is an error */
+static ssize_t util_cq_read_aux(struct util_cq *cq, void **buf,
+				fi_addr_t *src_addr)
 {
-	*(struct fi_cq_tagged_entry *) *dst = *(struct fi_cq_tagged_entry *) src;
-	*(char **)dst += sizeof(struct fi_cq_tagged_entry);
+	struct util_cq_aux_entry *aux_entry;
+	ssize_t ret = 0;
+
+	fastlock_acquire(&cq->aux_lock);
+	assert(!slist_empty(&cq->aux_queue));
+	aux_entry = container_of(cq->aux_queue.head,
+				 struct util_cq_aux_entry, list_entry);
+	assert(aux_entry->cq_slot == ofi_cirque_head(cq->cirq));
+	if (aux_entry->comp.err) {
+		ret = -FI_EAVAIL;
+		goto unlock;
+	}
+
+	if (src_addr && cq->src)
+		*src_addr = aux_entry->src;
+	cq->read_entry(buf, &aux_entry->comp, 1);
+	slist_remove_head(&cq->aux_queue);
+	free(aux_entry);
+	util_cq_discard_aux_slot(cq);
+unlock:
+	fastlock_release(&cq->aux_lock);
+	return ret;
 }
 
 ssize_t ofi_cq_readfrom(struct fid_cq *cq_fid, void *buf, size_t count,
 			fi_addr_t *src_addr)
 {
 	struct fi_cq_tagged_entry *entry;
-	struct util_cq_aux_entry *aux_entry;
 	struct util_cq *cq;
-	ssize_t i;
+	size_t avail, run, n, index;
+	ssize_t i, ret;
 
 	cq = container_of(cq_fid, struct util_cq, cq_fid);
 
@@ -235,43 +333,38 @@ ssize_t ofi_cq_readfrom(struct fid_cq *cq_fid, void *buf, size_t count,
 		}
 	}
 
-	if (count > ofi_cirque_usedcnt(cq->cirq))
-		count = ofi_cirque_usedcnt(cq->cirq);
+	/* Copy contiguous runs of regular entries, stopping at the end of
+	 * the ring or at an entry that lives on the aux queue. */
+	for (i = 0; i < (ssize_t) count; ) {
+		avail = ofi_cirque_usedcnt(cq->cirq);
+		ofi_atomic_acquire_fence();
+		if (!avail)
+			break;
 
-	for (i = 0; i < (ssize_t) count; i++) {
-		entry = ofi_cirque_head(cq->cirq);
-		if (!(entry->flags & UTIL_FLAG_AUX)) {
-			if (src_addr && cq->src)
-				src_addr[i] = cq->src[ofi_cirque_rindex(cq->cirq)];
-			cq->read_entry(&buf, entry);
-			ofi_cirque_discard(cq->cirq);
-		} else {
-			assert(!slist_empty(&cq->aux_queue));
-			aux_entry = container_of(cq->aux_queue.head,
-						 struct util_cq_aux_entry,
-						 list_entry);
-			assert(aux_entry->cq_slot == entry);
-			if (aux_entry->comp.err) {
-				if (!i)
-					i = -FI_EAVAIL;
-				break;
-			}
+		index = ofi_cirque_rindex(cq->cirq);
+		run = MIN(MIN(count - i, avail), cq->cirq->size - index);
+		entry = &cq->cirq->buf[index];
+		for (n = 0; n < run && !(entry[n].flags & UTIL_FLAG_AUX); n++)
+			;
 
+		if (n) {
 			if (src_addr && cq->src)
-				src_addr[i] = aux_entry->src;
-			cq->read_entry(&buf, &aux_entry->comp);
-			slist_remove_head(&cq->aux_queue);
-
-			if (slist_empty(&cq->aux_queue)) {
-				ofi_cirque_discard(cq->cirq);
-			} else {
-				aux_entry = container_of(cq->aux_queue.head,
-							struct util_cq_aux_entry,
-							list_entry);
-				if (aux_entry->cq_slot != ofi_cirque_head(cq->cirq))
-					ofi_cirque_discard(cq->cirq);
-			}
+				memcpy(&src_addr[i], &cq->src[index],
+				       n * sizeof(*src_addr));
+			cq->read_entry(&buf, entry, n);
+			ofi_atomic_release_fence();
+			cq->cirq->rcnt += n;
+			i += n;
+			continue;
 		}
+
+		ret = util_cq_read_aux(cq, &buf, src_addr ? &src_addr[i] : NULL);
+		if (ret) {
+			if (!i)
+				i = ret;
+			break;
+		}
+		i++;
 	}
 out:
 	cq->cq_fastlock_release(&cq->cq_lock);
@@ -297,6 +390,7 @@ ssize_t ofi_cq_readerr(struct fid_cq *cq_fid, struct fi_cq_err_entry *buf,
 	api_version = cq->domain->fabric->fabric_fid.api_version;
 
 	cq->cq_fastlock_acquire(&cq->cq_lock);
+	fastlock_acquire(&cq->aux_lock);
 	if (ofi_cirque_isempty(cq->cirq) ||
 	    !(ofi_cirque_head(cq->cirq)->flags & UTIL_FLAG_AUX)) {
 		ret = -FI_EAGAIN;
@@ -330,17 +424,11 @@ ssize_t ofi_cq_readerr(struct fid_cq *cq_fid, struct fi_cq_err_entry *buf,
 
 	slist_remove_head(&cq->aux_queue);
 	free(aux_entry);
-	if (slist_empty(&cq->aux_queue)) {
-		ofi_cirque_discard(cq->cirq);
-	} else {
-		aux_entry = container_of(cq->aux_queue.head,
-					 struct util_cq_aux_entry, list_entry);
-		if (aux_entry->cq_slot != ofi_cirque_head(cq->cirq))
-			ofi_cirque_discard(cq->cirq);
-	}
+	util_cq_discard_aux_slot(cq);
 
 	ret = 1;
 unlock:
+	fastlock_release(&cq->aux_lock);
 	cq->cq_fastlock_release(&cq->cq_lock);
 	return ret;
 }
@@ -389,8 +477,8 @@ int ofi_cq_signal(struct fid_cq *cq_fid)
 	return 0;
 }
 
-static const char *util_cq_strerror(struct fid_cq *cq, int prov_errno,
-				    const void *err_data, char *buf, size_t len)
+const char *ofi_cq_strerror(struct fid_cq *cq_fid, int prov_errno,
+			    const void *err_data, char *buf, size_t len)
 {
 	return fi_strerror(prov_errno);
 }
@@ -403,7 +491,7 @@ static struct fi_ops_cq util_cq_ops = {
 	.sread = ofi_cq_sread,
 	.sreadfrom = ofi_cq_sreadfrom,
 	.signal = ofi_cq_signal,
-	.strerror = util_cq_strerror,
+	.strerror = ofi_cq_strerror,
 };
 
 int ofi_cq_cleanup(struct util_cq *cq)
@@ -429,6 +517,7 @@ int ofi_cq_cleanup(struct util_cq *cq)
 
 	ofi_atomic_dec32(&cq->domain->ref);
 	util_comp_cirq_free(cq->cirq);
+	fastlock_destroy(&cq->aux_lock);
 	fastlock_destroy(&cq->cq_lock);
 	fastlock_destroy(&cq->ep_list_lock);
 	free(cq->src);
@@ -487,6 +576,7 @@ static int fi_cq_init(struct fid_domain *domain, struct fi_cq_attr *attr,
 	dlist_init(&cq->ep_list);
 	fastlock_init(&cq->ep_list_lock);
 	fastlock_init(&cq->cq_lock);
+	fastlock_init(&cq->aux_lock);
 	if (cq->domain->threading == FI_THREAD_COMPLETION ||
 	    (cq->domain->threading == FI_THREAD_DOMAIN)) {
 		cq->cq_fastlock_acquire = ofi_fastlock_acquire_noop;
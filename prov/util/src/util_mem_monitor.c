@@ -122,6 +122,19 @@ void ofi_monitors_init(void)
 			" and free calls.  Userfaultfd is the default if"
 			" available on the system. 'disabled' option disables"
 			" memory caching.");
+	fi_param_define(NULL, "mr_cache_high_watermark", FI_PARAM_SIZE_T,
+			"Percentage of the MR cache max count or max size at"
+			" which unused regions start being evicted."
+			" (default: 100)");
+	fi_param_define(NULL, "mr_cache_low_watermark", FI_PARAM_SIZE_T,
+			"Percentage of the MR cache max count or max size"
+			" below which eviction stops.  Must not exceed the"
+			" high watermark.  (default: 100)");
+	fi_param_define(NULL, "mr_cache_async_evict", FI_PARAM_BOOL,
+			"Deregister evicted and invalidated regions from a"
+			" background thread instead of inline with"
+			" registration and deregistration calls."
+			" (default: false)");
 	fi_param_define(NULL, "mr_cuda_cache_monitor_enabled", FI_PARAM_BOOL,
 			"Enable or disable the CUDA cache memory monitor."
 			"Monitor is enabled by default.");
@@ -132,6 +145,12 @@ void ofi_monitors_init(void)
 	fi_param_get_size_t(NULL, "mr_cache_max_size", &cache_params.max_size);
 	fi_param_get_size_t(NULL, "mr_cache_max_count", &cache_params.max_cnt);
 	fi_param_get_str(NULL, "mr_cache_monitor", &cache_params.monitor);
+	fi_param_get_size_t(NULL, "mr_cache_high_watermark",
+			    &cache_params.high_watermark);
+	fi_param_get_size_t(NULL, "mr_cache_low_watermark",
+			    &cache_params.low_watermark);
+	fi_param_get_bool(NULL, "mr_cache_async_evict",
+			  &cache_params.async_evict);
 	fi_param_get_bool(NULL, "mr_cuda_cache_monitor_enabled",
 			  &cache_params.cuda_monitor_enabled);
 	fi_param_get_bool(NULL, "mr_rocr_cache_monitor_enabled",
@@ -140,6 +159,17 @@ void ofi_monitors_init(void)
 	if (!cache_params.max_size)
 		cache_params.max_size = ofi_default_cache_size();
 
+	if (!cache_params.high_watermark || cache_params.high_watermark > 100 ||
+	    !cache_params.low_watermark ||
+	    cache_params.low_watermark > cache_params.high_watermark) {
+		FI_WARN(&core_prov, FI_LOG_MR,
+			"invalid MR cache watermarks (high %zu, low %zu), "
+			"using defaults\n", cache_params.high_watermark,
+			cache_params.low_watermark);
+		cache_params.high_watermark = 100;
+		cache_params.low_watermark = 100;
+	}
+
 	if (cache_params.monitor != NULL) {
 		if (!strcmp(cache_params.monitor, "userfaultfd")) {
 #if HAVE_UFFD_MONITOR
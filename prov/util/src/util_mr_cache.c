@@ -43,12 +43,54 @@
 #include <ofi_tree.h>
 
 
+/* Each thread remembers the last few entries it hit in a cache.  A hit
+ * on one of those takes a reference with a compare-and-swap instead of
+ * acquiring mm_lock and searching the tree.  The recorded generation
+ * must still match the cache's, proving the entry was not removed from
+ * the tree (and possibly freed) since it was recorded.  The recorded
+ * entry sequence must match as well, so a reference taken on storage
+ * that was freed and reused is detected and backed out.
+ */
+struct ofi_mr_cache_tls {
+	struct dlist_entry	entry;
+	struct ofi_mr_cache	*cache;
+	size_t			search_cnt;
+	size_t			hit_cnt;
+	size_t			next;
+	struct {
+		struct ofi_mr_entry	*entry;
+		int64_t			gen;
+		int32_t			seq;
+	} slot[OFI_MR_CACHE_TLS_CNT];
+};
+
 struct ofi_mr_cache_params cache_params = {
 	.max_cnt = 1024,
+	.high_watermark = 100,
+	.low_watermark = 100,
 	.cuda_monitor_enabled = true,
 	.rocr_monitor_enabled = true,
 };
 
+static size_t util_mr_pct(size_t max, size_t pct)
+{
+	return max / 100 * pct + max % 100 * pct / 100;
+}
+
+/* Caller must hold mm_lock */
+static bool util_mr_cache_over(struct ofi_mr_cache *cache, size_t pct)
+{
+	return (cache->cached_cnt >= util_mr_pct(cache_params.max_cnt, pct)) ||
+	       (cache->cached_size >= util_mr_pct(cache_params.max_size, pct));
+}
+
+/* Caller must hold mm_lock */
+static void util_mr_reaper_kick(struct ofi_mr_cache *cache)
+{
+	if (cache->reaper_running)
+		pthread_cond_signal(&cache->reaper_cond);
+}
+
 static int util_mr_find_within(struct ofi_rbmap *map, void *key, void *data)
 {
 	struct ofi_mr_entry *entry = data;
@@ -75,6 +117,18 @@ static int util_mr_find_overlap(struct ofi_rbmap *map, void *key, void *data)
 	return 0;
 }
 
+/* Entries start out dead, so that a stale per-thread entry can never
+ * take a reference on an unused buffer.  A reused entry stays dead until
+ * it is published to the cache under mm_lock.
+ */
+static void util_mr_entry_init(struct ofi_bufpool_region *region, void *buf)
+{
+	struct ofi_mr_entry *entry = buf;
+
+	ofi_atomic_initialize32(&entry->use_cnt, -1);
+	ofi_atomic_initialize32(&entry->seq, 0);
+}
+
 static struct ofi_mr_entry *util_mr_entry_alloc(struct ofi_mr_cache *cache)
 {
 	struct ofi_mr_entry *entry;
@@ -89,6 +143,8 @@ static void util_mr_entry_free(struct ofi_mr_cache *cache,
 			       struct ofi_mr_entry *entry)
 {
 	pthread_mutex_lock(&cache->lock);
+	ofi_atomic_set32(&entry->use_cnt, -1);
+	ofi_atomic_inc32(&entry->seq);
 	ofi_buf_free(entry);
 	pthread_mutex_unlock(&cache->lock);
 }
@@ -121,6 +177,7 @@ static void util_mr_uncache_entry_storage(struct ofi_mr_cache *cache,
 
 	ofi_rbmap_delete(&cache->tree, entry->node);
 	entry->node = NULL;
+	ofi_atomic_inc64(&cache->gen);
 
 	cache->cached_cnt--;
 	cache->cached_size -= entry->info.iov.iov_len;
@@ -131,10 +188,13 @@ static void util_mr_uncache_entry(struct ofi_mr_cache *cache,
 {
 	util_mr_uncache_entry_storage(cache, entry);
 
-	if (entry->use_cnt == 0) {
+	if (ofi_atomic_cas_bool_strong32(&entry->use_cnt, 0, -1)) {
 		dlist_remove(&entry->list_entry);
 		dlist_insert_tail(&entry->list_entry, &cache->flush_list);
 	} else {
+		/* In use entries may still sit on the LRU list if they
+		 * were picked up through a per-thread hit */
+		dlist_remove_init(&entry->list_entry);
 		cache->uncached_cnt++;
 		cache->uncached_size += entry->info.iov.iov_len;
 	}
@@ -178,6 +238,9 @@ void ofi_mr_cache_notify(struct ofi_mr_cache *cache, const void *addr, size_t le
 	for (entry = ofi_mr_rbt_overlap(&cache->tree, &iov); entry;
 	     entry = ofi_mr_rbt_overlap(&cache->tree, &iov))
 		util_mr_uncache_entry(cache, entry);
+
+	if (!dlist_empty(&cache->flush_list))
+		util_mr_reaper_kick(cache);
 }
 
 bool ofi_mr_cache_flush(struct ofi_mr_cache *cache, bool flush_lru)
@@ -205,6 +268,10 @@ bool ofi_mr_cache_flush(struct ofi_mr_cache *cache, bool flush_lru)
 		dlist_pop_front(&cache->lru_list, struct ofi_mr_entry,
 				entry, list_entry);
 		dlist_init(&entry->list_entry);
+		/* Referenced again through a per-thread hit */
+		if (!ofi_atomic_cas_bool_strong32(&entry->use_cnt, 0, -1))
+			continue;
+
 		FI_DBG(cache->domain->prov, FI_LOG_MR, "flush %p (len: %zu)\n",
 		       entry->info.iov.iov_base, entry->info.iov.iov_len);
 
@@ -215,32 +282,162 @@ bool ofi_mr_cache_flush(struct ofi_mr_cache *cache, bool flush_lru)
 		pthread_mutex_lock(&mm_lock);
 
 	} while (!dlist_empty(&cache->lru_list) &&
-		 ((cache->cached_cnt >= cache_params.max_cnt) ||
-		  (cache->cached_size >= cache_params.max_size)));
+		 util_mr_cache_over(cache, cache_params.low_watermark));
 	pthread_mutex_unlock(&mm_lock);
 
 	return true;
 }
 
+/* Caller must hold mm_lock.  Returns true if the entry must be freed
+ * once the lock has been released.
+ */
+static bool util_mr_entry_put(struct ofi_mr_cache *cache,
+			      struct ofi_mr_entry *entry)
+{
+	if (!entry->node) {
+		/* Per-thread lookups may briefly hold a reference to an
+		 * uncached entry.  They drop it through here as well. */
+		if (!ofi_atomic_cas_bool_strong32(&entry->use_cnt, 1, -1)) {
+			ofi_atomic_dec32(&entry->use_cnt);
+			return false;
+		}
+		cache->uncached_cnt--;
+		cache->uncached_size -= entry->info.iov.iov_len;
+		if (cache->reaper_running) {
+			dlist_insert_tail(&entry->list_entry,
+					  &cache->flush_list);
+			util_mr_reaper_kick(cache);
+			return false;
+		}
+		return true;
+	}
+
+	if (ofi_atomic_dec32(&entry->use_cnt) == 0) {
+		dlist_remove(&entry->list_entry);
+		dlist_insert_tail(&entry->list_entry, &cache->lru_list);
+	}
+	return false;
+}
+
 void ofi_mr_cache_delete(struct ofi_mr_cache *cache, struct ofi_mr_entry *entry)
 {
+	bool free_entry;
+
 	FI_DBG(cache->domain->prov, FI_LOG_MR, "delete %p (len: %zu)\n",
 	       entry->info.iov.iov_base, entry->info.iov.iov_len);
 
 	pthread_mutex_lock(&mm_lock);
 	cache->delete_cnt++;
+	free_entry = util_mr_entry_put(cache, entry);
+	pthread_mutex_unlock(&mm_lock);
 
-	if (--entry->use_cnt == 0) {
-		if (!entry->node) {
-			cache->uncached_cnt--;
-			cache->uncached_size -= entry->info.iov.iov_len;
-			pthread_mutex_unlock(&mm_lock);
-			util_mr_free_entry(cache, entry);
-			return;
-		}
-		dlist_insert_tail(&entry->list_entry, &cache->lru_list);
+	if (free_entry)
+		util_mr_free_entry(cache, entry);
+}
+
+/* Thread exit: fold the counters back into the cache */
+static void util_mr_tls_release(void *arg)
+{
+	struct ofi_mr_cache_tls *tls = arg;
+
+	pthread_mutex_lock(&mm_lock);
+	tls->cache->search_cnt += tls->search_cnt;
+	tls->cache->hit_cnt += tls->hit_cnt;
+	dlist_remove(&tls->entry);
+	pthread_mutex_unlock(&mm_lock);
+	free(tls);
+}
+
+static struct ofi_mr_cache_tls *util_mr_get_tls(struct ofi_mr_cache *cache)
+{
+	struct ofi_mr_cache_tls *tls;
+
+	tls = pthread_getspecific(cache->tls_key);
+	if (OFI_LIKELY(tls != NULL))
+		return tls;
+
+	tls = calloc(1, sizeof(*tls));
+	if (!tls)
+		return NULL;
+
+	tls->cache = cache;
+	if (pthread_setspecific(cache->tls_key, tls)) {
+		free(tls);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&mm_lock);
+	dlist_insert_tail(&tls->entry, &cache->tls_list);
+	pthread_mutex_unlock(&mm_lock);
+	return tls;
+}
+
+/* Caller must hold mm_lock */
+static void util_mr_tls_record(struct ofi_mr_cache *cache,
+			       struct ofi_mr_cache_tls *tls,
+			       struct ofi_mr_entry *entry)
+{
+	size_t i;
+
+	for (i = 0; i < OFI_MR_CACHE_TLS_CNT; i++) {
+		if (tls->slot[i].entry == entry)
+			goto set;
 	}
+	i = tls->next++ % OFI_MR_CACHE_TLS_CNT;
+set:
+	tls->slot[i].entry = entry;
+	tls->slot[i].gen = ofi_atomic_get64(&cache->gen);
+	tls->slot[i].seq = ofi_atomic_get32(&entry->seq);
+}
+
+/* Only used for system memory, whose monitors keep no per-buffer state
+ * and need no validity check under mm_lock.
+ */
+static struct ofi_mr_entry *
+util_mr_tls_find(struct ofi_mr_cache *cache, struct ofi_mr_cache_tls *tls,
+		 const struct ofi_mr_info *info)
+{
+	struct ofi_mr_entry *entry;
+	int64_t gen;
+	int32_t cnt;
+	bool free_entry;
+	size_t i;
+
+	gen = ofi_atomic_get64(&cache->gen);
+	for (i = 0; i < OFI_MR_CACHE_TLS_CNT; i++) {
+		entry = tls->slot[i].entry;
+		/* Entry storage stays valid until the cache is cleaned up,
+		 * so a stale entry only fails the checks below */
+		if (entry && tls->slot[i].gen == gen &&
+		    ofi_atomic_get32(&entry->seq) == tls->slot[i].seq &&
+		    entry->info.iface == info->iface &&
+		    ofi_iov_within(&info->iov, &entry->info.iov))
+			goto found;
+	}
+	return NULL;
+
+found:
+	do {
+		cnt = ofi_atomic_get32(&entry->use_cnt);
+		if (cnt < 0)
+			return NULL;
+	} while (!ofi_atomic_cas_bool_weak32(&entry->use_cnt, cnt, cnt + 1));
+
+	if (OFI_LIKELY(ofi_atomic_get64(&cache->gen) == gen &&
+		       ofi_atomic_get32(&entry->seq) == tls->slot[i].seq))
+		return entry;
+
+	/* The count only leaves -1 once an entry is published, so the
+	 * reference taken here is on a live entry and is dropped normally.
+	 */
+	tls->slot[i].entry = NULL;
+	pthread_mutex_lock(&mm_lock);
+	free_entry = util_mr_entry_put(cache, entry);
 	pthread_mutex_unlock(&mm_lock);
+
+	if (free_entry)
+		util_mr_free_entry(cache, entry);
+	return NULL;
 }
 
 /*
@@ -272,7 +469,7 @@ util_mr_cache_create(struct ofi_mr_cache *cache, const struct ofi_mr_info *info,
 
 	(*entry)->node = NULL;
 	(*entry)->info = *info;
-	(*entry)->use_cnt = 1;
+	dlist_init(&(*entry)->list_entry);
 
 	ret = cache->add_region(cache, *entry);
 	if (ret)
@@ -285,13 +482,17 @@ util_mr_cache_create(struct ofi_mr_cache *cache, const struct ofi_mr_info *info,
 		goto unlock;
 	}
 
-	if ((cache->cached_cnt >= cache_params.max_cnt) ||
-	    (cache->cached_size >= cache_params.max_size)) {
+	/* Publish the entry.  Until now it was dead to per-thread lookups
+	 * still holding its storage from an earlier use.
+	 */
+	ofi_atomic_set32(&(*entry)->use_cnt, 1);
+	if (util_mr_cache_over(cache, 100)) {
 		cache->uncached_cnt++;
 		cache->uncached_size += info->iov.iov_len;
 	} else {
 		if (ofi_rbmap_insert(&cache->tree, (void *) &(*entry)->info,
 				     (void *) *entry, &(*entry)->node)) {
+			ofi_atomic_set32(&(*entry)->use_cnt, -1);
 			ret = -FI_ENOMEM;
 			goto unlock;
 		}
@@ -321,6 +522,7 @@ int ofi_mr_cache_search(struct ofi_mr_cache *cache, const struct fi_mr_attr *att
 			struct ofi_mr_entry **entry)
 {
 	struct ofi_mr_info info;
+	struct ofi_mr_cache_tls *tls;
 	int ret;
 	struct ofi_mem_monitor *monitor = cache->monitors[attr->iface];
 
@@ -339,14 +541,27 @@ int ofi_mr_cache_search(struct ofi_mr_cache *cache, const struct fi_mr_attr *att
 	info.iface = attr->iface;
 	info.device = attr->device.reserved;
 
+	tls = (info.iface == FI_HMEM_SYSTEM) ? util_mr_get_tls(cache) : NULL;
+	if (OFI_LIKELY(tls != NULL)) {
+		*entry = util_mr_tls_find(cache, tls, &info);
+		if (*entry) {
+			tls->search_cnt++;
+			tls->hit_cnt++;
+			return 0;
+		}
+	}
+
 	do {
 		pthread_mutex_lock(&mm_lock);
 
-		if ((cache->cached_cnt >= cache_params.max_cnt) ||
-		    (cache->cached_size >= cache_params.max_size)) {
-			pthread_mutex_unlock(&mm_lock);
-			ofi_mr_cache_flush(cache, true);
-			pthread_mutex_lock(&mm_lock);
+		if (util_mr_cache_over(cache, cache_params.high_watermark)) {
+			if (cache->reaper_running) {
+				util_mr_reaper_kick(cache);
+			} else {
+				pthread_mutex_unlock(&mm_lock);
+				ofi_mr_cache_flush(cache, true);
+				pthread_mutex_lock(&mm_lock);
+			}
 		}
 
 		cache->search_cnt++;
@@ -378,8 +593,10 @@ int ofi_mr_cache_search(struct ofi_mr_cache *cache, const struct fi_mr_attr *att
 
 hit:
 	cache->hit_cnt++;
-	if ((*entry)->use_cnt++ == 0)
-		dlist_remove_init(&(*entry)->list_entry);
+	ofi_atomic_inc32(&(*entry)->use_cnt);
+	dlist_remove_init(&(*entry)->list_entry);
+	if (tls)
+		util_mr_tls_record(cache, tls, *entry);
 	pthread_mutex_unlock(&mm_lock);
 	return 0;
 }
@@ -409,8 +626,8 @@ struct ofi_mr_entry *ofi_mr_cache_find(struct ofi_mr_cache *cache,
 	}
 
 	cache->hit_cnt++;
-	if ((entry)->use_cnt++ == 0)
-		dlist_remove_init(&(entry)->list_entry);
+	ofi_atomic_inc32(&entry->use_cnt);
+	dlist_remove_init(&entry->list_entry);
 
 unlock:
 	pthread_mutex_unlock(&mm_lock);
@@ -436,13 +653,14 @@ int ofi_mr_cache_reg(struct ofi_mr_cache *cache, const struct fi_mr_attr *attr,
 	pthread_mutex_unlock(&mm_lock);
 
 	(*entry)->info.iov = *attr->mr_iov;
-	(*entry)->use_cnt = 1;
 	(*entry)->node = NULL;
+	dlist_init(&(*entry)->list_entry);
 
 	ret = cache->add_region(cache, *entry);
 	if (ret)
 		goto buf_free;
 
+	ofi_atomic_set32(&(*entry)->use_cnt, 1);
 	return 0;
 
 buf_free:
@@ -454,16 +672,107 @@ buf_free:
 	return ret;
 }
 
+static void *util_mr_reaper(void *arg)
+{
+	struct ofi_mr_cache *cache = arg;
+	bool flush_lru;
+
+	pthread_mutex_lock(&mm_lock);
+	while (!cache->reaper_stop) {
+		flush_lru = !dlist_empty(&cache->lru_list) &&
+			    util_mr_cache_over(cache, cache_params.high_watermark);
+		if (!flush_lru && dlist_empty(&cache->flush_list)) {
+			fi_wait_cond(&cache->reaper_cond, &mm_lock, -1);
+			continue;
+		}
+
+		pthread_mutex_unlock(&mm_lock);
+		ofi_mr_cache_flush(cache, flush_lru);
+		pthread_mutex_lock(&mm_lock);
+	}
+	pthread_mutex_unlock(&mm_lock);
+	return NULL;
+}
+
+static int util_mr_reaper_start(struct ofi_mr_cache *cache)
+{
+	int ret;
+
+	pthread_cond_init(&cache->reaper_cond, NULL);
+	cache->reaper_stop = false;
+	ret = pthread_create(&cache->reaper, NULL, util_mr_reaper, cache);
+	if (ret) {
+		FI_WARN(cache->domain->prov, FI_LOG_MR,
+			"failed to start MR cache reaper thread: %s\n",
+			strerror(ret));
+		pthread_cond_destroy(&cache->reaper_cond);
+		return -ret;
+	}
+	cache->reaper_running = true;
+	return 0;
+}
+
+static void util_mr_reaper_stop(struct ofi_mr_cache *cache)
+{
+	if (!cache->reaper_running)
+		return;
+
+	pthread_mutex_lock(&mm_lock);
+	cache->reaper_stop = true;
+	pthread_cond_signal(&cache->reaper_cond);
+	pthread_mutex_unlock(&mm_lock);
+
+	pthread_join(cache->reaper, NULL);
+	cache->reaper_running = false;
+	pthread_cond_destroy(&cache->reaper_cond);
+}
+
+void ofi_mr_cache_get_stats(struct ofi_mr_cache *cache,
+			    struct ofi_mr_cache_stats *stats)
+{
+	struct ofi_mr_cache_tls *tls;
+
+	pthread_mutex_lock(&mm_lock);
+	stats->search_cnt = cache->search_cnt;
+	stats->hit_cnt = cache->hit_cnt;
+	stats->delete_cnt = cache->delete_cnt;
+	stats->notify_cnt = cache->notify_cnt;
+	stats->cached_cnt = cache->cached_cnt;
+	stats->cached_size = cache->cached_size;
+
+	dlist_foreach_container(&cache->tls_list, struct ofi_mr_cache_tls,
+				tls, entry) {
+		stats->search_cnt += tls->search_cnt;
+		stats->hit_cnt += tls->hit_cnt;
+	}
+	pthread_mutex_unlock(&mm_lock);
+}
+
 void ofi_mr_cache_cleanup(struct ofi_mr_cache *cache)
 {
+	struct ofi_mr_cache_stats stats;
+	struct ofi_mr_cache_tls *tls;
+
 	/* If we don't have a domain, initialization failed */
 	if (!cache->domain)
 		return;
 
+	ofi_mr_cache_get_stats(cache, &stats);
 	FI_INFO(cache->domain->prov, FI_LOG_MR, "MR cache stats: "
 		"searches %zu, deletes %zu, hits %zu notify %zu\n",
-		cache->search_cnt, cache->delete_cnt, cache->hit_cnt,
-		cache->notify_cnt);
+		stats.search_cnt, stats.delete_cnt, stats.hit_cnt,
+		stats.notify_cnt);
+
+	util_mr_reaper_stop(cache);
+
+	/* Threads still holding per-thread state must not touch the
+	 * cache on exit */
+	pthread_key_delete(cache->tls_key);
+	while (!dlist_empty(&cache->tls_list)) {
+		dlist_pop_front(&cache->tls_list, struct ofi_mr_cache_tls,
+				tls, entry);
+		free(tls);
+	}
 
 	while (ofi_mr_cache_flush(cache, true))
 		;
@@ -484,6 +793,11 @@ int ofi_mr_cache_init(struct util_domain *domain,
 		      struct ofi_mem_monitor **monitors,
 		      struct ofi_mr_cache *cache)
 {
+	struct ofi_bufpool_attr attr = {
+		.size = sizeof(struct ofi_mr_entry) + cache->entry_data_size,
+		.alignment = 16,
+		.init_fn = util_mr_entry_init,
+	};
 	int ret;
 
 	assert(cache->add_region && cache->delete_region);
@@ -501,6 +815,12 @@ int ofi_mr_cache_init(struct util_domain *domain,
 	cache->delete_cnt = 0;
 	cache->hit_cnt = 0;
 	cache->notify_cnt = 0;
+	ofi_atomic_initialize64(&cache->gen, 0);
+	dlist_init(&cache->tls_list);
+	if (pthread_key_create(&cache->tls_key, util_mr_tls_release)) {
+		pthread_mutex_destroy(&cache->lock);
+		return -FI_ENOMEM;
+	}
 	cache->domain = domain;
 	ofi_atomic_inc32(&domain->ref);
 
@@ -509,19 +829,26 @@ int ofi_mr_cache_init(struct util_domain *domain,
 	if (ret)
 		goto destroy;
 
-	ret = ofi_bufpool_create(&cache->entry_pool,
-				 sizeof(struct ofi_mr_entry) +
-				 cache->entry_data_size,
-				 16, 0, 0, 0);
+	ret = ofi_bufpool_create_attr(&attr, &cache->entry_pool);
 	if (ret)
 		goto del;
 
+	cache->reaper_running = false;
+	if (cache_params.async_evict) {
+		ret = util_mr_reaper_start(cache);
+		if (ret)
+			goto pool;
+	}
+
 	return 0;
+pool:
+	ofi_bufpool_destroy(cache->entry_pool);
 del:
 	ofi_monitors_del_cache(cache);
 destroy:
 	ofi_rbmap_cleanup(&cache->tree);
 	ofi_atomic_dec32(&cache->domain->ref);
+	pthread_key_delete(cache->tls_key);
 	pthread_mutex_destroy(&cache->lock);
 	cache->domain = NULL;
 	return ret;
@@ -65,6 +65,13 @@ static void smr_peer_addr_init(struct smr_addr *peer)
 	peer->id = -1;
 }
 
+static void smr_peer_data_init(struct smr_peer_data *peer_data)
+{
+	smr_peer_addr_init(&peer_data->addr);
+	peer_data->sar_status = 0;
+	peer_data->name_sent = 0;
+}
+
 void smr_cma_check(struct smr_region *smr, struct smr_region *peer_smr)
 {
 	struct iovec local_iov, remote_iov;
@@ -93,31 +100,40 @@ void smr_cma_check(struct smr_region *smr, struct smr_region *peer_smr)
 	}
 }
 
+static size_t smr_sar_buf_size(size_t sar_size)
+{
+	return ofi_get_aligned_size(sizeof(struct smr_sar_buf) + sar_size, 64);
+}
+
 size_t smr_calculate_size_offsets(size_t tx_count, size_t rx_count,
+				  size_t sar_depth, size_t sar_size,
 				  size_t *cmd_offset, size_t *resp_offset,
 				  size_t *inject_offset, size_t *sar_offset,
 				  size_t *peer_offset, size_t *name_offset,
-				  size_t *sock_offset)
+				  size_t *sock_offset, size_t *sar_buf_offset)
 {
 	size_t cmd_queue_offset, resp_queue_offset, inject_pool_offset;
 	size_t sar_pool_offset, peer_data_offset, ep_name_offset;
 	size_t tx_size, rx_size, total_size, sock_name_offset;
+	size_t sar_bufs_offset;
 
 	tx_size = roundup_power_of_two(tx_count);
 	rx_size = roundup_power_of_two(rx_count);
 
-	cmd_queue_offset = sizeof(struct smr_region);
+	cmd_queue_offset = ofi_get_aligned_size(sizeof(struct smr_region), 64);
 	resp_queue_offset = cmd_queue_offset + sizeof(struct smr_cmd_queue) +
-			    sizeof(struct smr_cmd) * rx_size;
+			    sizeof(struct smr_cmd_queue_entry) * rx_size;
 	inject_pool_offset = resp_queue_offset + sizeof(struct smr_resp_queue) +
 			     sizeof(struct smr_resp) * tx_size;
 	sar_pool_offset = inject_pool_offset + sizeof(struct smr_inject_pool) +
 			  sizeof(struct smr_inject_pool_entry) * rx_size;
 	peer_data_offset = sar_pool_offset + sizeof(struct smr_sar_pool) +
-			   sizeof(struct smr_sar_pool_entry) * SMR_MAX_PEERS;
+			   sizeof(struct smr_sar_pool_entry) * SMR_MAX_SAR_MSGS;
 	ep_name_offset = peer_data_offset + sizeof(struct smr_peer_data) * SMR_MAX_PEERS;
 
 	sock_name_offset = ep_name_offset + SMR_NAME_MAX;
+	sar_bufs_offset = ofi_get_aligned_size(sock_name_offset +
+					       SMR_SOCK_NAME_MAX, 64);
 
 	if (cmd_offset)
 		*cmd_offset = cmd_queue_offset;
@@ -133,8 +149,11 @@ size_t smr_calculate_size_offsets(size_t tx_count, size_t rx_count,
 		*name_offset = ep_name_offset;
 	if (sock_offset)
 		*sock_offset = sock_name_offset;
+	if (sar_buf_offset)
+		*sar_buf_offset = sar_bufs_offset;
 
-	total_size = sock_name_offset + SMR_SOCK_NAME_MAX;
+	total_size = sar_bufs_offset + SMR_MAX_SAR_MSGS * sar_depth *
+		     smr_sar_buf_size(sar_size);
 
 	/*
  	 * Revisit later to see if we really need the size adjustment, or
@@ -190,17 +209,21 @@ int smr_create(const struct fi_provider *prov, struct smr_map *map,
 	struct smr_ep_name *ep_name;
 	size_t total_size, cmd_queue_offset, peer_data_offset;
 	size_t resp_queue_offset, inject_pool_offset, name_offset;
-	size_t sar_pool_offset, sock_name_offset;
+	size_t sar_pool_offset, sock_name_offset, sar_buf_offset;
+	struct smr_sar_pool *sar_pool;
 	int fd, ret, i;
 	void *mapped_addr;
 	size_t tx_size, rx_size;
 
+	assert(sizeof(struct smr_cmd) == SMR_CMD_SIZE);
 	tx_size = roundup_power_of_two(attr->tx_count);
 	rx_size = roundup_power_of_two(attr->rx_count);
-	total_size = smr_calculate_size_offsets(tx_size, rx_size, &cmd_queue_offset,
-					&resp_queue_offset, &inject_pool_offset,
-					&sar_pool_offset, &peer_data_offset,
-					&name_offset, &sock_name_offset);
+	total_size = smr_calculate_size_offsets(tx_size, rx_size,
+					attr->sar_depth, attr->sar_size,
+					&cmd_queue_offset, &resp_queue_offset,
+					&inject_pool_offset, &sar_pool_offset,
+					&peer_data_offset, &name_offset,
+					&sock_name_offset, &sar_buf_offset);
 
 	fd = shm_open(attr->name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
 	if (fd < 0) {
@@ -271,18 +294,25 @@ int smr_create(const struct fi_provider *prov, struct smr_map *map,
 	(*smr)->peer_data_offset = peer_data_offset;
 	(*smr)->name_offset = name_offset;
 	(*smr)->sock_name_offset = sock_name_offset;
-	(*smr)->cmd_cnt = rx_size;
+	(*smr)->sar_buf_offset = sar_buf_offset;
+	ofi_atomic_initialize64(&(*smr)->cmd_cnt, rx_size);
 	/* Limit of 1 outstanding SAR message per peer */
-	(*smr)->sar_cnt = SMR_MAX_PEERS;
+	(*smr)->sar_cnt = SMR_MAX_SAR_MSGS;
+	(*smr)->sar_depth = attr->sar_depth;
+	(*smr)->sar_size = attr->sar_size;
+	(*smr)->sar_buf_size = smr_sar_buf_size(attr->sar_size);
+	/* peer_data entries are initialized as peers are added, so that the
+	 * pages reserved for unused ids are never touched */
+	ofi_atomic_initialize64(&(*smr)->peer_data_cnt, 0);
 
 	smr_cmd_queue_init(smr_cmd_queue(*smr), rx_size);
 	smr_resp_queue_init(smr_resp_queue(*smr), tx_size);
 	smr_inject_pool_init(smr_inject_pool(*smr), rx_size);
-	smr_sar_pool_init(smr_sar_pool(*smr), SMR_MAX_PEERS);
-	for (i = 0; i < SMR_MAX_PEERS; i++) {
-		smr_peer_addr_init(&smr_peer_data(*smr)[i].addr);
-		smr_peer_data(*smr)[i].sar_status = 0;
-		smr_peer_data(*smr)[i].name_sent = 0;
+	sar_pool = smr_sar_pool(*smr);
+	smr_sar_pool_init(sar_pool, SMR_MAX_SAR_MSGS);
+	for (i = 0; i < SMR_MAX_SAR_MSGS; i++) {
+		sar_pool->entry[i].buf.buf_offset = sar_buf_offset +
+			i * attr->sar_depth * (*smr)->sar_buf_size;
 	}
 
 	strncpy((char *) smr_name(*smr), attr->name, total_size - name_offset);
@@ -307,20 +337,70 @@ void smr_free(struct smr_region *smr)
 	munmap(smr, smr->total_size);
 }
 
+void smr_peer_data_grow(struct smr_region *smr, int64_t id)
+{
+	int64_t i, cnt;
+
+	assert(id >= 0 && id < SMR_MAX_PEERS);
+
+	fastlock_acquire(&smr->lock);
+	cnt = ofi_atomic_get64(&smr->peer_data_cnt);
+	if (id >= cnt) {
+		for (i = cnt; i <= id; i++)
+			smr_peer_data_init(&smr_peer_data(smr)[i]);
+		ofi_atomic_set64(&smr->peer_data_cnt, id + 1);
+	}
+	fastlock_release(&smr->lock);
+}
+
 static int smr_name_compare(struct ofi_rbmap *map, void *key, void *data)
 {
 	struct smr_map *smr_map;
 
 	smr_map = container_of(map, struct smr_map, rbmap);
 
-	return strncmp(smr_map->peers[(int64_t) data].peer.name,
+	return strncmp(smr_map_peer(smr_map, (int64_t) data)->peer.name,
 		       (char *) key, SMR_NAME_MAX);
 }
 
+static int smr_map_grow(const struct fi_provider *prov, struct smr_map *map)
+{
+	struct smr_peer *chunk;
+	int64_t i, base;
+
+	if (map->peer_cnt >= SMR_MAX_PEERS) {
+		FI_WARN(prov, FI_LOG_AV, "maximum number of peers reached\n");
+		return -FI_ENOMEM;
+	}
+
+	chunk = calloc(SMR_PEER_CHUNK_SIZE, sizeof(*chunk));
+	if (!chunk) {
+		FI_WARN(prov, FI_LOG_AV, "failed to grow SHM region group\n");
+		return -FI_ENOMEM;
+	}
+
+	base = map->peer_cnt;
+	for (i = 0; i < SMR_PEER_CHUNK_SIZE; i++) {
+		smr_peer_addr_init(&chunk[i].peer);
+		chunk[i].fiaddr = FI_ADDR_UNSPEC;
+		chunk[i].next_free = base + i + 1;
+	}
+	chunk[SMR_PEER_CHUNK_SIZE - 1].next_free = -1;
+	map->peers[base >> SMR_PEER_CHUNK_SHIFT] = chunk;
+
+	if (map->free_tail < 0)
+		map->free_head = base;
+	else
+		smr_map_peer(map, map->free_tail)->next_free = base;
+	map->free_tail = base + SMR_PEER_CHUNK_SIZE - 1;
+	map->peer_cnt += SMR_PEER_CHUNK_SIZE;
+	return 0;
+}
+
 int smr_map_create(const struct fi_provider *prov, int peer_count,
 		   struct smr_map **map)
 {
-	int i;
+	int ret;
 
 	(*map) = calloc(1, sizeof(struct smr_map));
 	if (!*map) {
@@ -328,14 +408,19 @@ int smr_map_create(const struct fi_provider *prov, int peer_count,
 		return -FI_ENOMEM;
 	}
 
-	for (i = 0; i < peer_count; i++) {
-		smr_peer_addr_init(&(*map)->peers[i].peer);
-		(*map)->peers[i].fiaddr = FI_ADDR_UNSPEC;
-	}
-
 	ofi_rbmap_init(&(*map)->rbmap, smr_name_compare);
 	fastlock_init(&(*map)->lock);
 
+	(*map)->free_head = -1;
+	(*map)->free_tail = -1;
+	while ((*map)->peer_cnt < peer_count) {
+		ret = smr_map_grow(prov, *map);
+		if (ret) {
+			smr_map_free(*map);
+			return ret;
+		}
+	}
+
 	return 0;
 }
 
@@ -395,18 +480,38 @@ out:
 	return ret;
 }
 
+/* Peers are mapped on first use, rather than when they are added */
+int smr_map_region(const struct fi_provider *prov, struct smr_map *map,
+		   int64_t id)
+{
+	struct smr_peer *peer;
+	int ret = 0;
+
+	fastlock_acquire(&map->lock);
+	peer = smr_map_peer(map, id);
+	if (peer->peer.id < 0) {
+		ret = smr_map_to_region(prov, peer);
+		if (!ret)
+			peer->peer.id = id;
+	}
+	fastlock_release(&map->lock);
+	return ret;
+}
+
 void smr_map_to_endpoint(struct smr_region *region, int64_t id)
 {
 	struct smr_region *peer_smr;
 	struct smr_peer_data *local_peers;
+	struct smr_peer *peer;
 
-	if (region->map->peers[id].peer.id < 0)
+	peer = smr_map_peer(region->map, id);
+	if (peer->peer.id < 0)
 		return;
 
+	smr_reserve_peer_data(region, id);
 	local_peers = smr_peer_data(region);
 
-	strncpy(local_peers[id].addr.name,
-		region->map->peers[id].peer.name, SMR_NAME_MAX - 1);
+	strncpy(local_peers[id].addr.name, peer->peer.name, SMR_NAME_MAX - 1);
 	local_peers[id].addr.name[SMR_NAME_MAX - 1] = '\0';
 
 	peer_smr = smr_peer_region(region, id);
@@ -416,30 +521,24 @@ void smr_map_to_endpoint(struct smr_region *region, int64_t id)
 		smr_cma_check(region, peer_smr);
 }
 
+/*
+ * The map entry has already been released by smr_map_del, so only the
+ * local state is reset, leaving the id clean for reuse.
+ */
 void smr_unmap_from_endpoint(struct smr_region *region, int64_t id)
 {
-	struct smr_region *peer_smr;
-	struct smr_peer_data *local_peers, *peer_peers;
-	int64_t peer_id;
-
-	local_peers = smr_peer_data(region);
-
-	memset(local_peers[id].addr.name, 0, SMR_NAME_MAX);
-	peer_id = region->map->peers[id].peer.id;
-	if (peer_id < 0)
+	if (id < 0 || id >= ofi_atomic_get64(&region->peer_data_cnt))
 		return;
 
-	peer_smr = smr_peer_region(region, id);
-	peer_peers = smr_peer_data(peer_smr);
-
-	peer_peers[peer_id].addr.id = -1;
-	peer_peers[peer_id].name_sent = 0;
+	smr_peer_data_init(&smr_peer_data(region)[id]);
 }
 
 void smr_exchange_all_peers(struct smr_region *region)
 {
-	int64_t i;
-	for (i = 0; i < SMR_MAX_PEERS; i++)
+	int64_t i, cnt;
+
+	cnt = region->map->peer_cnt;
+	for (i = 0; i < cnt; i++)
 		smr_map_to_endpoint(region, i);
 }
 
@@ -447,7 +546,8 @@ int smr_map_add(const struct fi_provider *prov, struct smr_map *map,
 		const char *name, int64_t *id)
 {
 	struct ofi_rbnode *node;
-	int tries = 0, ret = 0;
+	struct smr_peer *peer;
+	int ret = 0;
 
 	fastlock_acquire(&map->lock);
 	ret = ofi_rbmap_insert(&map->rbmap, (void *) name, (void *) *id, &node);
@@ -458,48 +558,62 @@ int smr_map_add(const struct fi_provider *prov, struct smr_map *map,
 		return 0;
 	}
 
-	while (map->peers[map->cur_id].peer.id != -1 &&
-	       tries < SMR_MAX_PEERS) {
-		if (++map->cur_id == SMR_MAX_PEERS)
-			map->cur_id = 0;
-		tries++;
+	if (map->free_head < 0) {
+		ret = smr_map_grow(prov, map);
+		if (ret) {
+			ofi_rbmap_delete(&map->rbmap, node);
+			fastlock_release(&map->lock);
+			return ret;
+		}
 	}
 
-	assert(map->cur_id < SMR_MAX_PEERS && tries < SMR_MAX_PEERS);
-	*id = map->cur_id;
-	node->data = (void *) *id;
-	strncpy(map->peers[*id].peer.name, name, SMR_NAME_MAX);
-	map->peers[*id].peer.name[SMR_NAME_MAX - 1] = '\0';
+	*id = map->free_head;
+	peer = smr_map_peer(map, *id);
+	map->free_head = peer->next_free;
+	if (map->free_head < 0)
+		map->free_tail = -1;
 
-	ret = smr_map_to_region(prov, &map->peers[*id]);
-	if (!ret)
-		map->peers[*id].peer.id = *id;
+	node->data = (void *) *id;
+	strncpy(peer->peer.name, name, SMR_NAME_MAX);
+	peer->peer.name[SMR_NAME_MAX - 1] = '\0';
 
 	fastlock_release(&map->lock);
-	return ret == -ENOENT ? 0 : ret;
+	return 0;
 }
 
 void smr_map_del(struct smr_map *map, int64_t id)
 {
 	struct dlist_entry *entry;
+	struct smr_peer *peer;
 
-	if (id >= SMR_MAX_PEERS || id < 0 || map->peers[id].peer.id < 0)
+	if (id >= map->peer_cnt || id < 0)
+		return;
+
+	peer = smr_map_peer(map, id);
+	if (!peer->peer.name[0])
 		return;
 
 	pthread_mutex_lock(&ep_list_lock);
 	entry = dlist_find_first_match(&ep_name_list, smr_match_name,
-				       map->peers[id].peer.name);
+				       peer->peer.name);
 	pthread_mutex_unlock(&ep_list_lock);
 
 	fastlock_acquire(&map->lock);
-	if (!entry)
-		munmap(map->peers[id].region, map->peers[id].region->total_size);
+	if (!entry && peer->peer.id >= 0)
+		munmap(peer->region, peer->region->total_size);
+
+	(void) ofi_rbmap_find_delete(&map->rbmap, (void *) peer->peer.name);
 
-	(void) ofi_rbmap_find_delete(&map->rbmap,
-				     (void *) map->peers[id].peer.name);
+	smr_peer_addr_init(&peer->peer);
+	peer->fiaddr = FI_ADDR_UNSPEC;
+	peer->region = NULL;
 
-	map->peers[id].fiaddr = FI_ADDR_UNSPEC;	
-	map->peers[id].peer.id = -1;
+	peer->next_free = -1;
+	if (map->free_tail < 0)
+		map->free_head = id;
+	else
+		smr_map_peer(map, map->free_tail)->next_free = id;
+	map->free_tail = id;
 
 	fastlock_release(&map->lock);
 }
@@ -508,17 +622,20 @@ void smr_map_free(struct smr_map *map)
 {
 	int64_t i;
 
-	for (i = 0; i < SMR_MAX_PEERS; i++)
+	for (i = 0; i < map->peer_cnt; i++)
 		smr_map_del(map, i);
 
+	for (i = 0; i < map->peer_cnt; i += SMR_PEER_CHUNK_SIZE)
+		free(map->peers[i >> SMR_PEER_CHUNK_SHIFT]);
+
 	ofi_rbmap_cleanup(&map->rbmap);
 	free(map);
 }
 
 struct smr_region *smr_map_get(struct smr_map *map, int64_t id)
 {
-	if (id < 0 || id >= SMR_MAX_PEERS)
+	if (id < 0 || id >= map->peer_cnt)
 		return NULL;
 
-	return map->peers[id].region;
+	return smr_map_peer(map, id)->region;
 }
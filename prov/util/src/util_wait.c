@@ -405,6 +405,17 @@ static int util_wait_fd_run(struct fid_wait *wait_fid, int timeout)
 		if (ret > 0)
 			return FI_SUCCESS;
 
+		/* A provider may interrupt the wait while making an event
+		 * ready, as io_uring task_work does.  That is a wakeup, not
+		 * a signal, if a wait source now reports it is ready.
+		 */
+		if (ret == -FI_EINTR) {
+			ret = wait->util_wait.wait_try(&wait->util_wait);
+			if (ret == -FI_EAGAIN)
+				return FI_SUCCESS;
+			return ret ? ret : -FI_EINTR;
+		}
+
 		if (ret < 0) {
 			FI_WARN(wait->util_wait.prov, FI_LOG_FABRIC,
 				"poll failed\n");
@@ -45,6 +45,7 @@
 #include <sys/types.h>
 #include <linux/ethtool.h>
 #include <linux/sockios.h>
+#include <linux/mempolicy.h>
 #include <sys/ioctl.h>
 
 ssize_t ofi_get_hugepage_size(void)
@@ -71,6 +72,34 @@ ssize_t ofi_get_hugepage_size(void)
 	return val * 1024;
 }
 
+#define OFI_MAX_NUMA_NODES	1024
+
+/* Prefer node for the whole pages within [addr, addr + len), moving any
+ * that are already populated.  Avoids a libnuma dependency. */
+int ofi_mbind_node(void *addr, size_t len, int node)
+{
+	unsigned long mask[OFI_MAX_NUMA_NODES / (8 * sizeof(unsigned long))];
+	size_t page_size = ofi_get_page_size();
+	uintptr_t start, end;
+
+	if (node < 0 || node >= OFI_MAX_NUMA_NODES)
+		return -FI_EINVAL;
+
+	start = ofi_get_aligned_size((uintptr_t) addr, page_size);
+	end = (uintptr_t) ofi_get_page_start((char *) addr + len, page_size);
+	if (end <= start)
+		return 0;
+
+	memset(mask, 0, sizeof(mask));
+	mask[node / (8 * sizeof(unsigned long))] |=
+		1UL << (node % (8 * sizeof(unsigned long)));
+
+	if (syscall(__NR_mbind, start, end - start, MPOL_PREFERRED, mask,
+		    OFI_MAX_NUMA_NODES + 1, MPOL_MF_MOVE))
+		return -errno;
+	return 0;
+}
+
 #ifdef HAVE_ETHTOOL
 
 #if HAVE_DECL_ETHTOOL_CMD_SPEED
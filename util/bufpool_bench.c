@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2021 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under the BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Microbenchmark for ofi_bufpool.  Each thread repeatedly allocates a
+ * burst of buffers and frees them again.  Without -c the threads share
+ * one pool behind a lock, the way providers use it today.  With -c the
+ * pool uses per-thread caches and no external lock.
+ *
+ * This uses internal interfaces and is linked statically; build it with
+ * "make util/fi_bufpool_bench".
+ */
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <ofi.h>
+#include <ofi_mem.h>
+#include <ofi_lock.h>
+
+static struct ofi_bufpool *pool;
+static fastlock_t pool_lock;
+static int use_cache;
+static size_t iters = 1000000;
+static size_t burst = 16;
+
+static void *bench_thread(void *arg)
+{
+	void **bufs;
+	size_t i, j;
+
+	bufs = calloc(burst, sizeof(*bufs));
+	if (!bufs)
+		return (void *) (uintptr_t) -FI_ENOMEM;
+
+	for (i = 0; i < iters; i += burst) {
+		if (!use_cache)
+			fastlock_acquire(&pool_lock);
+		for (j = 0; j < burst; j++) {
+			bufs[j] = ofi_buf_alloc(pool);
+			if (!bufs[j]) {
+				if (!use_cache)
+					fastlock_release(&pool_lock);
+				free(bufs);
+				return (void *) (uintptr_t) -FI_ENOMEM;
+			}
+			*(char *) bufs[j] = (char) j;
+		}
+		if (!use_cache) {
+			fastlock_release(&pool_lock);
+			fastlock_acquire(&pool_lock);
+		}
+		for (j = 0; j < burst; j++)
+			ofi_buf_free(bufs[j]);
+		if (!use_cache)
+			fastlock_release(&pool_lock);
+	}
+
+	free(bufs);
+	return NULL;
+}
+
+static void usage(const char *argv0)
+{
+	printf("Usage: %s [OPTIONS]\n", argv0);
+	printf("  -t <threads>   number of threads (default 1)\n");
+	printf("  -n <iters>     alloc/free pairs per thread (default 1000000)\n");
+	printf("  -b <burst>     buffers allocated before freeing (default 16)\n");
+	printf("  -s <size>      buffer size (default 64)\n");
+	printf("  -c             enable per-thread caches\n");
+	printf("  -m <count>     cache refill/flush count (default %d)\n",
+	       OFI_BUFPOOL_DEF_CACHE_CNT);
+	printf("  -N <node>      bind regions to NUMA node\n");
+	printf("  -H             back regions with huge pages\n");
+}
+
+int main(int argc, char **argv)
+{
+	struct ofi_bufpool_attr attr = {
+		.size = 64,
+		.alignment = 16,
+	};
+	struct ofi_bufpool_stats stats;
+	pthread_t *threads;
+	size_t thread_cnt = 1, i;
+	uint64_t start, elapsed;
+	void *thread_ret;
+	int op, ret = 0;
+
+	while ((op = getopt(argc, argv, "t:n:b:s:cm:N:Hh")) != -1) {
+		switch (op) {
+		case 't':
+			thread_cnt = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			iters = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			burst = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			attr.size = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			use_cache = 1;
+			attr.flags |= OFI_BUFPOOL_THREAD_CACHE;
+			break;
+		case 'm':
+			attr.cache_cnt = strtoul(optarg, NULL, 0);
+			break;
+		case 'N':
+			attr.flags |= OFI_BUFPOOL_NUMA_NODE;
+			attr.numa_node = atoi(optarg);
+			break;
+		case 'H':
+			attr.flags |= OFI_BUFPOOL_HUGEPAGES;
+			break;
+		default:
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!thread_cnt || !burst) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	ofi_mem_init();
+	fastlock_init(&pool_lock);
+	ret = ofi_bufpool_create_attr(&attr, &pool);
+	if (ret) {
+		fprintf(stderr, "ofi_bufpool_create_attr: %s\n",
+			fi_strerror(-ret));
+		goto out;
+	}
+
+	threads = calloc(thread_cnt, sizeof(*threads));
+	if (!threads) {
+		ret = -FI_ENOMEM;
+		goto destroy;
+	}
+
+	start = ofi_gettime_ns();
+	for (i = 0; i < thread_cnt; i++) {
+		if (pthread_create(&threads[i], NULL, bench_thread, NULL)) {
+			fprintf(stderr, "pthread_create failed\n");
+			thread_cnt = i;
+			ret = -FI_EOTHER;
+			break;
+		}
+	}
+	for (i = 0; i < thread_cnt; i++) {
+		pthread_join(threads[i], &thread_ret);
+		if (thread_ret && !ret)
+			ret = (int) (intptr_t) thread_ret;
+	}
+	elapsed = ofi_gettime_ns() - start;
+	free(threads);
+
+	if (ret) {
+		fprintf(stderr, "benchmark failed: %s\n", fi_strerror(-ret));
+		goto destroy;
+	}
+
+	ofi_bufpool_get_stats(pool, &stats);
+	printf("threads %zu, burst %zu, size %zu, cache %s\n", thread_cnt,
+	       burst, attr.size, use_cache ? "on" : "off");
+	printf("%-12s %-12s %-10s %-10s %-10s %-10s %-10s\n", "allocs",
+	       "frees", "refills", "flushes", "entries", "ns/pair", "Mpairs/s");
+	printf("%-12" PRIu64 " %-12" PRIu64 " %-10" PRIu64 " %-10" PRIu64
+	       " %-10zu %-10.2f %-10.2f\n", stats.alloc_cnt, stats.free_cnt,
+	       stats.refill_cnt, stats.flush_cnt, stats.entry_cnt,
+	       (double) elapsed / iters,
+	       (double) stats.alloc_cnt * 1000 / elapsed);
+destroy:
+	ofi_bufpool_destroy(pool);
+out:
+	fastlock_destroy(&pool_lock);
+	ofi_mem_fini();
+	return ret ? EXIT_FAILURE : EXIT_SUCCESS;
+}